@@ -0,0 +1,355 @@
+#define _POSIX_C_SOURCE 200809L
+#include <pthread.h>
+#include "agg_map.h"
+
+/*
+ * Finds the slot of key, or the empty slot where it should be inserted.
+ */
+static agg_entry *find_slot (const agg_map *map, const_keyT key, size_t hash)
+{
+  size_t mask = map->capacity - 1;
+  size_t ind = hash & mask;
+  while (map->entries[ind].key != NULL){
+      agg_entry *entry = &(map->entries[ind]);
+      if ((entry->hash == hash) && (map->key_cmp (entry->key, key) == 1)){
+          return entry;
+      }
+      ind = (ind + 1) & mask;
+  }
+  return &(map->entries[ind]);
+}
+
+/*
+ * Moves every entry to a new array of new_capacity slots.
+ */
+static int resize (agg_map *map, size_t new_capacity)
+{
+  agg_entry *entries = calloc (new_capacity, sizeof (agg_entry));
+  if (entries == NULL){
+      return 0;
+  }
+  for (size_t i = 0; i < map->capacity; ++i)
+    {
+      if (map->entries[i].key != NULL){
+          size_t ind = map->entries[i].hash & (new_capacity - 1);
+          while (entries[ind].key != NULL){
+              ind = (ind + 1) & (new_capacity - 1);
+          }
+          entries[ind] = map->entries[i];
+      }
+    }
+  free (map->entries);
+  map->entries = entries;
+  map->capacity = new_capacity;
+  return 1;
+}
+
+/*
+ * Returns the entry of key, creating it (with a copy of the key, or
+ * with key itself if steal_key) if needed. Returns NULL on failure.
+ */
+static agg_entry *get_or_create (agg_map *map, const_keyT key, size_t hash,
+                                 int steal_key)
+{
+  agg_entry *entry = find_slot (map, key, hash);
+  if (entry->key != NULL){
+      return entry;
+  }
+  if ((double) (map->size + 1) / map->capacity > HASH_MAP_MAX_LOAD_FACTOR){
+      if (resize (map, map->capacity * HASH_MAP_GROWTH_FACTOR) == 0){
+          return NULL;
+      }
+      entry = find_slot (map, key, hash);
+  }
+  keyT new_key = steal_key ? (keyT) key : map->key_cpy (key);
+  if (new_key == NULL){
+      return NULL;
+  }
+  entry->hash = hash;
+  entry->key = new_key;
+  entry->stats.count = 0;
+  entry->stats.sum = 0;
+  map->size += 1;
+  return entry;
+}
+
+/*
+ * Adds one value to the accumulators.
+ */
+static void stats_add (agg_stats *stats, double value)
+{
+  if ((stats->count == 0) || (value < stats->min)){
+      stats->min = value;
+  }
+  if ((stats->count == 0) || (value > stats->max)){
+      stats->max = value;
+  }
+  stats->count += 1;
+  stats->sum += value;
+}
+
+/*
+ * Combines the accumulators of src into dest.
+ */
+static void stats_combine (agg_stats *dest, const agg_stats *src)
+{
+  if ((dest->count == 0) || (src->min < dest->min)){
+      dest->min = src->min;
+  }
+  if ((dest->count == 0) || (src->max > dest->max)){
+      dest->max = src->max;
+  }
+  dest->count += src->count;
+  dest->sum += src->sum;
+}
+
+/**
+ * Allocates dynamically a new aggregation map.
+ * @return pointer to dynamically allocated map.
+ * @if_fail return NULL.
+ */
+agg_map *agg_map_alloc (hash_func func, pair_key_cpy key_cpy,
+                        pair_key_cmp key_cmp, pair_key_free key_free)
+{
+  if ((func == NULL) || (key_cpy == NULL) || (key_cmp == NULL)
+      || (key_free == NULL)){
+      return NULL;
+  }
+  agg_map *map = malloc (sizeof (agg_map));
+  if (map == NULL){
+      return NULL;
+  }
+  map->entries = calloc (HASH_MAP_INITIAL_CAP, sizeof (agg_entry));
+  if (map->entries == NULL){
+      free (map);
+      return NULL;
+  }
+  map->size = 0;
+  map->capacity = HASH_MAP_INITIAL_CAP;
+  map->hash_func = func;
+  map->key_cpy = key_cpy;
+  map->key_cmp = key_cmp;
+  map->key_free = key_free;
+  return map;
+}
+
+/**
+ * Frees an aggregation map and its keys.
+ * @param p_map pointer to dynamically allocated pointer to map.
+ */
+void agg_map_free (agg_map **p_map)
+{
+  if ((p_map == NULL) || (*p_map == NULL)){
+      return;
+  }
+  for (size_t i = 0; i < (*p_map)->capacity; ++i)
+    {
+      if ((*p_map)->entries[i].key != NULL){
+          (*p_map)->key_free (&((*p_map)->entries[i].key));
+      }
+    }
+  free ((*p_map)->entries);
+  free (*p_map);
+  *p_map = NULL;
+}
+
+/**
+ * Accumulates one value into the accumulators of key.
+ * @return 1 on success, 0 otherwise.
+ */
+int agg_map_accumulate (agg_map *map, const_keyT key, double value)
+{
+  if ((map == NULL) || (key == NULL)){
+      return 0;
+  }
+  agg_entry *entry = get_or_create (map, key, map->hash_func (key), 0);
+  if (entry == NULL){
+      return 0;
+  }
+  stats_add (&(entry->stats), value);
+  return 1;
+}
+
+/**
+ * Accumulates values[i] into the accumulators of keys[i], for i in [0, n).
+ * @return the number of accumulated rows (n unless an allocation failed).
+ */
+size_t agg_map_accumulate_batch (agg_map *map, const const_keyT *keys,
+                                 const double *values, size_t n)
+{
+  if ((map == NULL) || (keys == NULL) || (values == NULL)){
+      return 0;
+  }
+  size_t hashes[AGG_MAP_BATCH];
+  for (size_t start = 0; start < n; start += AGG_MAP_BATCH)
+    {
+      size_t count = (n - start < AGG_MAP_BATCH) ? n - start : AGG_MAP_BATCH;
+      for (size_t i = 0; i < count; ++i)
+        {
+          hashes[i] = map->hash_func (keys[start + i]);
+#ifdef __GNUC__
+          __builtin_prefetch (&(map->entries[hashes[i] & (map->capacity - 1)]));
+#endif
+        }
+      for (size_t i = 0; i < count; ++i)
+        {
+          agg_entry *entry = get_or_create (map, keys[start + i], hashes[i], 0);
+          if (entry == NULL){
+              return start + i;
+          }
+          stats_add (&(entry->stats), values[start + i]);
+        }
+    }
+  return n;
+}
+
+/*
+ * Merges src into dest, if steal_keys the keys of src are moved to dest
+ * (and src is left without keys, to be freed by the caller).
+ */
+static int merge (agg_map *dest, agg_map *src, int steal_keys)
+{
+  for (size_t i = 0; i < src->capacity; ++i)
+    {
+      agg_entry *src_entry = &(src->entries[i]);
+      if (src_entry->key == NULL){
+          continue;
+      }
+      agg_entry *entry = get_or_create (dest, src_entry->key, src_entry->hash,
+                                        steal_keys);
+      if (entry == NULL){
+          return 0;
+      }
+      stats_combine (&(entry->stats), &(src_entry->stats));
+      if (steal_keys){
+          if (entry->key != src_entry->key){
+              src->key_free (&(src_entry->key));
+          }
+          src_entry->key = NULL;
+          src->size -= 1;
+      }
+    }
+  return 1;
+}
+
+/**
+ * Merges the accumulators of src into dest (src is unchanged).
+ * @return 1 on success, 0 otherwise.
+ */
+int agg_map_merge (agg_map *dest, const agg_map *src)
+{
+  if ((dest == NULL) || (src == NULL)){
+      return 0;
+  }
+  return merge (dest, (agg_map *) src, 0);
+}
+
+/*
+ * @struct agg_task
+ * The rows of one thread of agg_map_accumulate_parallel.
+ */
+typedef struct agg_task {
+    agg_map *partial;
+    const const_keyT *keys;
+    const double *values;
+    size_t n;
+    size_t done;
+} agg_task;
+
+/*
+ * Thread body of agg_map_accumulate_parallel.
+ */
+static void *accumulate_task (void *arg)
+{
+  agg_task *task = (agg_task *) arg;
+  task->done = agg_map_accumulate_batch (task->partial, task->keys,
+                                         task->values, task->n);
+  return NULL;
+}
+
+/**
+ * Splits the rows between num_threads threads, every thread accumulates its
+ * rows into a partial map, and the partial maps are merged into map.
+ * @return 1 on success, 0 otherwise (map may hold some of the rows).
+ */
+int agg_map_accumulate_parallel (agg_map *map, const const_keyT *keys,
+                                 const double *values, size_t n,
+                                 size_t num_threads)
+{
+  if ((map == NULL) || (keys == NULL) || (values == NULL)){
+      return 0;
+  }
+  if (num_threads <= 1){
+      return agg_map_accumulate_batch (map, keys, values, n) == n;
+  }
+  agg_task *tasks = calloc (num_threads, sizeof (agg_task));
+  pthread_t *threads = malloc (sizeof (pthread_t) * num_threads);
+  if ((tasks == NULL) || (threads == NULL)){
+      free (tasks);
+      free (threads);
+      return 0;
+  }
+  int success = 1;
+  size_t started = 0;
+  size_t rows_per_thread = (n + num_threads - 1) / num_threads;
+  for (size_t i = 0; i < num_threads; ++i)
+    {
+      size_t start = i * rows_per_thread;
+      tasks[i].keys = keys + start;
+      tasks[i].values = values + start;
+      tasks[i].n = (start >= n) ? 0 : ((n - start < rows_per_thread) ?
+                                       n - start : rows_per_thread);
+      tasks[i].partial = agg_map_alloc (map->hash_func, map->key_cpy,
+                                        map->key_cmp, map->key_free);
+      if ((tasks[i].partial == NULL)
+          || (pthread_create (&(threads[i]), NULL, accumulate_task,
+                              &(tasks[i])) != 0)){
+          success = 0;
+          break;
+      }
+      started++;
+    }
+  for (size_t i = 0; i < started; ++i)
+    {
+      pthread_join (threads[i], NULL);
+      if (tasks[i].done != tasks[i].n){
+          success = 0;
+      }
+    }
+  for (size_t i = 0; i < num_threads; ++i)
+    {
+      if ((tasks[i].partial != NULL) && success){
+          success = merge (map, tasks[i].partial, 1);
+      }
+      agg_map_free (&(tasks[i].partial));
+    }
+  free (tasks);
+  free (threads);
+  return success;
+}
+
+/**
+ * @return the accumulators of key (not a copy), NULL if key has no rows.
+ */
+const agg_stats *agg_map_at (const agg_map *map, const_keyT key)
+{
+  if ((map == NULL) || (key == NULL)){
+      return NULL;
+  }
+  agg_entry *entry = find_slot (map, key, map->hash_func (key));
+  if (entry->key == NULL){
+      return NULL;
+  }
+  return &(entry->stats);
+}
+
+/**
+ * @return the mean of the accumulated values, 0 if there are none.
+ */
+double agg_stats_mean (const agg_stats *stats)
+{
+  if ((stats == NULL) || (stats->count == 0)){
+      return 0;
+  }
+  return stats->sum / stats->count;
+}
@@ -0,0 +1,117 @@
+#ifndef AGG_MAP_H_
+#define AGG_MAP_H_
+
+#include <stdlib.h>
+#include "hashmap.h"
+
+/**
+ * An aggregation (group by) map: every key owns a set of accumulators that
+ * are updated in place, so counting or summing per key takes one probe and
+ * at most one allocation (the key copy, on the key's first row).
+ * For multi threaded aggregation every thread fills its own partial agg_map
+ * and the partial maps are combined with agg_map_merge,
+ * agg_map_accumulate_parallel does both.
+ */
+
+/**
+ * @def AGG_MAP_BATCH
+ * The number of rows agg_map_accumulate_batch hashes ahead of probing.
+ */
+#define AGG_MAP_BATCH 16UL
+
+/**
+ * @struct agg_stats
+ * The accumulators of a key.
+ * @param count number of values accumulated.
+ * @param sum, min, max sum, minimum and maximum of the values.
+ */
+typedef struct agg_stats {
+    size_t count;
+    double sum;
+    double min;
+    double max;
+} agg_stats;
+
+/**
+ * @struct agg_entry
+ * @param hash the hash of the key.
+ * @param key owned copy of the key, NULL for an empty slot.
+ * @param stats the accumulators, stored inline.
+ */
+typedef struct agg_entry {
+    size_t hash;
+    keyT key;
+    agg_stats stats;
+} agg_entry;
+
+/**
+ * @struct agg_map
+ * @param entries open addressed (linear probing) entry array.
+ * @param size the number of keys.
+ * @param capacity the number of slots (a power of 2).
+ * @param hash_func, key_cpy, key_cmp, key_free functions of the keys.
+ */
+typedef struct agg_map {
+    agg_entry *entries;
+    size_t size;
+    size_t capacity;
+    hash_func hash_func;
+    pair_key_cpy key_cpy;
+    pair_key_cmp key_cmp;
+    pair_key_free key_free;
+} agg_map;
+
+/**
+ * Allocates dynamically a new aggregation map.
+ * @return pointer to dynamically allocated map.
+ * @if_fail return NULL.
+ */
+agg_map *agg_map_alloc (hash_func func, pair_key_cpy key_cpy,
+                        pair_key_cmp key_cmp, pair_key_free key_free);
+
+/**
+ * Frees an aggregation map and its keys.
+ * @param p_map pointer to dynamically allocated pointer to map.
+ */
+void agg_map_free (agg_map **p_map);
+
+/**
+ * Accumulates one value into the accumulators of key.
+ * @return 1 on success, 0 otherwise.
+ */
+int agg_map_accumulate (agg_map *map, const_keyT key, double value);
+
+/**
+ * Accumulates values[i] into the accumulators of keys[i], for i in [0, n).
+ * Hashes AGG_MAP_BATCH rows ahead of probing so the probes overlap.
+ * @return the number of accumulated rows (n unless an allocation failed).
+ */
+size_t agg_map_accumulate_batch (agg_map *map, const const_keyT *keys,
+                                 const double *values, size_t n);
+
+/**
+ * Splits the rows between num_threads threads, every thread accumulates its
+ * rows into a partial map, and the partial maps are merged into map.
+ * @return 1 on success, 0 otherwise (map may hold some of the rows).
+ */
+int agg_map_accumulate_parallel (agg_map *map, const const_keyT *keys,
+                                 const double *values, size_t n,
+                                 size_t num_threads);
+
+/**
+ * Merges the accumulators of src into dest (src is unchanged).
+ * @return 1 on success, 0 otherwise.
+ */
+int agg_map_merge (agg_map *dest, const agg_map *src);
+
+/**
+ * @return the accumulators of key (not a copy), NULL if key has no rows.
+ */
+const agg_stats *agg_map_at (const agg_map *map, const_keyT key);
+
+/**
+ * @return the mean of the accumulated values, 0 if there are none.
+ */
+double agg_stats_mean (const agg_stats *stats);
+
+#endif //AGG_MAP_H_
@@ -0,0 +1,179 @@
+#include <string.h>
+#include <math.h>
+#include "bloom_filter.h"
+
+#define BLOCK_BIT_MASK (BLOOM_BLOCK_BITS - 1)
+#define PROBE_SHIFT 9
+
+/*
+ * Remixes a key hash, user hash functions may be the identity.
+ */
+static uint64_t remix (size_t hash)
+{
+  uint64_t x = (uint64_t) hash;
+  x ^= x >> 33;
+  x *= 0xff51afd7ed558ccdULL;
+  x ^= x >> 33;
+  x *= 0xc4ceb9fe1a85ec53ULL;
+  x ^= x >> 33;
+  return x;
+}
+
+/*
+ * Returns the first word of the block of a remixed hash.
+ */
+static uint64_t *get_block (const bloom_filter *filter, uint64_t mixed)
+{
+  size_t block = (size_t) (mixed >> 32) & (filter->num_blocks - 1);
+  return filter->blocks + block * BLOOM_BLOCK_WORDS;
+}
+
+/**
+ * Allocates dynamically a new empty filter.
+ * @return pointer to dynamically allocated filter.
+ * @if_fail return NULL.
+ */
+bloom_filter *bloom_filter_alloc (size_t max_keys, size_t bits_per_key)
+{
+  if (bits_per_key == 0){
+      bits_per_key = BLOOM_DEFAULT_BITS_PER_KEY;
+  }
+  if (max_keys == 0){
+      max_keys = 1;
+  }
+  bloom_filter *filter = malloc (sizeof (bloom_filter));
+  if (filter == NULL){
+      return NULL;
+  }
+  size_t num_blocks = 1;
+  while (num_blocks * BLOOM_BLOCK_BITS < max_keys * bits_per_key){
+      num_blocks *= 2;
+  }
+  filter->blocks = calloc (num_blocks * BLOOM_BLOCK_WORDS, sizeof (uint64_t));
+  if (filter->blocks == NULL){
+      free (filter);
+      return NULL;
+  }
+  filter->num_blocks = num_blocks;
+  filter->bits_per_key = bits_per_key;
+  filter->max_keys = max_keys;
+  filter->num_keys = 0;
+  filter->num_erased = 0;
+  filter->lookups = 0;
+  filter->negatives = 0;
+  filter->false_positives = 0;
+  return filter;
+}
+
+/**
+ * Frees a filter.
+ * @param p_filter pointer to dynamically allocated pointer to filter.
+ */
+void bloom_filter_free (bloom_filter **p_filter)
+{
+  if ((p_filter == NULL) || (*p_filter == NULL)){
+      return;
+  }
+  free ((*p_filter)->blocks);
+  free (*p_filter);
+  *p_filter = NULL;
+}
+
+/**
+ * Clears every bit and the key counters.
+ */
+void bloom_filter_clear (bloom_filter *filter)
+{
+  memset (filter->blocks, 0,
+          filter->num_blocks * BLOOM_BLOCK_WORDS * sizeof (uint64_t));
+  filter->num_keys = 0;
+  filter->num_erased = 0;
+}
+
+/**
+ * Adds a key hash to the filter.
+ */
+void bloom_filter_add (bloom_filter *filter, size_t hash)
+{
+  uint64_t mixed = remix (hash);
+  uint64_t *block = get_block (filter, mixed);
+  uint64_t bits = remix (mixed); // probe bits independent of the block.
+  for (size_t i = 0; i < BLOOM_NUM_PROBES; ++i)
+    {
+      size_t bit = (size_t) bits & BLOCK_BIT_MASK;
+      block[bit / 64] |= 1ULL << (bit % 64);
+      bits = (bits >> PROBE_SHIFT) | (bits << (64 - PROBE_SHIFT));
+    }
+  filter->num_keys += 1;
+}
+
+/**
+ * Queries the filter, without counting the query.
+ * @return 0 if the key is definitely absent, 1 if it may be present.
+ */
+int bloom_filter_may_contain (const bloom_filter *filter, size_t hash)
+{
+  uint64_t mixed = remix (hash);
+  const uint64_t *block = get_block (filter, mixed);
+  uint64_t bits = remix (mixed); // probe bits independent of the block.
+  for (size_t i = 0; i < BLOOM_NUM_PROBES; ++i)
+    {
+      size_t bit = (size_t) bits & BLOCK_BIT_MASK;
+      if ((block[bit / 64] & (1ULL << (bit % 64))) == 0){
+          return 0;
+      }
+      bits = (bits >> PROBE_SHIFT) | (bits << (64 - PROBE_SHIFT));
+    }
+  return 1;
+}
+
+/**
+ * Counts a lookup answered by bloom_filter_may_contain. The counters are
+ * relaxed atomics, lookups may run concurrently.
+ */
+void bloom_filter_count_lookup (bloom_filter *filter, int may_contain)
+{
+  __atomic_add_fetch (&(filter->lookups), 1, __ATOMIC_RELAXED);
+  if (may_contain == 0){
+      __atomic_add_fetch (&(filter->negatives), 1, __ATOMIC_RELAXED);
+  }
+}
+
+/**
+ * Counts a "maybe" answer that turned out to be absent.
+ */
+void bloom_filter_count_false_positive (bloom_filter *filter)
+{
+  __atomic_add_fetch (&(filter->false_positives), 1, __ATOMIC_RELAXED);
+}
+
+/**
+ * Counts a key erased from the owner (its bits stay set).
+ */
+void bloom_filter_count_erase (bloom_filter *filter)
+{
+  filter->num_erased += 1;
+}
+
+/**
+ * @return 1 if the filter should be rebuilt, 0 otherwise.
+ */
+int bloom_filter_needs_rebuild (const bloom_filter *filter)
+{
+  return (filter->num_keys > filter->max_keys)
+         || (filter->num_erased * 2 > filter->num_keys);
+}
+
+/**
+ * @return the expected false positive rate for the keys currently set,
+ * (1 - e^(-k * n / m))^k for n keys, k probes and m bits.
+ */
+double bloom_filter_estimated_fpr (const bloom_filter *filter)
+{
+  if ((filter == NULL) || (filter->num_keys == 0)){
+      return 0;
+  }
+  double bits = (double) filter->num_blocks * BLOOM_BLOCK_BITS;
+  double fill = 1 - exp (-(double) BLOOM_NUM_PROBES * filter->num_keys / bits);
+  return pow (fill, BLOOM_NUM_PROBES);
+}
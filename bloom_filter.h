@@ -0,0 +1,123 @@
+#ifndef BLOOM_FILTER_H_
+#define BLOOM_FILTER_H_
+
+#include <stdlib.h>
+#include <stdint.h>
+
+/**
+ * A cache line blocked Bloom filter over key hashes.
+ * Every key sets BLOOM_NUM_PROBES bits inside a single BLOOM_BLOCK_BITS bit
+ * block, so a query reads exactly one cache line.
+ * Bits cannot be removed, erased keys are counted instead and the owner
+ * rebuilds the filter when they pile up (see bloom_filter_needs_rebuild).
+ */
+
+/**
+ * @def BLOOM_BLOCK_BITS
+ * The number of bits in a block (one 64 byte cache line).
+ */
+#define BLOOM_BLOCK_BITS 512UL
+
+/**
+ * @def BLOOM_BLOCK_WORDS
+ * The number of 64 bit words in a block.
+ */
+#define BLOOM_BLOCK_WORDS (BLOOM_BLOCK_BITS / 64)
+
+/**
+ * @def BLOOM_NUM_PROBES
+ * The number of bits each key sets in its block.
+ */
+#define BLOOM_NUM_PROBES 6UL
+
+/**
+ * @def BLOOM_DEFAULT_BITS_PER_KEY
+ * Bits per key used when a filter is enabled with bits_per_key 0.
+ */
+#define BLOOM_DEFAULT_BITS_PER_KEY 10UL
+
+/**
+ * @struct bloom_filter
+ * @param blocks num_blocks * BLOOM_BLOCK_WORDS words.
+ * @param num_blocks the number of blocks (a power of 2).
+ * @param bits_per_key the bits per key the filter was sized with.
+ * @param max_keys the number of keys the filter was sized for.
+ * @param num_keys the keys added since the last clear.
+ * @param num_erased the keys erased (but still set) since the last clear.
+ * @param lookups, negatives, false_positives query statistics: all queries,
+ * queries answered "absent", and "maybe" answers for absent keys (reported
+ * by the owner through bloom_filter_count_lookup and
+ * bloom_filter_count_false_positive, relaxed atomics).
+ */
+typedef struct bloom_filter {
+    uint64_t *blocks;
+    size_t num_blocks;
+    size_t bits_per_key;
+    size_t max_keys;
+    size_t num_keys;
+    size_t num_erased;
+    size_t lookups;
+    size_t negatives;
+    size_t false_positives;
+} bloom_filter;
+
+/**
+ * Allocates dynamically a new empty filter.
+ * @param max_keys the number of keys the filter should hold.
+ * @param bits_per_key the bits per key, 0 for BLOOM_DEFAULT_BITS_PER_KEY.
+ * @return pointer to dynamically allocated filter.
+ * @if_fail return NULL.
+ */
+bloom_filter *bloom_filter_alloc (size_t max_keys, size_t bits_per_key);
+
+/**
+ * Frees a filter.
+ * @param p_filter pointer to dynamically allocated pointer to filter.
+ */
+void bloom_filter_free (bloom_filter **p_filter);
+
+/**
+ * Clears every bit and the key counters (not the query statistics).
+ */
+void bloom_filter_clear (bloom_filter *filter);
+
+/**
+ * Adds a key hash to the filter.
+ */
+void bloom_filter_add (bloom_filter *filter, size_t hash);
+
+/**
+ * Queries the filter, without counting the query.
+ * @return 0 if the key is definitely absent, 1 if it may be present.
+ */
+int bloom_filter_may_contain (const bloom_filter *filter, size_t hash);
+
+/**
+ * Counts a lookup of the owner answered by bloom_filter_may_contain
+ * (may_contain is its answer). Safe to call from concurrent lookups.
+ */
+void bloom_filter_count_lookup (bloom_filter *filter, int may_contain);
+
+/**
+ * Counts a "maybe" answer that turned out to be absent. Safe to call from
+ * concurrent lookups.
+ */
+void bloom_filter_count_false_positive (bloom_filter *filter);
+
+/**
+ * Counts a key erased from the owner (its bits stay set).
+ */
+void bloom_filter_count_erase (bloom_filter *filter);
+
+/**
+ * @return 1 if the filter holds more keys than it was sized for, or if
+ * erased keys make up more than half of its keys, 0 otherwise.
+ */
+int bloom_filter_needs_rebuild (const bloom_filter *filter);
+
+/**
+ * @return the expected false positive rate for the keys currently set.
+ */
+double bloom_filter_estimated_fpr (const bloom_filter *filter);
+
+#endif //BLOOM_FILTER_H_
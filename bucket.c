@@ -0,0 +1,161 @@
+#include <string.h>
+#include "bucket.h"
+
+/*
+ * Returns the key of an element of a bucket.
+ */
+static const_keyT key_of (const bucket_keys *keys, const void *elem)
+{
+  return (keys->key_cmp == NULL) ? ((const pair *) elem)->key : elem;
+}
+
+/*
+ * Returns 1 if elem holds key, 0 otherwise.
+ */
+static int holds_key (const bucket_keys *keys, const void *elem,
+                      const_keyT key)
+{
+  if (keys->key_cmp != NULL){
+      return keys->key_cmp (elem, key);
+  }
+  const pair *cur_pair = (const pair *) elem;
+  return cur_pair->key_cmp (cur_pair->key, key);
+}
+
+/*
+ * Returns the seeded hash of the key of elem.
+ */
+static size_t elem_hash (const bucket_keys *keys, const void *elem)
+{
+  return bucket_seed_hash (keys, keys->hash_func (key_of (keys, elem)));
+}
+
+/*
+ * Returns the position of the first of the first num_of_elems elements of
+ * the sorted bucket vec whose seeded hash is not below hash.
+ */
+static size_t lower_bound (const bucket_keys *keys, const vector *vec,
+                           size_t num_of_elems, size_t hash)
+{
+  size_t low = 0, high = num_of_elems;
+  while (low < high){
+      size_t mid = low + (high - low) / 2;
+      if (elem_hash (keys, vec->data[mid]) < hash){
+          low = mid + 1;
+      }
+      else{
+          high = mid;
+      }
+  }
+  return low;
+}
+
+/*
+ * Sorts bucket vec, which just went above HASH_MAP_TREEIFY_THRESHOLD
+ * elements, by seeded hash.
+ */
+static void sort_bucket (const bucket_keys *keys, vector *vec)
+{
+  size_t hashes[HASH_MAP_TREEIFY_THRESHOLD + 1];
+  for (size_t i = 0; i < vec->size; ++i)
+    {
+      void *elem = vec->data[i];
+      size_t hash = elem_hash (keys, elem);
+      size_t j = i;
+      for (; (j > 0) && (hashes[j - 1] > hash); --j)
+        {
+          hashes[j] = hashes[j - 1];
+          vec->data[j] = vec->data[j - 1];
+        }
+      hashes[j] = hash;
+      vec->data[j] = elem;
+    }
+}
+
+/**
+ * The splitmix64 finalizer.
+ */
+uint64_t bucket_mix_bits (uint64_t x)
+{
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ULL;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebULL;
+  x ^= x >> 31;
+  return x;
+}
+
+/**
+ * Returns the seeded hash of a hash_func result.
+ */
+size_t bucket_seed_hash (const bucket_keys *keys, size_t hash)
+{
+  return (size_t) bucket_mix_bits ((uint64_t) (hash ^ keys->seed));
+}
+
+/**
+ * Returns the index of the element of key in bucket vec, -1 if there is
+ * none. In a sorted bucket only the elements with the same seeded hash are
+ * compared.
+ */
+long bucket_find (const bucket_keys *keys, const vector *vec,
+                  const_keyT key, size_t hash)
+{
+  size_t i = 0;
+  int sorted = vec->size > HASH_MAP_TREEIFY_THRESHOLD;
+  if (sorted){
+      i = lower_bound (keys, vec, vec->size, hash);
+  }
+  for (; i < vec->size; ++i)
+    {
+      if (holds_key (keys, vec->data[i], key) == 1){
+          return (long) i;
+      }
+      if (sorted && (elem_hash (keys, vec->data[i]) != hash)){
+          break;
+      }
+    }
+  return -1;
+}
+
+/**
+ * Adds elem to bucket vec, keeping the buckets above
+ * HASH_MAP_TREEIFY_THRESHOLD sorted.
+ * @return 1 on success, 0 otherwise.
+ */
+int bucket_push (const bucket_keys *keys, vector *vec, const void *elem,
+                 size_t hash, int move)
+{
+  int pushed = move ? vector_push_back_move (vec, (void *) elem) :
+               vector_push_back (vec, elem);
+  if (pushed != 1){
+      return 0;
+  }
+  if (vec->size == HASH_MAP_TREEIFY_THRESHOLD + 1){
+      sort_bucket (keys, vec);
+  }
+  else if (vec->size > HASH_MAP_TREEIFY_THRESHOLD + 1){
+      size_t last = vec->size - 1;
+      size_t pos = lower_bound (keys, vec, last, hash);
+      void *new_elem = vec->data[last];
+      memmove (&(vec->data[pos + 1]), &(vec->data[pos]),
+               sizeof (void *) * (last - pos));
+      vec->data[pos] = new_elem;
+  }
+  return 1;
+}
+
+/**
+ * Returns the capacity that holds num_of_elems elements below
+ * HASH_MAP_MAX_LOAD_FACTOR, 0 if its array of buckets would overflow.
+ */
+size_t bucket_capacity_for (size_t capacity, size_t num_of_elems)
+{
+  while ((double) num_of_elems / capacity >= HASH_MAP_MAX_LOAD_FACTOR){
+      if (capacity > SIZE_MAX / HASH_MAP_GROWTH_FACTOR / sizeof (void *)){
+          return 0;
+      }
+      capacity *= HASH_MAP_GROWTH_FACTOR;
+  }
+  return capacity;
+}
@@ -0,0 +1,62 @@
+#ifndef BUCKET_H_
+#define BUCKET_H_
+
+#include <stdint.h>
+#include "vector.h"
+#include "hashmap.h"
+
+/**
+ * @struct bucket_keys
+ * How a table whose buckets are vectors (the hashmap, the hashset) hashes
+ * and compares the keys of the elements of its buckets.
+ * @param hash_func a function which "hashes" keys.
+ * @param seed mixed into the hashes of the keys (bucket_seed_hash).
+ * @param key_cmp compares the elements with keys if the elements are the
+ * keys themselves, NULL if the elements are pairs (compared with their own
+ * key_cmp).
+ *
+ * A bucket with more than HASH_MAP_TREEIFY_THRESHOLD elements is kept
+ * sorted by the seeded hashes of their keys and binary searched.
+ */
+typedef struct bucket_keys {
+    hash_func hash_func;
+    size_t seed;
+    pair_key_cmp key_cmp;
+} bucket_keys;
+
+/**
+ * The splitmix64 finalizer: every bit of x affects every bit of the result.
+ */
+uint64_t bucket_mix_bits (uint64_t x);
+
+/**
+ * Returns the seeded hash of a hash_func result: its bucket is this hash
+ * modulo the capacity.
+ */
+size_t bucket_seed_hash (const bucket_keys *keys, size_t hash);
+
+/**
+ * Returns the index of the element of key (whose seeded hash is hash) in
+ * bucket vec, -1 if there is none.
+ */
+long bucket_find (const bucket_keys *keys, const vector *vec,
+                  const_keyT key, size_t hash);
+
+/**
+ * Adds elem, whose key has seeded hash hash, to bucket vec (moved, or
+ * copied if move is 0), keeping the buckets above
+ * HASH_MAP_TREEIFY_THRESHOLD sorted.
+ * @return 1 on success, 0 otherwise.
+ */
+int bucket_push (const bucket_keys *keys, vector *vec, const void *elem,
+                 size_t hash, int move);
+
+/**
+ * Returns the capacity (capacity times a power of HASH_MAP_GROWTH_FACTOR)
+ * that holds num_of_elems elements below HASH_MAP_MAX_LOAD_FACTOR.
+ * @return the capacity, 0 if the size of its array of buckets would not
+ * fit in a size_t.
+ */
+size_t bucket_capacity_for (size_t capacity, size_t num_of_elems);
+
+#endif //BUCKET_H_
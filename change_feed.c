@@ -0,0 +1,158 @@
+#include "change_feed.h"
+
+/**
+ * Allocates dynamically a subscriber with an empty ring.
+ * @return pointer to dynamically allocated subscriber.
+ * @if_fail return NULL.
+ */
+change_feed_subscriber *change_feed_subscriber_alloc (size_t capacity)
+{
+  if (capacity == 0){
+      capacity = CHANGE_FEED_DEFAULT_CAP;
+  }
+  if (capacity > CHANGE_FEED_MAX_CAP){
+      return NULL;
+  }
+  size_t ring_capacity = 1;
+  while (ring_capacity < capacity){
+      ring_capacity *= 2;
+  }
+  change_feed_subscriber *subscriber = calloc (1,
+                                               sizeof (change_feed_subscriber));
+  if (subscriber == NULL){
+      return NULL;
+  }
+  subscriber->ring = malloc (sizeof (change_feed_event *) * ring_capacity);
+  if (subscriber->ring == NULL){
+      free (subscriber);
+      return NULL;
+  }
+  subscriber->capacity = ring_capacity;
+  return subscriber;
+}
+
+/*
+ * Drops one reference to an event, the last one frees it.
+ */
+static void release_event (change_feed_event *event)
+{
+  if (__atomic_sub_fetch (&(event->refs), 1, __ATOMIC_ACQ_REL) == 0){
+      pair_free ((void **) &(event->pair));
+      free (event);
+  }
+}
+
+/**
+ * Frees a subscriber, releasing the events it did not drain.
+ */
+void change_feed_subscriber_free (change_feed_subscriber **p_subscriber)
+{
+  if ((p_subscriber == NULL) || (*p_subscriber == NULL)){
+      return;
+  }
+  change_feed_subscriber *subscriber = *p_subscriber;
+  change_feed_event *event;
+  while (change_feed_drain (subscriber, &event, 1) == 1){
+      release_event (event);
+    }
+  free (subscriber->ring);
+  free (subscriber);
+  *p_subscriber = NULL;
+}
+
+/*
+ * Puts event into the ring of subscriber. Returns 1 on success, 0 if the
+ * ring is full.
+ */
+static int push_event (change_feed_subscriber *subscriber,
+                       change_feed_event *event)
+{
+  size_t head = subscriber->head; // only this thread writes it.
+  size_t tail = __atomic_load_n (&(subscriber->tail), __ATOMIC_ACQUIRE);
+  if (head - tail == subscriber->capacity){
+      return 0;
+  }
+  subscriber->ring[head & (subscriber->capacity - 1)] = event;
+  __atomic_store_n (&(subscriber->head), head + 1, __ATOMIC_RELEASE);
+  return 1;
+}
+
+/**
+ * Publishes a change to every subscriber of a list (producer side).
+ */
+void change_feed_publish (change_feed_subscriber *subscribers, int type,
+                          size_t seq, const pair *in_pair)
+{
+  if (subscribers == NULL){
+      return;
+  }
+  change_feed_event *event = malloc (sizeof (change_feed_event));
+  pair *copy = pair_copy (in_pair);
+  if ((event == NULL) || (copy == NULL)){
+      free (event);
+      pair_free ((void **) &copy);
+      for (; subscribers != NULL; subscribers = subscribers->next)
+        {
+          __atomic_add_fetch (&(subscribers->dropped), 1, __ATOMIC_RELAXED);
+        }
+      return;
+  }
+  event->type = type;
+  event->seq = seq;
+  event->pair = copy;
+  event->refs = 1; // the publisher's, dropped below.
+  for (; subscribers != NULL; subscribers = subscribers->next)
+    {
+      __atomic_add_fetch (&(event->refs), 1, __ATOMIC_RELAXED);
+      if (push_event (subscribers, event) == 0){
+          __atomic_sub_fetch (&(event->refs), 1, __ATOMIC_RELAXED);
+          __atomic_add_fetch (&(subscribers->dropped), 1, __ATOMIC_RELAXED);
+      }
+    }
+  release_event (event);
+}
+
+/**
+ * Takes up to max_events events from the ring of a subscriber, oldest
+ * first (consumer side).
+ * @return the number of events taken.
+ */
+size_t change_feed_drain (change_feed_subscriber *subscriber,
+                          change_feed_event **events, size_t max_events)
+{
+  if ((subscriber == NULL) || (events == NULL)){
+      return 0;
+  }
+  size_t tail = subscriber->tail; // only this thread writes it.
+  size_t head = __atomic_load_n (&(subscriber->head), __ATOMIC_ACQUIRE);
+  size_t num_of_events = (head - tail < max_events) ? head - tail : max_events;
+  for (size_t i = 0; i < num_of_events; ++i)
+    {
+      events[i] = subscriber->ring[(tail + i) & (subscriber->capacity - 1)];
+    }
+  __atomic_store_n (&(subscriber->tail), tail + num_of_events,
+                    __ATOMIC_RELEASE);
+  return num_of_events;
+}
+
+/**
+ * Releases drained events.
+ */
+void change_feed_release (change_feed_event **events, size_t num_of_events)
+{
+  for (size_t i = 0; (events != NULL) && (i < num_of_events); ++i)
+    {
+      release_event (events[i]);
+    }
+}
+
+/**
+ * Returns the number of events dropped for a subscriber.
+ */
+size_t change_feed_dropped (const change_feed_subscriber *subscriber)
+{
+  if (subscriber == NULL){
+      return 0;
+  }
+  return __atomic_load_n (&(subscriber->dropped), __ATOMIC_RELAXED);
+}
@@ -0,0 +1,121 @@
+#ifndef CHANGE_FEED_H_
+#define CHANGE_FEED_H_
+
+#include <stdlib.h>
+#include "pair.h"
+
+/**
+ * The change feed of a hashmap: every subscriber (hashmap_subscribe) gets
+ * its own single producer / single consumer ring of change events. The
+ * thread that modifies the map publishes into every ring, and each
+ * subscriber drains its ring in batches from its own thread; neither side
+ * takes a lock. The producer never waits: an event that finds a ring full
+ * is dropped for that subscriber and counted (change_feed_dropped), and the
+ * sequence numbers of the events show where. A subscriber that lost events
+ * resynchronizes, e.g. with hashmap_diff.
+ * An event is shared by all the subscribers it reached and freed once
+ * every one of them released it.
+ */
+
+/**
+ * @def CHANGE_FEED_INSERT, CHANGE_FEED_UPDATE, CHANGE_FEED_ERASE
+ * The kinds of change: a new key, a new value for a key, an erased key.
+ */
+#define CHANGE_FEED_INSERT 1
+#define CHANGE_FEED_UPDATE 2
+#define CHANGE_FEED_ERASE 3
+
+/**
+ * @def CHANGE_FEED_DEFAULT_CAP
+ * The ring capacity of a subscriber created with capacity 0.
+ */
+#define CHANGE_FEED_DEFAULT_CAP 4096UL
+
+/**
+ * @def CHANGE_FEED_MAX_CAP
+ * The largest ring capacity of a subscriber.
+ */
+#define CHANGE_FEED_MAX_CAP (1UL << 30)
+
+/**
+ * @struct change_feed_event
+ * @param type CHANGE_FEED_INSERT, CHANGE_FEED_UPDATE or CHANGE_FEED_ERASE.
+ * @param seq the number of the change in the map (1 for the first change
+ * since the first subscription), consecutive unless events were dropped.
+ * @param pair a copy of the pair after the change (before it, for an erase).
+ * @param refs the subscribers that have not released the event yet.
+ */
+typedef struct change_feed_event {
+    int type;
+    size_t seq;
+    pair *pair;
+    size_t refs;
+} change_feed_event;
+
+/**
+ * @struct change_feed_subscriber
+ * @param ring capacity slots, a power of 2.
+ * @param head the number of events published into the ring (written by the
+ * producer).
+ * @param tail the number of events drained from the ring (written by the
+ * consumer).
+ * @param dropped the events dropped because the ring was full.
+ * @param next the next subscriber of the same map.
+ */
+typedef struct change_feed_subscriber {
+    change_feed_event **ring;
+    size_t capacity;
+    size_t head;
+    size_t tail;
+    size_t dropped;
+    struct change_feed_subscriber *next;
+} change_feed_subscriber;
+
+/**
+ * Allocates dynamically a subscriber with an empty ring.
+ * @param capacity the ring capacity, rounded up to a power of 2
+ * (CHANGE_FEED_DEFAULT_CAP if 0, at most CHANGE_FEED_MAX_CAP).
+ * @return pointer to dynamically allocated subscriber.
+ * @if_fail return NULL.
+ */
+change_feed_subscriber *change_feed_subscriber_alloc (size_t capacity);
+
+/**
+ * Frees a subscriber, releasing the events it did not drain.
+ * @param p_subscriber pointer to dynamically allocated pointer to subscriber.
+ */
+void change_feed_subscriber_free (change_feed_subscriber **p_subscriber);
+
+/**
+ * Publishes a change to every subscriber of a list (producer side). The
+ * event holds a copy of in_pair, made only if there is a subscriber.
+ * @param subscribers the first subscriber of the list.
+ * @param type the kind of change.
+ * @param seq the number of the change.
+ * @param in_pair the pair after the change (before it, for an erase).
+ */
+void change_feed_publish (change_feed_subscriber *subscribers, int type,
+                          size_t seq, const pair *in_pair);
+
+/**
+ * Takes up to max_events events from the ring of a subscriber, oldest
+ * first (consumer side). The events belong to the caller until released.
+ * @return the number of events taken.
+ */
+size_t change_feed_drain (change_feed_subscriber *subscriber,
+                          change_feed_event **events, size_t max_events);
+
+/**
+ * Releases drained events.
+ * @param events the events.
+ * @param num_of_events the number of events.
+ */
+void change_feed_release (change_feed_event **events, size_t num_of_events);
+
+/**
+ * Returns the number of events dropped for a subscriber because its ring
+ * was full.
+ */
+size_t change_feed_dropped (const change_feed_subscriber *subscriber);
+
+#endif //CHANGE_FEED_H_
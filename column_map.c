@@ -0,0 +1,457 @@
+#include "column_map.h"
+#include "typed_hashmap.h"
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define COLUMN_MAP_AVX2 1
+#include <immintrin.h>
+#else
+#define COLUMN_MAP_AVX2 0
+#endif
+
+/*
+ * The bulk passes work on blocks of BLOCK entries: the predicate fills a
+ * bit mask per block, which then drives the update or the selection.
+ */
+#define BLOCK 64
+
+/*
+ * Returns the index slot of key, or the empty slot where it belongs.
+ */
+static size_t find_slot (const column_map *map, int64_t key)
+{
+  size_t mask = map->capacity - 1;
+  size_t ind = HASHMAP_INT_HASH (key) & mask;
+  while ((map->index[ind] != 0) && (map->keys[map->index[ind] - 1] != key)){
+      ind = (ind + 1) & mask;
+  }
+  return ind;
+}
+
+/*
+ * Rebuilds the index with new_capacity slots.
+ */
+static int resize_index (column_map *map, size_t new_capacity)
+{
+  size_t *index = calloc (new_capacity, sizeof (size_t));
+  if (index == NULL){
+      return 0;
+  }
+  free (map->index);
+  map->index = index;
+  map->capacity = new_capacity;
+  for (size_t i = 0; i < map->size; ++i)
+    {
+      map->index[find_slot (map, map->keys[i])] = i + 1;
+    }
+  return 1;
+}
+
+/*
+ * Reallocates both columns to new_capacity entries.
+ */
+static int resize_columns (column_map *map, size_t new_capacity)
+{
+  int64_t *keys = realloc (map->keys, sizeof (int64_t) * new_capacity);
+  if (keys == NULL){
+      return 0;
+  }
+  map->keys = keys;
+  double *values = realloc (map->values, sizeof (double) * new_capacity);
+  if (values == NULL){
+      if (new_capacity < map->columns_capacity){
+          map->columns_capacity = new_capacity; // values keeps more room.
+          return 1;
+      }
+      return 0;
+  }
+  map->values = values;
+  map->columns_capacity = new_capacity;
+  return 1;
+}
+
+/*
+ * Sets bit i of bits for the i'th of n entries that satisfies cond.
+ */
+#define MATCH_LOOP(cond)                                                      \
+  for (size_t i = 0; i < n; ++i)                                              \
+    {                                                                         \
+      bits |= (uint64_t) (cond) << i;                                         \
+    }
+
+/*
+ * Fills the bits of the n (at most BLOCK) entries from start that satisfy
+ * pred. The loops are branch free, so the compiler can vectorize them.
+ */
+static uint64_t match_scalar (const column_map *map, const column_pred *pred,
+                              size_t start, size_t n)
+{
+  uint64_t bits = 0;
+  if (pred->op == COLUMN_ALL){
+      return (n == BLOCK) ? ~(uint64_t) 0 : (((uint64_t) 1 << n) - 1);
+  }
+  if (pred->column == COLUMN_KEYS){
+      const int64_t *x = map->keys + start;
+      int64_t a = pred->key_a, b = pred->key_b;
+      switch (pred->op)
+        {
+          case COLUMN_EQ: MATCH_LOOP (x[i] == a) break;
+          case COLUMN_NE: MATCH_LOOP (x[i] != a) break;
+          case COLUMN_LT: MATCH_LOOP (x[i] < a) break;
+          case COLUMN_LE: MATCH_LOOP (x[i] <= a) break;
+          case COLUMN_GT: MATCH_LOOP (x[i] > a) break;
+          case COLUMN_GE: MATCH_LOOP (x[i] >= a) break;
+          default: MATCH_LOOP ((x[i] >= a) & (x[i] <= b))
+        }
+      return bits;
+  }
+  const double *x = map->values + start;
+  double a = pred->value_a, b = pred->value_b;
+  switch (pred->op)
+    {
+      case COLUMN_EQ: MATCH_LOOP (x[i] == a) break;
+      case COLUMN_NE: MATCH_LOOP (x[i] != a) break;
+      case COLUMN_LT: MATCH_LOOP (x[i] < a) break;
+      case COLUMN_LE: MATCH_LOOP (x[i] <= a) break;
+      case COLUMN_GT: MATCH_LOOP (x[i] > a) break;
+      case COLUMN_GE: MATCH_LOOP (x[i] >= a) break;
+      default: MATCH_LOOP ((x[i] >= a) & (x[i] <= b))
+    }
+  return bits;
+}
+
+static double update_value (const column_update *update, double v)
+{
+  switch (update->op)
+    {
+      case COLUMN_SET: return update->a;
+      case COLUMN_ADD: return v + update->a;
+      case COLUMN_SCALE: return v * update->a;
+      default: return v * update->a + update->b;
+    }
+}
+
+static void update_scalar (column_map *map, const column_update *update,
+                           size_t start, size_t n, uint64_t bits)
+{
+  double *v = map->values + start;
+  for (size_t i = 0; i < n; ++i)
+    {
+      if ((bits >> i) & 1){
+          v[i] = update_value (update, v[i]);
+      }
+    }
+}
+
+#if COLUMN_MAP_AVX2
+/*
+ * The AVX2 version of match_scalar: 4 entries per comparison.
+ */
+__attribute__ ((target ("avx2")))
+static uint64_t match_avx2 (const column_map *map, const column_pred *pred,
+                            size_t start, size_t n)
+{
+  if (pred->op == COLUMN_ALL){
+      return match_scalar (map, pred, start, n);
+  }
+  uint64_t bits = 0;
+  size_t i = 0;
+  if (pred->column == COLUMN_KEYS){
+      __m256i a = _mm256_set1_epi64x (pred->key_a);
+      __m256i b = _mm256_set1_epi64x (pred->key_b);
+      for (; i + 4 <= n; i += 4)
+        {
+          __m256i x = _mm256_loadu_si256 ((const __m256i *)
+                                              (map->keys + start + i));
+          __m256i hit;
+          int negate = 0;
+          switch (pred->op)
+            {
+              case COLUMN_EQ: hit = _mm256_cmpeq_epi64 (x, a); break;
+              case COLUMN_NE: hit = _mm256_cmpeq_epi64 (x, a); negate = 1;
+                break;
+              case COLUMN_LT: hit = _mm256_cmpgt_epi64 (a, x); break;
+              case COLUMN_LE: hit = _mm256_cmpgt_epi64 (x, a); negate = 1;
+                break;
+              case COLUMN_GT: hit = _mm256_cmpgt_epi64 (x, a); break;
+              case COLUMN_GE: hit = _mm256_cmpgt_epi64 (a, x); negate = 1;
+                break;
+              default: hit = _mm256_or_si256 (_mm256_cmpgt_epi64 (a, x),
+                                              _mm256_cmpgt_epi64 (x, b));
+                negate = 1;
+            }
+          uint64_t found = (uint64_t) _mm256_movemask_pd (
+              _mm256_castsi256_pd (hit));
+          bits |= (negate ? (found ^ 0xF) : found) << i;
+        }
+  }
+  else{
+      __m256d a = _mm256_set1_pd (pred->value_a);
+      __m256d b = _mm256_set1_pd (pred->value_b);
+      for (; i + 4 <= n; i += 4)
+        {
+          __m256d x = _mm256_loadu_pd (map->values + start + i);
+          __m256d hit;
+          switch (pred->op)
+            {
+              case COLUMN_EQ: hit = _mm256_cmp_pd (x, a, _CMP_EQ_OQ); break;
+              case COLUMN_NE: hit = _mm256_cmp_pd (x, a, _CMP_NEQ_UQ); break;
+              case COLUMN_LT: hit = _mm256_cmp_pd (x, a, _CMP_LT_OQ); break;
+              case COLUMN_LE: hit = _mm256_cmp_pd (x, a, _CMP_LE_OQ); break;
+              case COLUMN_GT: hit = _mm256_cmp_pd (x, a, _CMP_GT_OQ); break;
+              case COLUMN_GE: hit = _mm256_cmp_pd (x, a, _CMP_GE_OQ); break;
+              default: hit = _mm256_and_pd (_mm256_cmp_pd (x, a, _CMP_GE_OQ),
+                                            _mm256_cmp_pd (x, b, _CMP_LE_OQ));
+            }
+          bits |= (uint64_t) _mm256_movemask_pd (hit) << i;
+        }
+  }
+  if (i < n){
+      bits |= match_scalar (map, pred, start + i, n - i) << i;
+  }
+  return bits;
+}
+
+/*
+ * The AVX2 version of update_scalar: updates 4 values at a time and keeps
+ * the old value where the mask bit is clear.
+ */
+__attribute__ ((target ("avx2")))
+static void update_avx2 (column_map *map, const column_update *update,
+                         size_t start, size_t n, uint64_t bits)
+{
+  const __m256i lanes = _mm256_set_epi64x (8, 4, 2, 1);
+  __m256d a = _mm256_set1_pd (update->a);
+  __m256d b = _mm256_set1_pd (update->b);
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4)
+    {
+      uint64_t quad = (bits >> i) & 0xF;
+      if (quad == 0){
+          continue;
+      }
+      double *v = map->values + start + i;
+      __m256d x = _mm256_loadu_pd (v);
+      __m256d y;
+      switch (update->op)
+        {
+          case COLUMN_SET: y = a; break;
+          case COLUMN_ADD: y = _mm256_add_pd (x, a); break;
+          case COLUMN_SCALE: y = _mm256_mul_pd (x, a); break;
+          default: y = _mm256_add_pd (_mm256_mul_pd (x, a), b);
+        }
+      __m256i sel = _mm256_and_si256 (_mm256_set1_epi64x ((int64_t) quad),
+                                      lanes);
+      __m256d keep_new = _mm256_castsi256_pd (_mm256_cmpeq_epi64 (sel, lanes));
+      _mm256_storeu_pd (v, _mm256_blendv_pd (x, y, keep_new));
+    }
+  if (i < n){
+      update_scalar (map, update, start + i, n - i, bits >> i);
+    }
+}
+#endif
+
+static int cpu_has_avx2 (void)
+{
+#if COLUMN_MAP_AVX2
+  return __builtin_cpu_supports ("avx2") != 0;
+#else
+  return 0;
+#endif
+}
+
+static uint64_t match (const column_map *map, const column_pred *pred,
+                       size_t start, size_t n)
+{
+#if COLUMN_MAP_AVX2
+  if (map->use_simd){
+      return match_avx2 (map, pred, start, n);
+  }
+#endif
+  return match_scalar (map, pred, start, n);
+}
+
+static int valid_pred (const column_pred *pred)
+{
+  return (pred != NULL) && (pred->op >= COLUMN_ALL)
+         && (pred->op <= COLUMN_RANGE)
+         && ((pred->column == COLUMN_KEYS) || (pred->column == COLUMN_VALUES));
+}
+
+column_map *column_map_alloc (void)
+{
+  column_map *map = calloc (1, sizeof (column_map));
+  if (map == NULL){
+      return NULL;
+  }
+  if ((resize_index (map, HASH_MAP_INITIAL_CAP) == 0)
+      || (resize_columns (map, HASH_MAP_INITIAL_CAP) == 0)){
+      column_map_free (&map);
+      return NULL;
+  }
+  map->use_simd = cpu_has_avx2 ();
+  return map;
+}
+
+void column_map_free (column_map **p_map)
+{
+  if ((p_map == NULL) || (*p_map == NULL)){
+      return;
+  }
+  free ((*p_map)->keys);
+  free ((*p_map)->values);
+  free ((*p_map)->index);
+  free (*p_map);
+  *p_map = NULL;
+}
+
+int column_map_insert (column_map *map, int64_t key, double value)
+{
+  if (map == NULL){
+      return 0;
+  }
+  if (map->index[find_slot (map, key)] != 0){
+      return 0;
+  }
+  if ((map->size + 1 > HASH_MAP_MAX_LOAD_FACTOR * map->capacity)
+      && (resize_index (map, map->capacity * HASH_MAP_GROWTH_FACTOR) == 0)){
+      return 0;
+  }
+  if ((map->size == map->columns_capacity)
+      && (resize_columns (map, map->columns_capacity * HASH_MAP_GROWTH_FACTOR)
+          == 0)){
+      return 0;
+  }
+  map->keys[map->size] = key;
+  map->values[map->size] = value;
+  map->size += 1;
+  map->index[find_slot (map, key)] = map->size;
+  return 1;
+}
+
+double *column_map_at (const column_map *map, int64_t key)
+{
+  if (map == NULL){
+      return NULL;
+  }
+  size_t pos = map->index[find_slot (map, key)];
+  return (pos == 0) ? NULL : &(map->values[pos - 1]);
+}
+
+int column_map_erase (column_map *map, int64_t key)
+{
+  if (map == NULL){
+      return 0;
+  }
+  size_t ind = find_slot (map, key);
+  size_t pos = map->index[ind];
+  if (pos == 0){
+      return 0;
+  }
+  size_t mask = map->capacity - 1;
+  size_t next = (ind + 1) & mask;
+  while (map->index[next] != 0){ // backward shift, no tombstones.
+      size_t home = HASHMAP_INT_HASH (map->keys[map->index[next] - 1]) & mask;
+      if (((next - home) & mask) >= ((next - ind) & mask)){
+          map->index[ind] = map->index[next];
+          ind = next;
+      }
+      next = (next + 1) & mask;
+  }
+  map->index[ind] = 0;
+  size_t last = map->size - 1;
+  if (pos - 1 != last){ // the last entry fills the hole.
+      map->index[find_slot (map, map->keys[last])] = pos;
+      map->keys[pos - 1] = map->keys[last];
+      map->values[pos - 1] = map->values[last];
+  }
+  map->size -= 1;
+  if ((map->capacity > HASH_MAP_INITIAL_CAP)
+      && (map->size < HASH_MAP_MIN_LOAD_FACTOR * map->capacity)){
+      resize_index (map, map->capacity / HASH_MAP_GROWTH_FACTOR);
+  }
+  if ((map->columns_capacity > HASH_MAP_INITIAL_CAP)
+      && (map->size < HASH_MAP_MIN_LOAD_FACTOR * map->columns_capacity)){
+      resize_columns (map, map->columns_capacity / HASH_MAP_GROWTH_FACTOR);
+  }
+  return 1;
+}
+
+double column_map_get_load_factor (const column_map *map)
+{
+  if ((map == NULL) || (map->capacity == 0)){
+      return -1;
+  }
+  return (double) map->size / map->capacity;
+}
+
+int column_map_set_simd (column_map *map, int enable)
+{
+  if (map == NULL){
+      return 0;
+  }
+  map->use_simd = enable && cpu_has_avx2 ();
+  return map->use_simd;
+}
+
+size_t column_map_apply_if (column_map *map, const column_pred *pred,
+                            const column_update *update)
+{
+  if ((map == NULL) || !valid_pred (pred) || (update == NULL)
+      || (update->op < COLUMN_SET) || (update->op > COLUMN_SCALE_ADD)){
+      return 0;
+  }
+  size_t changed = 0;
+  for (size_t start = 0; start < map->size; start += BLOCK)
+    {
+      size_t n = (map->size - start < BLOCK) ? map->size - start : BLOCK;
+      uint64_t bits = match (map, pred, start, n);
+      if (bits == 0){
+          continue;
+      }
+#if COLUMN_MAP_AVX2
+      if (map->use_simd){
+          update_avx2 (map, update, start, n, bits);
+      }
+      else
+#endif
+      {
+          update_scalar (map, update, start, n, bits);
+      }
+      changed += (size_t) __builtin_popcountll (bits);
+    }
+  return changed;
+}
+
+size_t column_map_count_if (const column_map *map, const column_pred *pred)
+{
+  if ((map == NULL) || !valid_pred (pred)){
+      return 0;
+  }
+  size_t count = 0;
+  for (size_t start = 0; start < map->size; start += BLOCK)
+    {
+      size_t n = (map->size - start < BLOCK) ? map->size - start : BLOCK;
+      count += (size_t) __builtin_popcountll (match (map, pred, start, n));
+    }
+  return count;
+}
+
+size_t column_map_select (const column_map *map, const column_pred *pred,
+                          int64_t *out_keys, size_t max_keys)
+{
+  if ((map == NULL) || !valid_pred (pred) || (out_keys == NULL)){
+      return 0;
+  }
+  size_t count = 0;
+  for (size_t start = 0; (start < map->size) && (count < max_keys);
+       start += BLOCK)
+    {
+      size_t n = (map->size - start < BLOCK) ? map->size - start : BLOCK;
+      uint64_t bits = match (map, pred, start, n);
+      while ((bits != 0) && (count < max_keys)){
+          out_keys[count++] = map->keys[start + __builtin_ctzll (bits)];
+          bits &= bits - 1;
+      }
+    }
+  return count;
+}
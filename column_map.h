@@ -0,0 +1,166 @@
+#ifndef COLUMN_MAP_H_
+#define COLUMN_MAP_H_
+
+#include <stdlib.h>
+#include <stdint.h>
+
+/**
+ * A hash map from int64_t keys to double values, stored column-wise.
+ * The keys and values live in two dense, parallel arrays (the columns),
+ * and an open addressed index maps a key to its position. Erasing moves
+ * the last entry into the hole, so the columns never have gaps.
+ * Bulk passes (column_map_apply_if, column_map_count_if,
+ * column_map_select) do not call a function per entry: they take a
+ * predicate (a comparison of one column with constants) and an update
+ * (an arithmetic operation with constants), and run them over the columns
+ * with AVX2 kernels where the CPU has them, and with scalar loops
+ * otherwise.
+ */
+
+/**
+ * @def COLUMN_KEYS, COLUMN_VALUES
+ * The column a predicate tests.
+ */
+#define COLUMN_KEYS 0
+#define COLUMN_VALUES 1
+
+/**
+ * @def COLUMN_ALL, COLUMN_EQ, COLUMN_NE, COLUMN_LT, COLUMN_LE, COLUMN_GT,
+ * COLUMN_GE, COLUMN_RANGE
+ * Predicate operations: every entry, x == a, x != a, x < a, x <= a,
+ * x > a, x >= a, and a <= x <= b (x is the tested column).
+ */
+#define COLUMN_ALL 0
+#define COLUMN_EQ 1
+#define COLUMN_NE 2
+#define COLUMN_LT 3
+#define COLUMN_LE 4
+#define COLUMN_GT 5
+#define COLUMN_GE 6
+#define COLUMN_RANGE 7
+
+/**
+ * @def COLUMN_SET, COLUMN_ADD, COLUMN_SCALE, COLUMN_SCALE_ADD
+ * Update operations on a value v: v = a, v = v + a, v = v * a and
+ * v = v * a + b.
+ */
+#define COLUMN_SET 0
+#define COLUMN_ADD 1
+#define COLUMN_SCALE 2
+#define COLUMN_SCALE_ADD 3
+
+/**
+ * @struct column_pred
+ * @param column COLUMN_KEYS or COLUMN_VALUES.
+ * @param op the comparison.
+ * @param key_a, key_b the constants of a key comparison.
+ * @param value_a, value_b the constants of a value comparison.
+ */
+typedef struct column_pred {
+    int column;
+    int op;
+    int64_t key_a;
+    int64_t key_b;
+    double value_a;
+    double value_b;
+} column_pred;
+
+/**
+ * @struct column_update
+ * @param op the operation.
+ * @param a, b its constants.
+ */
+typedef struct column_update {
+    int op;
+    double a;
+    double b;
+} column_update;
+
+/**
+ * @struct column_map
+ * @param keys, values the columns, size entries each.
+ * @param size the number of entries.
+ * @param columns_capacity the allocated length of the columns.
+ * @param index the hash table: position + 1 of an entry, 0 for an empty
+ * slot.
+ * @param capacity the number of index slots (a power of 2).
+ * @param use_simd 1 to run the bulk passes with the AVX2 kernels (only if
+ * the CPU supports AVX2).
+ */
+typedef struct column_map {
+    int64_t *keys;
+    double *values;
+    size_t size;
+    size_t columns_capacity;
+    size_t *index;
+    size_t capacity;
+    int use_simd;
+} column_map;
+
+/**
+ * Allocates dynamically new column map.
+ * @return pointer to dynamically allocated column map.
+ * @if_fail return NULL.
+ */
+column_map *column_map_alloc (void);
+
+/**
+ * Frees a column map.
+ * @param p_map pointer to dynamically allocated pointer to column map.
+ */
+void column_map_free (column_map **p_map);
+
+/**
+ * Inserts (key, value).
+ * @return 1 for successful insertion, 0 otherwise (also if the key is
+ * already in the map).
+ */
+int column_map_insert (column_map *map, int64_t key, double value);
+
+/**
+ * @return a pointer to the value of key, NULL if key is not in the map
+ * (valid until the next insertion or erase).
+ */
+double *column_map_at (const column_map *map, int64_t key);
+
+/**
+ * Erases key, the last entry takes its position.
+ * @return 1 if the erasing was done successfully, 0 otherwise.
+ */
+int column_map_erase (column_map *map, int64_t key);
+
+/**
+ * Returns the load factor of the index, -1 if the function failed.
+ */
+double column_map_get_load_factor (const column_map *map);
+
+/**
+ * Chooses between the AVX2 and the scalar kernels.
+ * @param map a column map.
+ * @param enable 1 to use AVX2 when the CPU supports it, 0 for scalar.
+ * @return 1 if the AVX2 kernels will be used, 0 otherwise.
+ */
+int column_map_set_simd (column_map *map, int enable);
+
+/**
+ * Applies update on the value of every entry that satisfies pred.
+ * @return the number of changed values.
+ */
+size_t column_map_apply_if (column_map *map, const column_pred *pred,
+                            const column_update *update);
+
+/**
+ * @return the number of entries that satisfy pred.
+ */
+size_t column_map_count_if (const column_map *map, const column_pred *pred);
+
+/**
+ * Copies the keys of the entries that satisfy pred to out_keys, in column
+ * order.
+ * @param max_keys the length of out_keys.
+ * @return the number of keys copied.
+ */
+size_t column_map_select (const column_map *map, const column_pred *pred,
+                          int64_t *out_keys, size_t max_keys);
+
+#endif //COLUMN_MAP_H_
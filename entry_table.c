@@ -0,0 +1,159 @@
+#include "entry_table.h"
+#include "bucket.h"
+
+/*
+ * Moves every entry to a new bucket array of new_capacity buckets.
+ * The cached hashes are used, so the hash function is not called.
+ * Returns 1 on success, 0 otherwise (the table is unchanged).
+ */
+static int entry_table_resize (entry_table *table, size_t new_capacity)
+{
+  table_entry **new_buckets = calloc (new_capacity, sizeof (table_entry *));
+  if (new_buckets == NULL){
+      return 0;
+  }
+  for (size_t i = 0; i < table->capacity; ++i)
+    {
+      table_entry *cur = table->buckets[i];
+      while (cur != NULL){
+          table_entry *next = cur->chain_next;
+          size_t ind = cur->hash & (new_capacity - 1);
+          cur->chain_next = new_buckets[ind];
+          new_buckets[ind] = cur;
+          cur = next;
+      }
+    }
+  free (table->buckets);
+  table->buckets = new_buckets;
+  table->capacity = new_capacity;
+  return 1;
+}
+
+/**
+ * Initializes an empty table with HASH_MAP_INITIAL_CAP buckets.
+ * @return 1 on success, 0 otherwise.
+ */
+int entry_table_init (entry_table *table, hash_func func)
+{
+  if ((table == NULL) || (func == NULL)){
+      return 0;
+  }
+  table->buckets = calloc (HASH_MAP_INITIAL_CAP, sizeof (table_entry *));
+  if (table->buckets == NULL){
+      return 0;
+  }
+  table->size = 0;
+  table->capacity = HASH_MAP_INITIAL_CAP;
+  table->hash_func = func;
+  table->seed = hashmap_random_seed ();
+  return 1;
+}
+
+/**
+ * Frees the bucket array. The entries are owned by the caller.
+ */
+void entry_table_destroy (entry_table *table)
+{
+  free (table->buckets);
+  table->buckets = NULL;
+  table->size = 0;
+  table->capacity = 0;
+}
+
+/**
+ * Returns the seeded hash of key in the table.
+ */
+size_t entry_table_hash (const entry_table *table, const_keyT key)
+{
+  return (size_t) bucket_mix_bits ((uint64_t) (table->hash_func (key)
+                                               ^ table->seed));
+}
+
+/**
+ * @return the entry holding key, NULL if there is none.
+ */
+table_entry *entry_table_find (const entry_table *table, const_keyT key,
+                               size_t hash)
+{
+  table_entry *cur = table->buckets[hash & (table->capacity - 1)];
+  while (cur != NULL){
+      if ((cur->hash == hash) && (cur->entry.key_cmp (cur->entry.key, key) == 1)){
+          return cur;
+      }
+      cur = cur->chain_next;
+  }
+  return NULL;
+}
+
+/**
+ * Links an entry whose hash is set to the table.
+ * @return 1 on success, 0 if the table failed to grow.
+ */
+int entry_table_link (entry_table *table, table_entry *entry)
+{
+  if ((double) table->size / table->capacity >= HASH_MAP_MAX_LOAD_FACTOR){
+      if (entry_table_resize (table, table->capacity * HASH_MAP_GROWTH_FACTOR)
+          == 0){
+          return 0;
+      }
+  }
+  size_t ind = entry->hash & (table->capacity - 1);
+  entry->chain_next = table->buckets[ind];
+  table->buckets[ind] = entry;
+  table->size += 1;
+  return 1;
+}
+
+/**
+ * Unlinks an entry from the table, the entry itself is not freed.
+ * Shrinking is best effort, a failed shrink leaves the table as is.
+ */
+void entry_table_unlink (entry_table *table, table_entry *entry)
+{
+  table_entry **link = &(table->buckets[entry->hash & (table->capacity - 1)]);
+  while (*link != NULL){
+      if (*link == entry){
+          *link = entry->chain_next;
+          entry->chain_next = NULL;
+          table->size -= 1;
+          break;
+      }
+      link = &((*link)->chain_next);
+  }
+  if ((table->capacity > HASH_MAP_INITIAL_CAP)
+      && ((double) table->size / table->capacity <= HASH_MAP_MIN_LOAD_FACTOR)){
+      entry_table_resize (table, table->capacity / HASH_MAP_GROWTH_FACTOR);
+  }
+}
+
+/**
+ * Copies the key and value of in_pair (and its functions) into entry,
+ * and computes the hash of the key.
+ * @return 1 on success, 0 otherwise.
+ */
+int entry_table_set_entry (const entry_table *table, table_entry *entry,
+                           const pair *in_pair)
+{
+  entry->entry = *in_pair;
+  entry->entry.key = in_pair->key_cpy (in_pair->key);
+  if (entry->entry.key == NULL){
+      return 0;
+  }
+  entry->entry.value = in_pair->value_cpy (in_pair->value);
+  if (entry->entry.value == NULL){
+      entry->entry.key_free (&(entry->entry.key));
+      return 0;
+  }
+  entry->hash = entry_table_hash (table, in_pair->key);
+  entry->chain_next = NULL;
+  return 1;
+}
+
+/**
+ * Frees the key and value stored in entry (not the entry itself).
+ */
+void entry_table_release_entry (table_entry *entry)
+{
+  entry->entry.key_free (&(entry->entry.key));
+  entry->entry.value_free (&(entry->entry.value));
+}
@@ -0,0 +1,101 @@
+#ifndef ENTRY_TABLE_H_
+#define ENTRY_TABLE_H_
+
+#include <stdlib.h>
+#include "hashmap.h"
+
+/**
+ * An intrusive chained hash table, the building block of the containers
+ * that need to thread their own links through the map entries (lru_cache,
+ * ttl_map). The containers allocate their nodes with a table_entry as the
+ * first member and link / unlink them, the table never allocates or frees
+ * entries, only its bucket array. Entries never move, so pointers to them
+ * stay valid across resizes. The hashmap can not serve here: it allocates
+ * its own copy of every pair and moves the pointers between its bucket
+ * vectors, so a container could not embed its links in the entries. Like
+ * the hashmap, the table mixes a random seed into the hashes of the keys.
+ */
+
+/**
+ * @struct table_entry
+ * @param chain_next the next entry in the same bucket.
+ * @param hash the seeded hash of the key (entry_table_hash), computed once
+ * on insertion.
+ * @param entry the key and value (owned copies) with their functions.
+ */
+typedef struct table_entry {
+    struct table_entry *chain_next;
+    size_t hash;
+    pair entry;
+} table_entry;
+
+/**
+ * @struct entry_table
+ * @param buckets array of chains.
+ * @param size the number of linked entries.
+ * @param capacity the number of buckets (a power of 2).
+ * @param hash_func a function which "hashes" keys.
+ * @param seed mixed into the hashes of the keys, random for every table.
+ */
+typedef struct entry_table {
+    table_entry **buckets;
+    size_t size;
+    size_t capacity;
+    hash_func hash_func;
+    size_t seed;
+} entry_table;
+
+/**
+ * Initializes an empty table with HASH_MAP_INITIAL_CAP buckets.
+ * @return 1 on success, 0 otherwise.
+ */
+int entry_table_init (entry_table *table, hash_func func);
+
+/**
+ * Frees the bucket array. The entries are owned by the caller.
+ */
+void entry_table_destroy (entry_table *table);
+
+/**
+ * Returns the seeded hash of key in the table: the hash entry_table_find
+ * takes and entry_table_set_entry stores.
+ */
+size_t entry_table_hash (const entry_table *table, const_keyT key);
+
+/**
+ * @param table a table.
+ * @param key the key to look for.
+ * @param hash the hash of key (entry_table_hash).
+ * @return the entry holding key, NULL if there is none.
+ */
+table_entry *entry_table_find (const entry_table *table, const_keyT key,
+                               size_t hash);
+
+/**
+ * Links an entry whose hash is set to the table, growing the table
+ * by HASH_MAP_GROWTH_FACTOR when the load factor reaches
+ * HASH_MAP_MAX_LOAD_FACTOR. The key must not already be in the table.
+ * @return 1 on success, 0 if the table failed to grow.
+ */
+int entry_table_link (entry_table *table, table_entry *entry);
+
+/**
+ * Unlinks an entry from the table (the entry itself is not freed),
+ * shrinking the table when the load factor drops to HASH_MAP_MIN_LOAD_FACTOR.
+ */
+void entry_table_unlink (entry_table *table, table_entry *entry);
+
+/**
+ * Copies the key and value of in_pair (and its functions) into entry,
+ * and computes the hash of the key.
+ * @return 1 on success, 0 otherwise.
+ */
+int entry_table_set_entry (const entry_table *table, table_entry *entry,
+                           const pair *in_pair);
+
+/**
+ * Frees the key and value stored in entry (not the entry itself).
+ */
+void entry_table_release_entry (table_entry *entry);
+
+#endif //ENTRY_TABLE_H_
@@ -0,0 +1,231 @@
+#include <string.h>
+#include "fixed_map.h"
+#include "strkey.h"
+
+#define FIXED_MAP_ALIGN 8UL
+#define FIXED_MAP_HASH_MUL 0x9e3779b97f4a7c15ULL
+
+static size_t align_up (size_t bytes)
+{
+  return (bytes + FIXED_MAP_ALIGN - 1) & ~(FIXED_MAP_ALIGN - 1);
+}
+
+/*
+ * The number of index slots for max_entries entries: a power of 2, at
+ * least twice max_entries.
+ */
+static size_t index_capacity (size_t max_entries)
+{
+  size_t capacity = 8;
+  while (capacity < 2 * max_entries){
+      capacity *= 2;
+  }
+  return capacity;
+}
+
+/*
+ * The hash of a key, folded to 32 bits with the high bits of a multiply.
+ */
+static uint32_t hash_key (const fixed_map *map, const void *key)
+{
+  size_t hash = (map->hash != NULL) ? map->hash (key)
+                                    : strkey_hash_bytes (key, map->key_size);
+  return (uint32_t) (((uint64_t) hash * FIXED_MAP_HASH_MUL) >> 32);
+}
+
+static unsigned char *entry_at (const fixed_map *map, size_t pos)
+{
+  return map->entries + pos * map->entry_size;
+}
+
+/*
+ * Returns the slot of key, or the empty slot that ends its probe sequence.
+ */
+static size_t find_slot (const fixed_map *map, const void *key, uint32_t hash)
+{
+  size_t mask = map->capacity - 1;
+  size_t ind = hash & mask;
+  while ((map->slots[ind].pos != 0)
+         && ((map->slots[ind].hash != hash)
+             || (memcmp (entry_at (map, map->slots[ind].pos - 1), key,
+                         map->key_size) != 0))){
+      ind = (ind + 1) & mask;
+  }
+  return ind;
+}
+
+/**
+ * Computes the size of the buffer a map needs.
+ * @return the number of bytes, 0 if the arguments are invalid.
+ */
+size_t fixed_map_bytes (size_t max_entries, size_t key_size,
+                        size_t value_size)
+{
+  if ((max_entries == 0) || (max_entries > FIXED_MAP_MAX_ENTRIES)
+      || (key_size == 0) || (key_size > SIZE_MAX / 4)
+      || (value_size > SIZE_MAX / 4)){
+      return 0;
+  }
+  size_t entry_size = align_up (align_up (key_size) + value_size);
+  if (entry_size > (SIZE_MAX / 2) / max_entries){
+      return 0;
+  }
+  return FIXED_MAP_ALIGN - 1
+         + index_capacity (max_entries) * sizeof (fixed_map_slot)
+         + max_entries * entry_size;
+}
+
+/**
+ * Initializes an empty map on buffer.
+ * @return 1 on success, 0 otherwise.
+ */
+int fixed_map_init (fixed_map *map, void *buffer, size_t buffer_bytes,
+                    size_t max_entries, size_t key_size, size_t value_size,
+                    hash_func hash)
+{
+  size_t needed = fixed_map_bytes (max_entries, key_size, value_size);
+  if ((map == NULL) || (buffer == NULL) || (needed == 0)
+      || (buffer_bytes < needed)){
+      return 0;
+  }
+  uintptr_t start = (uintptr_t) buffer;
+  size_t padding = align_up (start) - start;
+  map->capacity = index_capacity (max_entries);
+  map->slots = (fixed_map_slot *) ((unsigned char *) buffer + padding);
+  map->entries = (unsigned char *) (map->slots + map->capacity);
+  map->max_entries = max_entries;
+  map->key_size = key_size;
+  map->value_size = value_size;
+  map->value_offset = align_up (key_size);
+  map->entry_size = align_up (map->value_offset + value_size);
+  map->hash = hash;
+  fixed_map_clear (map);
+  return 1;
+}
+
+/**
+ * Inserts a copy of key and value.
+ * @return 1 for successful insertion, FIXED_MAP_FULL if the map is full,
+ * 0 otherwise (also if the key is already in the map).
+ */
+int fixed_map_insert (fixed_map *map, const void *key, const void *value)
+{
+  if ((map == NULL) || (key == NULL)
+      || ((value == NULL) && (map->value_size > 0))){
+      return 0;
+  }
+  uint32_t hash = hash_key (map, key);
+  size_t ind = find_slot (map, key, hash);
+  if (map->slots[ind].pos != 0){
+      return 0;
+  }
+  if (map->size == map->max_entries){
+      return FIXED_MAP_FULL;
+  }
+  unsigned char *entry = entry_at (map, map->size);
+  memcpy (entry, key, map->key_size);
+  if (map->value_size > 0){
+      memcpy (entry + map->value_offset, value, map->value_size);
+  }
+  map->size += 1;
+  map->slots[ind].hash = hash;
+  map->slots[ind].pos = (uint32_t) map->size;
+  return 1;
+}
+
+/**
+ * @return a pointer to the value of key inside the buffer, NULL if key is
+ * not in the map.
+ */
+void *fixed_map_at (const fixed_map *map, const void *key)
+{
+  if ((map == NULL) || (key == NULL)){
+      return NULL;
+  }
+  size_t ind = find_slot (map, key, hash_key (map, key));
+  if (map->slots[ind].pos == 0){
+      return NULL;
+  }
+  return entry_at (map, map->slots[ind].pos - 1) + map->value_offset;
+}
+
+/**
+ * Erases key, the last entry takes its position.
+ * @return 1 if the erasing was done successfully, 0 otherwise.
+ */
+int fixed_map_erase (fixed_map *map, const void *key)
+{
+  if ((map == NULL) || (key == NULL)){
+      return 0;
+  }
+  size_t ind = find_slot (map, key, hash_key (map, key));
+  size_t pos = map->slots[ind].pos;
+  if (pos == 0){
+      return 0;
+  }
+  size_t mask = map->capacity - 1;
+  size_t next = (ind + 1) & mask;
+  while (map->slots[next].pos != 0){ // backward shift, no tombstones.
+      size_t home = map->slots[next].hash & mask;
+      if (((next - home) & mask) >= ((next - ind) & mask)){
+          map->slots[ind] = map->slots[next];
+          ind = next;
+      }
+      next = (next + 1) & mask;
+  }
+  map->slots[ind].pos = 0;
+  size_t last = map->size - 1;
+  if (pos - 1 != last){ // the last entry fills the hole.
+      unsigned char *last_entry = entry_at (map, last);
+      map->slots[find_slot (map, last_entry,
+                            hash_key (map, last_entry))].pos = (uint32_t) pos;
+      memcpy (entry_at (map, pos - 1), last_entry, map->entry_size);
+  }
+  map->size -= 1;
+  return 1;
+}
+
+/**
+ * Erases every entry.
+ */
+void fixed_map_clear (fixed_map *map)
+{
+  if (map == NULL){
+      return;
+  }
+  memset (map->slots, 0, map->capacity * sizeof (fixed_map_slot));
+  map->size = 0;
+}
+
+/**
+ * @return a pointer to the key at pos, NULL if pos >= size.
+ */
+const void *fixed_map_key_at (const fixed_map *map, size_t pos)
+{
+  if ((map == NULL) || (pos >= map->size)){
+      return NULL;
+  }
+  return entry_at (map, pos);
+}
+
+/**
+ * @return a pointer to the value at pos, NULL if pos >= size.
+ */
+void *fixed_map_value_at (const fixed_map *map, size_t pos)
+{
+  if ((map == NULL) || (pos >= map->size)){
+      return NULL;
+  }
+  return entry_at (map, pos) + map->value_offset;
+}
+
+/**
+ * Returns the load factor of the index, -1 if the function failed.
+ */
+double fixed_map_get_load_factor (const fixed_map *map)
+{
+  if (map == NULL){
+      return -1;
+  }
+  return (double) map->size / (double) map->capacity;
+}
@@ -0,0 +1,141 @@
+#ifndef FIXED_MAP_H_
+#define FIXED_MAP_H_
+
+#include <stdlib.h>
+#include <stdint.h>
+#include "hashmap.h"
+
+/**
+ * A hash map with a fixed maximum number of entries, laid out entirely in a
+ * buffer given by the caller, for code that may not allocate (e.g. a
+ * packet processing path after startup). Keys and values are fixed size
+ * byte strings copied into the buffer; no function of this file calls
+ * malloc or free.
+ * The buffer holds an open addressed index of at least twice max_entries
+ * slots (so the load factor never exceeds 0.5 and probes stay short), and
+ * the entries in one dense array. Erasing shifts the following slots back
+ * instead of leaving tombstones, and moves the last entry into the hole,
+ * so the cost of an operation depends only on the current contents and
+ * never on the map's history. The map never resizes: an insertion into a
+ * full map returns FIXED_MAP_FULL.
+ * Example:
+ *   static unsigned char buffer[1 << 20];
+ *   fixed_map flows;
+ *   fixed_map_init (&flows, buffer, sizeof (buffer), 10000,
+ *                   sizeof (flow_key), sizeof (flow_stats), NULL);
+ */
+
+/**
+ * @def FIXED_MAP_FULL
+ * Returned by fixed_map_insert when the map holds max_entries entries.
+ */
+#define FIXED_MAP_FULL (-1)
+
+/**
+ * @def FIXED_MAP_MAX_ENTRIES
+ * The largest max_entries (positions are stored in 32 bits).
+ */
+#define FIXED_MAP_MAX_ENTRIES (UINT32_MAX / 2)
+
+/**
+ * @struct fixed_map_slot
+ * A slot of the index.
+ * @param hash the hash of the key of the entry.
+ * @param pos the position + 1 of the entry, 0 for an empty slot.
+ */
+typedef struct fixed_map_slot {
+    uint32_t hash;
+    uint32_t pos;
+} fixed_map_slot;
+
+/**
+ * @struct fixed_map
+ * The map itself is a plain struct (on the stack, static, or inside the
+ * caller's own structures) pointing into the buffer.
+ * @param slots the index, capacity slots.
+ * @param entries size entries of entry_size bytes: the key, then the value
+ * at value_offset, both 8 byte aligned.
+ * @param capacity the number of index slots (a power of 2).
+ * @param max_entries the maximum number of entries.
+ * @param size the number of entries.
+ * @param key_size, value_size the sizes of a key and a value in bytes.
+ * @param value_offset, entry_size the layout of an entry.
+ * @param hash the hash function of the keys (NULL hashes their bytes).
+ */
+typedef struct fixed_map {
+    fixed_map_slot *slots;
+    unsigned char *entries;
+    size_t capacity;
+    size_t max_entries;
+    size_t size;
+    size_t key_size;
+    size_t value_size;
+    size_t value_offset;
+    size_t entry_size;
+    hash_func hash;
+} fixed_map;
+
+/**
+ * Computes the size of the buffer a map needs.
+ * @param max_entries the maximum number of entries.
+ * @param key_size, value_size the sizes of a key and a value in bytes.
+ * @return the number of bytes (any alignment will do), 0 if the arguments
+ * are invalid.
+ */
+size_t fixed_map_bytes (size_t max_entries, size_t key_size,
+                        size_t value_size);
+
+/**
+ * Initializes an empty map on buffer.
+ * @param map the map to initialize.
+ * @param buffer at least fixed_map_bytes (max_entries, key_size, value_size)
+ * bytes, owned by the caller and used by the map until it is no longer used.
+ * @param buffer_bytes the size of buffer.
+ * @param max_entries the maximum number of entries (1 to
+ * FIXED_MAP_MAX_ENTRIES).
+ * @param key_size, value_size the sizes of a key and a value in bytes (the
+ * key size must not be 0).
+ * @param hash the hash function of the keys, NULL to hash their bytes.
+ * @return 1 on success, 0 otherwise.
+ */
+int fixed_map_init (fixed_map *map, void *buffer, size_t buffer_bytes,
+                    size_t max_entries, size_t key_size, size_t value_size,
+                    hash_func hash);
+
+/**
+ * Inserts a copy of key and value.
+ * @return 1 for successful insertion, FIXED_MAP_FULL if the map is full,
+ * 0 otherwise (also if the key is already in the map).
+ */
+int fixed_map_insert (fixed_map *map, const void *key, const void *value);
+
+/**
+ * @return a pointer to the value of key inside the buffer, NULL if key is
+ * not in the map (valid until the next erase).
+ */
+void *fixed_map_at (const fixed_map *map, const void *key);
+
+/**
+ * Erases key, the last entry takes its position.
+ * @return 1 if the erasing was done successfully, 0 otherwise.
+ */
+int fixed_map_erase (fixed_map *map, const void *key);
+
+/**
+ * Erases every entry.
+ */
+void fixed_map_clear (fixed_map *map);
+
+/**
+ * The entries are at the positions 0 to size - 1, for iterating.
+ * @return a pointer to the key / value at pos, NULL if pos >= size.
+ */
+const void *fixed_map_key_at (const fixed_map *map, size_t pos);
+void *fixed_map_value_at (const fixed_map *map, size_t pos);
+
+/**
+ * Returns the load factor of the index, -1 if the function failed.
+ */
+double fixed_map_get_load_factor (const fixed_map *map);
+
+#endif //FIXED_MAP_H_
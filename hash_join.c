@@ -0,0 +1,484 @@
+#include <pthread.h>
+#include <string.h>
+#include "hash_join.h"
+#include "typed_hashmap.h"
+
+/*
+ * A row of a partitioned side.
+ */
+typedef struct join_tuple {
+    int64_t key;
+    int64_t payload;
+} join_tuple;
+
+/*
+ * The bytes a build row takes in the table of its partition: the tuple, its
+ * chain link and (at least) one bucket head.
+ */
+#define TABLE_BYTES_PER_ROW (sizeof (join_tuple) + 2 * sizeof (uint32_t))
+
+/*
+ * The low radix bits of the hash pick the partition, the bits above them
+ * pick the bucket in the partition's table.
+ */
+#define JOIN_HASH(key) HASHMAP_INT_HASH (key)
+
+/*
+ * @struct join_side
+ * A side, partitioned: the rows of partition p are
+ * tuples[starts[p]] .. tuples[starts[p + 1] - 1].
+ */
+typedef struct join_side {
+    join_tuple *tuples;
+    size_t *starts;
+} join_side;
+
+/*
+ * @struct join_state
+ * A join in progress, shared by its tasks.
+ * @param input, output the side being partitioned.
+ * @param histograms the row count (then the next position) of every
+ * partition in the chunk of every task, num_of_parts per task.
+ * @param next_part the next partition to join, taken atomically.
+ * @param results the matches of every task, NULL if they go to emit.
+ */
+typedef struct join_state {
+    int type;
+    size_t bits;
+    size_t num_of_parts;
+    size_t num_of_tasks;
+    const hash_join_input *input;
+    join_side *output;
+    size_t *histograms;
+    join_side build;
+    join_side probe;
+    size_t next_part;
+    hash_join_emit emit;
+    void *arg;
+    hash_join_result *results;
+} join_state;
+
+/*
+ * @struct join_task
+ * @param heads, next the table of the partition being joined, allocated for
+ * the largest build partition.
+ * @param failed 1 if a match could not be collected.
+ */
+typedef struct join_task {
+    join_state *state;
+    size_t id;
+    uint32_t *heads;
+    uint32_t *next;
+    int failed;
+} join_task;
+
+static void chunk_of (const join_task *task, size_t *start, size_t *end)
+{
+  size_t len = task->state->input->len;
+  size_t per_task = (len + task->state->num_of_tasks - 1)
+                    / task->state->num_of_tasks;
+  *start = task->id * per_task;
+  *start = (*start < len) ? *start : len;
+  *end = (len - *start < per_task) ? len : *start + per_task;
+}
+
+/*
+ * Counts the rows of every partition in the chunk of the task.
+ */
+static void *histogram_task (void *arg)
+{
+  join_task *task = (join_task *) arg;
+  join_state *state = task->state;
+  size_t *histogram = state->histograms + task->id * state->num_of_parts;
+  size_t mask = state->num_of_parts - 1, start, end;
+  memset (histogram, 0, sizeof (size_t) * state->num_of_parts);
+  chunk_of (task, &start, &end);
+  const int64_t *keys = state->input->keys;
+  for (size_t i = start; i < end; ++i)
+    {
+      histogram[JOIN_HASH (keys[i]) & mask]++;
+    }
+  return NULL;
+}
+
+/*
+ * Writes the rows of the chunk of the task to their partitions, from the
+ * positions the histogram of the task holds.
+ */
+static void *scatter_task (void *arg)
+{
+  join_task *task = (join_task *) arg;
+  join_state *state = task->state;
+  size_t *positions = state->histograms + task->id * state->num_of_parts;
+  size_t mask = state->num_of_parts - 1, start, end;
+  chunk_of (task, &start, &end);
+  const int64_t *keys = state->input->keys;
+  const int64_t *payloads = state->input->payloads;
+  join_tuple *tuples = state->output->tuples;
+  for (size_t i = start; i < end; ++i)
+    {
+      join_tuple *dest = tuples + positions[JOIN_HASH (keys[i]) & mask]++;
+      dest->key = keys[i];
+      dest->payload = (payloads == NULL) ? 0 : payloads[i];
+    }
+  return NULL;
+}
+
+/*
+ * Runs body for every task, tasks[0] on the calling thread. A task whose
+ * thread cannot be started runs on the calling thread as well.
+ */
+static void run_tasks (join_state *state, join_task *tasks,
+                       void *(*body) (void *))
+{
+  pthread_t *threads = NULL;
+  if (state->num_of_tasks > 1){
+      threads = malloc (sizeof (pthread_t) * state->num_of_tasks);
+  }
+  size_t started = 1;
+  for (size_t i = 1; i < state->num_of_tasks; ++i)
+    {
+      if ((threads == NULL)
+          || (pthread_create (&(threads[started]), NULL, body,
+                              &(tasks[i])) != 0)){
+          body (&(tasks[i]));
+      }
+      else{
+          started++;
+      }
+    }
+  body (&(tasks[0]));
+  for (size_t i = 1; i < started; ++i)
+    {
+      pthread_join (threads[i], NULL);
+    }
+  free (threads);
+}
+
+/*
+ * Radix partitions input into output: a histogram pass and a scatter pass,
+ * both split between the tasks.
+ * @return 1 on success, 0 otherwise.
+ */
+static int partition (join_state *state, join_task *tasks,
+                      const hash_join_input *input, join_side *output)
+{
+  output->tuples = malloc (sizeof (join_tuple) * (input->len + 1));
+  output->starts = malloc (sizeof (size_t) * (state->num_of_parts + 1));
+  if ((output->tuples == NULL) || (output->starts == NULL)){
+      return 0;
+  }
+  state->input = input;
+  state->output = output;
+  run_tasks (state, tasks, histogram_task);
+  size_t pos = 0;
+  for (size_t p = 0; p < state->num_of_parts; ++p)
+    {
+      output->starts[p] = pos;
+      for (size_t t = 0; t < state->num_of_tasks; ++t)
+        {
+          size_t *count = state->histograms + t * state->num_of_parts + p;
+          size_t rows = *count;
+          *count = pos;
+          pos += rows;
+        }
+    }
+  output->starts[state->num_of_parts] = pos;
+  run_tasks (state, tasks, scatter_task);
+  return 1;
+}
+
+static int result_push (hash_join_result *result, int with_build,
+                        int64_t key, int64_t build_payload,
+                        int64_t probe_payload)
+{
+  if (result->size == result->capacity){
+      size_t capacity = (result->capacity == 0) ? 64 : 2 * result->capacity;
+      int64_t *keys = realloc (result->keys, sizeof (int64_t) * capacity);
+      if (keys == NULL){
+          return 0;
+      }
+      result->keys = keys;
+      int64_t *probe = realloc (result->probe_payloads,
+                                sizeof (int64_t) * capacity);
+      if (probe == NULL){
+          return 0;
+      }
+      result->probe_payloads = probe;
+      if (with_build){
+          int64_t *build = realloc (result->build_payloads,
+                                    sizeof (int64_t) * capacity);
+          if (build == NULL){
+              return 0;
+          }
+          result->build_payloads = build;
+      }
+      result->capacity = capacity;
+  }
+  result->keys[result->size] = key;
+  result->probe_payloads[result->size] = probe_payload;
+  if (with_build){
+      result->build_payloads[result->size] = build_payload;
+  }
+  result->size++;
+  return 1;
+}
+
+static void emit_match (join_task *task, int64_t key, int64_t build_payload,
+                        int64_t probe_payload)
+{
+  join_state *state = task->state;
+  if (state->results == NULL){
+      state->emit (key, build_payload, probe_payload, state->arg);
+  }
+  else if (!task->failed){
+      task->failed = !result_push (&(state->results[task->id]),
+                                   state->type == HASH_JOIN_INNER, key,
+                                   build_payload, probe_payload);
+  }
+}
+
+/*
+ * Builds the table of build partition p and probes it with probe
+ * partition p.
+ */
+static void join_partition (join_task *task, size_t p)
+{
+  join_state *state = task->state;
+  const join_tuple *build = state->build.tuples + state->build.starts[p];
+  size_t num_of_build = state->build.starts[p + 1] - state->build.starts[p];
+  const join_tuple *probe = state->probe.tuples + state->probe.starts[p];
+  size_t num_of_probe = state->probe.starts[p + 1] - state->probe.starts[p];
+  if ((num_of_probe == 0)
+      || ((num_of_build == 0) && (state->type != HASH_JOIN_ANTI))){
+      return;
+  }
+  size_t capacity = 1;
+  while (capacity < num_of_build){
+      capacity *= 2;
+  }
+  size_t mask = capacity - 1, shift = state->bits;
+  memset (task->heads, 0, sizeof (uint32_t) * capacity);
+  for (size_t i = 0; i < num_of_build; ++i)
+    {
+      size_t slot = (JOIN_HASH (build[i].key) >> shift) & mask;
+      task->next[i] = task->heads[slot];
+      task->heads[slot] = (uint32_t) (i + 1);
+    }
+  for (size_t i = 0; i < num_of_probe; ++i)
+    {
+      int64_t key = probe[i].key;
+      size_t slot = (JOIN_HASH (key) >> shift) & mask;
+      int found = 0;
+      for (uint32_t j = task->heads[slot]; j != 0; j = task->next[j - 1])
+        {
+          if (build[j - 1].key == key){
+              found = 1;
+              if (state->type != HASH_JOIN_INNER){
+                  break;
+              }
+              emit_match (task, key, build[j - 1].payload, probe[i].payload);
+          }
+        }
+      if ((state->type == HASH_JOIN_SEMI) ? found :
+          ((state->type == HASH_JOIN_ANTI) && !found)){
+          emit_match (task, key, 0, probe[i].payload);
+      }
+    }
+}
+
+static void *join_task_body (void *arg)
+{
+  join_task *task = (join_task *) arg;
+  join_state *state = task->state;
+  size_t p;
+  while ((p = __atomic_fetch_add (&(state->next_part), 1, __ATOMIC_RELAXED))
+         < state->num_of_parts){
+      join_partition (task, p);
+    }
+  return NULL;
+}
+
+/*
+ * Moves the matches of every task into result.
+ */
+static int gather_results (join_state *state, hash_join_result *result)
+{
+  size_t size = 0;
+  for (size_t t = 0; t < state->num_of_tasks; ++t)
+    {
+      if ((state->results[t].size > 0) && (size == 0)){
+          // the first non empty result is taken as it is.
+          hash_join_result tmp = *result;
+          *result = state->results[t];
+          state->results[t] = tmp;
+          size = result->size;
+      }
+      else{
+          size += state->results[t].size;
+      }
+    }
+  if (size == result->size){
+      return 1;
+  }
+  int with_build = (state->type == HASH_JOIN_INNER);
+  int64_t *keys = realloc (result->keys, sizeof (int64_t) * size);
+  if (keys != NULL){
+      result->keys = keys;
+  }
+  int64_t *probe = realloc (result->probe_payloads, sizeof (int64_t) * size);
+  if (probe != NULL){
+      result->probe_payloads = probe;
+  }
+  int64_t *build = with_build ?
+                   realloc (result->build_payloads, sizeof (int64_t) * size) :
+                   NULL;
+  if (build != NULL){
+      result->build_payloads = build;
+  }
+  if ((keys == NULL) || (probe == NULL) || (with_build && (build == NULL))){
+      return 0;
+  }
+  result->capacity = size;
+  for (size_t t = 0; t < state->num_of_tasks; ++t)
+    {
+      hash_join_result *part = &(state->results[t]);
+      if (part->size == 0){
+          continue;
+      }
+      memcpy (result->keys + result->size, part->keys,
+              sizeof (int64_t) * part->size);
+      memcpy (result->probe_payloads + result->size, part->probe_payloads,
+              sizeof (int64_t) * part->size);
+      if (with_build){
+          memcpy (result->build_payloads + result->size, part->build_payloads,
+                  sizeof (int64_t) * part->size);
+      }
+      result->size += part->size;
+    }
+  return 1;
+}
+
+static int input_valid (const hash_join_input *input)
+{
+  return (input != NULL) && ((input->keys != NULL) || (input->len == 0));
+}
+
+/*
+ * The join behind hash_join and hash_join_collect: the matches go to emit,
+ * or to result if it is not NULL.
+ */
+static int join (int type, const hash_join_input *build,
+                 const hash_join_input *probe, size_t num_threads,
+                 hash_join_emit emit, void *arg, hash_join_result *result)
+{
+  if ((type < HASH_JOIN_INNER) || (type > HASH_JOIN_ANTI)
+      || !input_valid (build) || !input_valid (probe)){
+      return 0;
+  }
+  join_state state;
+  memset (&state, 0, sizeof (join_state));
+  state.type = type;
+  state.emit = emit;
+  state.arg = arg;
+  state.num_of_tasks = (num_threads == 0) ? 1 : num_threads;
+  while ((state.bits < HASH_JOIN_MAX_RADIX_BITS)
+         && ((build->len >> state.bits) * TABLE_BYTES_PER_ROW
+             > HASH_JOIN_CACHE_BYTES)){
+      state.bits++;
+    }
+  state.num_of_parts = (size_t) 1 << state.bits;
+  join_task *tasks = calloc (state.num_of_tasks, sizeof (join_task));
+  state.histograms = malloc (sizeof (size_t) * state.num_of_parts
+                             * state.num_of_tasks);
+  if (result != NULL){
+      state.results = calloc (state.num_of_tasks, sizeof (hash_join_result));
+  }
+  int success = (tasks != NULL) && (state.histograms != NULL)
+                && ((result == NULL) || (state.results != NULL));
+  for (size_t t = 0; success && (t < state.num_of_tasks); ++t)
+    {
+      tasks[t].state = &state;
+      tasks[t].id = t;
+    }
+  success = success && partition (&state, tasks, build, &(state.build))
+            && partition (&state, tasks, probe, &(state.probe));
+  size_t largest = 0;
+  for (size_t p = 0; success && (p < state.num_of_parts); ++p)
+    {
+      size_t rows = state.build.starts[p + 1] - state.build.starts[p];
+      largest = (rows > largest) ? rows : largest;
+    }
+  size_t capacity = 1;
+  while (capacity < largest){
+      capacity *= 2;
+  }
+  success = success && (largest < UINT32_MAX);
+  for (size_t t = 0; success && (t < state.num_of_tasks); ++t)
+    {
+      tasks[t].heads = malloc (sizeof (uint32_t) * capacity);
+      tasks[t].next = malloc (sizeof (uint32_t) * (largest + 1));
+      success = (tasks[t].heads != NULL) && (tasks[t].next != NULL);
+    }
+  if (success){
+      run_tasks (&state, tasks, join_task_body);
+  }
+  for (size_t t = 0; (tasks != NULL) && (t < state.num_of_tasks); ++t)
+    {
+      success = success && !tasks[t].failed;
+      free (tasks[t].heads);
+      free (tasks[t].next);
+    }
+  if (success && (result != NULL)){
+      success = gather_results (&state, result);
+  }
+  for (size_t t = 0; (state.results != NULL) && (t < state.num_of_tasks);
+       ++t)
+    {
+      hash_join_result_destroy (&(state.results[t]));
+    }
+  free (state.results);
+  free (state.build.tuples);
+  free (state.build.starts);
+  free (state.probe.tuples);
+  free (state.probe.starts);
+  free (state.histograms);
+  free (tasks);
+  return success;
+}
+
+int hash_join (int type, const hash_join_input *build,
+               const hash_join_input *probe, size_t num_threads,
+               hash_join_emit emit, void *arg)
+{
+  if (emit == NULL){
+      return 0;
+  }
+  return join (type, build, probe, num_threads, emit, arg, NULL);
+}
+
+int hash_join_collect (int type, const hash_join_input *build,
+                       const hash_join_input *probe, size_t num_threads,
+                       hash_join_result *result)
+{
+  if (result == NULL){
+      return 0;
+  }
+  memset (result, 0, sizeof (hash_join_result));
+  if (join (type, build, probe, num_threads, NULL, NULL, result) == 0){
+      hash_join_result_destroy (result);
+      return 0;
+  }
+  return 1;
+}
+
+void hash_join_result_destroy (hash_join_result *result)
+{
+  if (result == NULL){
+      return;
+  }
+  free (result->keys);
+  free (result->build_payloads);
+  free (result->probe_payloads);
+  memset (result, 0, sizeof (hash_join_result));
+}
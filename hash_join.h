@@ -0,0 +1,115 @@
+#ifndef HASH_JOIN_H_
+#define HASH_JOIN_H_
+
+#include <stdlib.h>
+#include <stdint.h>
+
+/**
+ * An equi-join of two tables given as columns: a build side and a probe
+ * side, each an array of int64_t keys with a parallel array of int64_t
+ * payloads (a row id, or any value carried along).
+ * Both sides are radix partitioned on the hash of the key first, with
+ * enough partitions that the table of one build partition fits in
+ * HASH_JOIN_CACHE_BYTES. Every build partition then gets a compact chained
+ * table (two arrays of 32 bit positions, no allocation per row) that the
+ * matching probe partition is joined against while it is in the cache.
+ * The partitions are joined by num_threads threads, and so is the
+ * partitioning itself. The matches are handed to a callback or collected
+ * into a hash_join_result, in no particular order.
+ */
+
+/**
+ * @def HASH_JOIN_INNER, HASH_JOIN_SEMI, HASH_JOIN_ANTI
+ * The join types: every (build row, probe row) pair with equal keys, every
+ * probe row with at least one matching build row (once), and every probe
+ * row with no matching build row.
+ */
+#define HASH_JOIN_INNER 0
+#define HASH_JOIN_SEMI 1
+#define HASH_JOIN_ANTI 2
+
+/**
+ * @def HASH_JOIN_CACHE_BYTES
+ * The size the table of a build partition is kept under (a typical L2).
+ */
+#define HASH_JOIN_CACHE_BYTES (256UL << 10)
+
+/**
+ * @def HASH_JOIN_MAX_RADIX_BITS
+ * At most 2 ^ HASH_JOIN_MAX_RADIX_BITS partitions are used: past that the
+ * scatter writes to more pages than the TLB holds.
+ */
+#define HASH_JOIN_MAX_RADIX_BITS 12
+
+/**
+ * A function that gets the matches of a join.
+ * @param key the key of the rows.
+ * @param build_payload the payload of the build row (0 for semi and anti
+ * joins).
+ * @param probe_payload the payload of the probe row.
+ * @param arg the argument given to hash_join.
+ */
+typedef void (*hash_join_emit) (int64_t key, int64_t build_payload,
+                                int64_t probe_payload, void *arg);
+
+/**
+ * @struct hash_join_result
+ * The matches of a join, as parallel arrays.
+ * @param keys the keys.
+ * @param build_payloads the payloads of the build rows (NULL for semi and
+ * anti joins).
+ * @param probe_payloads the payloads of the probe rows.
+ * @param size the number of matches.
+ * @param capacity the length of the arrays.
+ */
+typedef struct hash_join_result {
+    int64_t *keys;
+    int64_t *build_payloads;
+    int64_t *probe_payloads;
+    size_t size;
+    size_t capacity;
+} hash_join_result;
+
+/**
+ * @struct hash_join_input
+ * One side of a join.
+ * @param keys the keys of the rows.
+ * @param payloads the payloads of the rows (NULL if they are all 0).
+ * @param len the number of rows.
+ */
+typedef struct hash_join_input {
+    const int64_t *keys;
+    const int64_t *payloads;
+    size_t len;
+} hash_join_input;
+
+/**
+ * Joins build and probe, calling emit for every match. With num_threads > 1
+ * emit is called from several threads at once (one partition each).
+ * @param type HASH_JOIN_INNER, HASH_JOIN_SEMI or HASH_JOIN_ANTI.
+ * @param build the build side.
+ * @param probe the probe side.
+ * @param num_threads the number of threads (0 or 1 joins on the caller's).
+ * @param emit the function the matches are given to.
+ * @param arg the last argument of emit.
+ * @return 1 on success, 0 otherwise (before emit was ever called).
+ */
+int hash_join (int type, const hash_join_input *build,
+               const hash_join_input *probe, size_t num_threads,
+               hash_join_emit emit, void *arg);
+
+/**
+ * Joins build and probe, collecting the matches into result (which is
+ * initialized by the call, and freed with hash_join_result_destroy).
+ * @return 1 on success, 0 otherwise (result is then empty).
+ */
+int hash_join_collect (int type, const hash_join_input *build,
+                       const hash_join_input *probe, size_t num_threads,
+                       hash_join_result *result);
+
+/**
+ * Frees the arrays of result and empties it.
+ */
+void hash_join_result_destroy (hash_join_result *result);
+
+#endif //HASH_JOIN_H_
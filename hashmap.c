@@ -2,17 +2,182 @@
 // Created by roizh on 17/05/2021.
 //
 
+#define _POSIX_C_SOURCE 200809L
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
 #include "hashmap.h"
 #include "vector.h"
+#include "bucket.h"
+#ifdef __GLIBC__
+#include <malloc.h>
+#endif
 
 #define INCREASE 99
 #define DECREASE 95
 
+int hashmap_resize(hashmap* hash_map, size_t new_capacity);
+
+static pthread_once_t seed_once = PTHREAD_ONCE_INIT;
+static uint64_t seed_secret;
+static uint64_t seed_counter;
+
+/*
+ * Reads the process wide secret the seeds of the maps are derived from
+ * (from the clock if /dev/urandom is not available).
+ */
+static void init_seed_secret(void){
+  FILE* urandom = fopen ("/dev/urandom", "rb");
+  if ((urandom == NULL)
+      || (fread (&seed_secret, sizeof (seed_secret), 1, urandom) != 1)){
+      struct timespec now;
+      clock_gettime (CLOCK_REALTIME, &now);
+      seed_secret = bucket_mix_bits ((uint64_t) now.tv_sec * 1000000000ULL
+                                     + (uint64_t) now.tv_nsec);
+  }
+  if (urandom != NULL){
+      fclose (urandom);
+  }
+}
+
+/*
+ * Returns a new random seed, different for every map.
+ */
+static size_t new_seed(void){
+  pthread_once (&seed_once, init_seed_secret);
+  uint64_t count = __atomic_add_fetch (&seed_counter, 1, __ATOMIC_RELAXED);
+  return (size_t) bucket_mix_bits (seed_secret
+                                   + count * 0x9e3779b97f4a7c15ULL);
+}
+
+/*
+ * Returns the seeded hash of a hash_func result.
+ */
+static size_t seed_hash(const hashmap* hash_map, size_t hash){
+  return (size_t) bucket_mix_bits ((uint64_t) (hash ^ hash_map->seed));
+}
+
 size_t get_ind_from_hash(const hashmap* hash_map, const_keyT key){
-   size_t val = hash_map->hash_func(key) & (hash_map->capacity -1);
+   size_t val = hashmap_seeded_hash (hash_map, key) & (hash_map->capacity -1);
   return val;
 }
 
+/*
+ * Returns the payload bytes of a stored pair (0 without a size function).
+ */
+static size_t payload_of(const hashmap* hash_map, const pair* in_pair){
+  if (hash_map->size_func == NULL){
+      return 0;
+  }
+  return hash_map->size_func (in_pair->key, in_pair->value);
+}
+
+/*
+ * Returns 1 if the changes of the hash map are tracked (by digests or by
+ * the change feed), 0 otherwise.
+ */
+static int tracks_changes(const hashmap* hash_map){
+  return (hash_map->digests != NULL) || (hash_map->subscribers != NULL);
+}
+
+/*
+ * Adds (if add) or removes the digest of a pair, whose key has the seeded
+ * hash hash, to the digest of its group.
+ */
+static void digest_pair(hashmap* hash_map, const pair* in_pair, size_t hash,
+                        int add){
+  if (hash_map->digests == NULL){
+      return;
+  }
+  uint64_t value_hash = hash_map->value_hash (in_pair->value);
+  size_t digest = (size_t) bucket_mix_bits (hash
+                                            ^ bucket_mix_bits (value_hash));
+  size_t* group = &(hash_map->digests[hash & (hash_map->digest_groups - 1)]);
+  *group = add ? *group + digest : *group - digest;
+}
+
+/*
+ * Records a change of in_pair (after an insertion or update, before an
+ * erasure): the digest of its group and the change feed. The digest of the
+ * old value of an update is removed by the caller before the update.
+ */
+static void record_change(hashmap* hash_map, int type, const pair* in_pair,
+                          size_t hash){
+  digest_pair (hash_map, in_pair, hash, type != CHANGE_FEED_ERASE);
+  if (hash_map->subscribers != NULL){
+      hash_map->change_seq += 1;
+      change_feed_publish (hash_map->subscribers, type, hash_map->change_seq,
+                           in_pair);
+  }
+}
+
+/*
+ * Accounts for a change of the data capacity of bucket ind, which was
+ * old_capacity before the change (atomically, the workers of a parallel
+ * resize own buckets concurrently).
+ */
+void track_bucket(hashmap* hash_map, size_t ind, size_t old_capacity){
+  __atomic_add_fetch (&(hash_map->bucket_slots),
+                      hash_map->buckets[ind]->capacity - old_capacity,
+                      __ATOMIC_RELAXED);
+}
+
+/*
+ * Drops one reference to a buckets array (refs is NULL if the array was
+ * never shared). The last reference frees the array and drops its
+ * references to the vectors.
+ */
+void release_buckets(vector** buckets, size_t capacity, size_t* refs){
+  if (refs != NULL){
+      if (__atomic_sub_fetch (refs, 1, __ATOMIC_ACQ_REL) != 0){
+          return; // still used by other maps.
+      }
+      free (refs);
+  }
+  for (size_t  i = 0; i < capacity; ++i)
+    {
+      vector_free (&(buckets[i])); //ptr->ptr
+    }
+  huge_pages_free (buckets);
+}
+
+/*
+ * Returns the position of key (whose hash is hash) in the small_pairs of
+ * hash_map, -1 if it is not there.
+ */
+long get_small_ind(const hashmap* hash_map, size_t hash, const_keyT key){
+  for (size_t  i = 0; i < hash_map->size; ++i)
+    {
+      if ((hash_map->small_hashes[i] == hash)
+          && (hash_map->small_pairs[i]->key_cmp (hash_map->small_pairs[i]->key,
+                                                 key) == 1)){
+          return (long) i;
+      }
+    }
+  return -1;
+}
+
+/*
+ * Returns the index of the pair of key (whose seeded hash is hash) in
+ * bucket vec, -1 if there is none (see bucket_find).
+ */
+static long find_in_bucket(const hashmap* hash_map, const vector* vec,
+                           const_keyT key, size_t hash){
+  bucket_keys keys = {hash_map->hash_func, hash_map->seed, NULL};
+  return bucket_find (&keys, vec, key, hash);
+}
+
+/*
+ * Adds in_pair, whose key has seeded hash hash, to bucket vec (moved, or
+ * copied if move is 0, see bucket_push). Returns 1 on success, 0 otherwise.
+ */
+static int push_pair(const hashmap* hash_map, vector* vec,
+                     const pair* in_pair, size_t hash, int move){
+  bucket_keys keys = {hash_map->hash_func, hash_map->seed, NULL};
+  return bucket_push (&keys, vec, in_pair, hash, move);
+}
+
 /**
  * Allocates dynamically new hash map element.
  * @param func a function which "hashes" keys.
@@ -27,26 +192,22 @@ hashmap *hashmap_alloc (hash_func func){
   map->size = 0;
   map->capacity = HASH_MAP_INITIAL_CAP;
   map->hash_func = func;
-  vector** buckets = malloc (sizeof (vector*)*map->capacity);
-  if(buckets == NULL){
-      free (map);
-      return NULL;
-  }
-  map->buckets = buckets;
-  for (size_t i = 0; i <map->capacity ; ++i)
-    {
-      vector* vec = vector_alloc (pair_copy, pair_cmp, pair_free);
-      if (vec == NULL){
-          for (size_t j = 0; j <i ; ++j)
-            {
-              vector_free (&(map->buckets[j]));
-            }
-          free (buckets);
-          free(map);
-          return NULL;
-      }
-      map->buckets[i] = vec;
-    }
+  map->filter = NULL;
+  map->buckets_refs = NULL;
+  map->resize_threads = 1;
+  map->parallel_resize_min = HASH_MAP_PARALLEL_RESIZE_MIN;
+  map->huge_pages = 0;
+  map->size_func = NULL;
+  map->payload_bytes = 0;
+  map->bucket_slots = 0;
+  map->compact_cursor = 0;
+  map->seed = new_seed ();
+  map->digests = NULL;
+  map->digest_groups = 0;
+  map->value_hash = NULL;
+  map->subscribers = NULL;
+  map->change_seq = 0;
+  map->buckets = NULL; // the first pairs go to small_pairs.
   return map;
 }
 
@@ -55,14 +216,130 @@ hashmap *hashmap_alloc (hash_func func){
  * @param p_hash_map pointer to dynamically allocated pointer to hash_map.
  */
 void hashmap_free (hashmap **p_hash_map){
-  for (size_t  i = 0; i < (*p_hash_map)->capacity; ++i)
-    {
-      vector_free (&((*p_hash_map)->buckets[i])); //ptr->ptr
+  if ((*p_hash_map)->buckets == NULL){
+      for (size_t  i = 0; i < (*p_hash_map)->size; ++i)
+        {
+          pair_free ((void**) &((*p_hash_map)->small_pairs[i]));
+        }
+  }
+  else{
+      release_buckets ((*p_hash_map)->buckets, (*p_hash_map)->capacity,
+                       (*p_hash_map)->buckets_refs);
+  }
+  bloom_filter_free (&((*p_hash_map)->filter));
+  free ((*p_hash_map)->digests);
+  while ((*p_hash_map)->subscribers != NULL){
+      change_feed_subscriber* next = (*p_hash_map)->subscribers->next;
+      change_feed_subscriber_free (&((*p_hash_map)->subscribers));
+      (*p_hash_map)->subscribers = next;
     }
-  free ((*p_hash_map)->buckets);
   free (*p_hash_map);
   *p_hash_map = NULL;}
 
+/*
+ * Makes the buckets array private to hash_map before it is modified: if it
+ * is shared with a snapshot, the map switches to its own copy of the
+ * pointers (every vector gets one more owner). Returns 1 on success,
+ * 0 otherwise.
+ */
+int hashmap_own_buckets(hashmap* hash_map){
+  size_t* refs = hash_map->buckets_refs;
+  if (refs == NULL){
+      return 1;
+  }
+  if (__atomic_load_n (refs, __ATOMIC_ACQUIRE) == 1){
+      free (refs); // every snapshot is gone, no one else can see the array.
+      hash_map->buckets_refs = NULL;
+      return 1;
+  }
+  vector** new_buckets = huge_pages_alloc (sizeof (vector*)*hash_map->capacity,
+                                           hash_map->huge_pages);
+  if (new_buckets == NULL){
+      return 0;
+  }
+  for (size_t  i = 0; i < hash_map->capacity; ++i)
+    {
+      new_buckets[i] = hash_map->buckets[i];
+      vector_retain (new_buckets[i]);
+    }
+  release_buckets (hash_map->buckets, hash_map->capacity, refs);
+  hash_map->buckets = new_buckets;
+  hash_map->buckets_refs = NULL;
+  return 1;
+}
+
+/*
+ * Makes bucket ind private to hash_map before it is modified (the buckets
+ * array must already be private): a shared bucket is replaced by a copy.
+ * Returns 1 on success, 0 otherwise.
+ */
+int hashmap_own_bucket(hashmap* hash_map, size_t ind){
+  vector* vec = hash_map->buckets[ind];
+  if (__atomic_load_n (&(vec->ref_count), __ATOMIC_ACQUIRE) == 1){
+      return 1;
+  }
+  vector* copy = vector_alloc (pair_copy, pair_cmp, pair_free);
+  if (copy == NULL){
+      return 0;
+  }
+  for (size_t  i = 0; i < vec->size; ++i)
+    {
+      if (vector_push_back (copy, vec->data[i]) != 1){
+          vector_free (&copy);
+          return 0;
+      }
+    }
+  size_t old_capacity = vec->capacity;
+  vector_free (&(hash_map->buckets[ind])); // drops this map's reference.
+  hash_map->buckets[ind] = copy;
+  track_bucket (hash_map, ind, old_capacity);
+  return 1;
+}
+
+/**
+ * Takes a point in time snapshot of the hash map in O(1).
+ * @param hash_map a hash map.
+ * @return a dynamically allocated snapshot, NULL on failure.
+ */
+hashmap *hashmap_snapshot (hashmap *hash_map){
+  if (hash_map == NULL){
+      return NULL;
+  }
+  if ((hash_map->buckets == NULL)
+      && (hashmap_resize (hash_map, hash_map->capacity) == 0)){
+      return NULL; // only a buckets array can be shared.
+  }
+  hashmap* snapshot = malloc (sizeof (hashmap));
+  if (snapshot == NULL){
+      return NULL;
+  }
+  size_t* digests = NULL;
+  if (hash_map->digests != NULL){ // a copy, so the snapshot can be diffed.
+      digests = malloc (sizeof (size_t) * hash_map->digest_groups);
+      if (digests == NULL){
+          free (snapshot);
+          return NULL;
+      }
+      memcpy (digests, hash_map->digests,
+              sizeof (size_t) * hash_map->digest_groups);
+  }
+  if (hash_map->buckets_refs == NULL){
+      hash_map->buckets_refs = malloc (sizeof (size_t));
+      if (hash_map->buckets_refs == NULL){
+          free (digests);
+          free (snapshot);
+          return NULL;
+      }
+      *(hash_map->buckets_refs) = 1;
+  }
+  __atomic_add_fetch (hash_map->buckets_refs, 1, __ATOMIC_RELAXED);
+  *snapshot = *hash_map;
+  snapshot->filter = NULL;
+  snapshot->subscribers = NULL;
+  snapshot->digests = digests;
+  return snapshot;
+}
+
 /**
 * This function returns the load factor of the hash map.
 * @param hash_map a hash map.
@@ -80,45 +357,48 @@ double hashmap_get_load_factor (const hashmap *hash_map){
 }
 /*
  * The rehash function rehashes the table to a new vector array due to size
- * changes. each time we add the given pair to the new array and freeing
- * the vector after all pairs has been pushed back to the new vector.
+ * changes. The pairs are moved (not copied) to the new vectors, buckets
+ * shared with a snapshot are copied first so the snapshot keeps its pairs.
+ * The old vectors are only emptied and freed once every pair was placed,
+ * so on failure the hash map is unchanged (the new vectors must then be
+ * emptied by the caller, they only hold borrowed pairs).
  * Returns 0 if failed otherwise 1.
  */
 int rehash(hashmap* hash_map, vector*** new_bucket_lst, size_t new_capacity){
   for (size_t  i = 0; i < hash_map->capacity; ++i)
     {
+      if (hashmap_own_bucket (hash_map, i) == 0){
+          return 0;
+      }
       for (size_t  j = 0; j <hash_map->buckets[i]->size ; ++j)
         {
           pair* cur_pair = (pair*)(hash_map->buckets[i]->data[j]);
-          size_t key = hash_map->hash_func(cur_pair->key) & (new_capacity-1);
-          if (vector_push_back ((*new_bucket_lst)[key], cur_pair) != 1){
+          size_t hash = hashmap_seeded_hash (hash_map, cur_pair->key);
+          if (push_pair (hash_map, (*new_bucket_lst)[hash & (new_capacity-1)],
+                         cur_pair, hash, 1) != 1){
               return 0; // failure!
           }
         }
+    }
+  for (size_t  i = 0; i < hash_map->capacity; ++i)
+    {
+      hash_map->buckets[i]->size = 0; // the pairs were moved.
       vector_free (&(hash_map->buckets[i]));
     }
   return 1;
 }
+
 /*
- * Increase/decrease the has_table size using the rehash function.
- * The function creates a new buckets array, hashes the old hashmap pairs
- * to it using the hash function with the bitwise operation and then frees
- * the old array, switching the ptr in the hash_map struct to the relevant one.
- * Function returns 1 upon success 0 otherwise.
+ * Allocates an array of num_of_buckets empty vectors (from huge pages if
+ * use_huge is set), NULL on failure.
  */
-int hashmap_increase_decrease(hashmap* hash_map, int flag){
-  size_t new_capacity;
-  if (flag == INCREASE){
-    new_capacity = hash_map->capacity*HASH_MAP_GROWTH_FACTOR;
-  }
-  else{
-    new_capacity = hash_map->capacity/HASH_MAP_GROWTH_FACTOR;
-  }
-  vector ** new_bucket = malloc (sizeof(vector*)*new_capacity);
+vector** alloc_buckets(size_t num_of_buckets, int use_huge){
+  vector ** new_bucket = huge_pages_alloc (sizeof(vector*)*num_of_buckets,
+                                           use_huge);
   if (new_bucket == NULL){
-      return 0;
+      return NULL;
   }
-  for (size_t  i = 0; i <new_capacity ; ++i)
+  for (size_t  i = 0; i <num_of_buckets ; ++i)
     {
       vector * vec = vector_alloc (pair_copy, pair_cmp, pair_free);
       if (vec == NULL){
@@ -126,127 +406,691 @@ int hashmap_increase_decrease(hashmap* hash_map, int flag){
             {
               vector_free (&(new_bucket[j])); // release all previous vectors.
             }
-          free (new_bucket); // release bucket_malloc.
-          return 0;
+          huge_pages_free (new_bucket); // release bucket_malloc.
+          return NULL;
       }
       new_bucket[i] = vec;
     }
-  if (rehash (hash_map, &new_bucket, new_capacity) == 0){
-      for (size_t  i = 0; i < new_capacity; ++i) //free all the vector in case
-        // of failure.
-        {
-          vector_free (&(new_bucket[i]));
-        }
-      free (new_bucket);
+  return new_bucket;
+}
+
+/*
+ * @struct rehash_task
+ * The share of one thread in a multi threaded resize: old buckets
+ * [from, to) when growing, new buckets [from, to) when shrinking.
+ */
+typedef struct rehash_task {
+    hashmap* hash_map;
+    vector** new_buckets;
+    size_t new_capacity;
+    size_t from;
+    size_t to;
+    int success;
+} rehash_task;
+
+/*
+ * Allocates the new vectors [from, to) of a task, scaled from the old
+ * range to the new one.
+ */
+void* alloc_buckets_task(void* arg){
+  rehash_task* task = (rehash_task*) arg;
+  size_t cap = task->hash_map->capacity;
+  size_t from = task->from, to = task->to;
+  if (task->new_capacity > cap){ // the ranges are in old buckets.
+      from = from * (task->new_capacity / cap);
+      to = to * (task->new_capacity / cap);
+  }
+  for (size_t  i = from; i < to; ++i)
+    {
+      task->new_buckets[i] = vector_alloc (pair_copy, pair_cmp, pair_free);
+      if (task->new_buckets[i] == NULL){
+          task->success = 0;
+          return NULL;
+      }
+    }
+  return NULL;
+}
+
+/*
+ * Moves the pairs of old bucket i to the new buckets.
+ */
+int move_bucket(hashmap* hash_map, size_t i, vector** new_buckets,
+                size_t new_capacity){
+  if (hashmap_own_bucket (hash_map, i) == 0){
       return 0;
   }
-  vector ** temp_ptr = hash_map->buckets;
-  hash_map->buckets = new_bucket;
-  hash_map->capacity = new_capacity;
-  free (temp_ptr);
+  vector* vec = hash_map->buckets[i];
+  for (size_t  j = 0; j < vec->size; ++j)
+    {
+      pair* cur_pair = (pair*)(vec->data[j]);
+      size_t hash = hashmap_seeded_hash (hash_map, cur_pair->key);
+      if (push_pair (hash_map, new_buckets[hash & (new_capacity-1)],
+                     cur_pair, hash, 1) != 1){
+          return 0;
+      }
+    }
   return 1;
 }
 
-/**
- * The function returns the value associated with the given key.
- * @param hash_map a hash map.
- * @param key the key to be checked.
- * @return the value associated with key if exists, NULL otherwise
- * (the value itself,
- * not a copy of it).
+/*
+ * Moves the pairs of a task. When growing, the task's old buckets feed
+ * only their own new buckets, when shrinking the task visits every old
+ * bucket that feeds its new buckets.
  */
-valueT hashmap_at (const hashmap *hash_map, const_keyT key){
-  if ((key ==NULL)||(hash_map == NULL)){
-      return NULL;
-  }
-  size_t ind_key = get_ind_from_hash (hash_map, key);
-  vector* vec = hash_map->buckets[ind_key];
-  for (size_t  i = 0; i < vec->size; ++i)
+void* move_buckets_task(void* arg){
+  rehash_task* task = (rehash_task*) arg;
+  hashmap* hash_map = task->hash_map;
+  for (size_t  i = task->from; (i < task->to) && task->success; ++i)
     {
-      pair* cur_pair = (pair*)vec->data[i];
-      if (cur_pair->key_cmp(cur_pair->key, key) == 1){
-          return cur_pair->value;
+      if (task->new_capacity > hash_map->capacity){
+          task->success = move_bucket (hash_map, i, task->new_buckets,
+                                       task->new_capacity);
+          continue;
+      }
+      for (size_t  j = i; (j < hash_map->capacity) && task->success;
+           j += task->new_capacity)
+        {
+          task->success = move_bucket (hash_map, j, task->new_buckets,
+                                       task->new_capacity);
         }
     }
   return NULL;
 }
 
-/**
-* Inserts a new in_pair to the hash map.
-* The function inserts *new*, *copied*, *dynamically allocated* in_pair,
-* NOT the in_pair it receives as a parameter.
-* @param hash_map the hash map to be inserted with new element.
-* @param in_pair a in_pair the hash map would contain.
-* @return returns 1 for successful insertion, 0 otherwise.
-*/
-int hashmap_insert (hashmap *hash_map, const pair *in_pair){
-  if ((in_pair == NULL) || (hash_map == NULL)){
-      return 0;
+/*
+ * Frees the (emptied) old vectors of a task.
+ */
+void* free_buckets_task(void* arg){
+  rehash_task* task = (rehash_task*) arg;
+  hashmap* hash_map = task->hash_map;
+  size_t from = task->from, to = task->to;
+  if (task->new_capacity < hash_map->capacity){ // the ranges are in new buckets.
+      from = from * (hash_map->capacity / task->new_capacity);
+      to = to * (hash_map->capacity / task->new_capacity);
   }
-  if((in_pair->value == NULL) || (in_pair->key == NULL)){
-      return 0;
+  for (size_t  i = from; i < to; ++i)
+    {
+      hash_map->buckets[i]->size = 0; // the pairs were moved.
+      vector_free (&(hash_map->buckets[i]));
+    }
+  return NULL;
+}
+
+/*
+ * Runs func on every task, each in its own thread (a task whose thread
+ * cannot be created runs in the calling thread). Returns 1 if every task
+ * succeeded.
+ */
+int run_tasks(rehash_task* tasks, pthread_t* threads, size_t num_of_tasks,
+              void* (*func)(void*)){
+  int* started = calloc (num_of_tasks, sizeof (int));
+  for (size_t  i = 0; i < num_of_tasks; ++i)
+    {
+      if ((started != NULL)
+          && (pthread_create (&(threads[i]), NULL, func, &(tasks[i])) == 0)){
+          started[i] = 1;
+      }
+      else{
+          func (&(tasks[i]));
+      }
+    }
+  int success = 1;
+  for (size_t  i = 0; i < num_of_tasks; ++i)
+    {
+      if ((started != NULL) && started[i]){
+          pthread_join (threads[i], NULL);
+      }
+      success = success && tasks[i].success;
+    }
+  free (started);
+  return success;
+}
+
+/*
+ * The multi threaded version of alloc_buckets and rehash: every phase
+ * (allocating the new vectors, moving the pairs, freeing the old vectors)
+ * is split between the threads. Returns the new buckets array, NULL on
+ * failure (the hash map is then unchanged).
+ */
+vector** parallel_rehash(hashmap* hash_map, size_t new_capacity){
+  size_t num_threads = hash_map->resize_threads;
+  // tasks split the smaller of the two bucket ranges.
+  size_t range = (new_capacity > hash_map->capacity) ? hash_map->capacity :
+                 new_capacity;
+  if (num_threads > range){
+      num_threads = range;
   }
-  if (hashmap_at (hash_map, in_pair->key) != NULL){
-      return 0;
+  vector** new_buckets = huge_pages_alloc (sizeof (vector*) * new_capacity,
+                                           hash_map->huge_pages);
+  rehash_task* tasks = malloc (sizeof (rehash_task) * num_threads);
+  pthread_t* threads = malloc (sizeof (pthread_t) * num_threads);
+  if ((new_buckets == NULL) || (tasks == NULL) || (threads == NULL)){
+      huge_pages_free (new_buckets);
+      free (tasks);
+      free (threads);
+      return NULL;
   }
-  if (hashmap_get_load_factor (hash_map) >= HASH_MAP_MAX_LOAD_FACTOR)
+  for (size_t  i = 0; i < new_capacity; ++i)
     {
-      if (hashmap_increase_decrease (hash_map, INCREASE) != 1)
+      new_buckets[i] = NULL; // lets a failure tell which vectors exist.
+    }
+  for (size_t  i = 0; i < num_threads; ++i)
+    {
+      tasks[i].hash_map = hash_map;
+      tasks[i].new_buckets = new_buckets;
+      tasks[i].new_capacity = new_capacity;
+      tasks[i].from = range * i / num_threads;
+      tasks[i].to = range * (i + 1) / num_threads;
+      tasks[i].success = 1;
+    }
+  if ((run_tasks (tasks, threads, num_threads, alloc_buckets_task) == 0)
+      || (run_tasks (tasks, threads, num_threads, move_buckets_task) == 0)){
+      for (size_t  i = 0; i < new_capacity; ++i)
         {
-          return 0;
+          if (new_buckets[i] != NULL){
+              new_buckets[i]->size = 0; // borrowed pairs.
+              vector_free (&(new_buckets[i]));
+          }
         }
-    }
-  size_t hash_ind = get_ind_from_hash (hash_map, in_pair->key);
-  if(vector_push_back (hash_map->buckets[hash_ind], in_pair) != 1){
-      return 0;
+      huge_pages_free (new_buckets);
+      new_buckets = NULL;
   }
-  hash_map->size += 1;
-  return 1;
+  else{
+      run_tasks (tasks, threads, num_threads, free_buckets_task);
+  }
+  free (tasks);
+  free (threads);
+  return new_buckets;
 }
 
-
 /**
- * The function erases the pair associated with key.
- * @param hash_map a hash map.
- * @param key a key of the pair to be erased.
- * @return 1 if the erasing was done successfully, 0 otherwise.
- * (if key not in map,
- * considered fail).
+ * Lets resizes of large maps run on several threads.
+ * @return 1 on success, 0 otherwise.
  */
-int hashmap_erase (hashmap *hash_map, const_keyT key){
-  if ((hash_map == NULL)||key == NULL){
-      return 0;//invalid input.
-  }
-  if (hash_map->size == 0){
-      return 0; //no pairs to delete.
-  }
-  if (hashmap_at (hash_map, key) == NULL){
+int hashmap_set_resize_threads (hashmap *hash_map, size_t num_threads,
+                                size_t min_size){
+  if ((hash_map == NULL) || (num_threads == 0)){
       return 0;
   }
-  if (hashmap_get_load_factor (hash_map)<=HASH_MAP_MIN_LOAD_FACTOR){
-      if (hashmap_increase_decrease (hash_map, DECREASE) != 1){
-          return 0;
-      }
-  }
-  size_t key_ind = get_ind_from_hash (hash_map, key);
-  vector * vec = hash_map->buckets[key_ind];
-  for (size_t  i = 0; i < vec->size; ++i)
-    {
-      pair* cur_pair = (pair*)vec->data[i];
-      if (cur_pair->key_cmp(cur_pair->key, key) == 1){
-          if(vector_erase (vec, i) == 0){
-              return 0;
-          }
-          else{
-              hash_map->size -= 1;
-              break;
-          }}}
+  hash_map->resize_threads = num_threads;
+  hash_map->parallel_resize_min = (min_size == 0) ?
+                                  HASH_MAP_PARALLEL_RESIZE_MIN : min_size;
   return 1;
 }
 
-/**
- * This function receives a hashmap and 2 functions, the first checks a
- * condition on the keys,and the seconds apply some modification on the values.
+/*
+ * Moves the pairs of a map without buckets to a new array of new_capacity
+ * buckets. Returns 1 on success, 0 otherwise (the map is then unchanged).
+ */
+int expand_small(hashmap* hash_map, size_t new_capacity){
+  vector** new_buckets = alloc_buckets (new_capacity, hash_map->huge_pages);
+  if (new_buckets == NULL){
+      return 0;
+  }
+  for (size_t  i = 0; i < hash_map->size; ++i)
+    {
+      size_t hash = hash_map->small_hashes[i];
+      if (push_pair (hash_map, new_buckets[hash & (new_capacity - 1)],
+                     hash_map->small_pairs[i], hash, 1) != 1){
+          for (size_t  j = 0; j < new_capacity; ++j)
+            {
+              new_buckets[j]->size = 0; // the pairs stay in small_pairs.
+              vector_free (&(new_buckets[j]));
+            }
+          huge_pages_free (new_buckets);
+          return 0;
+      }
+    }
+  hash_map->buckets = new_buckets;
+  hash_map->capacity = new_capacity;
+  hash_map->bucket_slots = 0;
+  for (size_t  i = 0; i < new_capacity; ++i)
+    {
+      hash_map->bucket_slots += new_buckets[i]->capacity;
+    }
+  return 1;
+}
+
+/*
+ * Resizes the hash table to new_capacity buckets using the rehash function
+ * (or parallel_rehash for large maps with more than one resize thread).
+ * The function creates a new buckets array, moves the old hashmap pairs
+ * to it using the hash function with the bitwise operation and then frees
+ * the old array, switching the ptr in the hash_map struct to the relevant one.
+ * Function returns 1 upon success 0 otherwise.
+ */
+int hashmap_resize(hashmap* hash_map, size_t new_capacity){
+  if (hash_map->buckets == NULL){
+      return expand_small (hash_map, new_capacity);
+  }
+  if (hashmap_own_buckets (hash_map) == 0){
+      return 0;
+  }
+  vector ** new_bucket;
+  if ((hash_map->resize_threads > 1)
+      && (hash_map->size >= hash_map->parallel_resize_min)){
+      new_bucket = parallel_rehash (hash_map, new_capacity);
+      if (new_bucket == NULL){
+          return 0;
+      }
+  }
+  else{
+      new_bucket = alloc_buckets (new_capacity, hash_map->huge_pages);
+      if (new_bucket == NULL){
+          return 0;
+      }
+      if (rehash (hash_map, &new_bucket, new_capacity) == 0){
+          for (size_t  i = 0; i < new_capacity; ++i) //free all the vector in
+            // case of failure, the pairs still belong to the old vectors.
+            {
+              new_bucket[i]->size = 0;
+              vector_free (&(new_bucket[i]));
+            }
+          huge_pages_free (new_bucket);
+          return 0;
+      }
+  }
+  vector ** temp_ptr = hash_map->buckets;
+  hash_map->buckets = new_bucket;
+  hash_map->capacity = new_capacity;
+  huge_pages_free (temp_ptr);
+  hash_map->bucket_slots = 0; // the resize already visited every bucket.
+  for (size_t  i = 0; i < new_capacity; ++i)
+    {
+      hash_map->bucket_slots += new_bucket[i]->capacity;
+    }
+  return 1;
+}
+
+/**
+ * Moves the buckets array of the hash map to huge pages (or back).
+ * @return 1 on success, 0 otherwise.
+ */
+int hashmap_set_huge_pages (hashmap *hash_map, int enable){
+  if (hash_map == NULL){
+      return 0;
+  }
+  if (hash_map->buckets == NULL){
+      hash_map->huge_pages = enable; // used once the buckets are allocated.
+      return 1;
+  }
+  if (hashmap_own_buckets (hash_map) == 0){
+      return 0;
+  }
+  vector** new_buckets = huge_pages_alloc (sizeof (vector*)*hash_map->capacity,
+                                           enable);
+  if (new_buckets == NULL){
+      return 0;
+  }
+  memcpy (new_buckets, hash_map->buckets,
+          sizeof (vector*)*hash_map->capacity);
+  huge_pages_free (hash_map->buckets);
+  hash_map->buckets = new_buckets;
+  hash_map->huge_pages = enable;
+  return 1;
+}
+
+/**
+ * Reports how the buckets array of the hash map is backed.
+ * @return 1 on success, 0 otherwise.
+ */
+int hashmap_get_huge_page_stats (const hashmap *hash_map,
+                                 hashmap_huge_page_stats *stats){
+  if ((hash_map == NULL) || (stats == NULL)){
+      return 0;
+  }
+  stats->requested = hash_map->huge_pages;
+  stats->kind = huge_pages_kind (hash_map->buckets);
+  stats->bucket_bytes = (hash_map->buckets == NULL) ? 0 :
+                        sizeof (vector*)*hash_map->capacity;
+  stats->huge_page_bytes = huge_pages_backed (hash_map->buckets);
+  return 1;
+}
+
+/*
+ * Increase/decrease the has_table size by HASH_MAP_GROWTH_FACTOR.
+ * Function returns 1 upon success 0 otherwise.
+ */
+int hashmap_increase_decrease(hashmap* hash_map, int flag){
+  if (flag == INCREASE){
+    return hashmap_resize (hash_map, hash_map->capacity*HASH_MAP_GROWTH_FACTOR);
+  }
+  return hashmap_resize (hash_map, hash_map->capacity/HASH_MAP_GROWTH_FACTOR);
+}
+
+/**
+ * Grows the hash map so that it holds num_of_pairs pairs below
+ * HASH_MAP_MAX_LOAD_FACTOR, so inserting up to num_of_pairs pairs
+ * does not resize it.
+ * @param hash_map a hash map.
+ * @param num_of_pairs the number of pairs the map should hold.
+ * @return 1 on success, 0 otherwise.
+ */
+int hashmap_reserve (hashmap *hash_map, size_t num_of_pairs){
+  if (hash_map == NULL){
+      return 0;
+  }
+  size_t new_capacity = bucket_capacity_for (hash_map->capacity,
+                                             num_of_pairs);
+  if (new_capacity == 0){
+      return 0; // more pairs than any bucket array can hold.
+  }
+  if ((hash_map->buckets == NULL) && (num_of_pairs <= HASH_MAP_SMALL_MAX)){
+      hash_map->capacity = new_capacity; // the pairs still fit without buckets.
+      return 1;
+  }
+  if ((new_capacity == hash_map->capacity) && (hash_map->buckets != NULL)){
+      return 1;
+  }
+  return hashmap_resize (hash_map, new_capacity);
+}
+
+/*
+ * Returns the value associated with key, NULL if there is none. Lookups
+ * of users (count_lookup == 1) are counted in the filter statistics, the
+ * probes of insert and erase are not.
+ */
+static valueT find_value(const hashmap* hash_map, const_keyT key,
+                         int count_lookup){
+  size_t hash = hash_map->hash_func(key);
+  if (hash_map->filter != NULL){
+      int may_contain = bloom_filter_may_contain (hash_map->filter, hash);
+      if (count_lookup){
+          bloom_filter_count_lookup (hash_map->filter, may_contain);
+      }
+      if (may_contain == 0){
+          return NULL; // definitely absent.
+      }
+  }
+  hash = seed_hash (hash_map, hash);
+  if (hash_map->buckets == NULL){
+      long ind = get_small_ind (hash_map, hash, key);
+      return (ind == -1) ? NULL : hash_map->small_pairs[ind]->value;
+  }
+  vector* vec = hash_map->buckets[hash & (hash_map->capacity -1)];
+  long ind = find_in_bucket (hash_map, vec, key, hash);
+  if (ind != -1){
+      return ((pair*)vec->data[ind])->value;
+  }
+  if ((hash_map->filter != NULL) && count_lookup){
+      bloom_filter_count_false_positive (hash_map->filter);
+  }
+  return NULL;
+}
+
+/**
+ * The function returns the value associated with the given key.
+ * @param hash_map a hash map.
+ * @param key the key to be checked.
+ * @return the value associated with key if exists, NULL otherwise
+ * (the value itself,
+ * not a copy of it).
+ */
+valueT hashmap_at (const hashmap *hash_map, const_keyT key){
+  if ((key ==NULL)||(hash_map == NULL)){
+      return NULL;
+  }
+  return find_value (hash_map, key, 1);
+}
+
+/*
+ * Replaces the filter of the hash map with a new one sized for twice the
+ * keys the map can hold before its next growth, holding all current keys.
+ * The query statistics are carried over. Returns 1 on success, 0 otherwise
+ * (the old filter is kept, it is still correct, only less selective).
+ */
+int rebuild_filter(hashmap* hash_map, size_t bits_per_key){
+  size_t max_keys = (size_t) (HASH_MAP_MAX_LOAD_FACTOR * hash_map->capacity);
+  if (max_keys < hash_map->size){
+      max_keys = hash_map->size;
+  }
+  bloom_filter* filter = bloom_filter_alloc (max_keys * 2, bits_per_key);
+  if (filter == NULL){
+      return 0;
+  }
+  for (size_t  i = 0; i < hash_map->capacity; ++i)
+    {
+      for (size_t  j = 0; j <hash_map->buckets[i]->size ; ++j)
+        {
+          pair* cur_pair = (pair*)(hash_map->buckets[i]->data[j]);
+          bloom_filter_add (filter, hash_map->hash_func(cur_pair->key));
+        }
+    }
+  if (hash_map->filter != NULL){
+      filter->lookups = hash_map->filter->lookups;
+      filter->negatives = hash_map->filter->negatives;
+      filter->false_positives = hash_map->filter->false_positives;
+      bloom_filter_free (&(hash_map->filter));
+  }
+  hash_map->filter = filter;
+  return 1;
+}
+
+/**
+ * Enables a blocked Bloom filter in front of the hash map.
+ * @param hash_map a hash map.
+ * @param bits_per_key filter bits per key, 0 for BLOOM_DEFAULT_BITS_PER_KEY.
+ * @return 1 on success, 0 otherwise.
+ */
+int hashmap_enable_filter (hashmap *hash_map, size_t bits_per_key){
+  if (hash_map == NULL){
+      return 0;
+  }
+  if ((hash_map->buckets == NULL)
+      && (hashmap_resize (hash_map, hash_map->capacity) == 0)){
+      return 0; // the filter is kept up to date by the bucketed paths.
+  }
+  return rebuild_filter (hash_map, bits_per_key);
+}
+
+/**
+ * Disables (and frees) the Bloom filter of the hash map.
+ * @param hash_map a hash map.
+ */
+void hashmap_disable_filter (hashmap *hash_map){
+  if (hash_map == NULL){
+      return;
+  }
+  bloom_filter_free (&(hash_map->filter));
+}
+
+/**
+ * Reports the Bloom filter statistics of the hash map.
+ * @return 1 on success, 0 if the map has no filter.
+ */
+int hashmap_get_filter_stats (const hashmap *hash_map,
+                              hashmap_filter_stats *stats){
+  if ((hash_map == NULL) || (hash_map->filter == NULL) || (stats == NULL)){
+      return 0;
+  }
+  const bloom_filter* filter = hash_map->filter;
+  stats->lookups = __atomic_load_n (&(filter->lookups), __ATOMIC_RELAXED);
+  stats->negatives = __atomic_load_n (&(filter->negatives), __ATOMIC_RELAXED);
+  stats->false_positives = __atomic_load_n (&(filter->false_positives),
+                                            __ATOMIC_RELAXED);
+  size_t absent = stats->negatives + stats->false_positives;
+  stats->observed_fpr = (absent == 0) ? 0 :
+                        (double) stats->false_positives / absent;
+  stats->estimated_fpr = bloom_filter_estimated_fpr (filter);
+  stats->filter_bytes = filter->num_blocks * BLOOM_BLOCK_WORDS
+                        * sizeof (uint64_t);
+  return 1;
+}
+
+/*
+ * Keeps the filter (if any) in sync after an insertion or erase of key.
+ */
+void update_filter(hashmap* hash_map, const_keyT key, int inserted){
+  if (hash_map->filter == NULL){
+      return;
+  }
+  if (inserted){
+      bloom_filter_add (hash_map->filter, hash_map->hash_func(key));
+  }
+  else{
+      bloom_filter_count_erase (hash_map->filter);
+  }
+  if (bloom_filter_needs_rebuild (hash_map->filter)){
+      rebuild_filter (hash_map, hash_map->filter->bits_per_key);
+  }
+}
+
+/*
+ * Inserts a copy of in_pair, whose key is not in the map, into the
+ * small_pairs of a map without buckets (which must have room for it). The
+ * capacity grows as it would with buckets. Returns 1 on success, 0 otherwise.
+ */
+int small_insert(hashmap* hash_map, const pair* in_pair){
+  pair* copy = pair_copy (in_pair);
+  if (copy == NULL){
+      return 0;
+  }
+  if (hashmap_get_load_factor (hash_map) >= HASH_MAP_MAX_LOAD_FACTOR){
+      hash_map->capacity *= HASH_MAP_GROWTH_FACTOR;
+  }
+  hash_map->small_hashes[hash_map->size] = hashmap_seeded_hash (hash_map,
+                                                                copy->key);
+  hash_map->small_pairs[hash_map->size] = copy;
+  hash_map->size += 1;
+  hash_map->payload_bytes += payload_of (hash_map, copy);
+  record_change (hash_map, CHANGE_FEED_INSERT, copy,
+                 hash_map->small_hashes[hash_map->size - 1]);
+  return 1;
+}
+
+/*
+ * Erases key, which is in the map, from the small_pairs of a map without
+ * buckets: the last pair takes its position. The capacity shrinks as it
+ * would with buckets.
+ */
+void small_erase(hashmap* hash_map, const_keyT key){
+  if (hashmap_get_load_factor (hash_map) <= HASH_MAP_MIN_LOAD_FACTOR){
+      hash_map->capacity /= HASH_MAP_GROWTH_FACTOR;
+  }
+  size_t ind = (size_t) get_small_ind (hash_map,
+                                       hashmap_seeded_hash (hash_map, key),
+                                       key);
+  hash_map->payload_bytes -= payload_of (hash_map, hash_map->small_pairs[ind]);
+  record_change (hash_map, CHANGE_FEED_ERASE, hash_map->small_pairs[ind],
+                 hash_map->small_hashes[ind]);
+  pair_free ((void**) &(hash_map->small_pairs[ind]));
+  hash_map->size -= 1;
+  hash_map->small_pairs[ind] = hash_map->small_pairs[hash_map->size];
+  hash_map->small_hashes[ind] = hash_map->small_hashes[hash_map->size];
+}
+
+/**
+* Inserts a new in_pair to the hash map.
+* The function inserts *new*, *copied*, *dynamically allocated* in_pair,
+* NOT the in_pair it receives as a parameter.
+* @param hash_map the hash map to be inserted with new element.
+* @param in_pair a in_pair the hash map would contain.
+* @return returns 1 for successful insertion, 0 otherwise.
+*/
+int hashmap_insert (hashmap *hash_map, const pair *in_pair){
+  if ((in_pair == NULL) || (hash_map == NULL)){
+      return 0;
+  }
+  if((in_pair->value == NULL) || (in_pair->key == NULL)){
+      return 0;
+  }
+  if (find_value (hash_map, in_pair->key, 0) != NULL){
+      return 0;
+  }
+  if (hash_map->buckets == NULL){
+      if (hash_map->size < HASH_MAP_SMALL_MAX){
+          return small_insert (hash_map, in_pair);
+      }
+      if (hashmap_resize (hash_map, hash_map->capacity) == 0){
+          return 0; // the map outgrew small_pairs.
+      }
+  }
+  if (hashmap_own_buckets (hash_map) == 0){
+      return 0;
+  }
+  if (hashmap_get_load_factor (hash_map) >= HASH_MAP_MAX_LOAD_FACTOR)
+    {
+      if (hashmap_increase_decrease (hash_map, INCREASE) != 1)
+        {
+          return 0;
+        }
+    }
+  size_t hash = hashmap_seeded_hash (hash_map, in_pair->key);
+  size_t hash_ind = hash & (hash_map->capacity -1);
+  if (hashmap_own_bucket (hash_map, hash_ind) == 0){
+      return 0;
+  }
+  size_t old_capacity = hash_map->buckets[hash_ind]->capacity;
+  if(push_pair (hash_map, hash_map->buckets[hash_ind], in_pair, hash, 0)
+     != 1){
+      return 0;
+  }
+  track_bucket (hash_map, hash_ind, old_capacity);
+  hash_map->size += 1;
+  hash_map->payload_bytes += payload_of (hash_map, in_pair);
+  update_filter (hash_map, in_pair->key, 1);
+  record_change (hash_map, CHANGE_FEED_INSERT, in_pair, hash);
+  return 1;
+}
+
+
+/**
+ * The function erases the pair associated with key.
+ * @param hash_map a hash map.
+ * @param key a key of the pair to be erased.
+ * @return 1 if the erasing was done successfully, 0 otherwise.
+ * (if key not in map,
+ * considered fail).
+ */
+int hashmap_erase (hashmap *hash_map, const_keyT key){
+  if ((hash_map == NULL)||key == NULL){
+      return 0;//invalid input.
+  }
+  if (hash_map->size == 0){
+      return 0; //no pairs to delete.
+  }
+  if (find_value (hash_map, key, 0) == NULL){
+      return 0;
+  }
+  if (hash_map->buckets == NULL){
+      small_erase (hash_map, key);
+      return 1;
+  }
+  if (hashmap_own_buckets (hash_map) == 0){
+      return 0;
+  }
+  if (hashmap_get_load_factor (hash_map)<=HASH_MAP_MIN_LOAD_FACTOR){
+      if (hashmap_increase_decrease (hash_map, DECREASE) != 1){
+          return 0;
+      }
+  }
+  size_t hash = hashmap_seeded_hash (hash_map, key);
+  size_t key_ind = hash & (hash_map->capacity -1);
+  if (hashmap_own_bucket (hash_map, key_ind) == 0){
+      return 0;
+  }
+  vector * vec = hash_map->buckets[key_ind];
+  long i = find_in_bucket (hash_map, vec, key, hash);
+  size_t old_capacity = vec->capacity;
+  pair* erased = vec->data[i];
+  vec->data[i] = NULL; // freed once the erasure is recorded.
+  if(vector_erase (vec, (size_t) i) == 0){ // keeps the bucket's order.
+      vec->data[i] = erased;
+      return 0;
+  }
+  size_t payload = payload_of (hash_map, erased);
+  record_change (hash_map, CHANGE_FEED_ERASE, erased, hash);
+  pair_free ((void**) &erased);
+  track_bucket (hash_map, key_ind, old_capacity);
+  hash_map->payload_bytes -= payload;
+  hash_map->size -= 1;
+  update_filter (hash_map, key, 0);
+  return 1;
+}
+
+/**
+ * This function receives a hashmap and 2 functions, the first checks a
+ * condition on the keys,and the seconds apply some modification on the values.
  * The function should apply the modification
  * only on the values that are associated with keys that meet the condition.
  *
@@ -266,14 +1110,48 @@ int hashmap_apply_if (const hashmap *hash_map, keyT_func keyT_func,
   if((hash_map == NULL) || (keyT_func == NULL) || (valT_func == NULL)){
       return 0;
   }
+  // the values change in place, so buckets shared with a snapshot are
+  // copied before the first change.
+  hashmap* map = (hashmap*) hash_map;
   int changed_vals = 0;
-  for (size_t  i = 0; i <hash_map->capacity ; ++i)
+  if (map->buckets == NULL){
+      for (size_t  i = 0; i < map->size; ++i)
+        {
+          pair* cur_pair = map->small_pairs[i];
+          if (keyT_func(cur_pair->key) == 1){
+              map->payload_bytes -= payload_of (map, cur_pair);
+              digest_pair (map, cur_pair, map->small_hashes[i], 0);
+              valT_func(cur_pair->value);
+              map->payload_bytes += payload_of (map, cur_pair);
+              record_change (map, CHANGE_FEED_UPDATE, cur_pair,
+                             map->small_hashes[i]);
+              changed_vals++;
+          }
+        }
+      return changed_vals;
+  }
+  for (size_t  i = 0; i <map->capacity ; ++i)
     {
-      for (size_t  j = 0; j <hash_map->buckets[i]->size ; ++j)
+      for (size_t  j = 0; j <map->buckets[i]->size ; ++j)
         {
-          pair* cur_pair = (pair*)(hash_map->buckets[i]->data[j]);
+          pair* cur_pair = (pair*)(map->buckets[i]->data[j]);
           if (keyT_func(cur_pair->key) == 1){
+            if ((map->buckets_refs != NULL)
+                || (__atomic_load_n (&(map->buckets[i]->ref_count),
+                                     __ATOMIC_ACQUIRE) != 1)){
+                if ((hashmap_own_buckets (map) == 0)
+                    || (hashmap_own_bucket (map, i) == 0)){
+                    return changed_vals;
+                }
+                cur_pair = (pair*)(map->buckets[i]->data[j]);
+            }
+            size_t hash = tracks_changes (map) ?
+                          hashmap_seeded_hash (map, cur_pair->key) : 0;
+            map->payload_bytes -= payload_of (map, cur_pair);
+            digest_pair (map, cur_pair, hash, 0);
             valT_func(cur_pair->value);
+            map->payload_bytes += payload_of (map, cur_pair);
+            record_change (map, CHANGE_FEED_UPDATE, cur_pair, hash);
             changed_vals++;
           }
         }
@@ -281,4 +1159,671 @@ int hashmap_apply_if (const hashmap *hash_map, keyT_func keyT_func,
   return changed_vals;
 }
 
-
+/*
+ * Erases the pairs of bucket ind whose keys meet keyT_func, moving the kept
+ * pairs down in place (so a sorted bucket stays sorted). A bucket shared
+ * with a snapshot is copied only if it has such a pair. Returns the number
+ * of erased pairs, or -1 if the bucket could not be copied.
+ */
+long erase_bucket_if(hashmap* hash_map, size_t ind, keyT_func keyT_func){
+  vector* vec = hash_map->buckets[ind];
+  size_t j = 0;
+  while ((j < vec->size)
+         && (keyT_func (((pair*) vec->data[j])->key) != 1)){
+      j++;
+    }
+  if (j == vec->size){
+      return 0;
+  }
+  if ((hash_map->buckets_refs != NULL)
+      || (__atomic_load_n (&(vec->ref_count), __ATOMIC_ACQUIRE) != 1)){
+      if ((hashmap_own_buckets (hash_map) == 0)
+          || (hashmap_own_bucket (hash_map, ind) == 0)){
+          return -1;
+      }
+      vec = hash_map->buckets[ind];
+  }
+  size_t kept = j;
+  long erased = 0;
+  for (; j < vec->size; ++j)
+    {
+      pair* cur_pair = (pair*) vec->data[j];
+      // the first pair is the match found above.
+      if ((erased > 0) && (keyT_func (cur_pair->key) != 1)){
+          vec->data[kept++] = cur_pair;
+          continue;
+      }
+      hash_map->payload_bytes -= payload_of (hash_map, cur_pair);
+      if (tracks_changes (hash_map)){
+          record_change (hash_map, CHANGE_FEED_ERASE, cur_pair,
+                         hashmap_seeded_hash (hash_map, cur_pair->key));
+      }
+      vec->elem_free_func (&(vec->data[j]));
+      erased++;
+    }
+  vec->size = kept;
+  return erased;
+}
+
+/**
+ * Erases every pair whose key meets keyT_func in one sweep: the pairs are
+ * compacted in place bucket by bucket, the size is updated once and the map
+ * shrinks at most once, at the end, to the smallest capacity (down to
+ * HASH_MAP_INITIAL_CAP) above HASH_MAP_MIN_LOAD_FACTOR.
+ * @param hash_map a hashmap
+ * @param keyT_func a function that checks a condition on keyT and return 1
+ * if true, 0 else
+ * @return number of erased pairs
+ */
+size_t hashmap_erase_if (hashmap *hash_map, keyT_func keyT_func){
+  if ((hash_map == NULL) || (keyT_func == NULL)){
+      return 0;
+  }
+  size_t erased = 0;
+  if (hash_map->buckets == NULL){
+      size_t kept = 0;
+      for (size_t  i = 0; i < hash_map->size; ++i)
+        {
+          pair* cur_pair = hash_map->small_pairs[i];
+          if (keyT_func (cur_pair->key) == 1){
+              hash_map->payload_bytes -= payload_of (hash_map, cur_pair);
+              record_change (hash_map, CHANGE_FEED_ERASE, cur_pair,
+                             hash_map->small_hashes[i]);
+              pair_free ((void**) &(hash_map->small_pairs[i]));
+              erased++;
+          }
+          else{
+              hash_map->small_pairs[kept] = cur_pair;
+              hash_map->small_hashes[kept] = hash_map->small_hashes[i];
+              kept++;
+          }
+        }
+  }
+  else{
+      for (size_t  i = 0; i < hash_map->capacity; ++i)
+        {
+          long bucket_erased = erase_bucket_if (hash_map, i, keyT_func);
+          if (bucket_erased < 0){
+              break; // the pairs erased so far stay erased.
+          }
+          erased += (size_t) bucket_erased;
+        }
+  }
+  if (erased == 0){
+      return 0;
+  }
+  hash_map->size -= erased;
+  size_t new_capacity = hash_map->capacity;
+  while ((new_capacity > HASH_MAP_INITIAL_CAP)
+         && ((double) hash_map->size / new_capacity
+             <= HASH_MAP_MIN_LOAD_FACTOR)){
+      new_capacity /= HASH_MAP_GROWTH_FACTOR;
+    }
+  if (hash_map->buckets == NULL){
+      hash_map->capacity = new_capacity;
+  }
+  else if (new_capacity != hash_map->capacity){
+      hashmap_resize (hash_map, new_capacity); // on failure the map is
+      // only larger than needed.
+  }
+  if (hash_map->filter != NULL){
+      for (size_t  i = 0; i < erased; ++i)
+        {
+          bloom_filter_count_erase (hash_map->filter);
+        }
+      if (bloom_filter_needs_rebuild (hash_map->filter)){
+          rebuild_filter (hash_map, hash_map->filter->bits_per_key);
+      }
+  }
+  return erased;
+}
+
+
+
+/*
+ * Places a pair of the source map into dest according to policy.
+ * If move, dest takes ownership of in_pair (or frees it if it is not
+ * needed), otherwise in_pair is copied. Returns 1 on success, 0 otherwise
+ * (in_pair is then still owned by the caller).
+ */
+static int merge_pair(hashmap* dest, pair* in_pair, int policy,
+                      valueT_combine_func combine, int move){
+  size_t hash = hashmap_seeded_hash (dest, in_pair->key);
+  size_t ind = hash & (dest->capacity -1);
+  if (hashmap_own_bucket (dest, ind) == 0){
+      return 0;
+  }
+  vector* vec = dest->buckets[ind];
+  long found = find_in_bucket (dest, vec, in_pair->key, hash);
+  if (found == -1){
+      size_t old_capacity = vec->capacity;
+      if (push_pair (dest, vec, in_pair, hash, move) != 1){
+          return 0;
+      }
+      track_bucket (dest, ind, old_capacity);
+      dest->size += 1;
+      dest->payload_bytes += payload_of (dest, in_pair);
+      update_filter (dest, in_pair->key, 1);
+      record_change (dest, CHANGE_FEED_INSERT, in_pair, hash);
+      return 1;
+  }
+  pair* cur_pair = (pair*)vec->data[found];
+  if (policy == HASH_MAP_MERGE_OVERWRITE){
+      void* new_pair = move ? in_pair : pair_copy (in_pair);
+      if (new_pair == NULL){
+          return 0;
+      }
+      dest->payload_bytes -= payload_of (dest, cur_pair);
+      dest->payload_bytes += payload_of (dest, in_pair);
+      digest_pair (dest, cur_pair, hash, 0);
+      pair_free (&(vec->data[found]));
+      vec->data[found] = new_pair;
+      record_change (dest, CHANGE_FEED_UPDATE, new_pair, hash);
+      return 1;
+  }
+  if (policy == HASH_MAP_MERGE_COMBINE){
+      dest->payload_bytes -= payload_of (dest, cur_pair);
+      digest_pair (dest, cur_pair, hash, 0);
+      combine (cur_pair->value, in_pair->value);
+      dest->payload_bytes += payload_of (dest, cur_pair);
+      record_change (dest, CHANGE_FEED_UPDATE, cur_pair, hash);
+  }
+  if (move){
+      pair_free ((void**) &in_pair);
+  }
+  return 1;
+}
+
+/**
+ * Inserts copies of all the pairs of src into dest.
+ * @return 1 on success, 0 otherwise (dest may hold some of the pairs).
+ */
+int hashmap_merge (hashmap *dest, const hashmap *src, int policy,
+                   valueT_combine_func combine){
+  if ((dest == NULL) || (src == NULL) || (dest == src)){
+      return 0;
+  }
+  if ((policy == HASH_MAP_MERGE_COMBINE) && (combine == NULL)){
+      return 0;
+  }
+  if (((dest->buckets == NULL)
+       && (hashmap_resize (dest, dest->capacity) == 0))
+      || (hashmap_own_buckets (dest) == 0)
+      || (hashmap_reserve (dest, dest->size + src->size) == 0)){
+      return 0;
+  }
+  if (src->buckets == NULL){
+      for (size_t  i = 0; i < src->size; ++i)
+        {
+          if (merge_pair (dest, src->small_pairs[i], policy, combine, 0) == 0){
+              return 0;
+          }
+        }
+      return 1;
+  }
+  for (size_t  i = 0; i < src->capacity; ++i)
+    {
+      for (size_t  j = 0; j <src->buckets[i]->size ; ++j)
+        {
+          pair* cur_pair = (pair*)(src->buckets[i]->data[j]);
+          if (merge_pair (dest, cur_pair, policy, combine, 0) == 0){
+              return 0;
+          }
+        }
+    }
+  return 1;
+}
+
+/**
+ * Like hashmap_merge, but consumes src: its pairs are moved into dest
+ * instead of copied, and src is left empty.
+ * @return 1 on success, 0 otherwise.
+ */
+int hashmap_move_all (hashmap *dest, hashmap *src, int policy,
+                      valueT_combine_func combine){
+  if ((dest == NULL) || (src == NULL) || (dest == src)){
+      return 0;
+  }
+  if ((policy == HASH_MAP_MERGE_COMBINE) && (combine == NULL)){
+      return 0;
+  }
+  if (((dest->buckets == NULL)
+       && (hashmap_resize (dest, dest->capacity) == 0))
+      || (hashmap_own_buckets (dest) == 0) || (hashmap_own_buckets (src) == 0)
+      || (hashmap_reserve (dest, dest->size + src->size) == 0)){
+      return 0;
+  }
+  while ((src->buckets == NULL) && (src->size > 0)){
+      pair* cur_pair = src->small_pairs[src->size - 1];
+      size_t payload = payload_of (src, cur_pair);
+      size_t hash = src->small_hashes[src->size - 1];
+      record_change (src, CHANGE_FEED_ERASE, cur_pair, hash);
+      src->size -= 1; // taken out of src before it is placed.
+      if (merge_pair (dest, cur_pair, policy, combine, 1) == 0){
+          src->size += 1;
+          record_change (src, CHANGE_FEED_INSERT, cur_pair, hash);
+          return 0;
+      }
+      src->payload_bytes -= payload;
+    }
+  for (size_t  i = 0; (src->buckets != NULL) && (i < src->capacity); ++i)
+    {
+      if (hashmap_own_bucket (src, i) == 0){
+          return 0;
+      }
+      vector* vec = src->buckets[i];
+      while (vec->size > 0){
+          pair* cur_pair = (pair*)vec->data[vec->size - 1];
+          size_t payload = payload_of (src, cur_pair);
+          size_t hash = tracks_changes (src) ?
+                        hashmap_seeded_hash (src, cur_pair->key) : 0;
+          record_change (src, CHANGE_FEED_ERASE, cur_pair, hash);
+          vec->size -= 1; // taken out of src before it is placed.
+          if (merge_pair (dest, cur_pair, policy, combine, 1) == 0){
+              vec->size += 1;
+              record_change (src, CHANGE_FEED_INSERT, cur_pair, hash);
+              return 0;
+          }
+          src->size -= 1;
+          src->payload_bytes -= payload;
+        }
+    }
+  if (src->filter != NULL){
+      bloom_filter_clear (src->filter);
+  }
+  return 1;
+}
+
+/**
+ * Sets the function that measures the key and value payload of a pair.
+ * @return 1 on success, 0 otherwise.
+ */
+int hashmap_set_payload_size_func (hashmap *hash_map, pair_size_func func){
+  if (hash_map == NULL){
+      return 0;
+  }
+  hash_map->size_func = func;
+  hash_map->payload_bytes = 0;
+  for (size_t  i = 0; (hash_map->buckets == NULL) && (i < hash_map->size); ++i)
+    {
+      hash_map->payload_bytes += payload_of (hash_map,
+                                             hash_map->small_pairs[i]);
+    }
+  for (size_t  i = 0; (hash_map->buckets != NULL) && (i < hash_map->capacity);
+       ++i)
+    {
+      for (size_t  j = 0; j <hash_map->buckets[i]->size ; ++j)
+        {
+          hash_map->payload_bytes += payload_of (hash_map,
+                                                 hash_map->buckets[i]->data[j]);
+        }
+    }
+  return 1;
+}
+
+/**
+ * Reports the memory used by the hash map, in O(1).
+ * @return 1 on success, 0 otherwise.
+ */
+int hashmap_get_memory_usage (const hashmap *hash_map,
+                              hashmap_memory_usage *usage){
+  if ((hash_map == NULL) || (usage == NULL)){
+      return 0;
+  }
+  if (hash_map->buckets == NULL){ // the pairs are in the struct itself.
+      usage->table_bytes = sizeof (hashmap);
+      usage->bucket_bytes = 0;
+      usage->slack_bytes = 0;
+  }
+  else{
+      usage->table_bytes = sizeof (hashmap)
+                           + sizeof (vector*) * hash_map->capacity;
+      usage->bucket_bytes = sizeof (vector) * hash_map->capacity
+                            + sizeof (void*) * hash_map->size;
+      usage->slack_bytes = sizeof (void*) * (hash_map->bucket_slots
+                                             - hash_map->size);
+  }
+  if (hash_map->digests != NULL){
+      usage->table_bytes += sizeof (size_t) * hash_map->digest_groups;
+  }
+  usage->entry_bytes = sizeof (pair) * hash_map->size;
+  usage->payload_bytes = hash_map->payload_bytes;
+  usage->filter_bytes = 0;
+  if (hash_map->filter != NULL){
+      usage->filter_bytes = sizeof (bloom_filter) + hash_map->filter->num_blocks
+                            * BLOOM_BLOCK_WORDS * sizeof (uint64_t);
+  }
+  usage->total_bytes = usage->table_bytes + usage->bucket_bytes
+                       + usage->slack_bytes + usage->entry_bytes
+                       + usage->payload_bytes + usage->filter_bytes;
+  return 1;
+}
+
+/*
+ * Shrinks bucket ind to fit its pairs. The pairs themselves are not moved.
+ * Returns 1 on success, 0 otherwise (the bucket is unchanged).
+ */
+static int compact_bucket(hashmap* hash_map, size_t ind){
+  vector* vec = hash_map->buckets[ind];
+  size_t old_capacity = vec->capacity;
+  if (vector_shrink_to_fit (vec) == 0){
+      return 0;
+  }
+  track_bucket (hash_map, ind, old_capacity);
+  return 1;
+}
+
+/*
+ * Returns the memory freed by a compaction to the operating system, where
+ * the allocator supports it.
+ */
+void release_free_memory(void){
+#ifdef __GLIBC__
+  malloc_trim (0);
+#endif
+}
+
+/**
+ * Compacts up to num_of_buckets buckets, continuing the current pass.
+ * @return 1 if buckets are left in the pass, 0 once it is complete,
+ * -1 on failure.
+ */
+int hashmap_compact_step (hashmap *hash_map, size_t num_of_buckets){
+  if (hash_map == NULL){
+      return -1;
+  }
+  if (hash_map->buckets == NULL){
+      return 0; // small_pairs has no slack to release.
+  }
+  if ((hash_map->buckets_refs != NULL)
+      && (__atomic_load_n (hash_map->buckets_refs, __ATOMIC_ACQUIRE) != 1)){
+      hash_map->compact_cursor = 0; // a snapshot sees every bucket.
+      return 0;
+  }
+  if (hashmap_own_buckets (hash_map) == 0){
+      return -1;
+  }
+  size_t end = hash_map->compact_cursor + num_of_buckets;
+  if ((end > hash_map->capacity) || (end < num_of_buckets)){
+      end = hash_map->capacity;
+  }
+  for (size_t  i = hash_map->compact_cursor; i < end; ++i)
+    {
+      if (__atomic_load_n (&(hash_map->buckets[i]->ref_count),
+                           __ATOMIC_ACQUIRE) != 1){
+          continue; // shared with a snapshot, copying it would cost memory.
+      }
+      if (compact_bucket (hash_map, i) == 0){
+          hash_map->compact_cursor = i;
+          return -1;
+      }
+    }
+  if (end < hash_map->capacity){
+      hash_map->compact_cursor = end;
+      return 1;
+  }
+  hash_map->compact_cursor = 0;
+  release_free_memory ();
+  return 0;
+}
+
+/**
+ * Compacts the whole hash map.
+ * @return 1 on success, 0 otherwise.
+ */
+int hashmap_compact (hashmap *hash_map){
+  if (hash_map == NULL){
+      return 0;
+  }
+  hash_map->compact_cursor = 0;
+  return hashmap_compact_step (hash_map, hash_map->capacity) == 0;
+}
+
+/*
+ * Computes the digests of the hash map (if enabled) from all its pairs.
+ */
+static void compute_digests(hashmap* hash_map){
+  if (hash_map->digests == NULL){
+      return;
+  }
+  memset (hash_map->digests, 0, sizeof (size_t) * hash_map->digest_groups);
+  for (size_t  i = 0; (hash_map->buckets == NULL) && (i < hash_map->size); ++i)
+    {
+      digest_pair (hash_map, hash_map->small_pairs[i],
+                   hash_map->small_hashes[i], 1);
+    }
+  for (size_t  i = 0; (hash_map->buckets != NULL) && (i < hash_map->capacity);
+       ++i)
+    {
+      for (size_t  j = 0; j < hash_map->buckets[i]->size; ++j)
+        {
+          pair* cur_pair = (pair*)(hash_map->buckets[i]->data[j]);
+          digest_pair (hash_map, cur_pair,
+                       hashmap_seeded_hash (hash_map, cur_pair->key), 1);
+        }
+    }
+}
+
+/**
+ * Sets the seed the hash map mixes into the hashes of its keys, and rehashes
+ * it.
+ * @return 1 on success, 0 otherwise.
+ */
+int hashmap_set_seed (hashmap *hash_map, size_t seed){
+  if (hash_map == NULL){
+      return 0;
+  }
+  size_t old_seed = hash_map->seed;
+  hash_map->seed = seed;
+  if (hash_map->buckets == NULL){
+      for (size_t  i = 0; i < hash_map->size; ++i)
+        {
+          hash_map->small_hashes[i] = hashmap_seeded_hash
+              (hash_map, hash_map->small_pairs[i]->key);
+        }
+      compute_digests (hash_map);
+      return 1;
+  }
+  // the pairs are placed by the new seed, on failure the map is unchanged.
+  if (hashmap_resize (hash_map, hash_map->capacity) == 0){
+      hash_map->seed = old_seed;
+      return 0;
+  }
+  compute_digests (hash_map); // the keys moved between the groups.
+  return 1;
+}
+
+/**
+ * Returns the seeded hash of key in the hash map.
+ */
+size_t hashmap_seeded_hash (const hashmap *hash_map, const_keyT key){
+  return seed_hash (hash_map, hash_map->hash_func (key));
+}
+
+/**
+ * Returns a new random seed, derived from the process wide secret.
+ */
+size_t hashmap_random_seed (void){
+  return new_seed ();
+}
+
+/**
+ * Subscribes to the change feed of the hash map.
+ * @return pointer to dynamically allocated subscriber.
+ * @if_fail return NULL.
+ */
+change_feed_subscriber *hashmap_subscribe (hashmap *hash_map, size_t capacity){
+  if (hash_map == NULL){
+      return NULL;
+  }
+  change_feed_subscriber* subscriber = change_feed_subscriber_alloc (capacity);
+  if (subscriber == NULL){
+      return NULL;
+  }
+  subscriber->next = hash_map->subscribers;
+  hash_map->subscribers = subscriber;
+  return subscriber;
+}
+
+/**
+ * Removes a subscriber from the change feed of the hash map and frees it.
+ */
+void hashmap_unsubscribe (hashmap *hash_map,
+                          change_feed_subscriber **p_subscriber){
+  if ((hash_map == NULL) || (p_subscriber == NULL) || (*p_subscriber == NULL)){
+      return;
+  }
+  change_feed_subscriber** link = &(hash_map->subscribers);
+  while ((*link != NULL) && (*link != *p_subscriber)){
+      link = &((*link)->next);
+    }
+  if (*link == NULL){
+      return; // not a subscriber of this map.
+  }
+  *link = (*p_subscriber)->next;
+  change_feed_subscriber_free (p_subscriber);
+}
+
+/**
+ * Keeps a digest of every group of keys of the hash map.
+ * @return 1 on success, 0 otherwise.
+ */
+int hashmap_enable_digests (hashmap *hash_map, value_hash_func func,
+                            size_t num_of_groups){
+  if ((hash_map == NULL) || (func == NULL)){
+      return 0;
+  }
+  if (num_of_groups == 0){
+      num_of_groups = HASH_MAP_DIGEST_GROUPS;
+  }
+  size_t groups = 1;
+  while (groups < num_of_groups){
+      groups *= 2;
+  }
+  size_t* digests = malloc (sizeof (size_t) * groups);
+  if (digests == NULL){
+      return 0;
+  }
+  free (hash_map->digests);
+  hash_map->digests = digests;
+  hash_map->digest_groups = groups;
+  hash_map->value_hash = func;
+  compute_digests (hash_map);
+  return 1;
+}
+
+/**
+ * Disables (and frees) the digests of the hash map.
+ */
+void hashmap_disable_digests (hashmap *hash_map){
+  if (hash_map == NULL){
+      return;
+  }
+  free (hash_map->digests);
+  hash_map->digests = NULL;
+  hash_map->digest_groups = 0;
+  hash_map->value_hash = NULL;
+}
+
+/*
+ * @struct diff_state
+ * A diff in progress: the pairs of one map are looked up in other.
+ * @param first 1 while the pairs of map_a are visited, 0 for map_b.
+ */
+typedef struct diff_state {
+    const hashmap* other;
+    int first;
+    hashmap_diff_func func;
+    void* arg;
+    long count;
+} diff_state;
+
+/*
+ * Looks up in_pair in the other map of the diff. Keys in both maps are
+ * reported while map_a is visited, so each differing key is reported once.
+ */
+void diff_pair(diff_state* state, const pair* in_pair){
+  const_valueT other = hashmap_at (state->other, in_pair->key);
+  const_valueT value_a = state->first ? in_pair->value : other;
+  const_valueT value_b = state->first ? other : in_pair->value;
+  if ((state->first && (other != NULL)
+       && (in_pair->value_cmp (in_pair->value, other) == 1))
+      || (!state->first && (other != NULL))){
+      return;
+  }
+  state->count++;
+  if (state->func != NULL){
+      state->func (in_pair->key, value_a, value_b, state->arg);
+  }
+}
+
+/*
+ * Calls diff_pair on every pair of group group (of num_of_groups) of the
+ * hash map: the buckets group, group + num_of_groups, ... if the map has
+ * more buckets than groups, or the part of bucket group that is in it.
+ */
+void diff_group(const hashmap* hash_map, size_t group, size_t num_of_groups,
+                diff_state* state){
+  size_t mask = num_of_groups - 1;
+  if (hash_map->buckets == NULL){
+      for (size_t  i = 0; i < hash_map->size; ++i)
+        {
+          if ((hash_map->small_hashes[i] & mask) == group){
+              diff_pair (state, hash_map->small_pairs[i]);
+          }
+        }
+      return;
+  }
+  if (hash_map->capacity >= num_of_groups){
+      for (size_t  i = group; i < hash_map->capacity; i += num_of_groups)
+        {
+          for (size_t  j = 0; j < hash_map->buckets[i]->size; ++j)
+            {
+              diff_pair (state, hash_map->buckets[i]->data[j]);
+            }
+        }
+      return;
+  }
+  vector* vec = hash_map->buckets[group & (hash_map->capacity - 1)];
+  for (size_t  j = 0; j < vec->size; ++j)
+    {
+      pair* cur_pair = (pair*)vec->data[j];
+      if ((hashmap_seeded_hash (hash_map, cur_pair->key) & mask) == group){
+          diff_pair (state, cur_pair);
+      }
+    }
+}
+
+/**
+ * Finds the keys whose pairs differ between two maps.
+ * @return the number of differing keys, -1 if the function failed.
+ */
+long hashmap_diff (const hashmap *map_a, const hashmap *map_b,
+                   hashmap_diff_func func, void *arg, size_t *groups_visited){
+  if ((map_a == NULL) || (map_b == NULL)){
+      return -1;
+  }
+  int by_digests = (map_a->digests != NULL) && (map_b->digests != NULL)
+                   && (map_a->digest_groups == map_b->digest_groups)
+                   && (map_a->seed == map_b->seed);
+  size_t num_of_groups = by_digests ? map_a->digest_groups : 1;
+  size_t visited = 0;
+  diff_state state = {NULL, 0, func, arg, 0};
+  for (size_t  group = 0; group < num_of_groups; ++group)
+    {
+      if (by_digests && (map_a->digests[group] == map_b->digests[group])){
+          continue;
+      }
+      visited++;
+      state.other = map_b;
+      state.first = 1;
+      diff_group (map_a, group, num_of_groups, &state);
+      state.other = map_a;
+      state.first = 0;
+      diff_group (map_b, group, num_of_groups, &state);
+    }
+  if (groups_visited != NULL){
+      *groups_visited = visited;
+  }
+  return state.count;
+}
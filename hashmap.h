@@ -4,6 +4,9 @@
 #include <stdlib.h>
 #include "vector.h"
 #include "pair.h"
+#include "bloom_filter.h"
+#include "huge_pages.h"
+#include "change_feed.h"
 
 /**
  * @def HASH_MAP_INITIAL_CAP
@@ -41,6 +44,51 @@
  */
 #define HASH_MAP_MAX_LOAD_FACTOR 0.75
 
+/**
+ * @def HASH_MAP_PARALLEL_RESIZE_MIN
+ * The default minimal number of pairs for a resize to be split between
+ * threads (when the map has more than one resize thread, see
+ * hashmap_set_resize_threads).
+ */
+#define HASH_MAP_PARALLEL_RESIZE_MIN (1UL << 16)
+
+/**
+ * @def HASH_MAP_SMALL_MAX
+ * A new hash map keeps up to this many pairs in an array inside the hashmap
+ * struct, searched linearly, and allocates its buckets only when a pair is
+ * added beyond it (or when a function needs the buckets, e.g.
+ * hashmap_snapshot). The capacity still follows the load factors, as if
+ * the buckets existed.
+ */
+#define HASH_MAP_SMALL_MAX 8UL
+
+/**
+ * @def HASH_MAP_TREEIFY_THRESHOLD
+ * A bucket with more pairs than this is kept sorted by the seeded hashes of
+ * its keys, so it is binary searched instead of scanned (a bucket that
+ * shrinks back is scanned again). With a random seed per map a bucket only
+ * gets this long if the hash function itself collides, or by bad luck.
+ * Keys whose hash_func values are equal also have equal seeded hashes, so
+ * the run of them in a sorted bucket is still scanned key by key.
+ */
+#define HASH_MAP_TREEIFY_THRESHOLD 8UL
+
+/**
+ * @def HASH_MAP_MERGE_KEEP, HASH_MAP_MERGE_OVERWRITE, HASH_MAP_MERGE_COMBINE
+ * Conflict policies of hashmap_merge and hashmap_move_all, for keys that
+ * are in both maps: keep the destination's value, overwrite it with the
+ * source's value, or combine the source's value into it.
+ */
+#define HASH_MAP_MERGE_KEEP 0
+#define HASH_MAP_MERGE_OVERWRITE 1
+#define HASH_MAP_MERGE_COMBINE 2
+
+/**
+ * @def HASH_MAP_DIGEST_GROUPS
+ * The default number of digest groups (see hashmap_enable_digests).
+ */
+#define HASH_MAP_DIGEST_GROUPS 4096UL
+
 /**
  * @typedef hash_func
  * This type of function receives a keyT and returns
@@ -64,20 +112,141 @@ typedef int (*keyT_func) (const_keyT);
  */
 typedef void (*valueT_func) (valueT);
 
+/**
+ * @typedef valueT_combine_func
+ * A function that combines the second value into the first, in-place
+ * (e.g. adds it). Used by the HASH_MAP_MERGE_COMBINE policy.
+ */
+typedef void (*valueT_combine_func) (valueT, const_valueT);
+
+/**
+ * @typedef pair_size_func
+ * A function that returns the bytes a stored key and value occupy on the
+ * heap (e.g. sizeof (int) + sizeof (float)), used by the memory accounting.
+ */
+typedef size_t (*pair_size_func) (const_keyT, const_valueT);
+
+/**
+ * @typedef value_hash_func
+ * A function that "hashes" values, used by the digests of the map (equal
+ * values must get equal hashes).
+ */
+typedef size_t (*value_hash_func) (const_valueT);
+
+/**
+ * @typedef hashmap_diff_func
+ * Receives a key whose pairs differ between two maps, with its value in the
+ * first map and in the second (NULL where the key is missing).
+ */
+typedef void (*hashmap_diff_func) (const_keyT, const_valueT, const_valueT,
+                                   void *);
+
 /**
  * @struct hashmap
- * @param buckets dynamic array of vectors which stores the values.
+ * @param buckets dynamic array of vectors which stores the values, NULL
+ * while the pairs are in small_pairs.
  * @param size the number of elements (pairs) stored in the hash map.
  * @param capacity the number of buckets in the hash map.
  * @param hash_func a function which "hashes" keys.
+ * @param filter optional Bloom filter of the keys, NULL if disabled.
+ * @param buckets_refs the number of maps sharing the buckets array (see
+ * hashmap_snapshot), NULL if the array was never shared.
+ * @param resize_threads the number of threads a resize may use.
+ * @param parallel_resize_min the minimal size for a multi threaded resize.
+ * @param huge_pages 1 if the buckets array should come from huge pages.
+ * @param size_func measures the payload of a pair, NULL if not measured.
+ * @param payload_bytes the sum of size_func over the pairs.
+ * @param bucket_slots the sum of the data capacities of the buckets.
+ * @param compact_cursor the next bucket of an incremental compaction.
+ * @param seed mixed into the hashes of the keys (see hashmap_set_seed).
+ * @param small_pairs, small_hashes the pairs of a map without buckets, and
+ * the seeded hashes of their keys (compared before the keys).
+ * @param digests, digest_groups, value_hash the digest of every group of
+ * keys, NULL if disabled (see hashmap_enable_digests).
+ * @param subscribers the subscribers of the change feed, NULL if none.
+ * @param change_seq the number of changes published to the change feed.
  */
 typedef struct hashmap {
     vector **buckets;
     size_t size;
     size_t capacity; // num of buckets
     hash_func hash_func;
+    bloom_filter *filter;
+    size_t *buckets_refs;
+    size_t resize_threads;
+    size_t parallel_resize_min;
+    int huge_pages;
+    pair_size_func size_func;
+    size_t payload_bytes;
+    size_t bucket_slots;
+    size_t compact_cursor;
+    size_t seed;
+    pair *small_pairs[HASH_MAP_SMALL_MAX];
+    size_t small_hashes[HASH_MAP_SMALL_MAX];
+    size_t *digests;
+    size_t digest_groups;
+    value_hash_func value_hash;
+    change_feed_subscriber *subscribers;
+    size_t change_seq;
 } hashmap;
 
+/**
+ * @struct hashmap_filter_stats
+ * @param lookups the number of lookups that queried the filter.
+ * @param negatives lookups the filter answered as definitely absent.
+ * @param false_positives lookups that passed the filter but missed.
+ * @param observed_fpr false_positives / (false_positives + negatives).
+ * @param estimated_fpr the expected false positive rate of the filter.
+ * @param filter_bytes the memory of the filter bit array.
+ */
+typedef struct hashmap_filter_stats {
+    size_t lookups;
+    size_t negatives;
+    size_t false_positives;
+    double observed_fpr;
+    double estimated_fpr;
+    size_t filter_bytes;
+} hashmap_filter_stats;
+
+/**
+ * @struct hashmap_huge_page_stats
+ * @param requested 1 if huge pages were requested (hashmap_set_huge_pages).
+ * @param kind how the buckets array was obtained: HUGE_PAGES_NONE,
+ * HUGE_PAGES_TRANSPARENT or HUGE_PAGES_EXPLICIT (small arrays always come
+ * from malloc, see HUGE_PAGES_MIN_BYTES).
+ * @param bucket_bytes the size of the buckets array.
+ * @param huge_page_bytes the bytes of the array actually backed by huge
+ * pages.
+ */
+typedef struct hashmap_huge_page_stats {
+    int requested;
+    int kind;
+    size_t bucket_bytes;
+    size_t huge_page_bytes;
+} hashmap_huge_page_stats;
+
+/**
+ * @struct hashmap_memory_usage
+ * @param table_bytes the hashmap struct, its buckets array and its digests.
+ * @param bucket_bytes the vector structs of the buckets and their used
+ * data slots.
+ * @param slack_bytes the unused data slots of the buckets.
+ * @param entry_bytes the pair structs.
+ * @param payload_bytes the keys and values, as measured by the map's
+ * pair_size_func (0 without one).
+ * @param filter_bytes the Bloom filter, if enabled.
+ * @param total_bytes the sum of all the above.
+ */
+typedef struct hashmap_memory_usage {
+    size_t table_bytes;
+    size_t bucket_bytes;
+    size_t slack_bytes;
+    size_t entry_bytes;
+    size_t payload_bytes;
+    size_t filter_bytes;
+    size_t total_bytes;
+} hashmap_memory_usage;
+
 /**
  * Allocates dynamically new hash map element.
  * @param func a function which "hashes" keys.
@@ -141,4 +310,263 @@ double hashmap_get_load_factor (const hashmap *hash_map);
  * @return number of changed values
  */
 int hashmap_apply_if (const hashmap *hash_map, keyT_func keyT_func, valueT_func valT_func);//const
+
+/**
+ * Erases every pair whose key meets keyT_func, in one sweep over the
+ * buckets: each bucket is compacted in place, the size is updated once and
+ * the map is shrunk at most once, at the end (to the smallest capacity, down
+ * to HASH_MAP_INITIAL_CAP, whose load factor is above
+ * HASH_MAP_MIN_LOAD_FACTOR). The buckets keep their memory, see
+ * hashmap_compact.
+ * @param hash_map a hashmap
+ * @param keyT_func a function that checks a condition on keyT and return 1 if true, 0 else
+ * @return number of erased pairs
+ */
+size_t hashmap_erase_if (hashmap *hash_map, keyT_func keyT_func);
+
+/**
+ * Lets resizes of large maps run on several threads. The old buckets are
+ * split into ranges such that no two threads write to the same new bucket
+ * (when growing, old bucket i only feeds new buckets i + k * old_capacity,
+ * when shrinking every thread owns a range of new buckets), so the threads
+ * never contend.
+ * @param hash_map a hash map.
+ * @param num_threads the number of threads, 1 for single threaded resizes.
+ * @param min_size resizes of maps with less pairs stay single threaded,
+ * 0 for HASH_MAP_PARALLEL_RESIZE_MIN.
+ * @return 1 on success, 0 otherwise.
+ */
+int hashmap_set_resize_threads (hashmap *hash_map, size_t num_threads,
+                                size_t min_size);
+
+/**
+ * Allocates the buckets array of the hash map (now and after every resize)
+ * from 2 MiB pages. Explicit huge pages are tried first, then transparent
+ * huge pages, and malloc if neither is available (see huge_pages.h).
+ * Only that flat array moves: the bucket vectors, their data arrays and the
+ * pairs are still allocated one by one from malloc, so a random lookup in a
+ * large map saves the TLB miss on its bucket pointer but not the misses on
+ * the vector, its data and the pair.
+ * @param hash_map a hash map.
+ * @param enable 1 to use huge pages, 0 to go back to malloc.
+ * @return 1 on success, 0 otherwise (the map is then unchanged).
+ */
+int hashmap_set_huge_pages (hashmap *hash_map, int enable);
+
+/**
+ * Reports whether the buckets array of the hash map got huge pages.
+ * @param hash_map a hash map.
+ * @param stats filled with the statistics.
+ * @return 1 on success, 0 otherwise.
+ */
+int hashmap_get_huge_page_stats (const hashmap *hash_map,
+                                 hashmap_huge_page_stats *stats);
+
+/**
+ * Grows the hash map so that it holds num_of_pairs pairs below
+ * HASH_MAP_MAX_LOAD_FACTOR, so inserting up to num_of_pairs pairs
+ * does not resize it.
+ * @param hash_map a hash map.
+ * @param num_of_pairs the number of pairs the map should hold.
+ * @return 1 on success, 0 otherwise.
+ */
+int hashmap_reserve (hashmap *hash_map, size_t num_of_pairs);
+
+/**
+ * Inserts copies of all the pairs of src into dest. dest is resized once,
+ * up front, for both maps.
+ * @param dest the hash map to merge into.
+ * @param src the hash map to merge from (unchanged).
+ * @param policy HASH_MAP_MERGE_KEEP, HASH_MAP_MERGE_OVERWRITE or
+ * HASH_MAP_MERGE_COMBINE, for keys that are in both maps.
+ * @param combine the combine function of HASH_MAP_MERGE_COMBINE (else NULL).
+ * @return 1 on success, 0 otherwise (dest may hold some of the pairs).
+ */
+int hashmap_merge (hashmap *dest, const hashmap *src, int policy,
+                   valueT_combine_func combine);
+
+/**
+ * Like hashmap_merge, but consumes src: its pairs are moved into dest
+ * instead of copied, and src is left empty.
+ * @return 1 on success, 0 otherwise (every pair is then in exactly one of
+ * the maps).
+ */
+int hashmap_move_all (hashmap *dest, hashmap *src, int policy,
+                      valueT_combine_func combine);
+
+/**
+ * Takes a point in time snapshot of the hash map in O(1).
+ * The snapshot shares the buckets array and the buckets of hash_map, and
+ * both maps copy a shared bucket (and, once, the array of bucket pointers)
+ * before they modify it, so neither sees the other's later changes.
+ * Free the snapshot with hashmap_free, in any order relative to hash_map.
+ * Reference counts are atomic, so a snapshot may be read and freed in
+ * another thread while hash_map keeps changing. Values returned by
+ * hashmap_at may be shared with a snapshot and must not be modified in
+ * place while the snapshot lives (hashmap_apply_if copies them first).
+ * The snapshot does not get a copy of the Bloom filter nor the subscribers
+ * of the change feed; it gets a copy of the digests, so it can be diffed.
+ * @param hash_map a hash map.
+ * @return a dynamically allocated snapshot, NULL on failure.
+ */
+hashmap *hashmap_snapshot (hashmap *hash_map);
+
+/**
+ * Enables a blocked Bloom filter in front of the hash map, so lookups of
+ * absent keys are usually answered from one cache line without touching the
+ * buckets. The filter is rebuilt automatically when the map outgrows it or
+ * when erased keys make up more than half of its keys.
+ * @param hash_map a hash map.
+ * @param bits_per_key filter bits per key, 0 for BLOOM_DEFAULT_BITS_PER_KEY.
+ * @return 1 on success, 0 otherwise.
+ */
+int hashmap_enable_filter (hashmap *hash_map, size_t bits_per_key);
+
+/**
+ * Disables (and frees) the Bloom filter of the hash map.
+ * @param hash_map a hash map.
+ */
+void hashmap_disable_filter (hashmap *hash_map);
+
+/**
+ * Reports the Bloom filter statistics of the hash map.
+ * @param hash_map a hash map.
+ * @param stats filled with the statistics.
+ * @return 1 on success, 0 if the map has no filter.
+ */
+int hashmap_get_filter_stats (const hashmap *hash_map,
+                              hashmap_filter_stats *stats);
+
+/**
+ * Sets the function that measures the key and value payload of a pair
+ * (walks the map once, the payload is then maintained on every change).
+ * @param hash_map a hash map.
+ * @param func the function, NULL to stop measuring payloads.
+ * @return 1 on success, 0 otherwise.
+ */
+int hashmap_set_payload_size_func (hashmap *hash_map, pair_size_func func);
+
+/**
+ * Reports the memory used by the hash map, broken down by kind. Every
+ * counter is maintained incrementally, so this is O(1).
+ * Buckets shared with snapshots are counted in full by every map.
+ * @param hash_map a hash map.
+ * @param usage filled with the byte counts.
+ * @return 1 on success, 0 otherwise.
+ */
+int hashmap_get_memory_usage (const hashmap *hash_map,
+                              hashmap_memory_usage *usage);
+
+/**
+ * Compacts the hash map after mass deletion: every bucket is shrunk to fit
+ * and the freed memory is returned to the operating system (malloc_trim,
+ * with glibc). Only the slack of the buckets is released: the pairs are
+ * not moved, so values returned by hashmap_at stay valid, and the pairs
+ * left by the deletion stay where they were allocated.
+ * Buckets shared with a snapshot are left as they are.
+ * @param hash_map a hash map.
+ * @return 1 on success, 0 otherwise (the map stays valid).
+ */
+int hashmap_compact (hashmap *hash_map);
+
+/**
+ * Incremental hashmap_compact: compacts the next num_of_buckets buckets of
+ * the current pass, so the work can be spread between other operations.
+ * Insertions, erasures and resizes in between are allowed.
+ * @param hash_map a hash map.
+ * @param num_of_buckets the number of buckets to compact.
+ * @return 1 if buckets are left in the pass, 0 once it is complete (the
+ * next call starts a new pass), -1 on failure.
+ */
+int hashmap_compact_step (hashmap *hash_map, size_t num_of_buckets);
+
+/**
+ * Sets the seed the hash map mixes into the hashes of its keys, and rehashes
+ * it. hashmap_alloc picks a random seed for every map, so keys whose
+ * hashes differ but fall into the same bucket of one map do not share a
+ * bucket of another; a fixed seed makes the placement of the keys
+ * reproducible. The seed is mixed into the result of hash_func, so keys
+ * with equal hash_func values collide under every seed: keys from an
+ * untrusted source need a keyed hash function.
+ * @param hash_map a hash map.
+ * @param seed the new seed.
+ * @return 1 on success, 0 otherwise (the map keeps its seed).
+ */
+int hashmap_set_seed (hashmap *hash_map, size_t seed);
+
+/**
+ * Returns the seeded hash of key in the hash map: its bucket is this hash
+ * modulo the capacity.
+ */
+size_t hashmap_seeded_hash (const hashmap *hash_map, const_keyT key);
+
+/**
+ * Returns a new random seed derived from the process wide secret (from
+ * /dev/urandom) the seeds of the maps come from, different on every call.
+ * Two of them make the key of strkey_hash_keyed.
+ */
+size_t hashmap_random_seed (void);
+
+/**
+ * Subscribes to the change feed of the hash map (see change_feed.h): every
+ * insertion, update (hashmap_apply_if, hashmap_merge and hashmap_move_all)
+ * and erasure from now on is published to the subscriber, which drains the
+ * events with change_feed_drain from any one thread. Values modified in
+ * place through the pointers hashmap_at returns are not seen.
+ * Subscribing and unsubscribing are done by the thread modifying the map.
+ * @param hash_map a hash map.
+ * @param capacity the events the subscriber can hold undrained (0 for
+ * CHANGE_FEED_DEFAULT_CAP, at most CHANGE_FEED_MAX_CAP), the rest are
+ * dropped.
+ * @return pointer to dynamically allocated subscriber, freed by
+ * hashmap_unsubscribe or hashmap_free.
+ * @if_fail return NULL.
+ */
+change_feed_subscriber *hashmap_subscribe (hashmap *hash_map, size_t capacity);
+
+/**
+ * Removes a subscriber from the change feed of the hash map and frees it
+ * (its consumer must be done with it).
+ * @param hash_map a hash map.
+ * @param p_subscriber pointer to dynamically allocated pointer to subscriber.
+ */
+void hashmap_unsubscribe (hashmap *hash_map,
+                          change_feed_subscriber **p_subscriber);
+
+/**
+ * Keeps a digest of every group of keys of the hash map: the keys are
+ * split into num_of_groups groups by their seeded hashes, and the digest of
+ * a group is the sum of a hash of every pair in it (key and value), updated
+ * on every change, like the payload bytes. hashmap_diff compares the
+ * digests of two maps first and visits only the groups that differ.
+ * @param hash_map a hash map.
+ * @param func a function that "hashes" values.
+ * @param num_of_groups the number of groups, rounded up to a power of 2
+ * (HASH_MAP_DIGEST_GROUPS if 0).
+ * @return 1 on success, 0 otherwise.
+ */
+int hashmap_enable_digests (hashmap *hash_map, value_hash_func func,
+                            size_t num_of_groups);
+
+/**
+ * Disables (and frees) the digests of the hash map.
+ * @param hash_map a hash map.
+ */
+void hashmap_disable_digests (hashmap *hash_map);
+
+/**
+ * Finds the keys whose pairs differ between two maps: keys in one map only,
+ * and keys whose values differ (by the value_cmp of the pairs of map_a).
+ * If both maps have digests with the same number of groups and the same
+ * seed (hashmap_set_seed), only the groups whose digests differ are
+ * visited, otherwise every pair is.
+ * @param map_a, map_b hash maps.
+ * @param func called for every differing key, NULL to only count them.
+ * @param arg the last argument of func.
+ * @param groups_visited set to the number of groups visited (1 if the maps
+ * were compared pair by pair), may be NULL.
+ * @return the number of differing keys, -1 if the function failed.
+ */
+long hashmap_diff (const hashmap *map_a, const hashmap *map_b,
+                   hashmap_diff_func func, void *arg, size_t *groups_visited);
 #endif //HASHMAP_H_
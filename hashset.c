@@ -0,0 +1,356 @@
+#include "hashset.h"
+#include "bucket.h"
+
+/*
+ * Returns how the buckets of hash_set see their keys.
+ */
+static bucket_keys keys_of (const hashset *hash_set)
+{
+  bucket_keys keys = {hash_set->hash_func, hash_set->seed, hash_set->key_cmp};
+  return keys;
+}
+
+/*
+ * Allocates an array of new_capacity empty vectors, NULL on failure.
+ */
+static vector **alloc_buckets (const hashset *hash_set, size_t new_capacity)
+{
+  vector **buckets = malloc (sizeof (vector *) * new_capacity);
+  if (buckets == NULL){
+      return NULL;
+  }
+  for (size_t i = 0; i < new_capacity; ++i)
+    {
+      buckets[i] = vector_alloc (hash_set->key_cpy, hash_set->key_cmp,
+                                 hash_set->key_free);
+      if (buckets[i] == NULL){
+          for (size_t j = 0; j < i; ++j)
+            {
+              vector_free (&(buckets[j]));
+            }
+          free (buckets);
+          return NULL;
+      }
+    }
+  return buckets;
+}
+
+/*
+ * Moves every key to a new array of new_capacity vectors. The keys
+ * themselves are moved, not copied. Returns 1 on success, 0 otherwise.
+ */
+static int resize (hashset *hash_set, size_t new_capacity)
+{
+  vector **new_buckets = alloc_buckets (hash_set, new_capacity);
+  if (new_buckets == NULL){
+      return 0;
+  }
+  bucket_keys keys = keys_of (hash_set);
+  for (size_t i = 0; i < hash_set->capacity; ++i)
+    {
+      vector *vec = hash_set->buckets[i];
+      for (size_t j = 0; j < vec->size; ++j)
+        {
+          size_t hash = bucket_seed_hash (&keys,
+                                          hash_set->hash_func (vec->data[j]));
+          if (bucket_push (&keys, new_buckets[hash & (new_capacity - 1)],
+                           vec->data[j], hash, 1) == 0){
+              for (size_t k = 0; k < new_capacity; ++k)
+                {
+                  new_buckets[k]->size = 0; // keys still owned by the old buckets.
+                  vector_free (&(new_buckets[k]));
+                }
+              free (new_buckets);
+              return 0;
+          }
+        }
+    }
+  for (size_t i = 0; i < hash_set->capacity; ++i)
+    {
+      hash_set->buckets[i]->size = 0; // keys were moved.
+      vector_free (&(hash_set->buckets[i]));
+    }
+  free (hash_set->buckets);
+  hash_set->buckets = new_buckets;
+  hash_set->capacity = new_capacity;
+  return 1;
+}
+
+/*
+ * Inserts a copy of a key known not to be in the set.
+ */
+static int insert_unique (hashset *hash_set, const_keyT key)
+{
+  if (hashset_get_load_factor (hash_set) >= HASH_MAP_MAX_LOAD_FACTOR){
+      if (resize (hash_set, hash_set->capacity * HASH_MAP_GROWTH_FACTOR) == 0){
+          return 0;
+      }
+  }
+  bucket_keys keys = keys_of (hash_set);
+  size_t hash = bucket_seed_hash (&keys, hash_set->hash_func (key));
+  if (bucket_push (&keys, hash_set->buckets[hash & (hash_set->capacity - 1)],
+                   key, hash, 0) == 0){
+      return 0;
+  }
+  hash_set->size += 1;
+  return 1;
+}
+
+/**
+ * Allocates dynamically new hash set.
+ * @return pointer to dynamically allocated hashset.
+ * @if_fail return NULL.
+ */
+hashset *hashset_alloc (hash_func func, pair_key_cpy key_cpy,
+                        pair_key_cmp key_cmp, pair_key_free key_free)
+{
+  if ((func == NULL) || (key_cpy == NULL) || (key_cmp == NULL)
+      || (key_free == NULL)){
+      return NULL;
+  }
+  hashset *hash_set = malloc (sizeof (hashset));
+  if (hash_set == NULL){
+      return NULL;
+  }
+  hash_set->size = 0;
+  hash_set->capacity = HASH_MAP_INITIAL_CAP;
+  hash_set->hash_func = func;
+  hash_set->seed = hashmap_random_seed ();
+  hash_set->key_cpy = key_cpy;
+  hash_set->key_cmp = key_cmp;
+  hash_set->key_free = key_free;
+  hash_set->buckets = alloc_buckets (hash_set, hash_set->capacity);
+  if (hash_set->buckets == NULL){
+      free (hash_set);
+      return NULL;
+  }
+  return hash_set;
+}
+
+/**
+ * Frees a hash set and the keys it holds.
+ * @param p_hash_set pointer to dynamically allocated pointer to hash_set.
+ */
+void hashset_free (hashset **p_hash_set)
+{
+  if ((p_hash_set == NULL) || (*p_hash_set == NULL)){
+      return;
+  }
+  for (size_t i = 0; i < (*p_hash_set)->capacity; ++i)
+    {
+      vector_free (&((*p_hash_set)->buckets[i]));
+    }
+  free ((*p_hash_set)->buckets);
+  free (*p_hash_set);
+  *p_hash_set = NULL;
+}
+
+/**
+ * Grows the set so that it can hold num_of_keys keys without resizing.
+ * @return 1 on success, 0 otherwise.
+ */
+int hashset_reserve (hashset *hash_set, size_t num_of_keys)
+{
+  if (hash_set == NULL){
+      return 0;
+  }
+  size_t new_capacity = bucket_capacity_for (hash_set->capacity, num_of_keys);
+  if (new_capacity == 0){
+      return 0; // more keys than any bucket array can hold.
+  }
+  if (new_capacity == hash_set->capacity){
+      return 1;
+  }
+  return resize (hash_set, new_capacity);
+}
+
+/**
+ * Inserts a copy of key to the set.
+ * @return 1 for successful insertion, 0 otherwise.
+ */
+int hashset_insert (hashset *hash_set, const_keyT key)
+{
+  if ((hash_set == NULL) || (key == NULL)){
+      return 0;
+  }
+  if (hashset_contains (hash_set, key)){
+      return 0;
+  }
+  return insert_unique (hash_set, key);
+}
+
+/**
+ * @return 1 if key is in the set, 0 otherwise.
+ */
+int hashset_contains (const hashset *hash_set, const_keyT key)
+{
+  if ((hash_set == NULL) || (key == NULL)){
+      return 0;
+  }
+  bucket_keys keys = keys_of (hash_set);
+  size_t hash = bucket_seed_hash (&keys, hash_set->hash_func (key));
+  const vector *vec = hash_set->buckets[hash & (hash_set->capacity - 1)];
+  return bucket_find (&keys, vec, key, hash) != -1;
+}
+
+/**
+ * Checks the membership of n keys.
+ * @return the number of keys found in the set.
+ */
+size_t hashset_contains_batch (const hashset *hash_set, const const_keyT *keys,
+                               size_t n, int *results)
+{
+  if ((hash_set == NULL) || (keys == NULL) || (results == NULL)){
+      return 0;
+  }
+  size_t found = 0;
+  for (size_t i = 0; i < n; ++i)
+    {
+      results[i] = hashset_contains (hash_set, keys[i]);
+      found += results[i];
+    }
+  return found;
+}
+
+/**
+ * Erases key from the set.
+ * @return 1 if the erasing was done successfully, 0 otherwise.
+ */
+int hashset_erase (hashset *hash_set, const_keyT key)
+{
+  if ((hash_set == NULL) || (key == NULL)){
+      return 0;
+  }
+  if (hashset_contains (hash_set, key) == 0){
+      return 0;
+  }
+  if (hashset_get_load_factor (hash_set) <= HASH_MAP_MIN_LOAD_FACTOR){
+      if (resize (hash_set, hash_set->capacity / HASH_MAP_GROWTH_FACTOR) == 0){
+          return 0;
+      }
+  }
+  bucket_keys keys = keys_of (hash_set);
+  size_t hash = bucket_seed_hash (&keys, hash_set->hash_func (key));
+  vector *vec = hash_set->buckets[hash & (hash_set->capacity - 1)];
+  long ind = bucket_find (&keys, vec, key, hash);
+  if (vector_erase (vec, (size_t) ind) == 0){ // keeps the bucket's order.
+      return 0;
+  }
+  hash_set->size -= 1;
+  return 1;
+}
+
+/**
+ * This function returns the load factor of the hash set.
+ * @return the hash set's load factor, -1 if the function failed.
+ */
+double hashset_get_load_factor (const hashset *hash_set)
+{
+  if ((hash_set == NULL) || (hash_set->capacity == 0)){
+      return -1;
+  }
+  return (double) hash_set->size / hash_set->capacity;
+}
+
+/*
+ * Allocates an empty set with the functions of model, sized for
+ * num_of_keys keys.
+ */
+static hashset *alloc_like (const hashset *model, size_t num_of_keys)
+{
+  hashset *result = hashset_alloc (model->hash_func, model->key_cpy,
+                                   model->key_cmp, model->key_free);
+  if (result == NULL){
+      return NULL;
+  }
+  if (hashset_reserve (result, num_of_keys) == 0){
+      hashset_free (&result);
+  }
+  return result;
+}
+
+/*
+ * Copies into result every key of source whose membership in filter equals
+ * keep_if_member (every key of source if filter is NULL). The copied keys
+ * must not be in result already.
+ */
+static int copy_keys (hashset *result, const hashset *source,
+                      const hashset *filter, int keep_if_member)
+{
+  for (size_t i = 0; i < source->capacity; ++i)
+    {
+      const vector *vec = source->buckets[i];
+      for (size_t j = 0; j < vec->size; ++j)
+        {
+          const_keyT key = vec->data[j];
+          if ((filter != NULL)
+              && (hashset_contains (filter, key) != keep_if_member)){
+              continue;
+          }
+          if (insert_unique (result, key) == 0){
+              return 0;
+          }
+        }
+    }
+  return 1;
+}
+
+/**
+ * @return the keys in set_1 or in set_2.
+ */
+hashset *hashset_union (const hashset *set_1, const hashset *set_2)
+{
+  if ((set_1 == NULL) || (set_2 == NULL)){
+      return NULL;
+  }
+  const hashset *larger = (set_1->size >= set_2->size) ? set_1 : set_2;
+  const hashset *smaller = (larger == set_1) ? set_2 : set_1;
+  hashset *result = alloc_like (set_1, set_1->size + set_2->size);
+  if (result == NULL){
+      return NULL;
+  }
+  // the keys of the larger set are unique, only the smaller one is checked.
+  if ((copy_keys (result, larger, NULL, 1) == 0)
+      || (copy_keys (result, smaller, larger, 0) == 0)){
+      hashset_free (&result);
+  }
+  return result;
+}
+
+/**
+ * @return the keys in both set_1 and set_2 (iterates the smaller set).
+ */
+hashset *hashset_intersection (const hashset *set_1, const hashset *set_2)
+{
+  if ((set_1 == NULL) || (set_2 == NULL)){
+      return NULL;
+  }
+  const hashset *smaller = (set_1->size <= set_2->size) ? set_1 : set_2;
+  const hashset *larger = (smaller == set_1) ? set_2 : set_1;
+  hashset *result = alloc_like (set_1, smaller->size);
+  if (result == NULL){
+      return NULL;
+  }
+  if (copy_keys (result, smaller, larger, 1) == 0){
+      hashset_free (&result);
+  }
+  return result;
+}
+
+/**
+ * @return the keys in set_1 that are not in set_2.
+ */
+hashset *hashset_difference (const hashset *set_1, const hashset *set_2)
+{
+  if ((set_1 == NULL) || (set_2 == NULL)){
+      return NULL;
+  }
+  hashset *result = alloc_like (set_1, set_1->size);
+  if (result == NULL){
+      return NULL;
+  }
+  if (copy_keys (result, set_1, set_2, 0) == 0){
+      hashset_free (&result);
+  }
+  return result;
+}
@@ -0,0 +1,108 @@
+#ifndef HASHSET_H_
+#define HASHSET_H_
+
+#include <stdlib.h>
+#include "vector.h"
+#include "hashmap.h"
+
+/**
+ * @struct hashset
+ * A key only hash set, laid out like the hashmap (a dynamic array of
+ * vectors, with the same load and growth factors, seeded hashes and
+ * sorted long buckets of bucket.h), but every vector holds the keys
+ * themselves, so no value or pair is stored per entry.
+ * @param buckets dynamic array of vectors which stores the keys.
+ * @param size the number of keys stored in the set.
+ * @param capacity the number of buckets in the set.
+ * @param hash_func a function which "hashes" keys.
+ * @param seed mixed into the hashes of the keys, random for every set.
+ * @param key_cpy, key_cmp, key_free copy, compare and free functions of the keys.
+ */
+typedef struct hashset {
+    vector **buckets;
+    size_t size;
+    size_t capacity;
+    hash_func hash_func;
+    size_t seed;
+    pair_key_cpy key_cpy;
+    pair_key_cmp key_cmp;
+    pair_key_free key_free;
+} hashset;
+
+/**
+ * Allocates dynamically new hash set.
+ * @param func a function which "hashes" keys.
+ * @param key_cpy, key_cmp, key_free copy, compare and free functions of the keys.
+ * @return pointer to dynamically allocated hashset.
+ * @if_fail return NULL.
+ */
+hashset *hashset_alloc (hash_func func, pair_key_cpy key_cpy,
+                        pair_key_cmp key_cmp, pair_key_free key_free);
+
+/**
+ * Frees a hash set and the keys it holds.
+ * @param p_hash_set pointer to dynamically allocated pointer to hash_set.
+ */
+void hashset_free (hashset **p_hash_set);
+
+/**
+ * Grows the set so that it can hold num_of_keys keys without resizing.
+ * @return 1 on success, 0 otherwise.
+ */
+int hashset_reserve (hashset *hash_set, size_t num_of_keys);
+
+/**
+ * Inserts a copy of key to the set.
+ * @return 1 for successful insertion, 0 otherwise (also if the key is
+ * already in the set).
+ */
+int hashset_insert (hashset *hash_set, const_keyT key);
+
+/**
+ * @return 1 if key is in the set, 0 otherwise.
+ */
+int hashset_contains (const hashset *hash_set, const_keyT key);
+
+/**
+ * Checks the membership of n keys.
+ * @param results results[i] is set to 1 if keys[i] is in the set, 0 otherwise.
+ * @return the number of keys found in the set.
+ */
+size_t hashset_contains_batch (const hashset *hash_set, const const_keyT *keys,
+                               size_t n, int *results);
+
+/**
+ * Erases key from the set.
+ * @return 1 if the erasing was done successfully, 0 otherwise.
+ */
+int hashset_erase (hashset *hash_set, const_keyT key);
+
+/**
+ * This function returns the load factor of the hash set.
+ * @return the hash set's load factor, -1 if the function failed.
+ */
+double hashset_get_load_factor (const hashset *hash_set);
+
+/**
+ * The following functions return a new set (with the functions of set_1),
+ * sized once for the result. Both sets must hold the same key type.
+ * @return pointer to dynamically allocated hashset.
+ * @if_fail return NULL.
+ */
+
+/**
+ * @return the keys in set_1 or in set_2.
+ */
+hashset *hashset_union (const hashset *set_1, const hashset *set_2);
+
+/**
+ * @return the keys in both set_1 and set_2 (iterates the smaller set).
+ */
+hashset *hashset_intersection (const hashset *set_1, const hashset *set_2);
+
+/**
+ * @return the keys in set_1 that are not in set_2.
+ */
+hashset *hashset_difference (const hashset *set_1, const hashset *set_2);
+
+#endif //HASHSET_H_
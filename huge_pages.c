@@ -0,0 +1,167 @@
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdint.h>
+#include "huge_pages.h"
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+/*
+ * Every block starts with a header (padded to a cache line, so the data
+ * stays aligned) describing how to release it.
+ */
+typedef union block_header {
+    struct {
+        void *base;
+        size_t length;
+        int kind;
+    } info;
+    char padding[64];
+} block_header;
+
+static block_header *header_of (const void *ptr)
+{
+  return (block_header *) ptr - 1;
+}
+
+#if defined(__linux__)
+/*
+ * Maps length bytes, 0 if the mapping failed. For transparent huge pages
+ * the mapping is trimmed to a HUGE_PAGE_SIZE aligned start, so the kernel
+ * can back it with whole huge pages.
+ */
+static void *map_block (size_t length, int kind)
+{
+#ifdef MAP_HUGETLB
+  if (kind == HUGE_PAGES_EXPLICIT){
+      void *base = mmap (NULL, length, PROT_READ | PROT_WRITE,
+                         MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+      return (base == MAP_FAILED) ? NULL : base;
+  }
+#endif
+#ifdef MADV_HUGEPAGE
+  if (kind == HUGE_PAGES_TRANSPARENT){
+      char *raw = mmap (NULL, length + HUGE_PAGE_SIZE, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (raw == MAP_FAILED){
+          return NULL;
+      }
+      uintptr_t start = ((uintptr_t) raw + HUGE_PAGE_SIZE - 1)
+                        & ~(uintptr_t) (HUGE_PAGE_SIZE - 1);
+      char *base = (char *) start;
+      if (base != raw){
+          munmap (raw, (size_t) (base - raw));
+      }
+      size_t tail = (size_t) (raw + HUGE_PAGE_SIZE - base);
+      if (tail != 0){
+          munmap (base + length, tail);
+      }
+      if (madvise (base, length, MADV_HUGEPAGE) != 0){
+          munmap (base, length); // THP is not available.
+          return NULL;
+      }
+      return base;
+  }
+#endif
+  (void) length;
+  (void) kind;
+  return NULL;
+}
+#endif
+
+void *huge_pages_alloc (size_t size, int use_huge)
+{
+  size_t total = size + sizeof (block_header);
+  if (total < size){
+      return NULL;
+  }
+  block_header *header = NULL;
+#if defined(__linux__)
+  if (use_huge && (size >= HUGE_PAGES_MIN_BYTES)){
+      size_t length = (total + HUGE_PAGE_SIZE - 1) & ~(HUGE_PAGE_SIZE - 1);
+      for (int kind = HUGE_PAGES_EXPLICIT; (header == NULL) &&
+                                           (kind > HUGE_PAGES_NONE); --kind)
+        {
+          header = map_block (length, kind);
+          if (header != NULL){
+              header->info.base = header;
+              header->info.length = length;
+              header->info.kind = kind;
+          }
+        }
+  }
+#else
+  (void) use_huge;
+#endif
+  if (header == NULL){
+      header = malloc (total);
+      if (header == NULL){
+          return NULL;
+      }
+      header->info.base = header;
+      header->info.length = total;
+      header->info.kind = HUGE_PAGES_NONE;
+  }
+  return header + 1;
+}
+
+void huge_pages_free (void *ptr)
+{
+  if (ptr == NULL){
+      return;
+  }
+  block_header *header = header_of (ptr);
+  if (header->info.kind == HUGE_PAGES_NONE){
+      free (header->info.base);
+      return;
+  }
+#if defined(__linux__)
+  munmap (header->info.base, header->info.length);
+#endif
+}
+
+int huge_pages_kind (const void *ptr)
+{
+  if (ptr == NULL){
+      return HUGE_PAGES_NONE;
+  }
+  return header_of (ptr)->info.kind;
+}
+
+size_t huge_pages_backed (const void *ptr)
+{
+  if (ptr == NULL){
+      return 0;
+  }
+  block_header *header = header_of (ptr);
+  if (header->info.kind == HUGE_PAGES_EXPLICIT){
+      return header->info.length;
+  }
+  if (header->info.kind == HUGE_PAGES_NONE){
+      return 0;
+  }
+  FILE *smaps = fopen ("/proc/self/smaps", "r");
+  if (smaps == NULL){
+      return 0;
+  }
+  // the mapping may have been merged with its neighbours, so look for the
+  // one containing the block and cap its count at the block's length.
+  uintptr_t base = (uintptr_t) header->info.base;
+  char line[256];
+  int in_block = 0;
+  size_t backed = 0;
+  while (fgets (line, sizeof (line), smaps) != NULL)
+    {
+      unsigned long start, end, kbytes;
+      if (sscanf (line, "%lx-%lx ", &start, &end) == 2){
+          in_block = (start <= base) && (base < end);
+      }
+      else if (in_block
+               && (sscanf (line, "AnonHugePages: %lu kB", &kbytes) == 1)){
+          backed = (size_t) kbytes * 1024;
+          break;
+      }
+    }
+  fclose (smaps);
+  return (backed < header->info.length) ? backed : header->info.length;
+}
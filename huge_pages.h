@@ -0,0 +1,65 @@
+#ifndef HUGE_PAGES_H_
+#define HUGE_PAGES_H_
+
+#include <stdlib.h>
+
+/**
+ * Large arrays backed by 2 MiB pages, so random accesses into them need
+ * far fewer TLB entries.
+ * huge_pages_alloc first asks for explicit huge pages (MAP_HUGETLB, taken
+ * from the hugetlbfs pool), then for a 2 MiB aligned mapping advised with
+ * MADV_HUGEPAGE (transparent huge pages), and finally falls back to
+ * malloc. Every block records how it was obtained, so huge_pages_free and
+ * huge_pages_kind work on any of them.
+ */
+
+/**
+ * @def HUGE_PAGE_SIZE
+ * The size of a huge page.
+ */
+#define HUGE_PAGE_SIZE (2UL << 20)
+
+/**
+ * @def HUGE_PAGES_MIN_BYTES
+ * Smaller requests are always served by malloc, a huge page for them would
+ * mostly be wasted.
+ */
+#define HUGE_PAGES_MIN_BYTES (HUGE_PAGE_SIZE / 2)
+
+/**
+ * @def HUGE_PAGES_NONE, HUGE_PAGES_TRANSPARENT, HUGE_PAGES_EXPLICIT
+ * How a block was obtained: by malloc, by a mapping advised to use
+ * transparent huge pages (the kernel may still back parts of it with
+ * small pages, see huge_pages_backed), or from the hugetlbfs pool.
+ */
+#define HUGE_PAGES_NONE 0
+#define HUGE_PAGES_TRANSPARENT 1
+#define HUGE_PAGES_EXPLICIT 2
+
+/**
+ * Allocates size bytes.
+ * @param size the number of bytes.
+ * @param use_huge 0 to always use malloc.
+ * @return pointer to the block (aligned for any type), NULL on failure.
+ */
+void *huge_pages_alloc (size_t size, int use_huge);
+
+/**
+ * Frees a block of huge_pages_alloc, NULL is ignored.
+ */
+void huge_pages_free (void *ptr);
+
+/**
+ * @return how the block was obtained (HUGE_PAGES_NONE for NULL).
+ */
+int huge_pages_kind (const void *ptr);
+
+/**
+ * Returns the number of bytes of the block that are actually backed by
+ * huge pages: the whole mapping for explicit huge pages, the
+ * AnonHugePages of the mapping (read from /proc/self/smaps) for
+ * transparent ones, and 0 otherwise or if it cannot be determined.
+ */
+size_t huge_pages_backed (const void *ptr);
+
+#endif //HUGE_PAGES_H_
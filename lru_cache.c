@@ -0,0 +1,280 @@
+#include "lru_cache.h"
+
+/*
+ * Removes node from the recency list.
+ */
+static void list_remove (lru_cache *cache, lru_node *node)
+{
+  if (node->prev != NULL){
+      node->prev->next = node->next;
+  }
+  else{
+      cache->head = node->next;
+  }
+  if (node->next != NULL){
+      node->next->prev = node->prev;
+  }
+  else{
+      cache->tail = node->prev;
+  }
+  node->prev = NULL;
+  node->next = NULL;
+}
+
+/*
+ * Adds node to the front (most recently used) of the recency list.
+ */
+static void list_push_front (lru_cache *cache, lru_node *node)
+{
+  node->prev = NULL;
+  node->next = cache->head;
+  if (cache->head != NULL){
+      cache->head->prev = node;
+  }
+  cache->head = node;
+  if (cache->tail == NULL){
+      cache->tail = node;
+  }
+}
+
+/*
+ * Unlinks a node from the table and the list and frees it.
+ */
+static void remove_node (lru_cache *cache, lru_node *node)
+{
+  list_remove (cache, node);
+  entry_table_unlink (&(cache->table), &(node->base));
+  cache->bytes -= node->bytes;
+  entry_table_release_entry (&(node->base));
+  free (node);
+}
+
+/*
+ * Returns the bytes a node holding entry is charged.
+ */
+static size_t entry_bytes (const lru_cache *cache, const pair *entry)
+{
+  if (cache->size_func == NULL){
+      return sizeof (lru_node);
+  }
+  return cache->size_func (entry);
+}
+
+/*
+ * Evicts least recently used entries (never keep) while over budget.
+ */
+static void evict_over_budget (lru_cache *cache, const lru_node *keep)
+{
+  while ((cache->tail != NULL) && (cache->tail != keep)
+         && (((cache->max_entries != 0)
+              && (cache->table.size > cache->max_entries))
+             || ((cache->max_bytes != 0)
+                 && (cache->bytes > cache->max_bytes)))){
+      lru_node *victim = cache->tail;
+      if (cache->evict_func != NULL){
+          cache->evict_func (victim->base.entry.key, victim->base.entry.value,
+                             cache->evict_ctx);
+      }
+      remove_node (cache, victim);
+  }
+}
+
+/**
+ * Allocates dynamically a new cache.
+ * @return pointer to dynamically allocated cache.
+ * @if_fail (or if both limits are 0) return NULL.
+ */
+lru_cache *lru_cache_alloc (hash_func func, size_t max_entries,
+                            size_t max_bytes, lru_size_func size_func)
+{
+  if ((max_entries == 0) && (max_bytes == 0)){
+      return NULL;
+  }
+  lru_cache *cache = malloc (sizeof (lru_cache));
+  if (cache == NULL){
+      return NULL;
+  }
+  if (entry_table_init (&(cache->table), func) == 0){
+      free (cache);
+      return NULL;
+  }
+  cache->head = NULL;
+  cache->tail = NULL;
+  cache->max_entries = max_entries;
+  cache->max_bytes = max_bytes;
+  cache->bytes = 0;
+  cache->size_func = size_func;
+  cache->evict_func = NULL;
+  cache->evict_ctx = NULL;
+  return cache;
+}
+
+/**
+ * Frees a cache and all of its entries.
+ * @param p_cache pointer to dynamically allocated pointer to cache.
+ */
+void lru_cache_free (lru_cache **p_cache)
+{
+  if ((p_cache == NULL) || (*p_cache == NULL)){
+      return;
+  }
+  lru_node *cur = (*p_cache)->head;
+  while (cur != NULL){
+      lru_node *next = cur->next;
+      entry_table_release_entry (&(cur->base));
+      free (cur);
+      cur = next;
+  }
+  entry_table_destroy (&((*p_cache)->table));
+  free (*p_cache);
+  *p_cache = NULL;
+}
+
+/**
+ * Sets the function called on every eviction.
+ */
+void lru_cache_set_evict_func (lru_cache *cache, lru_evict_func func,
+                               void *ctx)
+{
+  if (cache == NULL){
+      return;
+  }
+  cache->evict_func = func;
+  cache->evict_ctx = ctx;
+}
+
+/*
+ * Replaces the value of an existing node with a copy of in_pair's value.
+ * Fails, keeping the old value, if the entry would be larger than the
+ * byte budget.
+ */
+static int replace_value (lru_cache *cache, lru_node *node,
+                          const pair *in_pair)
+{
+  pair replaced = node->base.entry;
+  replaced.value = in_pair->value_cpy (in_pair->value);
+  if (replaced.value == NULL){
+      return 0;
+  }
+  replaced.value_cpy = in_pair->value_cpy;
+  replaced.value_cmp = in_pair->value_cmp;
+  replaced.value_free = in_pair->value_free;
+  size_t new_bytes = entry_bytes (cache, &replaced);
+  if ((cache->max_bytes != 0) && (new_bytes > cache->max_bytes)){
+      replaced.value_free (&(replaced.value));
+      return 0;
+  }
+  node->base.entry.value_free (&(node->base.entry.value));
+  node->base.entry = replaced;
+  cache->bytes -= node->bytes;
+  node->bytes = new_bytes;
+  cache->bytes += node->bytes;
+  list_remove (cache, node);
+  list_push_front (cache, node);
+  return 1;
+}
+
+/**
+ * Inserts a copy of in_pair as the most recently used entry, evicting the
+ * least recently used entries while the cache is over budget.
+ * If the key is already in the cache its value is replaced.
+ * @return 1 for successful insertion, 0 otherwise.
+ */
+int lru_cache_insert (lru_cache *cache, const pair *in_pair)
+{
+  if ((cache == NULL) || (in_pair == NULL)){
+      return 0;
+  }
+  if ((in_pair->key == NULL) || (in_pair->value == NULL)){
+      return 0;
+  }
+  size_t hash = entry_table_hash (&(cache->table), in_pair->key);
+  table_entry *found = entry_table_find (&(cache->table), in_pair->key, hash);
+  if (found != NULL){
+      if (replace_value (cache, (lru_node *) found, in_pair) == 0){
+          return 0;
+      }
+      evict_over_budget (cache, (lru_node *) found);
+      return 1;
+  }
+  lru_node *node = malloc (sizeof (lru_node));
+  if (node == NULL){
+      return 0;
+  }
+  if (entry_table_set_entry (&(cache->table), &(node->base), in_pair) == 0){
+      free (node);
+      return 0;
+  }
+  node->bytes = entry_bytes (cache, &(node->base.entry));
+  if ((cache->max_bytes != 0) && (node->bytes > cache->max_bytes)){
+      entry_table_release_entry (&(node->base));
+      free (node);
+      return 0;
+  }
+  if (entry_table_link (&(cache->table), &(node->base)) == 0){
+      entry_table_release_entry (&(node->base));
+      free (node);
+      return 0;
+  }
+  cache->bytes += node->bytes;
+  list_push_front (cache, node);
+  evict_over_budget (cache, node);
+  return 1;
+}
+
+/**
+ * Returns the value associated with key and marks the entry as the
+ * most recently used.
+ * @return the value (not a copy of it) if exists, NULL otherwise.
+ */
+valueT lru_cache_at (lru_cache *cache, const_keyT key)
+{
+  if ((cache == NULL) || (key == NULL)){
+      return NULL;
+  }
+  lru_node *node = (lru_node *) entry_table_find
+      (&(cache->table), key, entry_table_hash (&(cache->table), key));
+  if (node == NULL){
+      return NULL;
+  }
+  if (node != cache->head){
+      list_remove (cache, node);
+      list_push_front (cache, node);
+  }
+  return node->base.entry.value;
+}
+
+/**
+ * Returns the value associated with key without changing its recency.
+ * @return the value (not a copy of it) if exists, NULL otherwise.
+ */
+valueT lru_cache_peek (const lru_cache *cache, const_keyT key)
+{
+  if ((cache == NULL) || (key == NULL)){
+      return NULL;
+  }
+  size_t hash = entry_table_hash (&(cache->table), key);
+  table_entry *found = entry_table_find (&(cache->table), key, hash);
+  if (found == NULL){
+      return NULL;
+  }
+  return found->entry.value;
+}
+
+/**
+ * Erases the entry associated with key.
+ * @return 1 if the erasing was done successfully, 0 otherwise.
+ */
+int lru_cache_erase (lru_cache *cache, const_keyT key)
+{
+  if ((cache == NULL) || (key == NULL)){
+      return 0;
+  }
+  size_t hash = entry_table_hash (&(cache->table), key);
+  table_entry *found = entry_table_find (&(cache->table), key, hash);
+  if (found == NULL){
+      return 0;
+  }
+  remove_node (cache, (lru_node *) found);
+  return 1;
+}
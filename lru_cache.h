@@ -0,0 +1,113 @@
+#ifndef LRU_CACHE_H_
+#define LRU_CACHE_H_
+
+#include <stdlib.h>
+#include "entry_table.h"
+
+/**
+ * @typedef lru_evict_func
+ * Called with the key and value of an entry right before the cache evicts
+ * it to stay within its budget (not called on lru_cache_erase / free).
+ * The key and value are freed after the call returns.
+ */
+typedef void (*lru_evict_func) (const_keyT, valueT, void *);
+
+/**
+ * @typedef lru_size_func
+ * Returns the number of bytes an entry is charged against the byte budget.
+ */
+typedef size_t (*lru_size_func) (const pair *);
+
+/**
+ * @struct lru_node
+ * A cache entry, linked both to the table and to the recency list.
+ * @param base the table entry (must be the first member).
+ * @param prev, next neighbours in the recency list (prev is more recent).
+ * @param bytes the bytes charged for this entry.
+ */
+typedef struct lru_node {
+    table_entry base;
+    struct lru_node *prev;
+    struct lru_node *next;
+    size_t bytes;
+} lru_node;
+
+/**
+ * @struct lru_cache
+ * @param table the entries, by key.
+ * @param head, tail most and least recently used entries.
+ * @param max_entries entry budget, 0 for no entry budget.
+ * @param max_bytes byte budget, 0 for no byte budget.
+ * @param bytes the bytes currently charged.
+ * @param size_func computes the bytes of an entry, NULL charges
+ * sizeof(lru_node) per entry.
+ * @param evict_func, evict_ctx eviction callback and its context.
+ */
+typedef struct lru_cache {
+    entry_table table;
+    lru_node *head;
+    lru_node *tail;
+    size_t max_entries;
+    size_t max_bytes;
+    size_t bytes;
+    lru_size_func size_func;
+    lru_evict_func evict_func;
+    void *evict_ctx;
+} lru_cache;
+
+/**
+ * Allocates dynamically a new cache.
+ * @param func a function which "hashes" keys.
+ * @param max_entries maximal number of entries, 0 for no entry limit.
+ * @param max_bytes maximal number of bytes, 0 for no byte limit.
+ * @param size_func bytes charged per entry, may be NULL.
+ * @return pointer to dynamically allocated cache.
+ * @if_fail (or if both limits are 0) return NULL.
+ */
+lru_cache *lru_cache_alloc (hash_func func, size_t max_entries,
+                            size_t max_bytes, lru_size_func size_func);
+
+/**
+ * Frees a cache and all of its entries.
+ * @param p_cache pointer to dynamically allocated pointer to cache.
+ */
+void lru_cache_free (lru_cache **p_cache);
+
+/**
+ * Sets the function called on every eviction.
+ * @param cache a cache.
+ * @param func the eviction callback, NULL to disable.
+ * @param ctx passed as the last argument of func.
+ */
+void lru_cache_set_evict_func (lru_cache *cache, lru_evict_func func,
+                               void *ctx);
+
+/**
+ * Inserts a copy of in_pair as the most recently used entry, evicting the
+ * least recently used entries while the cache is over budget.
+ * If the key is already in the cache its value is replaced.
+ * @return 1 for successful insertion, 0 otherwise (also if the entry alone
+ * is larger than the byte budget, a replaced value is then kept).
+ */
+int lru_cache_insert (lru_cache *cache, const pair *in_pair);
+
+/**
+ * Returns the value associated with key and marks the entry as the
+ * most recently used.
+ * @return the value (not a copy of it) if exists, NULL otherwise.
+ */
+valueT lru_cache_at (lru_cache *cache, const_keyT key);
+
+/**
+ * Returns the value associated with key without changing its recency.
+ * @return the value (not a copy of it) if exists, NULL otherwise.
+ */
+valueT lru_cache_peek (const lru_cache *cache, const_keyT key);
+
+/**
+ * Erases the entry associated with key.
+ * @return 1 if the erasing was done successfully, 0 otherwise.
+ */
+int lru_cache_erase (lru_cache *cache, const_keyT key);
+
+#endif //LRU_CACHE_H_
@@ -0,0 +1,335 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "map_client.h"
+
+/*
+ * The free space reserved in the receive buffer before every read.
+ */
+#define READ_CHUNK (64UL << 10)
+
+static int buffer_reserve (map_client_buffer *buf, size_t extra)
+{
+  if (buf->start > 0){ // drop the bytes already taken.
+      memmove (buf->data, buf->data + buf->start, buf->len - buf->start);
+      buf->len -= buf->start;
+      buf->start = 0;
+  }
+  if (buf->len + extra <= buf->capacity){
+      return 1;
+  }
+  size_t capacity = (buf->capacity == 0) ? 4096 : buf->capacity;
+  while (capacity < buf->len + extra){
+      capacity *= 2;
+  }
+  char *data = realloc (buf->data, capacity);
+  if (data == NULL){
+      return 0;
+  }
+  buf->data = data;
+  buf->capacity = capacity;
+  return 1;
+}
+
+/*
+ * Appends a request header to the queue, reserving body_len more bytes.
+ */
+static char *begin_request (map_client *client, int op, size_t body_len)
+{
+  if ((body_len + 1 > MAP_PROTO_MAX_FRAME)
+      || (buffer_reserve (&(client->out),
+                          MAP_PROTO_HEADER_BYTES + body_len) == 0)
+      || (buffer_reserve (&(client->ops), 1) == 0)){
+      return NULL;
+  }
+  char *frame = client->out.data + client->out.len;
+  map_proto_put_u32 (frame, (uint32_t) (body_len + 1));
+  frame[sizeof (uint32_t)] = (char) op;
+  client->out.len += MAP_PROTO_HEADER_BYTES + body_len;
+  client->ops.data[client->ops.len++] = (char) op;
+  return frame + MAP_PROTO_HEADER_BYTES;
+}
+
+static char *put_bytes (char *dest, const char *bytes, size_t len)
+{
+  map_proto_put_u32 (dest, (uint32_t) len);
+  memcpy (dest + sizeof (uint32_t), bytes, len);
+  return dest + sizeof (uint32_t) + len;
+}
+
+/*
+ * Reads what the socket has into the receive buffer (blocking if wait is
+ * set). Returns 1 on success, 0 on failure or if the server closed the
+ * connection.
+ */
+static int read_replies (map_client *client, int wait)
+{
+  if (buffer_reserve (&(client->in), READ_CHUNK) == 0){
+      return 0;
+  }
+  ssize_t got = recv (client->fd, client->in.data + client->in.len,
+                      client->in.capacity - client->in.len,
+                      wait ? 0 : MSG_DONTWAIT);
+  if (got > 0){
+      client->in.len += (size_t) got;
+      return 1;
+  }
+  if (got == 0){
+      return 0;
+  }
+  return (errno == EINTR) || (!wait && ((errno == EAGAIN)
+                                        || (errno == EWOULDBLOCK)));
+}
+
+map_client *map_client_connect (const char *path)
+{
+  struct sockaddr_un addr;
+  if ((path == NULL) || (strlen (path) >= sizeof (addr.sun_path))){
+      return NULL;
+  }
+  map_client *client = calloc (1, sizeof (map_client));
+  if (client == NULL){
+      return NULL;
+  }
+  memset (&addr, 0, sizeof (addr));
+  addr.sun_family = AF_UNIX;
+  strcpy (addr.sun_path, path);
+  client->fd = socket (AF_UNIX, SOCK_STREAM, 0);
+  if ((client->fd < 0)
+      || (connect (client->fd, (struct sockaddr *) &addr,
+                   sizeof (addr)) != 0)){
+      if (client->fd >= 0){
+          close (client->fd);
+      }
+      free (client);
+      return NULL;
+  }
+  return client;
+}
+
+void map_client_close (map_client **p_client)
+{
+  if ((p_client == NULL) || (*p_client == NULL)){
+      return;
+  }
+  close ((*p_client)->fd);
+  free ((*p_client)->out.data);
+  free ((*p_client)->in.data);
+  free ((*p_client)->ops.data);
+  free (*p_client);
+  *p_client = NULL;
+}
+
+int map_client_send_get (map_client *client, const char *key, size_t key_len)
+{
+  if ((client == NULL) || (key == NULL)){
+      return 0;
+  }
+  char *body = begin_request (client, MAP_OP_GET,
+                              sizeof (uint32_t) + key_len);
+  if (body == NULL){
+      return 0;
+  }
+  put_bytes (body, key, key_len);
+  return 1;
+}
+
+int map_client_send_put (map_client *client, const char *key, size_t key_len,
+                         const char *value, size_t value_len)
+{
+  if ((client == NULL) || (key == NULL) || ((value == NULL) && value_len)){
+      return 0;
+  }
+  char *body = begin_request (client, MAP_OP_PUT,
+                              sizeof (uint32_t) + key_len + value_len);
+  if (body == NULL){
+      return 0;
+  }
+  body = put_bytes (body, key, key_len);
+  if (value_len > 0){
+      memcpy (body, value, value_len);
+  }
+  return 1;
+}
+
+int map_client_send_erase (map_client *client, const char *key,
+                           size_t key_len)
+{
+  if ((client == NULL) || (key == NULL)){
+      return 0;
+  }
+  char *body = begin_request (client, MAP_OP_ERASE,
+                              sizeof (uint32_t) + key_len);
+  if (body == NULL){
+      return 0;
+  }
+  put_bytes (body, key, key_len);
+  return 1;
+}
+
+int map_client_send_batch_get (map_client *client, const char *const *keys,
+                               const size_t *key_lens, size_t count)
+{
+  if ((client == NULL) || ((count > 0) && ((keys == NULL)
+                                           || (key_lens == NULL)))
+      || (count > UINT32_MAX)){
+      return 0;
+  }
+  size_t body_len = sizeof (uint32_t);
+  for (size_t i = 0; i < count; ++i)
+    {
+      body_len += sizeof (uint32_t) + key_lens[i];
+    }
+  char *body = begin_request (client, MAP_OP_BATCH_GET, body_len);
+  if (body == NULL){
+      return 0;
+  }
+  map_proto_put_u32 (body, (uint32_t) count);
+  body += sizeof (uint32_t);
+  for (size_t i = 0; i < count; ++i)
+    {
+      body = put_bytes (body, keys[i], key_lens[i]);
+    }
+  return 1;
+}
+
+int map_client_flush (map_client *client)
+{
+  if (client == NULL){
+      return 0;
+  }
+  while (client->out.start < client->out.len){
+      struct pollfd pfd;
+      pfd.fd = client->fd;
+      pfd.events = POLLIN | POLLOUT;
+      if (poll (&pfd, 1, -1) < 0){
+          if (errno == EINTR){
+              continue;
+          }
+          return 0;
+      }
+      // the server stops reading while its replies pile up, so they are
+      // taken in meanwhile.
+      if ((pfd.revents & POLLIN) && (read_replies (client, 0) == 0)){
+          return 0;
+      }
+      if (pfd.revents & (POLLOUT | POLLERR | POLLHUP)){
+          ssize_t sent = send (client->fd, client->out.data + client->out.start,
+                               client->out.len - client->out.start,
+                               MSG_NOSIGNAL | MSG_DONTWAIT);
+          if (sent < 0){
+              if ((errno != EAGAIN) && (errno != EWOULDBLOCK)
+                  && (errno != EINTR)){
+                  return 0;
+              }
+          }
+          else{
+              client->out.start += (size_t) sent;
+          }
+      }
+    }
+  client->out.start = 0;
+  client->out.len = 0;
+  return 1;
+}
+
+int map_client_recv (map_client *client, map_reply *reply)
+{
+  if ((client == NULL) || (reply == NULL)
+      || (client->ops.start == client->ops.len)
+      || (map_client_flush (client) == 0)){
+      return 0;
+  }
+  map_client_buffer *in = &(client->in);
+  for (;;){
+      size_t avail = in->len - in->start;
+      if (avail >= MAP_PROTO_HEADER_BYTES){
+          size_t frame_len = map_proto_get_u32 (in->data + in->start);
+          if ((frame_len == 0) || (frame_len > MAP_PROTO_MAX_FRAME)){
+              return 0;
+          }
+          if (avail - sizeof (uint32_t) >= frame_len){
+              break;
+          }
+      }
+      if (read_replies (client, 1) == 0){
+          return 0;
+      }
+    }
+  const char *frame = in->data + in->start;
+  size_t frame_len = map_proto_get_u32 (frame);
+  in->start += sizeof (uint32_t) + frame_len; // valid until the next read.
+  reply->op = (unsigned char) client->ops.data[client->ops.start++];
+  reply->status = (unsigned char) frame[sizeof (uint32_t)];
+  reply->body = frame + MAP_PROTO_HEADER_BYTES;
+  reply->body_len = frame_len - 1;
+  reply->value = NULL;
+  reply->value_len = 0;
+  reply->count = 0;
+  reply->pos = 0;
+  int found = (reply->status == MAP_STATUS_OK);
+  if ((reply->op == MAP_OP_GET) && found){
+      reply->value = reply->body;
+      reply->value_len = reply->body_len;
+  }
+  else if ((reply->op == MAP_OP_BATCH_GET) && found){
+      if (reply->body_len < sizeof (uint32_t)){
+          return 0;
+      }
+      reply->count = map_proto_get_u32 (reply->body);
+      reply->pos = sizeof (uint32_t);
+  }
+  return 1;
+}
+
+int map_reply_next (map_reply *reply, int *status, const char **value,
+                    size_t *value_len)
+{
+  if ((reply == NULL) || (reply->count == 0)
+      || (reply->body_len - reply->pos < 1 + sizeof (uint32_t))){
+      return 0;
+  }
+  const char *entry = reply->body + reply->pos;
+  size_t len = map_proto_get_u32 (entry + 1);
+  if (reply->body_len - reply->pos - 1 - sizeof (uint32_t) < len){
+      return 0;
+  }
+  *status = (unsigned char) entry[0];
+  *value = (*status == MAP_STATUS_OK) ? entry + 1 + sizeof (uint32_t) : NULL;
+  *value_len = len;
+  reply->pos += 1 + sizeof (uint32_t) + len;
+  reply->count -= 1;
+  return 1;
+}
+
+int map_client_get (map_client *client, const char *key, size_t key_len,
+                    map_reply *reply)
+{
+  return (map_client_send_get (client, key, key_len) == 1)
+         && (map_client_recv (client, reply) == 1);
+}
+
+int map_client_put (map_client *client, const char *key, size_t key_len,
+                    const char *value, size_t value_len)
+{
+  map_reply reply;
+  if ((map_client_send_put (client, key, key_len, value, value_len) == 0)
+      || (map_client_recv (client, &reply) == 0)){
+      return MAP_STATUS_ERROR;
+  }
+  return reply.status;
+}
+
+int map_client_erase (map_client *client, const char *key, size_t key_len)
+{
+  map_reply reply;
+  if ((map_client_send_erase (client, key, key_len) == 0)
+      || (map_client_recv (client, &reply) == 0)){
+      return MAP_STATUS_ERROR;
+  }
+  return reply.status;
+}
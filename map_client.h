@@ -0,0 +1,145 @@
+#ifndef MAP_CLIENT_H_
+#define MAP_CLIENT_H_
+
+#include <stdlib.h>
+#include "map_proto.h"
+
+/**
+ * A client of map_server (map_server.h). Requests are queued with the
+ * map_client_send_* functions and replies are taken, in the same order, with
+ * map_client_recv, so any number of requests can be in flight (pipelining).
+ * map_client_recv sends the queued requests first, and while it waits it
+ * keeps reading replies, so a long pipeline never blocks on a full socket.
+ * The values of a reply point into the client's receive buffer (they are not
+ * copied) and are valid until the next map_client_recv or map_client_flush.
+ * The map_client_get / put / erase functions send one request and wait for
+ * its reply. A client must not be used by several threads at once.
+ */
+
+/**
+ * @struct map_client_buffer
+ * Bytes queued for sending, or received and not yet taken (from start on).
+ */
+typedef struct map_client_buffer {
+    char *data;
+    size_t start;
+    size_t len;
+    size_t capacity;
+} map_client_buffer;
+
+/**
+ * @struct map_client
+ * @param fd the socket.
+ * @param out the queued requests.
+ * @param in the received replies.
+ * @param ops the op of every request sent (or queued) and not yet answered,
+ * one byte each, oldest first.
+ */
+typedef struct map_client {
+    int fd;
+    map_client_buffer out;
+    map_client_buffer in;
+    map_client_buffer ops;
+} map_client;
+
+/**
+ * @struct map_reply
+ * @param op the op of the request.
+ * @param status the status of the reply (MAP_STATUS_*).
+ * @param value, value_len the value of a MAP_OP_GET reply (NULL and 0 if
+ * the key was not found).
+ * @param count the number of values of a MAP_OP_BATCH_GET reply, read with
+ * map_reply_next.
+ * @param body, body_len, pos the body of the reply, and the position of the
+ * next value of a batch.
+ */
+typedef struct map_reply {
+    int op;
+    int status;
+    const char *value;
+    size_t value_len;
+    size_t count;
+    const char *body;
+    size_t body_len;
+    size_t pos;
+} map_reply;
+
+/**
+ * Connects to the server listening at path.
+ * @return pointer to dynamically allocated client.
+ * @if_fail return NULL.
+ */
+map_client *map_client_connect (const char *path);
+
+/**
+ * Closes the connection (replies not taken are dropped) and frees the
+ * client.
+ * @param p_client pointer to dynamically allocated pointer to client.
+ */
+void map_client_close (map_client **p_client);
+
+/**
+ * Queue a request. The bytes are copied, so they may be reused at once.
+ * @return 1 on success, 0 otherwise.
+ */
+int map_client_send_get (map_client *client, const char *key, size_t key_len);
+int map_client_send_put (map_client *client, const char *key, size_t key_len,
+                         const char *value, size_t value_len);
+int map_client_send_erase (map_client *client, const char *key,
+                           size_t key_len);
+
+/**
+ * Queues a MAP_OP_BATCH_GET request of count keys.
+ * @return 1 on success, 0 otherwise.
+ */
+int map_client_send_batch_get (map_client *client, const char *const *keys,
+                               const size_t *key_lens, size_t count);
+
+/**
+ * Sends every queued request, reading replies meanwhile.
+ * @return 1 on success, 0 otherwise.
+ */
+int map_client_flush (map_client *client);
+
+/**
+ * Sends the queued requests and waits for the reply of the oldest request
+ * in flight.
+ * @param client a client.
+ * @param reply the reply, its values are valid until the next call.
+ * @return 1 on success, 0 on failure (or if no request is in flight).
+ */
+int map_client_recv (map_client *client, map_reply *reply);
+
+/**
+ * Reads the next value of a MAP_OP_BATCH_GET reply.
+ * @param reply a batch reply.
+ * @param status the status of the value (MAP_STATUS_OK or
+ * MAP_STATUS_NOT_FOUND).
+ * @param value, value_len the value (NULL and 0 if not found).
+ * @return 1 on success, 0 if every value was read.
+ */
+int map_reply_next (map_reply *reply, int *status, const char **value,
+                    size_t *value_len);
+
+/**
+ * Gets the value of key, waiting for the reply.
+ * @param reply the reply, its value is valid until the next call.
+ * @return 1 if the request was answered (see reply->status), 0 otherwise.
+ */
+int map_client_get (map_client *client, const char *key, size_t key_len,
+                    map_reply *reply);
+
+/**
+ * Inserts or replaces the value of key, waiting for the reply.
+ * @return the status of the reply, MAP_STATUS_ERROR on failure.
+ */
+int map_client_put (map_client *client, const char *key, size_t key_len,
+                    const char *value, size_t value_len);
+
+/**
+ * Erases key, waiting for the reply.
+ * @return the status of the reply, MAP_STATUS_ERROR on failure.
+ */
+int map_client_erase (map_client *client, const char *key, size_t key_len);
+
+#endif //MAP_CLIENT_H_
@@ -0,0 +1,302 @@
+/*
+ * A load generator for map_server (map_server.h): client threads, each with
+ * its own connection, run a mix of gets and puts over a key space with a
+ * number of requests in flight per connection, and the throughput and the
+ * latency of every pipelined round trip are reported.
+ * usage: map_loadgen [-s socket] [-c clients] [-n requests per client]
+ *                    [-d pipeline depth] [-k keys] [-v value bytes]
+ *                    [-r get percent] [-b keys per batch get]
+ * Without -s a server is started in this process, on a temporary socket.
+ */
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "map_server.h"
+#include "map_client.h"
+
+#define KEY_BYTES 16
+#define DEFAULT_SOCKET "map_loadgen.sock"
+
+typedef struct loadgen_options {
+    const char *path;
+    size_t clients;
+    size_t requests;
+    size_t depth;
+    size_t keys;
+    size_t value_bytes;
+    size_t get_percent;
+    size_t batch;
+} loadgen_options;
+
+/*
+ * @struct loadgen_worker
+ * The work and the results of one client thread: the latency of every round
+ * trip, in ns.
+ */
+typedef struct loadgen_worker {
+    const loadgen_options *options;
+    size_t id;
+    double *latencies;
+    size_t num_of_rounds;
+    size_t misses;
+    int failed;
+} loadgen_worker;
+
+static double now_ns (void)
+{
+  struct timespec now;
+  clock_gettime (CLOCK_MONOTONIC, &now);
+  return (double) now.tv_sec * 1e9 + (double) now.tv_nsec;
+}
+
+static uint64_t next_random (uint64_t *state)
+{
+  *state ^= *state << 13;
+  *state ^= *state >> 7;
+  *state ^= *state << 17;
+  return *state;
+}
+
+static void make_key (char *key, size_t ind)
+{
+  snprintf (key, KEY_BYTES + 1, "key:%012zu", ind);
+}
+
+/*
+ * Puts every key of the key space, depth requests at a time.
+ */
+static int preload (const loadgen_options *options, const char *value)
+{
+  map_client *client = map_client_connect (options->path);
+  if (client == NULL){
+      return 0;
+  }
+  char key[KEY_BYTES + 1];
+  map_reply reply;
+  int success = 1;
+  for (size_t i = 0; success && (i < options->keys); ++i)
+    {
+      make_key (key, i);
+      success = map_client_send_put (client, key, KEY_BYTES, value,
+                                     options->value_bytes);
+      if (success && ((i + 1) % options->depth == 0)){
+          for (size_t j = 0; success && (j < options->depth); ++j)
+            {
+              success = map_client_recv (client, &reply)
+                        && (reply.status == MAP_STATUS_OK);
+            }
+      }
+    }
+  while (success && (map_client_recv (client, &reply) == 1)){
+      success = (reply.status == MAP_STATUS_OK);
+    }
+  map_client_close (&client);
+  return success;
+}
+
+static void *worker_thread (void *arg)
+{
+  loadgen_worker *worker = (loadgen_worker *) arg;
+  const loadgen_options *options = worker->options;
+  map_client *client = map_client_connect (options->path);
+  char *value = calloc (options->value_bytes + 1, 1);
+  char *keys = malloc ((KEY_BYTES + 1) * options->batch);
+  const char **batch_keys = malloc (sizeof (char *) * options->batch);
+  size_t *batch_lens = malloc (sizeof (size_t) * options->batch);
+  if ((client == NULL) || (value == NULL) || (keys == NULL)
+      || (batch_keys == NULL) || (batch_lens == NULL)){
+      worker->failed = 1;
+  }
+  uint64_t state = 0x9e3779b97f4a7c15ULL * (worker->id + 1);
+  for (size_t i = 0; !worker->failed && (i < options->batch); ++i)
+    {
+      batch_keys[i] = keys + i * (KEY_BYTES + 1);
+      batch_lens[i] = KEY_BYTES;
+    }
+  if (value != NULL){
+      memset (value, 'v', options->value_bytes);
+  }
+  size_t done = 0;
+  while (!worker->failed && (done < options->requests)){
+      size_t round = options->requests - done;
+      round = (round < options->depth) ? round : options->depth;
+      double start = now_ns ();
+      for (size_t i = 0; !worker->failed && (i < round); ++i)
+        {
+          int sent;
+          if (next_random (&state) % 100 < options->get_percent){
+              for (size_t j = 0; j < options->batch; ++j)
+                {
+                  make_key (keys + j * (KEY_BYTES + 1),
+                            next_random (&state) % options->keys);
+                }
+              sent = (options->batch == 1) ?
+                     map_client_send_get (client, keys, KEY_BYTES) :
+                     map_client_send_batch_get (client, batch_keys, batch_lens,
+                                                options->batch);
+          }
+          else{
+              make_key (keys, next_random (&state) % options->keys);
+              sent = map_client_send_put (client, keys, KEY_BYTES, value,
+                                          options->value_bytes);
+          }
+          worker->failed = !sent;
+        }
+      for (size_t i = 0; !worker->failed && (i < round); ++i)
+        {
+          map_reply reply;
+          int status, got;
+          const char *found;
+          size_t found_len;
+          if (map_client_recv (client, &reply) == 0){
+              worker->failed = 1;
+              break;
+          }
+          worker->misses += (reply.status == MAP_STATUS_NOT_FOUND);
+          while ((got = map_reply_next (&reply, &status, &found,
+                                        &found_len)) == 1){
+              worker->misses += (status == MAP_STATUS_NOT_FOUND);
+            }
+        }
+      worker->latencies[worker->num_of_rounds++] = now_ns () - start;
+      done += round;
+    }
+  map_client_close (&client);
+  free (value);
+  free (keys);
+  free (batch_keys);
+  free (batch_lens);
+  return NULL;
+}
+
+static int compare_doubles (const void *a, const void *b)
+{
+  double x = *(const double *) a, y = *(const double *) b;
+  return (x > y) - (x < y);
+}
+
+static size_t parse_size (const char *arg)
+{
+  char *end;
+  unsigned long value = strtoul (arg, &end, 10);
+  return (*end == '\0') ? (size_t) value : 0;
+}
+
+static int parse_options (int argc, char **argv, loadgen_options *options)
+{
+  int opt;
+  while ((opt = getopt (argc, argv, "s:c:n:d:k:v:r:b:")) != -1){
+      switch (opt){
+          case 's': options->path = optarg;
+            break;
+          case 'c': options->clients = parse_size (optarg);
+            break;
+          case 'n': options->requests = parse_size (optarg);
+            break;
+          case 'd': options->depth = parse_size (optarg);
+            break;
+          case 'k': options->keys = parse_size (optarg);
+            break;
+          case 'v': options->value_bytes = parse_size (optarg);
+            break;
+          case 'r': options->get_percent = parse_size (optarg);
+            break;
+          case 'b': options->batch = parse_size (optarg);
+            break;
+          default:
+            return 0;
+        }
+    }
+  return (options->clients > 0) && (options->requests > 0)
+         && (options->depth > 0) && (options->keys > 0)
+         && (options->get_percent <= 100) && (options->batch > 0);
+}
+
+int main (int argc, char **argv)
+{
+  loadgen_options options = {NULL, 4, 100000, 32, 100000, 64, 90, 1};
+  if (parse_options (argc, argv, &options) == 0){
+      fprintf (stderr, "usage: %s [-s socket] [-c clients] [-n requests] "
+                       "[-d depth] [-k keys] [-v value bytes] "
+                       "[-r get percent] [-b batch]\n", argv[0]);
+      return 1;
+  }
+  map_server *server = NULL;
+  if (options.path == NULL){
+      options.path = DEFAULT_SOCKET;
+      server = map_server_start (options.path, 0, 0);
+      if (server == NULL){
+          fprintf (stderr, "cannot start a server at %s\n", options.path);
+          return 1;
+      }
+  }
+  char *value = calloc (options.value_bytes + 1, 1);
+  loadgen_worker *workers = calloc (options.clients, sizeof (loadgen_worker));
+  pthread_t *threads = calloc (options.clients, sizeof (pthread_t));
+  int failed = (value == NULL) || (workers == NULL) || (threads == NULL)
+               || (preload (&options, value) == 0);
+  size_t rounds_per_worker = (options.requests + options.depth - 1)
+                             / options.depth;
+  size_t started = 0;
+  double start = now_ns ();
+  for (; !failed && (started < options.clients); ++started)
+    {
+      workers[started].options = &options;
+      workers[started].id = started;
+      workers[started].latencies = malloc (sizeof (double)
+                                           * rounds_per_worker);
+      if ((workers[started].latencies == NULL)
+          || (pthread_create (&(threads[started]), NULL, worker_thread,
+                              &(workers[started])) != 0)){
+          failed = 1;
+          break;
+      }
+    }
+  size_t num_of_rounds = 0, misses = 0;
+  for (size_t i = 0; i < started; ++i)
+    {
+      pthread_join (threads[i], NULL);
+      failed = failed || workers[i].failed;
+      num_of_rounds += workers[i].num_of_rounds;
+      misses += workers[i].misses;
+    }
+  double elapsed = now_ns () - start;
+  double *latencies = malloc (sizeof (double) * (num_of_rounds + 1));
+  if (!failed && (latencies != NULL) && (num_of_rounds > 0)){
+      size_t pos = 0;
+      for (size_t i = 0; i < started; ++i)
+        {
+          memcpy (latencies + pos, workers[i].latencies,
+                  sizeof (double) * workers[i].num_of_rounds);
+          pos += workers[i].num_of_rounds;
+        }
+      qsort (latencies, num_of_rounds, sizeof (double), compare_doubles);
+      double requests = (double) options.clients * (double) options.requests;
+      printf ("%zu clients x %zu requests, depth %zu, %zu keys, %zu byte "
+              "values, %zu%% gets (%zu keys each)\n", options.clients,
+              options.requests, options.depth, options.keys,
+              options.value_bytes, options.get_percent, options.batch);
+      printf ("throughput: %.0f requests/s, misses: %zu\n",
+              requests / (elapsed / 1e9), misses);
+      printf ("round trip latency (us): p50 %.1f, p99 %.1f, max %.1f\n",
+              latencies[num_of_rounds / 2] / 1e3,
+              latencies[num_of_rounds * 99 / 100] / 1e3,
+              latencies[num_of_rounds - 1] / 1e3);
+  }
+  else{
+      fprintf (stderr, "the load generation failed\n");
+      failed = 1;
+  }
+  for (size_t i = 0; (workers != NULL) && (i < options.clients); ++i)
+    {
+      free (workers[i].latencies);
+    }
+  free (latencies);
+  free (workers);
+  free (threads);
+  free (value);
+  map_server_stop (&server);
+  return failed;
+}
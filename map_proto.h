@@ -0,0 +1,81 @@
+#ifndef MAP_PROTO_H_
+#define MAP_PROTO_H_
+
+#include <stdint.h>
+#include <string.h>
+
+/**
+ * The binary protocol of map_server and map_client, over a Unix domain
+ * stream socket. Every integer is in the host byte order (both ends run on
+ * the same host).
+ *
+ * A request is a header, the length of the rest of the frame (4 bytes) and
+ * the op (1 byte), followed by the body of the op:
+ *   MAP_OP_GET, MAP_OP_ERASE: the key length (4 bytes) and the key.
+ *   MAP_OP_PUT: the key length (4 bytes), the key and the value (the rest of
+ *   the frame).
+ *   MAP_OP_BATCH_GET: the number of keys (4 bytes), then for every key its
+ *   length (4 bytes) and the key.
+ * A reply is a header, the length of the rest of the frame (4 bytes) and
+ * the status (1 byte), followed by:
+ *   MAP_OP_GET: the value (only with MAP_STATUS_OK).
+ *   MAP_OP_PUT, MAP_OP_ERASE: nothing.
+ *   MAP_OP_BATCH_GET: the number of keys (4 bytes), then for every key its
+ *   status (1 byte), the value length (4 bytes) and the value.
+ * Requests may be pipelined: a client may send any number of requests
+ * before reading the replies, which come back in the order of the requests.
+ * A malformed request gets a MAP_STATUS_BAD_REQUEST reply, and the server
+ * closes the connection.
+ */
+
+/**
+ * @def MAP_OP_GET, MAP_OP_PUT, MAP_OP_ERASE, MAP_OP_BATCH_GET
+ * The ops of a request.
+ */
+#define MAP_OP_GET 1
+#define MAP_OP_PUT 2
+#define MAP_OP_ERASE 3
+#define MAP_OP_BATCH_GET 4
+
+/**
+ * @def MAP_STATUS_OK, MAP_STATUS_NOT_FOUND, MAP_STATUS_ERROR,
+ * MAP_STATUS_BAD_REQUEST
+ * The statuses of a reply: success, the key is not in the map, the server
+ * failed (out of memory), and a malformed request.
+ */
+#define MAP_STATUS_OK 0
+#define MAP_STATUS_NOT_FOUND 1
+#define MAP_STATUS_ERROR 2
+#define MAP_STATUS_BAD_REQUEST 3
+
+/**
+ * @def MAP_PROTO_HEADER_BYTES
+ * The bytes of a request or reply header.
+ */
+#define MAP_PROTO_HEADER_BYTES 5
+
+/**
+ * @def MAP_PROTO_MAX_FRAME
+ * The longest frame either side accepts.
+ */
+#define MAP_PROTO_MAX_FRAME (64UL << 20)
+
+/**
+ * Reads a 4 byte integer from (possibly unaligned) bytes.
+ */
+static inline uint32_t map_proto_get_u32 (const char *bytes)
+{
+  uint32_t value;
+  memcpy (&value, bytes, sizeof (value));
+  return value;
+}
+
+/**
+ * Writes a 4 byte integer to (possibly unaligned) bytes.
+ */
+static inline void map_proto_put_u32 (char *bytes, uint32_t value)
+{
+  memcpy (bytes, &value, sizeof (value));
+}
+
+#endif //MAP_PROTO_H_
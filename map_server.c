@@ -0,0 +1,703 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include "map_server.h"
+#include "strkey.h"
+
+/*
+ * The most events a loop takes from epoll_wait at once, and the free space
+ * a connection reserves in its input buffer before every read.
+ */
+#define MAX_EVENTS 64
+#define READ_CHUNK (64UL << 10)
+
+/*
+ * @struct conn_buffer
+ * The bytes received but not yet served, or the replies not yet sent
+ * (from sent on).
+ */
+typedef struct conn_buffer {
+    char *data;
+    size_t len;
+    size_t capacity;
+} conn_buffer;
+
+/*
+ * @struct map_server_shard
+ * @param map the pairs of the shard.
+ * @param lock guards map (read locked by lookups).
+ */
+typedef struct map_server_shard {
+    hashmap *map;
+    pthread_rwlock_t lock;
+} map_server_shard;
+
+/*
+ * @struct map_server_conn
+ * A client connection, owned by the loop that accepted it (in the loop's
+ * doubly linked list). Once closing is set (the peer closed its end, or
+ * sent a malformed request) the connection is no longer read from, and is
+ * closed when its replies are sent.
+ */
+typedef struct map_server_conn {
+    int fd;
+    conn_buffer in;
+    conn_buffer out;
+    size_t sent;
+    uint32_t events;
+    int closing;
+    struct map_server_conn *prev;
+    struct map_server_conn *next;
+} map_server_conn;
+
+static int buffer_reserve (conn_buffer *buf, size_t extra)
+{
+  if (buf->len + extra <= buf->capacity){
+      return 1;
+  }
+  size_t capacity = (buf->capacity == 0) ? 4096 : buf->capacity;
+  while (capacity < buf->len + extra){
+      capacity *= 2;
+  }
+  char *data = realloc (buf->data, capacity);
+  if (data == NULL){
+      return 0;
+  }
+  buf->data = data;
+  buf->capacity = capacity;
+  return 1;
+}
+
+static int set_non_blocking (int fd)
+{
+  int flags = fcntl (fd, F_GETFL, 0);
+  return (flags != -1) && (fcntl (fd, F_SETFL, flags | O_NONBLOCK) != -1);
+}
+
+static map_server_shard *shard_of (map_server *server, const strkey *key)
+{
+  return &(server->shards[key->hash % server->num_of_shards]);
+}
+
+/*
+ * Reads a length prefixed key from body[*pos, len) into key, advancing
+ * *pos. The key is hashed with the secret key of the server, so clients
+ * can not pick keys that share a shard or a bucket.
+ * Returns 1 on success, 0 if the key does not fit in the body.
+ */
+static int parse_key (const map_server *server, const char *body, size_t len,
+                      size_t *pos, strkey *key)
+{
+  if (len - *pos < sizeof (uint32_t)){
+      return 0;
+  }
+  size_t key_len = map_proto_get_u32 (body + *pos);
+  *pos += sizeof (uint32_t);
+  if (len - *pos < key_len){
+      return 0;
+  }
+  *key = strkey_view_keyed (body + *pos, key_len, server->hash_key);
+  *pos += key_len;
+  return 1;
+}
+
+/*
+ * Appends a reply header with status to the output of conn, the length is
+ * filled in by end_reply. Returns the position of the reply, or
+ * (size_t) -1 if the buffer could not grow.
+ */
+static size_t begin_reply (map_server_conn *conn, int status, size_t extra)
+{
+  if (buffer_reserve (&(conn->out), MAP_PROTO_HEADER_BYTES + extra) == 0){
+      return (size_t) -1;
+  }
+  size_t start = conn->out.len;
+  conn->out.data[start + sizeof (uint32_t)] = (char) status;
+  conn->out.len += MAP_PROTO_HEADER_BYTES;
+  return start;
+}
+
+static void end_reply (map_server_conn *conn, size_t start)
+{
+  map_proto_put_u32 (conn->out.data + start,
+                     (uint32_t) (conn->out.len - start - sizeof (uint32_t)));
+}
+
+/*
+ * Appends a reply without a body. Returns 1 on success, 0 otherwise.
+ */
+static int reply_status (map_server_conn *conn, int status)
+{
+  size_t start = begin_reply (conn, status, 0);
+  if (start == (size_t) -1){
+      return 0;
+  }
+  end_reply (conn, start);
+  return 1;
+}
+
+/*
+ * Appends the value of key to the output of conn: the value itself for
+ * MAP_OP_GET, or its status, length and bytes for MAP_OP_BATCH_GET. The
+ * value is copied straight from the shard, under its read lock.
+ * Returns 1 on success, 0 if the buffer could not grow.
+ */
+static int append_value (map_server *server, map_server_conn *conn,
+                         const strkey *key, int batched, int *status)
+{
+  map_server_shard *shard = shard_of (server, key);
+  pthread_rwlock_rdlock (&(shard->lock));
+  const strkey *value = hashmap_at (shard->map, key);
+  size_t value_len = (value == NULL) ? 0 : value->len;
+  size_t header = batched ? 1 + sizeof (uint32_t) : 0;
+  int success = buffer_reserve (&(conn->out), header + value_len);
+  if (success){
+      char *dest = conn->out.data + conn->out.len;
+      *status = (value == NULL) ? MAP_STATUS_NOT_FOUND : MAP_STATUS_OK;
+      if (batched){
+          dest[0] = (char) *status;
+          map_proto_put_u32 (dest + 1, (uint32_t) value_len);
+      }
+      if (value != NULL){
+          memcpy (dest + header, strkey_data (value), value_len);
+      }
+      conn->out.len += header + value_len;
+  }
+  pthread_rwlock_unlock (&(shard->lock));
+  return success;
+}
+
+/*
+ * Inserts (key, value), or replaces the value of key. Returns a status.
+ */
+static int put_pair (map_server *server, const strkey *key,
+                     const strkey *value)
+{
+  map_server_shard *shard = shard_of (server, key);
+  int status = MAP_STATUS_OK;
+  pthread_rwlock_wrlock (&(shard->lock));
+  strkey *stored = hashmap_at (shard->map, key);
+  if (stored != NULL){
+      strkey *fresh = strkey_key_cpy (value);
+      if (fresh == NULL){
+          status = MAP_STATUS_ERROR;
+      }
+      else{
+          strkey old = *stored; // the old bytes go with the copy's struct.
+          *stored = *fresh;
+          *fresh = old;
+          strkey_key_free ((keyT *) &fresh);
+      }
+  }
+  else{
+      pair in_pair = {(keyT) key, (valueT) value, strkey_key_cpy,
+                      strkey_key_cpy, strkey_key_cmp, strkey_key_cmp,
+                      strkey_key_free, strkey_key_free};
+      if (hashmap_insert (shard->map, &in_pair) != 1){
+          status = MAP_STATUS_ERROR;
+      }
+  }
+  pthread_rwlock_unlock (&(shard->lock));
+  return status;
+}
+
+static int erase_key (map_server *server, const strkey *key)
+{
+  map_server_shard *shard = shard_of (server, key);
+  pthread_rwlock_wrlock (&(shard->lock));
+  int erased = hashmap_erase (shard->map, key);
+  pthread_rwlock_unlock (&(shard->lock));
+  return erased ? MAP_STATUS_OK : MAP_STATUS_NOT_FOUND;
+}
+
+/*
+ * Serves one request, appending its reply to the output of conn.
+ * Returns 1 on success, 0 if the request was malformed (a
+ * MAP_STATUS_BAD_REQUEST reply is appended) or the output could not grow.
+ */
+static int handle_request (map_server *server, map_server_conn *conn, int op,
+                           const char *body, size_t len)
+{
+  size_t pos = 0;
+  strkey key;
+  size_t start;
+  int status;
+  switch (op){
+      case MAP_OP_GET:
+        if ((parse_key (server, body, len, &pos, &key) == 0) || (pos != len)){
+            break;
+        }
+        start = begin_reply (conn, MAP_STATUS_OK, 0);
+        if ((start == (size_t) -1)
+            || (append_value (server, conn, &key, 0, &status) == 0)){
+            return 0;
+        }
+        conn->out.data[start + sizeof (uint32_t)] = (char) status;
+        end_reply (conn, start);
+        return 1;
+      case MAP_OP_PUT:{
+        if (parse_key (server, body, len, &pos, &key) == 0){
+            break;
+        }
+        strkey value = strkey_view (body + pos, len - pos);
+        return reply_status (conn, put_pair (server, &key, &value));
+      }
+      case MAP_OP_ERASE:
+        if ((parse_key (server, body, len, &pos, &key) == 0) || (pos != len)){
+            break;
+        }
+        return reply_status (conn, erase_key (server, &key));
+      case MAP_OP_BATCH_GET:{
+        if (len < sizeof (uint32_t)){
+            break;
+        }
+        size_t count = map_proto_get_u32 (body);
+        if (count > (len - sizeof (uint32_t)) / sizeof (uint32_t)){
+            break; // every key takes at least its length prefix.
+        }
+        pos = sizeof (uint32_t);
+        size_t i = 0;
+        for (; i < count; ++i) // validated before any reply.
+          {
+            if (parse_key (server, body, len, &pos, &key) == 0){
+                break;
+            }
+          }
+        if ((i != count) || (pos != len)){
+            break;
+        }
+        start = begin_reply (conn, MAP_STATUS_OK, sizeof (uint32_t));
+        if (start == (size_t) -1){
+            return 0;
+        }
+        map_proto_put_u32 (conn->out.data + conn->out.len, (uint32_t) count);
+        conn->out.len += sizeof (uint32_t);
+        pos = sizeof (uint32_t);
+        for (size_t i = 0; i < count; ++i)
+          {
+            if ((parse_key (server, body, len, &pos, &key) == 0)
+                || (append_value (server, conn, &key, 1, &status) == 0)){
+                return 0;
+            }
+          }
+        end_reply (conn, start);
+        return 1;
+      }
+      default:
+        break;
+    }
+  reply_status (conn, MAP_STATUS_BAD_REQUEST);
+  return 0;
+}
+
+/*
+ * Serves the complete requests at the start of the input of conn, until
+ * MAP_SERVER_MAX_PENDING_OUT reply bytes are unsent. After a malformed
+ * request the rest of the input is dropped and the connection is closing.
+ */
+static void handle_requests (map_server *server, map_server_conn *conn)
+{
+  size_t pos = 0;
+  while ((conn->in.len - pos >= MAP_PROTO_HEADER_BYTES)
+         && (conn->out.len - conn->sent < MAP_SERVER_MAX_PENDING_OUT)){
+      const char *frame = conn->in.data + pos;
+      size_t frame_len = map_proto_get_u32 (frame);
+      int success;
+      if ((frame_len == 0) || (frame_len > MAP_PROTO_MAX_FRAME)){
+          reply_status (conn, MAP_STATUS_BAD_REQUEST);
+          success = 0;
+      }
+      else if (conn->in.len - pos - sizeof (uint32_t) < frame_len){
+          break; // the rest of the frame is still on its way.
+      }
+      else{
+          success = handle_request (server, conn,
+                                    (unsigned char) frame[sizeof (uint32_t)],
+                                    frame + MAP_PROTO_HEADER_BYTES,
+                                    frame_len - 1);
+      }
+      if (success == 0){
+          conn->closing = 1;
+          conn->in.len = 0;
+          return;
+      }
+      pos += sizeof (uint32_t) + frame_len;
+    }
+  memmove (conn->in.data, conn->in.data + pos, conn->in.len - pos);
+  conn->in.len -= pos;
+}
+
+/*
+ * Reads once from the socket of conn. Returns 1 on success (or if there
+ * was nothing to read), 0 on failure.
+ */
+static int read_input (map_server_conn *conn)
+{
+  if (buffer_reserve (&(conn->in), READ_CHUNK) == 0){
+      return 0;
+  }
+  ssize_t got = read (conn->fd, conn->in.data + conn->in.len,
+                      conn->in.capacity - conn->in.len);
+  if (got > 0){
+      conn->in.len += (size_t) got;
+  }
+  else if (got == 0){
+      conn->closing = 1; // the requests already read are still served.
+  }
+  else if ((errno != EAGAIN) && (errno != EWOULDBLOCK) && (errno != EINTR)){
+      return 0;
+  }
+  return 1;
+}
+
+/*
+ * Sends as many of the pending replies of conn as the socket takes.
+ * Returns 1 on success, 0 on failure.
+ */
+static int send_output (map_server_conn *conn)
+{
+  while (conn->sent < conn->out.len){
+      ssize_t sent = send (conn->fd, conn->out.data + conn->sent,
+                           conn->out.len - conn->sent, MSG_NOSIGNAL);
+      if (sent < 0){
+          if (errno == EINTR){
+              continue;
+          }
+          return (errno == EAGAIN) || (errno == EWOULDBLOCK);
+      }
+      conn->sent += (size_t) sent;
+    }
+  conn->out.len = 0;
+  conn->sent = 0;
+  return 1;
+}
+
+static void close_conn (map_server_loop *loop, map_server_conn *conn)
+{
+  epoll_ctl (loop->epoll_fd, EPOLL_CTL_DEL, conn->fd, NULL);
+  close (conn->fd);
+  if (conn->prev != NULL){
+      conn->prev->next = conn->next;
+  }
+  else{
+      loop->conns = conn->next;
+  }
+  if (conn->next != NULL){
+      conn->next->prev = conn->prev;
+  }
+  free (conn->in.data);
+  free (conn->out.data);
+  free (conn);
+}
+
+/*
+ * Serves the events of conn: reads, answers every complete request (while
+ * the output is below MAP_SERVER_MAX_PENDING_OUT) and sends the replies,
+ * then waits for input only if the output is below the limit, and for
+ * output only if replies are left.
+ */
+static void serve_conn (map_server_loop *loop, map_server_conn *conn,
+                        uint32_t events)
+{
+  int open = ((events & EPOLLERR) == 0);
+  if (open && !conn->closing && (events & (EPOLLIN | EPOLLHUP))){
+      open = read_input (conn);
+  }
+  while (open){
+      size_t unserved = conn->in.len;
+      handle_requests (loop->server, conn);
+      int held_back = (conn->out.len - conn->sent
+                       >= MAP_SERVER_MAX_PENDING_OUT);
+      open = send_output (conn);
+      // once the output drained, the requests held back by its limit can
+      // be served: no more input may come until they are answered.
+      if ((conn->out.len != 0) || (!held_back && (conn->in.len == unserved))){
+          break;
+      }
+    }
+  size_t pending = conn->out.len - conn->sent;
+  if (!open || (conn->closing && (pending == 0))){
+      close_conn (loop, conn);
+      return;
+  }
+  uint32_t wanted = (pending > 0) ? EPOLLOUT : 0;
+  if ((pending < MAP_SERVER_MAX_PENDING_OUT) && !conn->closing){
+      wanted |= EPOLLIN;
+  }
+  if (wanted != conn->events){
+      struct epoll_event event;
+      event.events = wanted;
+      event.data.ptr = conn;
+      if (epoll_ctl (loop->epoll_fd, EPOLL_CTL_MOD, conn->fd, &event) != 0){
+          close_conn (loop, conn);
+          return;
+      }
+      conn->events = wanted;
+  }
+}
+
+static void accept_conns (map_server_loop *loop)
+{
+  for (;;){
+      int fd = accept (loop->server->listen_fd, NULL, NULL);
+      if (fd < 0){
+          return; // EAGAIN: another loop took it, or no more connections.
+      }
+      map_server_conn *conn = calloc (1, sizeof (map_server_conn));
+      struct epoll_event event;
+      event.events = EPOLLIN;
+      event.data.ptr = conn;
+      if ((conn == NULL) || (set_non_blocking (fd) == 0)
+          || (epoll_ctl (loop->epoll_fd, EPOLL_CTL_ADD, fd, &event) != 0)){
+          free (conn);
+          close (fd);
+          continue;
+      }
+      conn->fd = fd;
+      conn->events = EPOLLIN;
+      conn->next = loop->conns;
+      if (loop->conns != NULL){
+          loop->conns->prev = conn;
+      }
+      loop->conns = conn;
+    }
+}
+
+static void *loop_thread (void *arg)
+{
+  map_server_loop *loop = (map_server_loop *) arg;
+  map_server *server = loop->server;
+  struct epoll_event events[MAX_EVENTS];
+  int running = 1;
+  while (running){
+      int num_of_events = epoll_wait (loop->epoll_fd, events, MAX_EVENTS, -1);
+      if ((num_of_events < 0) && (errno != EINTR)){
+          break;
+      }
+      for (int i = 0; i < num_of_events; ++i)
+        {
+          void *ptr = events[i].data.ptr;
+          if (ptr == server->stop_pipe){
+              running = 0;
+          }
+          else if (ptr == &(server->listen_fd)){
+              accept_conns (loop);
+          }
+          else{
+              serve_conn (loop, ptr, events[i].events);
+          }
+        }
+    }
+  while (loop->conns != NULL){
+      close_conn (loop, loop->conns);
+    }
+  return NULL;
+}
+
+static int watch_fd (int epoll_fd, int fd, uint32_t events, void *ptr)
+{
+  struct epoll_event event;
+  event.events = events;
+  event.data.ptr = ptr;
+  return epoll_ctl (epoll_fd, EPOLL_CTL_ADD, fd, &event) == 0;
+}
+
+/*
+ * Removes a socket left at path by a previous run. Returns 1 if the path
+ * is free, 0 if something else is there (anything but a socket, or the
+ * socket of a live server, which answers a connection).
+ */
+static int remove_stale_socket (const char *path,
+                                const struct sockaddr_un *addr)
+{
+  struct stat st;
+  if (lstat (path, &st) != 0){
+      return errno == ENOENT;
+  }
+  if (!S_ISSOCK (st.st_mode)){
+      return 0;
+  }
+  int probe = socket (AF_UNIX, SOCK_STREAM, 0);
+  if ((probe < 0) || (set_non_blocking (probe) == 0)){
+      if (probe >= 0){
+          close (probe);
+      }
+      return 0;
+  }
+  int refused = (connect (probe, (const struct sockaddr *) addr,
+                          sizeof (*addr)) != 0)
+                && (errno == ECONNREFUSED);
+  close (probe);
+  return refused && (unlink (path) == 0);
+}
+
+static int open_socket (map_server *server)
+{
+  struct sockaddr_un addr;
+  if (strlen (server->path) >= sizeof (addr.sun_path)){
+      return 0;
+  }
+  memset (&addr, 0, sizeof (addr));
+  addr.sun_family = AF_UNIX;
+  strcpy (addr.sun_path, server->path);
+  if (remove_stale_socket (server->path, &addr) == 0){
+      return 0;
+  }
+  server->listen_fd = socket (AF_UNIX, SOCK_STREAM, 0);
+  if (server->listen_fd < 0){
+      return 0;
+  }
+  if (bind (server->listen_fd, (struct sockaddr *) &addr, sizeof (addr)) != 0){
+      return 0;
+  }
+  server->bound = 1;
+  return (listen (server->listen_fd, SOMAXCONN) == 0)
+         && set_non_blocking (server->listen_fd);
+}
+
+static int start_loop (map_server *server, map_server_loop *loop)
+{
+  uint32_t accept_events = EPOLLIN;
+#ifdef EPOLLEXCLUSIVE
+  accept_events |= EPOLLEXCLUSIVE; // wake one loop per connection.
+#endif
+  loop->server = server;
+  loop->epoll_fd = epoll_create1 (0);
+  if ((loop->epoll_fd < 0)
+      || (watch_fd (loop->epoll_fd, server->listen_fd, accept_events,
+                    &(server->listen_fd)) == 0)
+      || (watch_fd (loop->epoll_fd, server->stop_pipe[0], EPOLLIN,
+                    server->stop_pipe) == 0)){
+      return 0;
+  }
+  loop->started = (pthread_create (&(loop->thread), NULL, loop_thread,
+                                   loop) == 0);
+  return loop->started;
+}
+
+static void free_server (map_server *server)
+{
+  if (server->stop_pipe[1] >= 0){
+      char stop = 0;
+      while ((write (server->stop_pipe[1], &stop, 1) < 0) && (errno == EINTR)){
+        }
+  }
+  for (size_t i = 0; (server->loops != NULL) && (i < server->num_of_loops); ++i)
+    {
+      if (server->loops[i].started){
+          pthread_join (server->loops[i].thread, NULL);
+      }
+      if (server->loops[i].epoll_fd >= 0){
+          close (server->loops[i].epoll_fd);
+      }
+    }
+  free (server->loops);
+  for (int i = 0; i < 2; ++i)
+    {
+      if (server->stop_pipe[i] >= 0){
+          close (server->stop_pipe[i]);
+      }
+    }
+  if (server->listen_fd >= 0){
+      close (server->listen_fd);
+  }
+  if (server->bound){ // only a socket this server created.
+      unlink (server->path);
+  }
+  for (size_t i = 0; (server->shards != NULL) && (i < server->num_of_shards);
+       ++i)
+    {
+      if (server->shards[i].map != NULL){
+          hashmap_free (&(server->shards[i].map));
+          pthread_rwlock_destroy (&(server->shards[i].lock));
+      }
+    }
+  free (server->shards);
+  free (server->path);
+  free (server);
+}
+
+map_server *map_server_start (const char *path, size_t num_of_shards,
+                              size_t num_of_threads)
+{
+  if (path == NULL){
+      return NULL;
+  }
+  map_server *server = calloc (1, sizeof (map_server));
+  if (server == NULL){
+      return NULL;
+  }
+  server->listen_fd = -1;
+  server->stop_pipe[0] = server->stop_pipe[1] = -1;
+  server->num_of_shards = (num_of_shards == 0) ? MAP_SERVER_DEFAULT_SHARDS :
+                          num_of_shards;
+  server->num_of_loops = (num_of_threads == 0) ? MAP_SERVER_DEFAULT_THREADS :
+                         num_of_threads;
+  server->path = malloc (strlen (path) + 1);
+  server->shards = calloc (server->num_of_shards, sizeof (map_server_shard));
+  server->loops = calloc (server->num_of_loops, sizeof (map_server_loop));
+  if ((server->path == NULL) || (server->shards == NULL)
+      || (server->loops == NULL)){
+      free_server (server);
+      return NULL;
+  }
+  strcpy (server->path, path);
+  server->hash_key[0] = (uint64_t) hashmap_random_seed ();
+  server->hash_key[1] = (uint64_t) hashmap_random_seed ();
+  for (size_t i = 0; i < server->num_of_loops; ++i)
+    {
+      server->loops[i].epoll_fd = -1;
+    }
+  for (size_t i = 0; i < server->num_of_shards; ++i)
+    {
+      if (pthread_rwlock_init (&(server->shards[i].lock), NULL) != 0){
+          free_server (server);
+          return NULL;
+      }
+      server->shards[i].map = hashmap_alloc (hash_strkey);
+      if (server->shards[i].map == NULL){
+          pthread_rwlock_destroy (&(server->shards[i].lock));
+          free_server (server);
+          return NULL;
+      }
+    }
+  if ((open_socket (server) == 0) || (pipe (server->stop_pipe) != 0)){
+      free_server (server);
+      return NULL;
+  }
+  for (size_t i = 0; i < server->num_of_loops; ++i)
+    {
+      if (start_loop (server, &(server->loops[i])) == 0){
+          free_server (server);
+          return NULL;
+      }
+    }
+  return server;
+}
+
+void map_server_stop (map_server **p_server)
+{
+  if ((p_server == NULL) || (*p_server == NULL)){
+      return;
+  }
+  free_server (*p_server);
+  *p_server = NULL;
+}
+
+size_t map_server_size (map_server *server)
+{
+  size_t size = 0;
+  for (size_t i = 0; i < server->num_of_shards; ++i)
+    {
+      pthread_rwlock_rdlock (&(server->shards[i].lock));
+      size += server->shards[i].map->size;
+      pthread_rwlock_unlock (&(server->shards[i].lock));
+    }
+  return size;
+}
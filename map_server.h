@@ -0,0 +1,103 @@
+#ifndef MAP_SERVER_H_
+#define MAP_SERVER_H_
+
+#include <stdlib.h>
+#include <pthread.h>
+#include "hashmap.h"
+#include "map_proto.h"
+
+/**
+ * A server that owns a sharded map of byte string keys and values, and
+ * serves it to other processes of the host over a Unix domain socket with
+ * the pipelined binary protocol of map_proto.h (see map_client.h).
+ * Every shard is a hashmap with strkey keys and values, behind its own
+ * read-write lock. The connections are spread between event loop threads,
+ * each waiting on its own epoll instance; a loop parses every complete
+ * request it has received, writes the replies straight into the
+ * connection's output buffer and sends the buffer as it is. A connection
+ * whose replies pile up (a client that pipelines without reading) is not
+ * read from until its output drains.
+ * Linux only (epoll).
+ */
+
+/**
+ * @def MAP_SERVER_DEFAULT_SHARDS, MAP_SERVER_DEFAULT_THREADS
+ * The numbers of shards and event loop threads map_server_start uses when
+ * it gets 0.
+ */
+#define MAP_SERVER_DEFAULT_SHARDS 16UL
+#define MAP_SERVER_DEFAULT_THREADS 2UL
+
+/**
+ * @def MAP_SERVER_MAX_PENDING_OUT
+ * A connection is not read from while it has this many reply bytes unsent.
+ */
+#define MAP_SERVER_MAX_PENDING_OUT (4UL << 20)
+
+/**
+ * @struct map_server_loop
+ * @param server the server of the loop.
+ * @param epoll_fd the epoll instance of the loop.
+ * @param thread the thread running the loop.
+ * @param started 1 if the thread was started.
+ * @param conns the connections the loop accepted.
+ */
+typedef struct map_server_loop {
+    struct map_server *server;
+    int epoll_fd;
+    pthread_t thread;
+    int started;
+    struct map_server_conn *conns;
+} map_server_loop;
+
+/**
+ * @struct map_server
+ * @param path the path of the socket.
+ * @param listen_fd the listening socket.
+ * @param bound 1 once listen_fd is bound to path (which is then removed by
+ * map_server_stop).
+ * @param stop_pipe a pipe whose read end wakes every loop when written to.
+ * @param shards, num_of_shards the shards of the map (map_server.c).
+ * @param loops, num_of_loops the event loops.
+ * @param hash_key the random secret key the keys are hashed with
+ * (strkey_hash_keyed).
+ */
+typedef struct map_server {
+    char *path;
+    int listen_fd;
+    int bound;
+    int stop_pipe[2];
+    struct map_server_shard *shards;
+    size_t num_of_shards;
+    map_server_loop *loops;
+    size_t num_of_loops;
+    uint64_t hash_key[2];
+} map_server;
+
+/**
+ * Creates the socket at path and starts serving an empty map. A socket
+ * left at path by a previous run is replaced; anything else at path (a
+ * file, or the socket of a live server) makes the start fail.
+ * @param path the path of the socket.
+ * @param num_of_shards the number of shards, 0 for MAP_SERVER_DEFAULT_SHARDS.
+ * @param num_of_threads the number of event loop threads, 0 for
+ * MAP_SERVER_DEFAULT_THREADS.
+ * @return pointer to dynamically allocated server.
+ * @if_fail return NULL.
+ */
+map_server *map_server_start (const char *path, size_t num_of_shards,
+                              size_t num_of_threads);
+
+/**
+ * Stops the server: closes every connection, removes the socket and frees
+ * the map.
+ * @param p_server pointer to dynamically allocated pointer to server.
+ */
+void map_server_stop (map_server **p_server);
+
+/**
+ * Returns the number of pairs in the map (locking every shard in turn).
+ */
+size_t map_server_size (map_server *server);
+
+#endif //MAP_SERVER_H_
@@ -0,0 +1,341 @@
+#include <stdint.h>
+#include "ordered_map.h"
+
+#define EMPTY_SLOT 0
+/*
+ * A full dense array is squeezed in place only if that frees at least
+ * 1 / MIN_SQUEEZE_GAIN of it, otherwise the index grows.
+ */
+#define MIN_SQUEEZE_GAIN 4
+
+/*
+ * Returns the smallest slot size able to hold positions up to
+ * entries_capacity plus the empty and erased markers.
+ */
+static size_t slot_size_for (size_t entries_capacity)
+{
+  if (entries_capacity + 1 < UINT8_MAX){
+      return sizeof (uint8_t);
+  }
+  if (entries_capacity + 1 < UINT16_MAX){
+      return sizeof (uint16_t);
+  }
+  if (entries_capacity + 1 < UINT32_MAX){
+      return sizeof (uint32_t);
+  }
+  return sizeof (uint64_t);
+}
+
+/*
+ * Returns the marker of an erased entry for the map's slot size.
+ */
+static size_t erased_slot (const ordered_map *map)
+{
+  switch (map->slot_size)
+    {
+      case sizeof (uint8_t): return UINT8_MAX;
+      case sizeof (uint16_t): return UINT16_MAX;
+      case sizeof (uint32_t): return UINT32_MAX;
+      default: return (size_t) UINT64_MAX;
+    }
+}
+
+static size_t get_slot (const ordered_map *map, size_t ind)
+{
+  switch (map->slot_size)
+    {
+      case sizeof (uint8_t): return ((const uint8_t *) map->index)[ind];
+      case sizeof (uint16_t): return ((const uint16_t *) map->index)[ind];
+      case sizeof (uint32_t): return ((const uint32_t *) map->index)[ind];
+      default: return (size_t) ((const uint64_t *) map->index)[ind];
+    }
+}
+
+static void set_slot (ordered_map *map, size_t ind, size_t val)
+{
+  switch (map->slot_size)
+    {
+      case sizeof (uint8_t): ((uint8_t *) map->index)[ind] = (uint8_t) val;
+        break;
+      case sizeof (uint16_t): ((uint16_t *) map->index)[ind] = (uint16_t) val;
+        break;
+      case sizeof (uint32_t): ((uint32_t *) map->index)[ind] = (uint32_t) val;
+        break;
+      default: ((uint64_t *) map->index)[ind] = (uint64_t) val;
+    }
+}
+
+/*
+ * Returns the index slot holding key, or capacity if there is none.
+ */
+static size_t find_slot (const ordered_map *map, const_keyT key, size_t hash)
+{
+  size_t mask = map->capacity - 1;
+  size_t erased = erased_slot (map);
+  for (size_t ind = hash & mask;; ind = (ind + 1) & mask)
+    {
+      size_t val = get_slot (map, ind);
+      if (val == EMPTY_SLOT){
+          return map->capacity;
+      }
+      if (val != erased){
+          const ordered_entry *cur = &(map->entries[val - 1]);
+          if ((cur->hash == hash)
+              && (cur->entry.key_cmp (cur->entry.key, key) == 1)){
+              return ind;
+          }
+      }
+    }
+}
+
+/*
+ * Squeezes the erased entries out of the dense array, then rebuilds the
+ * index with new_capacity slots (and room for as many entries as the index
+ * can hold before its next resize). The pairs are never copied.
+ * Returns 1 on success, 0 otherwise (the map is unchanged).
+ */
+static int rebuild (ordered_map *map, size_t new_capacity)
+{
+  size_t new_entries_capacity =
+      (size_t) (HASH_MAP_MAX_LOAD_FACTOR * new_capacity) + 1;
+  size_t new_slot_size = slot_size_for (new_entries_capacity);
+  void *new_index = calloc (new_capacity, new_slot_size);
+  if (new_index == NULL){
+      return 0;
+  }
+  if (new_entries_capacity > map->entries_capacity){
+      ordered_entry *entries = realloc (map->entries, sizeof (ordered_entry)
+                                                      * new_entries_capacity);
+      if (entries == NULL){
+          free (new_index);
+          return 0;
+      }
+      map->entries = entries;
+  }
+  size_t live = 0;
+  for (size_t i = 0; i < map->num_entries; ++i)
+    {
+      if (map->entries[i].entry.key != NULL){
+          map->entries[live++] = map->entries[i];
+      }
+    }
+  map->num_entries = live;
+  if (new_entries_capacity < map->entries_capacity){
+      ordered_entry *entries = realloc (map->entries, sizeof (ordered_entry)
+                                                      * new_entries_capacity);
+      if (entries != NULL){ // otherwise keep the larger array.
+          map->entries = entries;
+      }
+  }
+  map->entries_capacity = new_entries_capacity;
+  free (map->index);
+  map->index = new_index;
+  map->slot_size = new_slot_size;
+  map->capacity = new_capacity;
+  size_t mask = new_capacity - 1;
+  for (size_t i = 0; i < map->num_entries; ++i)
+    {
+      size_t ind = map->entries[i].hash & mask;
+      while (get_slot (map, ind) != EMPTY_SLOT){
+          ind = (ind + 1) & mask;
+      }
+      set_slot (map, ind, i + 1);
+    }
+  return 1;
+}
+
+/**
+ * Allocates dynamically new ordered map.
+ * @return pointer to dynamically allocated ordered map.
+ * @if_fail return NULL.
+ */
+ordered_map *ordered_map_alloc (hash_func func)
+{
+  if (func == NULL){
+      return NULL;
+  }
+  ordered_map *map = malloc (sizeof (ordered_map));
+  if (map == NULL){
+      return NULL;
+  }
+  map->entries = NULL;
+  map->num_entries = 0;
+  map->entries_capacity = 0;
+  map->index = NULL;
+  map->size = 0;
+  map->hash_func = func;
+  if (rebuild (map, HASH_MAP_INITIAL_CAP) == 0){
+      free (map);
+      return NULL;
+  }
+  return map;
+}
+
+/**
+ * Frees an ordered map and the pairs it holds.
+ * @param p_map pointer to dynamically allocated pointer to ordered map.
+ */
+void ordered_map_free (ordered_map **p_map)
+{
+  if ((p_map == NULL) || (*p_map == NULL)){
+      return;
+  }
+  ordered_map *map = *p_map;
+  for (size_t i = 0; i < map->num_entries; ++i)
+    {
+      pair *cur = &(map->entries[i].entry);
+      if (cur->key != NULL){
+          cur->key_free (&(cur->key));
+          cur->value_free (&(cur->value));
+      }
+    }
+  free (map->entries);
+  free (map->index);
+  free (map);
+  *p_map = NULL;
+}
+
+/**
+ * Inserts a copy of in_pair at the end of the map.
+ * @return returns 1 for successful insertion, 0 otherwise.
+ */
+int ordered_map_insert (ordered_map *map, const pair *in_pair)
+{
+  if ((map == NULL) || (in_pair == NULL)){
+      return 0;
+  }
+  if ((in_pair->key == NULL) || (in_pair->value == NULL)){
+      return 0;
+  }
+  size_t hash = map->hash_func (in_pair->key);
+  if (find_slot (map, in_pair->key, hash) != map->capacity){
+      return 0;
+  }
+  if (map->num_entries + 1 >= map->entries_capacity){
+      // the dense array is full: grow unless erased entries make room for
+      // enough inserts to pay for the rebuild.
+      size_t new_capacity = map->capacity;
+      size_t min_gain = map->entries_capacity / MIN_SQUEEZE_GAIN;
+      if (map->size + 1 + min_gain > map->entries_capacity){
+          new_capacity *= HASH_MAP_GROWTH_FACTOR;
+      }
+      if (rebuild (map, new_capacity) == 0){
+          return 0;
+      }
+  }
+  ordered_entry *new_entry = &(map->entries[map->num_entries]);
+  new_entry->entry = *in_pair;
+  new_entry->entry.key = in_pair->key_cpy (in_pair->key);
+  if (new_entry->entry.key == NULL){
+      return 0;
+  }
+  new_entry->entry.value = in_pair->value_cpy (in_pair->value);
+  if (new_entry->entry.value == NULL){
+      new_entry->entry.key_free (&(new_entry->entry.key));
+      return 0;
+  }
+  new_entry->hash = hash;
+  size_t mask = map->capacity - 1;
+  size_t ind = hash & mask;
+  size_t erased = erased_slot (map);
+  while ((get_slot (map, ind) != EMPTY_SLOT) && (get_slot (map, ind) != erased)){
+      ind = (ind + 1) & mask;
+  }
+  map->num_entries += 1;
+  set_slot (map, ind, map->num_entries);
+  map->size += 1;
+  return 1;
+}
+
+/**
+ * @return the value associated with key if exists, NULL otherwise.
+ */
+valueT ordered_map_at (const ordered_map *map, const_keyT key)
+{
+  if ((map == NULL) || (key == NULL)){
+      return NULL;
+  }
+  size_t ind = find_slot (map, key, map->hash_func (key));
+  if (ind == map->capacity){
+      return NULL;
+  }
+  return map->entries[get_slot (map, ind) - 1].entry.value;
+}
+
+/**
+ * The function erases the pair associated with key.
+ * @return 1 if the erasing was done successfully, 0 otherwise.
+ */
+int ordered_map_erase (ordered_map *map, const_keyT key)
+{
+  if ((map == NULL) || (key == NULL)){
+      return 0;
+  }
+  size_t ind = find_slot (map, key, map->hash_func (key));
+  if (ind == map->capacity){
+      return 0;
+  }
+  pair *cur = &(map->entries[get_slot (map, ind) - 1].entry);
+  cur->key_free (&(cur->key));
+  cur->value_free (&(cur->value));
+  set_slot (map, ind, erased_slot (map));
+  map->size -= 1;
+  if ((map->capacity > HASH_MAP_INITIAL_CAP)
+      && (ordered_map_get_load_factor (map) <= HASH_MAP_MIN_LOAD_FACTOR)){
+      rebuild (map, map->capacity / HASH_MAP_GROWTH_FACTOR); // best effort.
+  }
+  return 1;
+}
+
+/**
+ * @return the map's load factor, -1 if the function failed.
+ */
+double ordered_map_get_load_factor (const ordered_map *map)
+{
+  if ((map == NULL) || (map->capacity == 0)){
+      return -1;
+  }
+  return (double) map->size / map->capacity;
+}
+
+/**
+ * Iterates the pairs in insertion order.
+ * @return the next pair (not a copy), NULL at the end.
+ */
+const pair *ordered_map_next (const ordered_map *map, size_t *pos)
+{
+  if ((map == NULL) || (pos == NULL)){
+      return NULL;
+  }
+  while (*pos < map->num_entries){
+      const pair *cur = &(map->entries[*pos].entry);
+      *pos += 1;
+      if (cur->key != NULL){
+          return cur;
+      }
+  }
+  return NULL;
+}
+
+/**
+ * Applies valT_func on the values whose keys meet keyT_func, in insertion
+ * order.
+ * @return number of changed values
+ */
+int ordered_map_apply_if (const ordered_map *map, keyT_func keyT_func,
+                          valueT_func valT_func)
+{
+  if ((map == NULL) || (keyT_func == NULL) || (valT_func == NULL)){
+      return 0;
+  }
+  int changed_vals = 0;
+  for (size_t i = 0; i < map->num_entries; ++i)
+    {
+      const pair *cur = &(map->entries[i].entry);
+      if ((cur->key != NULL) && (keyT_func (cur->key) == 1)){
+          valT_func (cur->value);
+          changed_vals++;
+      }
+    }
+  return changed_vals;
+}
@@ -0,0 +1,110 @@
+#ifndef ORDERED_MAP_H_
+#define ORDERED_MAP_H_
+
+#include <stdlib.h>
+#include "hashmap.h"
+
+/**
+ * An insertion ordered, compact hash map.
+ * The pairs live in one dense array in insertion order, and the hash table
+ * (the index) only holds small integer positions into that array, using
+ * 1, 2, 4 or 8 byte slots depending on the number of entries.
+ * Iteration is a linear scan of the dense array, in insertion order, and a
+ * resize rebuilds only the index (squeezing out erased entries).
+ */
+
+/**
+ * @struct ordered_entry
+ * @param hash the hash of the key.
+ * @param entry the key and value (owned copies), entry.key is NULL if the
+ * pair was erased.
+ */
+typedef struct ordered_entry {
+    size_t hash;
+    pair entry;
+} ordered_entry;
+
+/**
+ * @struct ordered_map
+ * @param entries the dense entry array, in insertion order.
+ * @param num_entries the number of used positions in entries (including
+ * erased ones).
+ * @param entries_capacity the allocated length of entries.
+ * @param index the hash table: position + 1 of an entry, 0 for an empty
+ * slot, the maximal slot value for an erased entry.
+ * @param slot_size the size in bytes of an index slot (1, 2, 4 or 8).
+ * @param size the number of pairs in the map.
+ * @param capacity the number of index slots (a power of 2).
+ * @param hash_func a function which "hashes" keys.
+ */
+typedef struct ordered_map {
+    ordered_entry *entries;
+    size_t num_entries;
+    size_t entries_capacity;
+    void *index;
+    size_t slot_size;
+    size_t size;
+    size_t capacity;
+    hash_func hash_func;
+} ordered_map;
+
+/**
+ * Allocates dynamically new ordered map.
+ * @param func a function which "hashes" keys.
+ * @return pointer to dynamically allocated ordered map.
+ * @if_fail return NULL.
+ */
+ordered_map *ordered_map_alloc (hash_func func);
+
+/**
+ * Frees an ordered map and the pairs it holds.
+ * @param p_map pointer to dynamically allocated pointer to ordered map.
+ */
+void ordered_map_free (ordered_map **p_map);
+
+/**
+ * Inserts a copy of in_pair at the end of the map.
+ * @return returns 1 for successful insertion, 0 otherwise (also if the key
+ * is already in the map).
+ */
+int ordered_map_insert (ordered_map *map, const pair *in_pair);
+
+/**
+ * @return the value associated with key if exists, NULL otherwise (the value
+ * itself, not a copy of it).
+ */
+valueT ordered_map_at (const ordered_map *map, const_keyT key);
+
+/**
+ * The function erases the pair associated with key, the order of the
+ * remaining pairs is kept.
+ * @return 1 if the erasing was done successfully, 0 otherwise.
+ */
+int ordered_map_erase (ordered_map *map, const_keyT key);
+
+/**
+ * @return the map's load factor (pairs per index slot), -1 if the
+ * function failed.
+ */
+double ordered_map_get_load_factor (const ordered_map *map);
+
+/**
+ * Iterates the pairs in insertion order.
+ * Example:
+ *   size_t pos = 0;
+ *   const pair *cur;
+ *   while ((cur = ordered_map_next (map, &pos)) != NULL) {...}
+ * @param pos the iteration position, set to 0 to start.
+ * @return the next pair (not a copy), NULL at the end.
+ */
+const pair *ordered_map_next (const ordered_map *map, size_t *pos);
+
+/**
+ * Applies valT_func on the values whose keys meet keyT_func, in insertion
+ * order (see hashmap_apply_if).
+ * @return number of changed values
+ */
+int ordered_map_apply_if (const ordered_map *map, keyT_func keyT_func,
+                          valueT_func valT_func);
+
+#endif //ORDERED_MAP_H_
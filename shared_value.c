@@ -0,0 +1,99 @@
+#include "shared_value.h"
+
+/**
+ * Allocates dynamically a handle that takes ownership of data, with one
+ * reference (the caller's).
+ * @return pointer to dynamically allocated handle.
+ * @if_fail return NULL (data is not freed).
+ */
+shared_value *shared_value_alloc (valueT data, pair_value_cmp data_cmp,
+                                  pair_value_free data_free)
+{
+  if ((data_cmp == NULL) || (data_free == NULL)){
+      return NULL;
+  }
+  shared_value *value = malloc (sizeof (shared_value));
+  if (value == NULL){
+      return NULL;
+  }
+  value->refs = 1;
+  value->data = data;
+  value->data_cmp = data_cmp;
+  value->data_free = data_free;
+  return value;
+}
+
+/**
+ * @return the data of the handle, NULL if value is NULL.
+ */
+const_valueT shared_value_data (const shared_value *value)
+{
+  return (value == NULL) ? NULL : value->data;
+}
+
+/**
+ * @return the current number of references to the handle.
+ */
+size_t shared_value_refs (const shared_value *value)
+{
+  if (value == NULL){
+      return 0;
+  }
+  return __atomic_load_n (&(value->refs), __ATOMIC_ACQUIRE);
+}
+
+/**
+ * Drops the caller's reference to a handle, the last reference frees it
+ * with its data.
+ */
+void shared_value_release (shared_value **p_value)
+{
+  if ((p_value == NULL) || (*p_value == NULL)){
+      return;
+  }
+  shared_value *value = *p_value;
+  *p_value = NULL;
+  if (__atomic_sub_fetch (&(value->refs), 1, __ATOMIC_ACQ_REL) == 0){
+      value->data_free (&(value->data));
+      free (value);
+  }
+}
+
+/**
+ * Copies a shared value (pair_value_cpy): takes a reference.
+ * The data is not touched, so a reference is taken in O(1) whatever its size.
+ */
+valueT shared_value_cpy (const_valueT value)
+{
+  if (value == NULL){
+      return NULL;
+  }
+  shared_value *handle = (shared_value *) value;
+  __atomic_add_fetch (&(handle->refs), 1, __ATOMIC_RELAXED);
+  return handle;
+}
+
+/**
+ * Compares two shared values (pair_value_cmp).
+ * @return 1 if the values are equal, 0 otherwise.
+ */
+int shared_value_cmp (const_valueT value_1, const_valueT value_2)
+{
+  if (value_1 == value_2){
+      return 1;
+  }
+  if ((value_1 == NULL) || (value_2 == NULL)){
+      return 0;
+  }
+  const shared_value *handle_1 = (const shared_value *) value_1;
+  const shared_value *handle_2 = (const shared_value *) value_2;
+  return handle_1->data_cmp (handle_1->data, handle_2->data);
+}
+
+/**
+ * Frees a shared value (pair_value_free): drops a reference.
+ */
+void shared_value_free (valueT *value)
+{
+  shared_value_release ((shared_value **) value);
+}
@@ -0,0 +1,88 @@
+#ifndef SHARED_VALUE_H_
+#define SHARED_VALUE_H_
+
+#include <stdlib.h>
+#include "pair.h"
+
+/**
+ * @struct shared_value - a reference counted handle to a value.
+ * @param refs the number of references to the handle (atomic).
+ * @param data the value itself, owned by the handle.
+ * @param data_cmp compare function for the data.
+ * @param data_free free function for the data, called with the last
+ * reference.
+ *
+ * A shared_value is used as the valueT of a pair, with the shared_value_*
+ * functions as the value functions: copying such a pair (on insertion into
+ * a map, into a snapshot's bucket, in a merge ...) takes a reference to the
+ * same handle instead of copying the data, and freeing it drops the
+ * reference. So one large value can be put into several maps (or into an
+ * index and its secondary indexes) and is stored once. The counts are
+ * atomic, so maps on different threads can share values; the data should
+ * not be modified once it is shared, replace the handle instead.
+ * Example:
+ *   shared_value *value = shared_value_alloc (record, record_cmp, record_free);
+ *   pair *p = pair_alloc (&key, value, int_key_cpy, shared_value_cpy,
+ *                         int_key_cmp, shared_value_cmp, basic_data_key_free,
+ *                         shared_value_free);
+ *   hashmap_insert (by_id, p);
+ *   hashmap_insert (by_name, p_with_the_same_value);
+ *   shared_value_release (&value);
+ */
+typedef struct shared_value {
+    size_t refs;
+    valueT data;
+    pair_value_cmp data_cmp;
+    pair_value_free data_free;
+} shared_value;
+
+/**
+ * Allocates dynamically a handle that takes ownership of data, with one
+ * reference (the caller's, dropped with shared_value_release).
+ * @param data dynamically allocated value.
+ * @param data_cmp compare function for the data.
+ * @param data_free free function for the data.
+ * @return pointer to dynamically allocated handle.
+ * @if_fail return NULL (data is not freed).
+ */
+shared_value *shared_value_alloc (valueT data, pair_value_cmp data_cmp,
+                                  pair_value_free data_free);
+
+/**
+ * @param value a handle.
+ * @return the data of the handle, NULL if value is NULL.
+ */
+const_valueT shared_value_data (const shared_value *value);
+
+/**
+ * @param value a handle.
+ * @return the current number of references to the handle.
+ */
+size_t shared_value_refs (const shared_value *value);
+
+/**
+ * Drops the caller's reference to a handle, the last reference frees it
+ * with its data.
+ * @param p_value pointer to pointer to the handle, set to NULL.
+ */
+void shared_value_release (shared_value **p_value);
+
+/**
+ * Copies a shared value (pair_value_cpy): takes a reference.
+ * @return the same handle.
+ */
+valueT shared_value_cpy (const_valueT value);
+
+/**
+ * Compares two shared values (pair_value_cmp), the same handle without
+ * comparing the data.
+ * @return 1 if the values are equal, 0 otherwise.
+ */
+int shared_value_cmp (const_valueT value_1, const_valueT value_2);
+
+/**
+ * Frees a shared value (pair_value_free): drops a reference.
+ */
+void shared_value_free (valueT *value);
+
+#endif //SHARED_VALUE_H_
@@ -0,0 +1,665 @@
+#define _POSIX_C_SOURCE 200809L
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include "spill_map.h"
+
+#define PAGE_HASH_MUL 0x9e3779b97f4a7c15ULL
+#define LEN_BYTES sizeof (uint32_t)
+
+/**
+ * @def SPILL_PAGE_OUT, SPILL_PAGE_QUEUED, SPILL_PAGE_LOADING,
+ * SPILL_PAGE_LOADED, SPILL_PAGE_IN
+ * The states of a page: in the file (or empty), waiting for a prefetch
+ * thread, being read by one, read but not installed yet, resident.
+ */
+#define SPILL_PAGE_OUT 0
+#define SPILL_PAGE_QUEUED 1
+#define SPILL_PAGE_LOADING 2
+#define SPILL_PAGE_LOADED 3
+#define SPILL_PAGE_IN 4
+
+/*
+ * @struct spill_map_page
+ * @param map the pairs of a resident page, NULL otherwise.
+ * @param loaded the pairs read by a prefetch thread (SPILL_PAGE_LOADED).
+ * @param state the state, changed under the lock of the map.
+ * @param referenced the reference bit of the clock.
+ * @param dirty 1 if the page changed since it was last written.
+ * @param offset, extent the place of the page in the file.
+ * @param disk_bytes the size of the page in the file, 0 if it is empty.
+ * @param disk_pairs the number of pairs of the page in the file.
+ * @param payload_bytes the encoded size of the keys and values.
+ * @param mem_bytes the part of resident_bytes this page takes.
+ *
+ * Only the thread calling the map's functions changes map, offset, extent
+ * and disk_bytes, and a prefetch thread reads a page's place in the file
+ * only while the page is not resident, so they need no lock.
+ */
+typedef struct spill_map_page {
+    hashmap *map;
+    hashmap *loaded;
+    int state;
+    int referenced;
+    int dirty;
+    uint64_t offset;
+    size_t extent;
+    size_t disk_bytes;
+    size_t disk_pairs;
+    size_t payload_bytes;
+    size_t mem_bytes;
+} spill_map_page;
+
+static size_t page_of (const spill_map *map, const_keyT key)
+{
+  if (map->page_bits == 0){
+      return 0;
+  }
+  uint64_t hash = (uint64_t) map->func (key) * PAGE_HASH_MUL;
+  return (size_t) (hash >> (64 - map->page_bits));
+}
+
+static int image_reserve (wal_buffer *buf, size_t extra)
+{
+  if (buf->len + extra <= buf->capacity){
+      return 1;
+  }
+  size_t capacity = (buf->capacity == 0) ? SPILL_MAP_EXTENT_ALIGN
+                                         : buf->capacity;
+  while (capacity < buf->len + extra){
+      capacity *= 2;
+  }
+  char *data = realloc (buf->data, capacity);
+  if (data == NULL){
+      return 0;
+  }
+  buf->data = data;
+  buf->capacity = capacity;
+  return 1;
+}
+
+/*
+ * Appends a length prefixed encoding of elem to buf.
+ */
+static int append_encoded (wal_buffer *buf, wal_encode_func encode,
+                           const void *elem)
+{
+  size_t len = encode (elem, NULL, 0);
+  if ((len > UINT32_MAX) || (image_reserve (buf, LEN_BYTES + len) == 0)){
+      return 0;
+  }
+  uint32_t len32 = (uint32_t) len;
+  memcpy (buf->data + buf->len, &len32, LEN_BYTES);
+  encode (elem, buf->data + buf->len + LEN_BYTES, len);
+  buf->len += LEN_BYTES + len;
+  return 1;
+}
+
+/*
+ * Serializes the pairs of a page into map->image: the length and the
+ * encoding of every key and value, in the host byte order.
+ */
+static int encode_page (spill_map *map, const hashmap *page_map)
+{
+  map->image.len = 0;
+  int ok = 1;
+  if (page_map->buckets == NULL){
+      for (size_t i = 0; ok && (i < page_map->size); ++i)
+        {
+          const pair *cur_pair = page_map->small_pairs[i];
+          ok = append_encoded (&(map->image), map->codec.key_encode,
+                               cur_pair->key)
+               && append_encoded (&(map->image), map->codec.value_encode,
+                                  cur_pair->value);
+        }
+      return ok;
+  }
+  for (size_t i = 0; ok && (i < page_map->capacity); ++i)
+    {
+      const vector *vec = page_map->buckets[i];
+      for (size_t j = 0; ok && (j < vec->size); ++j)
+        {
+          const pair *cur_pair = (const pair *) vec->data[j];
+          ok = append_encoded (&(map->image), map->codec.key_encode,
+                               cur_pair->key)
+               && append_encoded (&(map->image), map->codec.value_encode,
+                                  cur_pair->value);
+        }
+    }
+  return ok;
+}
+
+/*
+ * Rebuilds a page of num_of_pairs pairs from its image.
+ */
+static hashmap *decode_page (const spill_map *map, const char *image,
+                             size_t len, size_t num_of_pairs)
+{
+  const wal_codec *codec = &(map->codec);
+  hashmap *page_map = hashmap_alloc (map->func);
+  if ((page_map != NULL) && (hashmap_reserve (page_map, num_of_pairs) == 0)){
+      hashmap_free (&page_map);
+  }
+  size_t pos = 0;
+  while ((page_map != NULL) && (pos < len)){
+      uint32_t key_len, value_len;
+      memcpy (&key_len, image + pos, LEN_BYTES);
+      const char *key_bytes = image + pos + LEN_BYTES;
+      memcpy (&value_len, key_bytes + key_len, LEN_BYTES);
+      const char *value_bytes = key_bytes + key_len + LEN_BYTES;
+      pos += 2 * LEN_BYTES + key_len + value_len;
+      keyT key = codec->key_decode (key_bytes, key_len);
+      valueT value = codec->value_decode (value_bytes, value_len);
+      pair tmp = {key, value, codec->key_cpy, codec->value_cpy,
+                  codec->key_cmp, codec->value_cmp, codec->key_free,
+                  codec->value_free};
+      if ((key == NULL) || (value == NULL)
+          || (hashmap_insert (page_map, &tmp) == 0)){
+          hashmap_free (&page_map);
+      }
+      if (key != NULL){
+          codec->key_free (&key);
+      }
+      if (value != NULL){
+          codec->value_free (&value);
+      }
+  }
+  return page_map;
+}
+
+/*
+ * Reads a page from the file (an empty page if it was never written).
+ * Called by the prefetch threads too.
+ */
+static hashmap *read_page (const spill_map *map, const spill_map_page *page)
+{
+  if (page->disk_bytes == 0){
+      return hashmap_alloc (map->func);
+  }
+  char *image = malloc (page->disk_bytes);
+  if (image == NULL){
+      return NULL;
+  }
+  size_t done = 0;
+  while (done < page->disk_bytes){
+      ssize_t got = pread (map->fd, image + done, page->disk_bytes - done,
+                           (off_t) (page->offset + done));
+      if ((got < 0) && (errno == EINTR)){
+          continue;
+      }
+      if (got <= 0){
+          free (image);
+          return NULL;
+      }
+      done += (size_t) got;
+  }
+  hashmap *page_map = decode_page (map, image, page->disk_bytes,
+                                   page->disk_pairs);
+  free (image);
+  return page_map;
+}
+
+static int write_at (int fd, const char *data, size_t len, uint64_t offset)
+{
+  while (len > 0){
+      ssize_t written = pwrite (fd, data, len, (off_t) offset);
+      if (written < 0){
+          if (errno == EINTR){
+              continue;
+          }
+          return 0;
+      }
+      data += written;
+      len -= (size_t) written;
+      offset += (size_t) written;
+  }
+  return 1;
+}
+
+/*
+ * Writes a dirty page to its extent, or to a new extent at the end of the
+ * file if it outgrew it.
+ */
+static int write_page (spill_map *map, spill_map_page *page)
+{
+  if (encode_page (map, page->map) == 0){
+      return 0;
+  }
+  size_t len = map->image.len;
+  if (len > page->extent){
+      size_t extent = (len + SPILL_MAP_EXTENT_ALIGN - 1)
+                      & ~(SPILL_MAP_EXTENT_ALIGN - 1);
+      extent = (extent < 2 * page->extent) ? 2 * page->extent : extent;
+      if (write_at (map->fd, map->image.data, len,
+                    map->stats.file_bytes) == 0){
+          return 0;
+      }
+      page->offset = map->stats.file_bytes;
+      page->extent = extent;
+      map->stats.file_bytes += extent;
+  }
+  else if (write_at (map->fd, map->image.data, len, page->offset) == 0){
+      return 0;
+  }
+  page->disk_bytes = len;
+  page->disk_pairs = page->map->size;
+  page->dirty = 0;
+  map->stats.pages_written += 1;
+  return 1;
+}
+
+/*
+ * Writes (if dirty) and frees a resident page.
+ */
+static int evict_page (spill_map *map, spill_map_page *page)
+{
+  if (page->dirty && (write_page (map, page) == 0)){
+      map->failed = 1;
+      return 0;
+  }
+  hashmap_free (&(page->map));
+  pthread_mutex_lock (&(map->lock));
+  page->state = SPILL_PAGE_OUT;
+  pthread_mutex_unlock (&(map->lock));
+  map->stats.resident_bytes -= page->mem_bytes;
+  map->stats.resident_pages -= 1;
+  map->stats.evictions += 1;
+  page->mem_bytes = 0;
+  return 1;
+}
+
+/*
+ * Evicts pages with the clock until the resident pages fit in the budget.
+ * The page pinned (the one in use) is never evicted.
+ */
+static void evict_over_budget (spill_map *map, size_t pinned)
+{
+  size_t steps = 0;
+  while (!map->failed && (map->stats.resident_bytes > map->memory_budget)
+         && (steps < 2 * map->num_of_pages)){
+      size_t ind = map->clock_hand;
+      spill_map_page *page = &(map->pages[ind]);
+      map->clock_hand = (ind + 1) & (map->num_of_pages - 1);
+      steps += 1;
+      if ((page->map == NULL) || (ind == pinned)){
+          continue;
+      }
+      if (page->referenced){
+          page->referenced = 0; // a second chance.
+          continue;
+      }
+      evict_page (map, page);
+      steps = 0;
+  }
+}
+
+/*
+ * Updates the memory of a resident page after it changed, and evicts
+ * others if the budget is exceeded.
+ */
+static void account_page (spill_map *map, size_t ind)
+{
+  spill_map_page *page = &(map->pages[ind]);
+  hashmap_memory_usage usage;
+  hashmap_get_memory_usage (page->map, &usage);
+  size_t bytes = usage.total_bytes + page->payload_bytes;
+  map->stats.resident_bytes = map->stats.resident_bytes - page->mem_bytes
+                              + bytes;
+  page->mem_bytes = bytes;
+  evict_over_budget (map, ind);
+}
+
+/*
+ * Returns the pairs of page ind, reading the page (or taking it from a
+ * prefetch thread) if it is not resident.
+ */
+static hashmap *get_page (spill_map *map, size_t ind)
+{
+  spill_map_page *page = &(map->pages[ind]);
+  page->referenced = 1;
+  if (page->map != NULL){
+      return page->map;
+  }
+  hashmap *page_map = NULL;
+  pthread_mutex_lock (&(map->lock));
+  while (page->state == SPILL_PAGE_LOADING){
+      pthread_cond_wait (&(map->loaded), &(map->lock));
+    }
+  if (page->state == SPILL_PAGE_LOADED){
+      page_map = page->loaded;
+      page->loaded = NULL;
+  }
+  page->state = SPILL_PAGE_IN; // a queued page is skipped by the threads.
+  pthread_mutex_unlock (&(map->lock));
+  if (page_map != NULL){
+      map->stats.prefetched += (page->disk_bytes > 0);
+  }
+  else{
+      page_map = read_page (map, page);
+      map->stats.page_faults += (page->disk_bytes > 0);
+  }
+  if (page_map == NULL){
+      pthread_mutex_lock (&(map->lock));
+      page->state = SPILL_PAGE_OUT;
+      pthread_mutex_unlock (&(map->lock));
+      return NULL;
+  }
+  page->map = page_map;
+  page->payload_bytes = page->disk_bytes - 2 * LEN_BYTES * page_map->size;
+  page->mem_bytes = 0;
+  map->stats.resident_pages += 1;
+  account_page (map, ind);
+  return page_map;
+}
+
+static void *prefetch_thread (void *arg)
+{
+  spill_map *map = (spill_map *) arg;
+  pthread_mutex_lock (&(map->lock));
+  while (1){
+      while (!map->stop && (map->queue_len == 0)){
+          pthread_cond_wait (&(map->wake), &(map->lock));
+        }
+      if (map->stop){
+          break;
+      }
+      size_t ind = map->queue[map->queue_head];
+      map->queue_head = (map->queue_head + 1) & (map->num_of_pages - 1);
+      map->queue_len -= 1;
+      spill_map_page *page = &(map->pages[ind]);
+      if (page->state != SPILL_PAGE_QUEUED){
+          continue; // taken by get_page meanwhile.
+      }
+      page->state = SPILL_PAGE_LOADING;
+      pthread_mutex_unlock (&(map->lock));
+      hashmap *page_map = read_page (map, page);
+      pthread_mutex_lock (&(map->lock));
+      page->loaded = page_map;
+      page->state = SPILL_PAGE_LOADED;
+      pthread_cond_broadcast (&(map->loaded));
+  }
+  pthread_mutex_unlock (&(map->lock));
+  return NULL;
+}
+
+/*
+ * Queues page ind for the prefetch threads, if it is in the file and the
+ * queue has room.
+ */
+static void prefetch_page (spill_map *map, size_t ind)
+{
+  spill_map_page *page = &(map->pages[ind]);
+  if ((map->num_of_threads == 0) || (page->map != NULL)
+      || (page->disk_bytes == 0)){
+      return;
+  }
+  pthread_mutex_lock (&(map->lock));
+  if ((page->state == SPILL_PAGE_OUT) && (map->queue_len < map->num_of_pages)){
+      size_t tail = (map->queue_head + map->queue_len)
+                    & (map->num_of_pages - 1);
+      map->queue[tail] = ind;
+      map->queue_len += 1;
+      page->state = SPILL_PAGE_QUEUED;
+      pthread_cond_signal (&(map->wake));
+  }
+  pthread_mutex_unlock (&(map->lock));
+}
+
+/**
+ * Creates an empty map that spills its pages to a new file at path.
+ * @return pointer to dynamically allocated map.
+ * @if_fail return NULL.
+ */
+spill_map *spill_map_open (const char *path, hash_func func,
+                           const wal_codec *codec, size_t num_of_pages,
+                           size_t memory_budget, size_t num_of_threads)
+{
+  if ((path == NULL) || (func == NULL) || (codec == NULL)
+      || (codec->key_encode == NULL) || (codec->value_encode == NULL)
+      || (codec->key_decode == NULL) || (codec->value_decode == NULL)
+      || (num_of_pages > SPILL_MAP_MAX_PAGES)){
+      return NULL;
+  }
+  spill_map *map = calloc (1, sizeof (spill_map));
+  if (map == NULL){
+      return NULL;
+  }
+  num_of_pages = (num_of_pages == 0) ? SPILL_MAP_DEFAULT_PAGES : num_of_pages;
+  map->num_of_pages = 1;
+  while (map->num_of_pages < num_of_pages){
+      map->num_of_pages *= 2;
+      map->page_bits += 1;
+  }
+  map->func = func;
+  map->codec = *codec;
+  map->memory_budget = (memory_budget == 0) ? SPILL_MAP_DEFAULT_BUDGET
+                                            : memory_budget;
+  map->pages = calloc (map->num_of_pages, sizeof (spill_map_page));
+  map->queue = malloc (sizeof (size_t) * map->num_of_pages);
+  map->threads = calloc (num_of_threads + 1, sizeof (pthread_t));
+  map->fd = open (path, O_RDWR | O_CREAT | O_EXCL, 0600);
+  if ((map->pages == NULL) || (map->queue == NULL) || (map->threads == NULL)
+      || (map->fd < 0)){
+      if (map->fd >= 0){
+          close (map->fd);
+          unlink (path);
+      }
+      free (map->pages);
+      free (map->queue);
+      free (map->threads);
+      free (map);
+      return NULL;
+  }
+  unlink (path); // the file lives as long as the descriptor.
+  pthread_mutex_init (&(map->lock), NULL);
+  pthread_cond_init (&(map->wake), NULL);
+  pthread_cond_init (&(map->loaded), NULL);
+  for (; map->num_of_threads < num_of_threads; ++map->num_of_threads)
+    {
+      if (pthread_create (&(map->threads[map->num_of_threads]), NULL,
+                          prefetch_thread, map) != 0){
+          break; // fewer prefetch threads.
+      }
+    }
+  return map;
+}
+
+/**
+ * Stops the prefetch threads, frees the map and closes its file.
+ */
+void spill_map_close (spill_map **p_map)
+{
+  if ((p_map == NULL) || (*p_map == NULL)){
+      return;
+  }
+  spill_map *map = *p_map;
+  pthread_mutex_lock (&(map->lock));
+  map->stop = 1;
+  pthread_cond_broadcast (&(map->wake));
+  pthread_mutex_unlock (&(map->lock));
+  for (size_t i = 0; i < map->num_of_threads; ++i)
+    {
+      pthread_join (map->threads[i], NULL);
+    }
+  for (size_t i = 0; i < map->num_of_pages; ++i)
+    {
+      if (map->pages[i].map != NULL){
+          hashmap_free (&(map->pages[i].map));
+      }
+      if (map->pages[i].loaded != NULL){
+          hashmap_free (&(map->pages[i].loaded));
+      }
+    }
+  close (map->fd);
+  pthread_mutex_destroy (&(map->lock));
+  pthread_cond_destroy (&(map->wake));
+  pthread_cond_destroy (&(map->loaded));
+  free (map->image.data);
+  free (map->pages);
+  free (map->queue);
+  free (map->threads);
+  free (map);
+  *p_map = NULL;
+}
+
+/**
+ * Inserts a copy of in_pair, like hashmap_insert.
+ * @return 1 on success, 0 if the key is already in the map or on failure.
+ */
+int spill_map_insert (spill_map *map, const pair *in_pair)
+{
+  if ((map == NULL) || (in_pair == NULL)){
+      return 0;
+  }
+  if (map->failed){
+      return 0; // nothing is evicted any more, the memory would grow.
+  }
+  size_t ind = page_of (map, in_pair->key);
+  hashmap *page_map = get_page (map, ind);
+  if ((page_map == NULL) || (hashmap_insert (page_map, in_pair) == 0)){
+      return 0;
+  }
+  spill_map_page *page = &(map->pages[ind]);
+  page->payload_bytes += map->codec.key_encode (in_pair->key, NULL, 0)
+                         + map->codec.value_encode (in_pair->value, NULL, 0);
+  page->dirty = 1;
+  map->size += 1;
+  account_page (map, ind);
+  return 1;
+}
+
+/**
+ * Returns the value of key, like hashmap_at (valid until the next call on
+ * the map).
+ * @return the value, NULL if key is not in the map or on failure.
+ */
+valueT spill_map_at (spill_map *map, const_keyT key)
+{
+  if ((map == NULL) || (key == NULL)){
+      return NULL;
+  }
+  hashmap *page_map = get_page (map, page_of (map, key));
+  return (page_map == NULL) ? NULL : hashmap_at (page_map, key);
+}
+
+/*
+ * A key of a batch and its page.
+ */
+typedef struct batch_key {
+    size_t page;
+    size_t ind;
+} batch_key;
+
+static int compare_batch_keys (const void *a, const void *b)
+{
+  const batch_key *x = (const batch_key *) a, *y = (const batch_key *) b;
+  if (x->page != y->page){
+      return (x->page > y->page) - (x->page < y->page);
+  }
+  return (x->ind > y->ind) - (x->ind < y->ind);
+}
+
+/**
+ * Looks up num_of_keys keys, page by page, with the prefetch threads
+ * reading the next pages meanwhile.
+ * Every page of the batch is read at most once, and at most
+ * SPILL_MAP_PREFETCH_DEPTH pages ahead of the current one are queued.
+ * @return the number of keys found.
+ */
+size_t spill_map_at_batch (spill_map *map, const_keyT *keys,
+                           size_t num_of_keys, valueT *values)
+{
+  if ((map == NULL) || (keys == NULL) || (values == NULL)){
+      return 0;
+  }
+  batch_key *order = malloc (sizeof (batch_key) * (num_of_keys + 1));
+  for (size_t i = 0; i < num_of_keys; ++i)
+    {
+      values[i] = NULL;
+      if (order != NULL){
+          order[i].page = page_of (map, keys[i]);
+          order[i].ind = i;
+      }
+    }
+  size_t found = 0;
+  if (order == NULL){ // no memory for the order, key by key.
+      for (size_t i = 0; i < num_of_keys; ++i)
+        {
+          valueT value = spill_map_at (map, keys[i]);
+          values[i] = (value == NULL) ? NULL : map->codec.value_cpy (value);
+          found += (values[i] != NULL);
+        }
+      return found;
+  }
+  qsort (order, num_of_keys, sizeof (batch_key), compare_batch_keys);
+  size_t ahead = 0, pages_ahead = 0;
+  for (size_t i = 0; i < num_of_keys;)
+    {
+      // queues the pages up to SPILL_MAP_PREFETCH_DEPTH pages on.
+      while ((ahead < num_of_keys)
+             && (pages_ahead <= SPILL_MAP_PREFETCH_DEPTH)){
+          prefetch_page (map, order[ahead].page);
+          pages_ahead += 1;
+          size_t page = order[ahead].page;
+          while ((ahead < num_of_keys) && (order[ahead].page == page)){
+              ahead += 1;
+            }
+      }
+      size_t page = order[i].page;
+      hashmap *page_map = get_page (map, page);
+      for (; (i < num_of_keys) && (order[i].page == page); ++i)
+        {
+          valueT value = (page_map == NULL) ? NULL :
+                         hashmap_at (page_map, keys[order[i].ind]);
+          if (value != NULL){
+              values[order[i].ind] = map->codec.value_cpy (value);
+              found += (values[order[i].ind] != NULL);
+          }
+        }
+      pages_ahead -= 1;
+    }
+  free (order);
+  return found;
+}
+
+/**
+ * Erases the pair of key, like hashmap_erase.
+ * @return 1 on success, 0 if key is not in the map or on failure.
+ */
+int spill_map_erase (spill_map *map, const_keyT key)
+{
+  if ((map == NULL) || (key == NULL)){
+      return 0;
+  }
+  size_t ind = page_of (map, key);
+  hashmap *page_map = get_page (map, ind);
+  valueT value = (page_map == NULL) ? NULL : hashmap_at (page_map, key);
+  if (value == NULL){
+      return 0;
+  }
+  size_t bytes = map->codec.key_encode (key, NULL, 0)
+                 + map->codec.value_encode (value, NULL, 0);
+  if (hashmap_erase (page_map, key) == 0){
+      return 0;
+  }
+  spill_map_page *page = &(map->pages[ind]);
+  page->payload_bytes -= bytes;
+  page->dirty = 1;
+  map->size -= 1;
+  account_page (map, ind);
+  return 1;
+}
+
+/**
+ * Fills stats with the counters of the map.
+ * @return 1 on success, 0 otherwise.
+ */
+int spill_map_get_stats (const spill_map *map, spill_map_stats *stats)
+{
+  if ((map == NULL) || (stats == NULL)){
+      return 0;
+  }
+  *stats = map->stats;
+  return 1;
+}
@@ -0,0 +1,194 @@
+#ifndef SPILL_MAP_H_
+#define SPILL_MAP_H_
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "hashmap.h"
+#include "wal_map.h"
+
+/**
+ * A hash map that may be larger than the memory it is given: the key space
+ * is split by hash into a fixed number of pages (groups of buckets), each
+ * page is an ordinary hashmap while it is in memory, and the pages that
+ * were not used recently are written to a local file and freed once the
+ * resident pages exceed a memory budget.
+ * The resident pages form a page cache with a clock (second chance)
+ * eviction policy: every access sets the reference bit of its page, and
+ * the clock hand evicts the first resident page whose bit is clear,
+ * clearing the bits it passes. A clean page is just freed, a dirty one is
+ * serialized (with the keys and values encoded by a wal_codec) to its
+ * extent of the file first. A page that is not resident is read back when
+ * a key of it is accessed. spill_map_at_batch groups its keys by page and
+ * has prefetch threads read the next pages of the batch while the keys of
+ * the current one are looked up.
+ * The file is a cache, not a durable copy (see wal_map.h for that): it is
+ * unlinked as soon as it is created, so it never outlives the map.
+ * The functions must be called from one thread at a time, like those of a
+ * hashmap; the prefetch threads are internal.
+ */
+
+/**
+ * @def SPILL_MAP_DEFAULT_PAGES
+ * The number of pages of a map opened with 0 pages. Choose enough pages
+ * that one page is a small part of the memory budget.
+ */
+#define SPILL_MAP_DEFAULT_PAGES 1024UL
+
+/**
+ * @def SPILL_MAP_MAX_PAGES
+ * The largest number of pages of a map.
+ */
+#define SPILL_MAP_MAX_PAGES (1UL << 30)
+
+/**
+ * @def SPILL_MAP_DEFAULT_BUDGET
+ * The memory budget of a map opened with a budget of 0.
+ */
+#define SPILL_MAP_DEFAULT_BUDGET (64UL << 20)
+
+/**
+ * @def SPILL_MAP_EXTENT_ALIGN
+ * The extents of the pages in the file are multiples of this size. A page
+ * that outgrows its extent moves to a new one at least twice as large.
+ */
+#define SPILL_MAP_EXTENT_ALIGN 4096UL
+
+/**
+ * @def SPILL_MAP_PREFETCH_DEPTH
+ * spill_map_at_batch keeps at most this many pages ahead of the current
+ * one being read, which bounds the memory of the prefetched pages.
+ */
+#define SPILL_MAP_PREFETCH_DEPTH 8
+
+/**
+ * @struct spill_map_stats
+ * @param resident_pages, resident_bytes the pages in memory, and their
+ * memory (hashmap_get_memory_usage plus the encoded size of their pairs).
+ * @param page_faults the pages read from the file on demand.
+ * @param prefetched the pages read from the file by the prefetch threads
+ * before they were needed.
+ * @param evictions the pages evicted from memory.
+ * @param pages_written the evictions that wrote a dirty page to the file.
+ * @param file_bytes the size of the file.
+ */
+typedef struct spill_map_stats {
+    size_t resident_pages;
+    size_t resident_bytes;
+    size_t page_faults;
+    size_t prefetched;
+    size_t evictions;
+    size_t pages_written;
+    size_t file_bytes;
+} spill_map_stats;
+
+/**
+ * @struct spill_map
+ * @param pages the pages, num_of_pages of them (a power of 2).
+ * @param page_bits log2 of num_of_pages.
+ * @param func a function which "hashes" keys.
+ * @param codec the key and value serialization.
+ * @param fd the (unlinked) file of the evicted pages.
+ * @param size the number of pairs.
+ * @param memory_budget pages are evicted while resident_bytes exceeds it.
+ * @param clock_hand the next page the clock considers.
+ * @param image the buffer pages are serialized into.
+ * @param failed 1 after a write error, pages are no longer evicted and
+ * inserts fail.
+ * @param stats the counters of spill_map_get_stats.
+ * @param queue, queue_head, queue_len the pages waiting for a prefetch
+ * thread (a ring of num_of_pages).
+ * @param stop 1 when the prefetch threads should exit.
+ * @param lock, wake, loaded the lock of the page states and the queue, the
+ * condition that wakes the prefetch threads, and the one signalled when a
+ * page was read.
+ * @param threads, num_of_threads the prefetch threads.
+ */
+typedef struct spill_map {
+    struct spill_map_page *pages;
+    size_t num_of_pages;
+    size_t page_bits;
+    hash_func func;
+    wal_codec codec;
+    int fd;
+    size_t size;
+    size_t memory_budget;
+    size_t clock_hand;
+    wal_buffer image;
+    int failed;
+    spill_map_stats stats;
+    size_t *queue;
+    size_t queue_head;
+    size_t queue_len;
+    int stop;
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    pthread_cond_t loaded;
+    pthread_t *threads;
+    size_t num_of_threads;
+} spill_map;
+
+/**
+ * Creates an empty map that spills its pages to a new file at path.
+ * @param path the file, created and unlinked at once (fails if it exists).
+ * @param func a function which "hashes" keys.
+ * @param codec the key and value serialization (copied), its encode and
+ * decode functions are required.
+ * @param num_of_pages the number of pages, rounded up to a power of 2 (0
+ * for SPILL_MAP_DEFAULT_PAGES, at most SPILL_MAP_MAX_PAGES).
+ * @param memory_budget the bytes the resident pages may take (0 for
+ * SPILL_MAP_DEFAULT_BUDGET). At least the page in use stays resident, so
+ * a page larger than the budget still works.
+ * @param num_of_threads the number of prefetch threads (0 reads every page
+ * on demand).
+ * @return pointer to dynamically allocated map.
+ * @if_fail return NULL.
+ */
+spill_map *spill_map_open (const char *path, hash_func func,
+                           const wal_codec *codec, size_t num_of_pages,
+                           size_t memory_budget, size_t num_of_threads);
+
+/**
+ * Stops the prefetch threads, frees the map and closes its file.
+ * @param p_map pointer to dynamically allocated pointer to map.
+ */
+void spill_map_close (spill_map **p_map);
+
+/**
+ * Inserts a copy of in_pair, like hashmap_insert.
+ * @return 1 on success, 0 if the key is already in the map or on failure
+ * (always once a page could not be written to the file).
+ */
+int spill_map_insert (spill_map *map, const pair *in_pair);
+
+/**
+ * Returns the value of key, like hashmap_at. The value belongs to the map
+ * and is valid until the next call on the map (which may evict its page):
+ * do not modify it, erase and insert the key instead.
+ * @return the value, NULL if key is not in the map or on failure.
+ */
+valueT spill_map_at (spill_map *map, const_keyT key);
+
+/**
+ * Looks up num_of_keys keys, page by page, with the prefetch threads
+ * reading the next pages meanwhile.
+ * @param values gets a copy (codec value_cpy, freed by the caller with
+ * value_free) of the value of every key, NULL for a missing key.
+ * @return the number of keys found.
+ */
+size_t spill_map_at_batch (spill_map *map, const_keyT *keys,
+                           size_t num_of_keys, valueT *values);
+
+/**
+ * Erases the pair of key, like hashmap_erase.
+ * @return 1 on success, 0 if key is not in the map or on failure.
+ */
+int spill_map_erase (spill_map *map, const_keyT key);
+
+/**
+ * Fills stats with the counters of the map.
+ * @return 1 on success, 0 otherwise.
+ */
+int spill_map_get_stats (const spill_map *map, spill_map_stats *stats);
+
+#endif //SPILL_MAP_H_
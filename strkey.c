@@ -0,0 +1,222 @@
+#include <string.h>
+#include <stdint.h>
+#include "strkey.h"
+
+#define HASH_MUL_1 0x9e3779b97f4a7c15ULL
+#define HASH_MUL_2 0xff51afd7ed558ccdULL
+
+/*
+ * Mixes a 64 bit word into the running hash.
+ */
+static uint64_t mix_word (uint64_t hash, uint64_t word)
+{
+  hash ^= word * HASH_MUL_1;
+  hash = (hash << 29) | (hash >> 35);
+  return hash * HASH_MUL_2;
+}
+
+/**
+ * Hashes len bytes.
+ * The bytes are consumed 8 at a time, the tail is zero padded.
+ * @param bytes the bytes to hash, do not need to be NUL terminated.
+ * @param len number of bytes.
+ * @return the hash of the bytes.
+ */
+size_t strkey_hash_bytes (const char *bytes, size_t len)
+{
+  uint64_t hash = len * HASH_MUL_1;
+  uint64_t word;
+  size_t i = 0;
+  for (; i + sizeof (word) <= len; i += sizeof (word))
+    {
+      memcpy (&word, bytes + i, sizeof (word));
+      hash = mix_word (hash, word);
+    }
+  if (i < len){
+      word = 0;
+      memcpy (&word, bytes + i, len - i);
+      hash = mix_word (hash, word);
+  }
+  hash ^= hash >> 32;
+  return (size_t) hash;
+}
+
+static uint64_t rotate_left (uint64_t x, int bits)
+{
+  return (x << bits) | (x >> (64 - bits));
+}
+
+/*
+ * One SipRound over the state v.
+ */
+static void sip_round (uint64_t v[4])
+{
+  v[0] += v[1];
+  v[1] = rotate_left (v[1], 13) ^ v[0];
+  v[0] = rotate_left (v[0], 32);
+  v[2] += v[3];
+  v[3] = rotate_left (v[3], 16) ^ v[2];
+  v[0] += v[3];
+  v[3] = rotate_left (v[3], 21) ^ v[0];
+  v[2] += v[1];
+  v[1] = rotate_left (v[1], 17) ^ v[2];
+  v[2] = rotate_left (v[2], 32);
+}
+
+/**
+ * Hashes len bytes with SipHash-1-3 keyed by key.
+ * @param bytes the bytes to hash, do not need to be NUL terminated.
+ * @param len number of bytes.
+ * @param key the 128 bit secret key.
+ * @return the hash of the bytes.
+ */
+size_t strkey_hash_keyed (const char *bytes, size_t len, const uint64_t key[2])
+{
+  uint64_t v[4] = {key[0] ^ 0x736f6d6570736575ULL,
+                   key[1] ^ 0x646f72616e646f6dULL,
+                   key[0] ^ 0x6c7967656e657261ULL,
+                   key[1] ^ 0x7465646279746573ULL};
+  uint64_t word;
+  size_t i = 0;
+  for (; i + sizeof (word) <= len; i += sizeof (word))
+    {
+      memcpy (&word, bytes + i, sizeof (word));
+      v[3] ^= word;
+      sip_round (v);
+      v[0] ^= word;
+    }
+  word = 0;
+  memcpy (&word, bytes + i, len - i);
+  word |= (uint64_t) len << 56;
+  v[3] ^= word;
+  sip_round (v);
+  v[0] ^= word;
+  v[2] ^= 0xff;
+  sip_round (v);
+  sip_round (v);
+  sip_round (v);
+  return (size_t) (v[0] ^ v[1] ^ v[2] ^ v[3]);
+}
+
+/**
+ * Creates a borrowed view of len bytes, the bytes are not copied
+ * so they must outlive the view. The hash is computed here, once.
+ * @param bytes the bytes of the key.
+ * @param len number of bytes.
+ * @return the view (by value).
+ */
+strkey strkey_view (const char *bytes, size_t len)
+{
+  strkey key;
+  key.hash = strkey_hash_bytes (bytes, len);
+  key.len = len;
+  key.data.ptr = bytes;
+  key.is_inline = 0;
+  key.is_owned = 0;
+  return key;
+}
+
+/**
+ * Creates a borrowed view of len bytes hashed with strkey_hash_keyed.
+ * @param bytes the bytes of the key.
+ * @param len number of bytes.
+ * @param hash_key the 128 bit secret key of the hash.
+ * @return the view (by value).
+ */
+strkey strkey_view_keyed (const char *bytes, size_t len,
+                          const uint64_t hash_key[2])
+{
+  strkey key;
+  key.hash = strkey_hash_keyed (bytes, len, hash_key);
+  key.len = len;
+  key.data.ptr = bytes;
+  key.is_inline = 0;
+  key.is_owned = 0;
+  return key;
+}
+
+/**
+ * @param key a strkey.
+ * @return pointer to the bytes of the key.
+ */
+const char *strkey_data (const strkey *key)
+{
+  if (key->is_inline){
+      return key->data.inline_bytes;
+  }
+  return key->data.ptr;
+}
+
+/**
+ * Copies a strkey, keys of at most STRKEY_INLINE_MAX bytes are copied into
+ * the strkey struct itself.
+ * @return dynamically allocated owned copy of the key, NULL on failure.
+ */
+keyT strkey_key_cpy (const_keyT key)
+{
+  const strkey *old_key = (const strkey *) key;
+  strkey *new_key = malloc (sizeof (strkey));
+  if (new_key == NULL){
+      return NULL;
+  }
+  new_key->hash = old_key->hash;
+  new_key->len = old_key->len;
+  if (old_key->len <= STRKEY_INLINE_MAX){
+      memcpy (new_key->data.inline_bytes, strkey_data (old_key), old_key->len);
+      new_key->data.inline_bytes[old_key->len] = '\0';
+      new_key->is_inline = 1;
+      new_key->is_owned = 0;
+      return new_key;
+  }
+  char *bytes = malloc (old_key->len + 1);
+  if (bytes == NULL){
+      free (new_key);
+      return NULL;
+  }
+  memcpy (bytes, strkey_data (old_key), old_key->len);
+  bytes[old_key->len] = '\0';
+  new_key->data.ptr = bytes;
+  new_key->is_inline = 0;
+  new_key->is_owned = 1;
+  return new_key;
+}
+
+/**
+ * Compares two strkeys, checks the length and the hash before comparing
+ * any bytes.
+ * @return 1 if the keys hold the same bytes, 0 otherwise.
+ */
+int strkey_key_cmp (const_keyT key_1, const_keyT key_2)
+{
+  const strkey *str_1 = (const strkey *) key_1;
+  const strkey *str_2 = (const strkey *) key_2;
+  if ((str_1->len != str_2->len) || (str_1->hash != str_2->hash)){
+      return 0;
+  }
+  return memcmp (strkey_data (str_1), strkey_data (str_2), str_1->len) == 0;
+}
+
+/**
+ * Frees a strkey allocated by strkey_key_cpy.
+ */
+void strkey_key_free (keyT *key)
+{
+  if ((key == NULL) || (*key == NULL)){
+      return;
+  }
+  strkey *str = (strkey *) *key;
+  if (str->is_owned){
+      free ((char *) str->data.ptr);
+  }
+  free (str);
+  *key = NULL;
+}
+
+/**
+ * Hash function for hash maps with strkey keys, returns the precomputed
+ * hash without scanning the bytes.
+ */
+size_t hash_strkey (const_keyT key)
+{
+  return ((const strkey *) key)->hash;
+}
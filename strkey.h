@@ -0,0 +1,115 @@
+#ifndef STRKEY_H_
+#define STRKEY_H_
+
+#include <stdlib.h>
+#include <stdint.h>
+#include "pair.h"
+
+/**
+ * @def STRKEY_INLINE_MAX
+ * Keys of at most STRKEY_INLINE_MAX bytes are stored inside the strkey
+ * itself, longer keys get a separate allocation.
+ */
+#define STRKEY_INLINE_MAX 22UL
+
+/**
+ * @struct strkey - a byte string key with its length and precomputed hash.
+ * @param hash the hash of the bytes, computed once by strkey_view.
+ * @param len the number of bytes (the bytes may contain '\0').
+ * @param data the bytes, either inline (is_inline == 1) or through ptr.
+ * @param is_inline 1 if the bytes are stored in data.inline_bytes.
+ * @param is_owned 1 if ptr was allocated by the strkey (and should be freed).
+ *
+ * A strkey is used as the keyT of a pair: create a borrowed view of any
+ * bytes (no copy, no NUL needed) with strkey_view, and pass its address
+ * to pair_alloc / hashmap_at / hashmap_erase, with the strkey_key_* functions
+ * as the key functions and hash_strkey as the hash map's hash function.
+ * Example:
+ *   strkey key = strkey_view (buf + start, len);
+ *   valueT val = hashmap_at (map, &key);
+ */
+typedef struct strkey {
+    size_t hash;
+    size_t len;
+    union {
+        char inline_bytes[STRKEY_INLINE_MAX + 1];
+        const char *ptr;
+    } data;
+    unsigned char is_inline;
+    unsigned char is_owned;
+} strkey;
+
+/**
+ * Hashes len bytes.
+ * @param bytes the bytes to hash, do not need to be NUL terminated.
+ * @param len number of bytes.
+ * @return the hash of the bytes.
+ */
+size_t strkey_hash_bytes (const char *bytes, size_t len);
+
+/**
+ * Hashes len bytes with SipHash-1-3 keyed by key. Unlike strkey_hash_bytes,
+ * keys with equal hashes can not be found without knowing the key, so this
+ * is the hash for keys from an untrusted source (with a random key, e.g.
+ * from hashmap_random_seed).
+ * @param bytes the bytes to hash, do not need to be NUL terminated.
+ * @param len number of bytes.
+ * @param key the 128 bit secret key.
+ * @return the hash of the bytes.
+ */
+size_t strkey_hash_keyed (const char *bytes, size_t len, const uint64_t key[2]);
+
+/**
+ * Creates a borrowed view of len bytes, the bytes are not copied
+ * so they must outlive the view. The hash is computed here, once.
+ * @param bytes the bytes of the key.
+ * @param len number of bytes.
+ * @return the view (by value).
+ */
+strkey strkey_view (const char *bytes, size_t len);
+
+/**
+ * Creates a borrowed view of len bytes like strkey_view, hashed with
+ * strkey_hash_keyed. Every key looked up in a map must be hashed the same
+ * way as the keys inserted in it.
+ * @param bytes the bytes of the key.
+ * @param len number of bytes.
+ * @param hash_key the 128 bit secret key of the hash.
+ * @return the view (by value).
+ */
+strkey strkey_view_keyed (const char *bytes, size_t len,
+                          const uint64_t hash_key[2]);
+
+/**
+ * @param key a strkey.
+ * @return pointer to the bytes of the key (len bytes, NUL terminated
+ * only if the key is owned by a map).
+ */
+const char *strkey_data (const strkey *key);
+
+/**
+ * Copies a strkey (pair_key_cpy). Keys of at most STRKEY_INLINE_MAX bytes
+ * take a single allocation.
+ * @return dynamically allocated owned copy of the key, NULL on failure.
+ */
+keyT strkey_key_cpy (const_keyT key);
+
+/**
+ * Compares two strkeys (pair_key_cmp), checks the length and the hash
+ * before comparing any bytes.
+ * @return 1 if the keys hold the same bytes, 0 otherwise.
+ */
+int strkey_key_cmp (const_keyT key_1, const_keyT key_2);
+
+/**
+ * Frees a strkey allocated by strkey_key_cpy (pair_key_free).
+ */
+void strkey_key_free (keyT *key);
+
+/**
+ * Hash function (hash_func) for hash maps with strkey keys, returns the
+ * precomputed hash without scanning the bytes.
+ */
+size_t hash_strkey (const_keyT key);
+
+#endif //STRKEY_H_
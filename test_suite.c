@@ -1,7 +1,28 @@
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 #include "test_suite.h"
 #include "hashmap.h"
 #include "test_pairs.h"
 #include "hash_funcs.h"
+#include "typed_hashmap.h"
+#include "strkey.h"
+#include "shared_value.h"
+#include "lru_cache.h"
+#include "ttl_map.h"
+#include "agg_map.h"
+#include "hashset.h"
+#include "bucket.h"
+#include "ordered_map.h"
+#include "wal_map.h"
+#include "spill_map.h"
+#include "column_map.h"
+#include "fixed_map.h"
+#include "map_server.h"
+#include "map_client.h"
+#include "hash_join.h"
 
 #define NUM_OF_CHAR_INT_PAIRS 200 //careful from char overflow as some
 //functions checks the char pairs and we can only have 256 keys.
@@ -13,6 +34,31 @@
 #define INT_VALUE_DELTA 30
 #define CHAR_KEY_BASE 10
 #define NUM_OF_DIGITS 10
+#define WAL_TEST_PATH "wal_test_map"
+#define NUM_OF_WAL_PAIRS 2000
+#define SPILL_TEST_PATH "spill_test_map"
+#define NUM_OF_SPILL_PAIRS 4000
+#define SPILL_TEST_BUDGET (256UL << 10)
+#define NUM_OF_SPILL_PAGES 64
+#define NUM_OF_COLLIDING_PAIRS 100
+#define COLLIDING_MASK 1023UL
+#define SERVER_TEST_PATH "map_server_test.sock"
+#define NUM_OF_SERVER_PAIRS 1000
+#define NUM_OF_CHURN_SIZES 100
+#define BIG_VALUE_BYTES (1UL << 20)
+#define NUM_OF_FLOODING_KEYS 2000
+#define NUM_OF_SHARING_MAPS 3
+#define NUM_OF_SHARED_KEYS 1000
+#define NUM_OF_FEED_EVENTS 64
+#define NUM_OF_FIXED_ENTRIES 1000
+#define NUM_OF_CHANGED_PAIRS 10
+#define NUM_OF_JOIN_KEYS 60000
+#define NUM_OF_PROBE_ROWS 100000
+#define PROBE_KEY_OFFSET 20000
+
+HASHMAP_DECLARE(int64_map, int64_t, int64_t, HASHMAP_INT_HASH, HASHMAP_INT_EQ)
+HASHMAP_DECLARE(int_float_map, int32_t, float, HASHMAP_INT_HASH,
+                HASHMAP_INT_EQ)
 
 /*
  * creates MUM_OF_PAIRS int-float general pairs. FREE NEEDED!
@@ -390,3 +436,2336 @@ void test_hash_map_apply_if(){
   free_pair_list (&char_int_pairs, NUM_OF_CHAR_INT_PAIRS);
 }
 
+
+/*
+ * checks if an int32_t key is even. returns 1 if even 0 otherwise.
+ */
+int is_even_int32(int32_t key){
+  return key % 2 == 0;
+}
+
+/*
+ * divides in half a float value stored in a typed map.
+ */
+void dev_float_ptr(float *value){
+  *value /= 2;
+}
+
+/**
+ * This function checks the maps generated by HASHMAP_DECLARE.
+ * The int64->int64 map runs through insertion, lookup and erasing of
+ * NUM_OF_INT_FLOAT_PAIRS keys while checking size and capacity, the
+ * int32->float map checks apply_if.
+ */
+void test_typed_hashmap(void){
+  int64_map *map = int64_map_alloc ();
+  if (map == NULL){
+      exit (1); // malloc fails.
+  }
+  assert(map->capacity == HASH_MAP_INITIAL_CAP);
+  for (int64_t i = 0; i < NUM_OF_INT_FLOAT_PAIRS; ++i)
+    {
+      assert(int64_map_insert (map, i * INT_KEY_BASE_VALUE, i) == 1);
+      assert(map->size == (size_t) i + 1);
+      assert(int64_map_get_load_factor (map) <= HASH_MAP_MAX_LOAD_FACTOR);
+    }
+  assert(int64_map_insert (map, 0, 1) == 0); // key already in the map.
+  for (int64_t i = 0; i < NUM_OF_INT_FLOAT_PAIRS; ++i)
+    {
+      int64_t *val = int64_map_at (map, i * INT_KEY_BASE_VALUE);
+      assert(val != NULL && *val == i);
+      assert(int64_map_at (map, i * INT_KEY_BASE_VALUE + 1) == NULL);
+    }
+  for (int64_t i = 0; i < NUM_OF_INT_FLOAT_PAIRS; i += 2)
+    {
+      assert(int64_map_erase (map, i * INT_KEY_BASE_VALUE) == 1);
+      assert(int64_map_erase (map, i * INT_KEY_BASE_VALUE) == 0);
+    }
+  for (int64_t i = 0; i < NUM_OF_INT_FLOAT_PAIRS; ++i)
+    {
+      int64_t *val = int64_map_at (map, i * INT_KEY_BASE_VALUE);
+      assert((i % 2 == 0) ? (val == NULL) : (*val == i));
+      // erasing must not lose the entries that were shifted back.
+    }
+  for (int64_t i = 1; i < NUM_OF_INT_FLOAT_PAIRS; i += 2)
+    {
+      assert(int64_map_erase (map, i * INT_KEY_BASE_VALUE) == 1);
+    }
+  assert(map->size == 0);
+  assert(map->capacity == HASH_MAP_INITIAL_CAP); // shrunk back.
+  int64_map_free (&map);
+  assert(map == NULL);
+
+  int_float_map *float_map = int_float_map_alloc ();
+  float base_val = FLOAT_VALUE_BASE_VAL;
+  for (int32_t i = 0; i < NUM_OF_CHAR_INT_PAIRS; ++i)
+    {
+      assert(int_float_map_insert (float_map, i, base_val + i) == 1);
+    }
+  assert(int_float_map_apply_if (float_map, is_even_int32, dev_float_ptr)
+         == NUM_OF_CHAR_INT_PAIRS / 2);
+  for (int32_t i = 0; i < NUM_OF_CHAR_INT_PAIRS; ++i)
+    {
+      float expected = (i % 2 == 0) ? (base_val + i) / 2 : base_val + i;
+      assert(*int_float_map_at (float_map, i) == expected);
+    }
+  int_float_map_free (&float_map);
+}
+
+/**
+ * This function checks hash maps with strkey keys.
+ * The keys are views into one buffer that has no NUL between keys, half of
+ * them are short enough to be stored inline and half are not.
+ */
+void test_strkey_hashmap(void){
+  const char *buf = "id_0id_1id_2id_3id_4a_much_longer_identifier_than_inline";
+  hashmap *map = hashmap_alloc (hash_strkey);
+  if (map == NULL){
+      exit (1); // malloc fails.
+  }
+  int val = INT_VALUE_BASE;
+  for (size_t i = 0; i < 5; ++i)
+    {
+      strkey key = strkey_view (buf + 4 * i, 4);
+      pair *pr = pair_alloc (&key, &val, strkey_key_cpy, int_value_cpy,
+                             strkey_key_cmp, int_value_cmp,
+                             strkey_key_free, basic_data_value_free);
+      assert(hashmap_insert (map, pr) == 1);
+      pair_free ((void **) &pr);
+      val++;
+    }
+  strkey long_key = strkey_view (buf + 20, strlen (buf + 20));
+  assert(long_key.len > STRKEY_INLINE_MAX);
+  pair *pr = pair_alloc (&long_key, &val, strkey_key_cpy, int_value_cpy,
+                         strkey_key_cmp, int_value_cmp,
+                         strkey_key_free, basic_data_value_free);
+  assert(hashmap_insert (map, pr) == 1);
+  assert(hashmap_insert (map, pr) == 0); // already in the map.
+  pair_free ((void **) &pr);
+  for (size_t i = 0; i < 5; ++i)
+    {
+      strkey key = strkey_view (buf + 4 * i, 4);
+      int *found = hashmap_at (map, &key);
+      assert(found != NULL && *found == INT_VALUE_BASE + (int) i);
+    }
+  strkey prefix = strkey_view (buf, 3); // "id_" is a prefix, not a key.
+  assert(hashmap_at (map, &prefix) == NULL);
+  assert(*(int *) hashmap_at (map, &long_key) == val);
+  assert(hashmap_erase (map, &long_key) == 1);
+  assert(hashmap_at (map, &long_key) == NULL);
+  hashmap_free (&map);
+}
+
+/*
+ * Fills a new map with NUM_OF_SHARED_KEYS int keys, all with the shared
+ * value arg, and frees it (test_shared_value runs it on several threads).
+ */
+void *share_value(void *arg){
+  hashmap *map = hashmap_alloc (hash_int);
+  assert(map != NULL);
+  for (int key = 0; key < NUM_OF_SHARED_KEYS; ++key)
+    {
+      pair *pr = pair_alloc (&key, arg, int_key_cpy, shared_value_cpy,
+                             int_key_cmp, shared_value_cmp,
+                             basic_data_key_free, shared_value_free);
+      assert(hashmap_insert (map, pr) == 1);
+      pair_free ((void **) &pr);
+    }
+  assert(shared_value_refs (arg) >= NUM_OF_SHARED_KEYS + 1);
+  hashmap_free (&map);
+  return NULL;
+}
+
+void test_shared_value(void){
+  float *data = malloc (sizeof (float));
+  if (data == NULL){
+      exit (1); // malloc fails.
+  }
+  *data = FLOAT_VALUE_BASE_VAL;
+  assert(shared_value_alloc (data, NULL, basic_data_value_free) == NULL);
+  shared_value *value = shared_value_alloc (data, float_value_cmp,
+                                            basic_data_value_free);
+  hashmap *maps[NUM_OF_SHARING_MAPS];
+  assert(value != NULL && shared_value_refs (value) == 1);
+  // every map, and every resize and snapshot, refers to the same data.
+  for (size_t i = 0; i < NUM_OF_SHARING_MAPS; ++i)
+    {
+      maps[i] = hashmap_alloc (hash_int);
+      for (int key = 0; key < NUM_OF_SHARED_KEYS; ++key)
+        {
+          pair *pr = pair_alloc (&key, value, int_key_cpy, shared_value_cpy,
+                                 int_key_cmp, shared_value_cmp,
+                                 basic_data_key_free, shared_value_free);
+          assert(hashmap_insert (maps[i], pr) == 1);
+          pair_free ((void **) &pr);
+        }
+      int key = (int) i;
+      assert(hashmap_at (maps[i], &key) == value);
+    }
+  assert(shared_value_refs (value) == 1 + NUM_OF_SHARING_MAPS
+                                          * NUM_OF_SHARED_KEYS);
+  assert(shared_value_data (value) == data);
+  hashmap *snapshot = hashmap_snapshot (maps[0]);
+  for (int key = 0; key < NUM_OF_SHARED_KEYS / 2; ++key)
+    {
+      assert(hashmap_erase (maps[0], &key) == 1); // copies the buckets.
+    }
+  assert(shared_value_refs (value) == 1 + (NUM_OF_SHARING_MAPS + 1)
+                                          * NUM_OF_SHARED_KEYS
+                                      - NUM_OF_SHARED_KEYS / 2);
+  hashmap_free (&snapshot);
+  // equal data in another handle compares equal.
+  float *other_data = malloc (sizeof (float));
+  if (other_data == NULL){
+      exit (1); // malloc fails.
+  }
+  *other_data = FLOAT_VALUE_BASE_VAL;
+  shared_value *other = shared_value_alloc (other_data, float_value_cmp,
+                                            basic_data_value_free);
+  assert(shared_value_cmp (value, other) == 1);
+  *other_data += 1;
+  assert(shared_value_cmp (value, other) == 0);
+  shared_value_release (&other);
+  assert(other == NULL);
+  for (size_t i = 0; i < NUM_OF_SHARING_MAPS; ++i)
+    {
+      hashmap_free (&maps[i]);
+    }
+  assert(shared_value_refs (value) == 1);
+  // maps on other threads take and drop references concurrently.
+  pthread_t threads[NUM_OF_SHARING_MAPS];
+  for (size_t i = 0; i < NUM_OF_SHARING_MAPS; ++i)
+    {
+      assert(pthread_create (&threads[i], NULL, share_value, value) == 0);
+    }
+  for (size_t i = 0; i < NUM_OF_SHARING_MAPS; ++i)
+    {
+      pthread_join (threads[i], NULL);
+    }
+  assert(shared_value_refs (value) == 1);
+  shared_value_release (&value); // frees the data.
+}
+
+/*
+ * eviction callback for test_lru_cache, counts the evictions in *ctx and
+ * checks the evicted value is still valid.
+ */
+void count_evictions(const_keyT key, valueT value, void *ctx){
+  assert(key != NULL && value != NULL);
+  *((size_t *) ctx) += 1;
+}
+
+/*
+ * lru_size_func for test_lru_cache: charges an int-float entry its value.
+ */
+size_t float_value_bytes(const pair *entry){
+  return (size_t) *(const float *) entry->value;
+}
+
+/**
+ * This function checks the lru_cache container.
+ * Fills a cache of NUM_OF_DIGITS entries with the int-float pairs while
+ * keeping the first key hot, then checks which keys survived.
+ */
+void test_lru_cache(void){
+  pair **pairs = create_int_float_pairs (NUM_OF_CHAR_INT_PAIRS);
+  if (pairs == NULL){
+      exit (1); // malloc fails.
+  }
+  assert(lru_cache_alloc (hash_int, 0, 0, NULL) == NULL); // no budget.
+  lru_cache *cache = lru_cache_alloc (hash_int, NUM_OF_DIGITS, 0, NULL);
+  size_t evictions = 0;
+  lru_cache_set_evict_func (cache, count_evictions, &evictions);
+  for (size_t i = 0; i < NUM_OF_CHAR_INT_PAIRS; ++i)
+    {
+      assert(lru_cache_insert (cache, pairs[i]) == 1);
+      assert(lru_cache_at (cache, pairs[0]->key) != NULL); // keeps 0 hot.
+      assert(cache->table.size <= NUM_OF_DIGITS);
+    }
+  assert(evictions == NUM_OF_CHAR_INT_PAIRS - NUM_OF_DIGITS);
+  for (size_t i = 1; i < NUM_OF_CHAR_INT_PAIRS; ++i)
+    {
+      int in_cache = i >= NUM_OF_CHAR_INT_PAIRS - (NUM_OF_DIGITS - 1);
+      assert((lru_cache_peek (cache, pairs[i]->key) != NULL) == in_cache);
+    }
+  // re-inserting a key replaces the value and does not evict.
+  float new_val = FLOAT_VALUE_BASE_VAL;
+  pair *update = pair_alloc (pairs[0]->key, &new_val, int_key_cpy,
+                             float_value_cpy, int_key_cmp, float_value_cmp,
+                             basic_data_key_free, basic_data_value_free);
+  assert(lru_cache_insert (cache, update) == 1);
+  assert(*(float *) lru_cache_at (cache, pairs[0]->key) == new_val);
+  assert(evictions == NUM_OF_CHAR_INT_PAIRS - NUM_OF_DIGITS);
+  assert(lru_cache_erase (cache, pairs[0]->key) == 1);
+  assert(lru_cache_erase (cache, pairs[0]->key) == 0);
+  assert(cache->table.size == NUM_OF_DIGITS - 1);
+  lru_cache_free (&cache);
+  assert(cache == NULL);
+  pair_free ((void **) &update);
+
+  // byte budget: every entry is charged sizeof(lru_node).
+  cache = lru_cache_alloc (hash_int, 0, 3 * sizeof (lru_node), NULL);
+  for (size_t i = 0; i < NUM_OF_DIGITS; ++i)
+    {
+      assert(lru_cache_insert (cache, pairs[i]) == 1);
+    }
+  assert(cache->table.size == 3);
+  assert(cache->bytes == 3 * sizeof (lru_node));
+  lru_cache_free (&cache);
+
+  // a replacing value larger than the budget is rejected, the old one kept.
+  cache = lru_cache_alloc (hash_int, 0, (size_t) FLOAT_VALUE_BASE_VAL,
+                           float_value_bytes);
+  new_val = 1;
+  update = pair_alloc (pairs[0]->key, &new_val, int_key_cpy, float_value_cpy,
+                       int_key_cmp, float_value_cmp, basic_data_key_free,
+                       basic_data_value_free);
+  assert(lru_cache_insert (cache, update) == 1);
+  *(float *) update->value = FLOAT_VALUE_BASE_VAL + 1;
+  assert(lru_cache_insert (cache, update) == 0);
+  assert(*(float *) lru_cache_at (cache, pairs[0]->key) == 1);
+  assert(cache->bytes == 1);
+  lru_cache_free (&cache);
+  pair_free ((void **) &update);
+  free_pair_list (&pairs, NUM_OF_CHAR_INT_PAIRS);
+}
+
+/**
+ * This function checks the ttl_map container.
+ * pair i gets a ttl of (i * i * INT_VALUE_DELTA + 1) ticks, so the
+ * expiries spread over every level of the timer wheel, and every tenth pair
+ * never expires. The clock advances in uneven steps and after each step
+ * exactly the expired pairs must be gone.
+ */
+void test_ttl_map(void){
+  pair **pairs = create_int_float_pairs (NUM_OF_CHAR_INT_PAIRS);
+  if (pairs == NULL){
+      exit (1); // malloc fails.
+  }
+  ttl_map *map = ttl_map_alloc (hash_int, 0);
+  for (size_t i = 0; i < NUM_OF_CHAR_INT_PAIRS; ++i)
+    {
+      uint64_t ttl = (i % 10 == 0) ? TTL_NEVER : i * i * INT_VALUE_DELTA + 1;
+      assert(ttl_map_insert (map, pairs[i], 0, ttl) == 1);
+      assert(ttl_map_insert (map, pairs[i], 0, ttl) == 0);
+    }
+  // lazy expiry: pair 1 expired at tick 31, before any advance.
+  assert(ttl_map_at (map, pairs[1]->key, 30) != NULL);
+  assert(ttl_map_at (map, pairs[1]->key, 31) == NULL);
+  assert(map->table.size == NUM_OF_CHAR_INT_PAIRS - 1);
+  // touch: pair 2 (expires at 121) is extended to 10000.
+  assert(ttl_map_touch (map, pairs[2]->key, 0, 10000) == 1);
+  uint64_t now = 0;
+  while (now < 2000000){
+      now += 1 + now / 3;
+      ttl_map_advance (map, now, 0);
+      size_t num_alive = 1; // pair 0 never expires.
+      for (size_t i = 1; i < NUM_OF_CHAR_INT_PAIRS; ++i)
+        {
+          uint64_t expires = (i == 2) ? 10000 : i * i * INT_VALUE_DELTA + 1;
+          int alive = (i != 1) && ((i % 10 == 0) || (expires > now));
+          num_alive += alive;
+        }
+      assert(map->table.size == num_alive); // removed by the wheel alone.
+      for (size_t i = 1; i < NUM_OF_CHAR_INT_PAIRS; ++i)
+        {
+          uint64_t expires = (i == 2) ? 10000 : i * i * INT_VALUE_DELTA + 1;
+          int alive = (i != 1) && ((i % 10 == 0) || (expires > now));
+          assert((ttl_map_at (map, pairs[i]->key, now) != NULL) == alive);
+        }
+    }
+  assert(map->table.size == NUM_OF_CHAR_INT_PAIRS / 10);
+  ttl_map_free (&map);
+  assert(map == NULL);
+
+  // incremental removal: at most max_expired entries per call.
+  map = ttl_map_alloc (hash_int, 0);
+  for (size_t i = 0; i < NUM_OF_DIGITS; ++i)
+    {
+      assert(ttl_map_insert (map, pairs[i], 0, 1) == 1);
+    }
+  assert(ttl_map_advance (map, 5, 3) == 3);
+  assert(map->table.size == NUM_OF_DIGITS - 3);
+  assert(ttl_map_advance (map, 6, 0) == NUM_OF_DIGITS - 3);
+  assert(map->table.size == 0);
+  assert(ttl_map_erase (map, pairs[0]->key) == 0);
+  ttl_map_free (&map);
+  free_pair_list (&pairs, NUM_OF_CHAR_INT_PAIRS);
+}
+
+/**
+ * This function checks the agg_map aggregation map.
+ * NUM_OF_INT_FLOAT_PAIRS rows over NUM_OF_CHAR_INT_PAIRS keys are
+ * aggregated one by one, in batches and in parallel, and the accumulators
+ * of every key are compared with the expected values.
+ */
+void test_agg_map(void){
+  int *key_vals = malloc (sizeof (int) * NUM_OF_INT_FLOAT_PAIRS);
+  const_keyT *keys = malloc (sizeof (const_keyT) * NUM_OF_INT_FLOAT_PAIRS);
+  double *values = malloc (sizeof (double) * NUM_OF_INT_FLOAT_PAIRS);
+  if ((key_vals == NULL) || (keys == NULL) || (values == NULL)){
+      exit (1); // malloc fails.
+  }
+  for (size_t i = 0; i < NUM_OF_INT_FLOAT_PAIRS; ++i)
+    {
+      key_vals[i] = (int) (i % NUM_OF_CHAR_INT_PAIRS);
+      keys[i] = &(key_vals[i]);
+      values[i] = (double) i;
+    }
+  agg_map *single = agg_map_alloc (hash_int, int_key_cpy, int_key_cmp,
+                                   basic_data_key_free);
+  agg_map *batch = agg_map_alloc (hash_int, int_key_cpy, int_key_cmp,
+                                  basic_data_key_free);
+  agg_map *parallel = agg_map_alloc (hash_int, int_key_cpy, int_key_cmp,
+                                     basic_data_key_free);
+  for (size_t i = 0; i < NUM_OF_INT_FLOAT_PAIRS; ++i)
+    {
+      assert(agg_map_accumulate (single, keys[i], values[i]) == 1);
+    }
+  assert(agg_map_accumulate_batch (batch, keys, values, NUM_OF_INT_FLOAT_PAIRS)
+         == NUM_OF_INT_FLOAT_PAIRS);
+  assert(agg_map_accumulate_parallel (parallel, keys, values,
+                                      NUM_OF_INT_FLOAT_PAIRS, 4) == 1);
+  assert(single->size == NUM_OF_CHAR_INT_PAIRS);
+  assert(batch->size == NUM_OF_CHAR_INT_PAIRS);
+  assert(parallel->size == NUM_OF_CHAR_INT_PAIRS);
+  size_t rows_per_key = NUM_OF_INT_FLOAT_PAIRS / NUM_OF_CHAR_INT_PAIRS;
+  for (int k = 0; k < NUM_OF_CHAR_INT_PAIRS; ++k)
+    {
+      // the values of key k are k, k + 200, ..., an arithmetic series.
+      double min = k;
+      double max = k + (double) (rows_per_key - 1) * NUM_OF_CHAR_INT_PAIRS;
+      const agg_stats *stats[3] = {agg_map_at (single, &k),
+                                   agg_map_at (batch, &k),
+                                   agg_map_at (parallel, &k)};
+      for (size_t j = 0; j < 3; ++j)
+        {
+          assert(stats[j]->count == rows_per_key);
+          assert(stats[j]->min == min && stats[j]->max == max);
+          assert(stats[j]->sum == (min + max) * rows_per_key / 2);
+          assert(agg_stats_mean (stats[j]) == (min + max) / 2);
+        }
+    }
+  int missing = -1;
+  assert(agg_map_at (single, &missing) == NULL);
+  assert(agg_map_merge (single, batch) == 1);
+  assert(single->size == NUM_OF_CHAR_INT_PAIRS);
+  assert(agg_map_at (single, &key_vals[0])->count == 2 * rows_per_key);
+  agg_map_free (&single);
+  agg_map_free (&batch);
+  agg_map_free (&parallel);
+  free (key_vals);
+  free (keys);
+  free (values);
+}
+
+/**
+ * This function checks the hashset container.
+ * set_1 holds the keys [0, 2N) and set_2 the even keys in [0, 4N), for
+ * N = NUM_OF_CHAR_INT_PAIRS, so every algebra result is known.
+ */
+void test_hashset(void){
+  hashset *set_1 = hashset_alloc (hash_int, int_key_cpy, int_key_cmp,
+                                  basic_data_key_free);
+  hashset *set_2 = hashset_alloc (hash_int, int_key_cpy, int_key_cmp,
+                                  basic_data_key_free);
+  if ((set_1 == NULL) || (set_2 == NULL)){
+      exit (1); // malloc fails.
+  }
+  assert(hashset_alloc (hash_int, int_key_cpy, NULL, basic_data_key_free)
+         == NULL);
+  assert(hashset_reserve (set_1, SIZE_MAX) == 0);
+  assert(hashset_reserve (set_1, 12) == 1); // 12 keys fill 16 buckets.
+  assert(set_1->capacity == 2 * HASH_MAP_INITIAL_CAP);
+  size_t old_capacity = set_1->capacity;
+  for (int i = 0; i < 2 * NUM_OF_CHAR_INT_PAIRS; ++i)
+    {
+      double prev_load = hashset_get_load_factor (set_1);
+      assert(hashset_insert (set_1, &i) == 1);
+      assert(hashset_insert (set_1, &i) == 0);
+      if (prev_load >= HASH_MAP_MAX_LOAD_FACTOR){
+          assert(set_1->capacity == old_capacity * HASH_MAP_GROWTH_FACTOR);
+      }
+      old_capacity = set_1->capacity;
+      int even = 2 * i;
+      assert(hashset_insert (set_2, &even) == 1);
+    }
+  assert(set_1->size == 2 * NUM_OF_CHAR_INT_PAIRS);
+  hashset *uni = hashset_union (set_1, set_2);
+  hashset *inter = hashset_intersection (set_1, set_2);
+  hashset *diff = hashset_difference (set_1, set_2);
+  assert(uni->size == 3 * NUM_OF_CHAR_INT_PAIRS);
+  assert(inter->size == NUM_OF_CHAR_INT_PAIRS);
+  assert(diff->size == NUM_OF_CHAR_INT_PAIRS);
+  int keys_vals[4 * NUM_OF_CHAR_INT_PAIRS];
+  const_keyT keys[4 * NUM_OF_CHAR_INT_PAIRS];
+  int results[4 * NUM_OF_CHAR_INT_PAIRS];
+  for (int i = 0; i < 4 * NUM_OF_CHAR_INT_PAIRS; ++i)
+    {
+      keys_vals[i] = i;
+      keys[i] = &(keys_vals[i]);
+      int in_1 = i < 2 * NUM_OF_CHAR_INT_PAIRS;
+      int in_2 = i % 2 == 0;
+      assert(hashset_contains (uni, &i) == (in_1 || in_2));
+      assert(hashset_contains (inter, &i) == (in_1 && in_2));
+      assert(hashset_contains (diff, &i) == (in_1 && !in_2));
+    }
+  assert(hashset_contains_batch (inter, keys, 4 * NUM_OF_CHAR_INT_PAIRS,
+                                 results) == NUM_OF_CHAR_INT_PAIRS);
+  assert(results[0] == 1 && results[1] == 0);
+  for (int i = 0; i < 2 * NUM_OF_CHAR_INT_PAIRS; ++i)
+    {
+      assert(hashset_erase (set_1, &i) == 1);
+      assert(hashset_erase (set_1, &i) == 0);
+    }
+  assert(set_1->size == 0);
+  // keys colliding under a fixed seed share a sorted bucket.
+  assert(set_1->seed != set_2->seed);
+  set_1->seed = 0;
+  bucket_keys set_keys = {hash_int, 0, int_key_cmp};
+  int colliding[NUM_OF_COLLIDING_PAIRS];
+  int key = 0;
+  for (size_t i = 0; i < NUM_OF_COLLIDING_PAIRS; ++key)
+    {
+      if ((bucket_seed_hash (&set_keys, hash_int (&key)) & COLLIDING_MASK)
+          == 0){
+          colliding[i++] = key;
+          assert(hashset_insert (set_1, &key) == 1);
+      }
+    }
+  const vector *bucket = set_1->buckets[0];
+  assert(bucket->size == NUM_OF_COLLIDING_PAIRS);
+  for (size_t i = 1; i < bucket->size; ++i)
+    {
+      assert(bucket_seed_hash (&set_keys, hash_int (bucket->data[i - 1]))
+             <= bucket_seed_hash (&set_keys, hash_int (bucket->data[i])));
+    }
+  for (size_t i = 0; i < NUM_OF_COLLIDING_PAIRS; i += 2)
+    {
+      assert(hashset_erase (set_1, &(colliding[i])) == 1);
+    }
+  for (size_t i = 0; i < NUM_OF_COLLIDING_PAIRS; ++i)
+    {
+      assert(hashset_contains (set_1, &(colliding[i])) == (i % 2 == 1));
+    }
+  hashset_free (&set_1);
+  hashset_free (&set_2);
+  hashset_free (&uni);
+  hashset_free (&inter);
+  hashset_free (&diff);
+  assert(set_1 == NULL);
+}
+
+/**
+ * This function checks the insertion ordered ordered_map.
+ * The int-float pairs are inserted in reverse key order, so the hash order
+ * and the insertion order differ, and iteration must follow the insertion
+ * order before and after erasing every odd key.
+ */
+void test_ordered_map(void){
+  pair **pairs = create_int_float_pairs (NUM_OF_INT_FLOAT_PAIRS);
+  ordered_map *map = ordered_map_alloc (hash_int);
+  if ((pairs == NULL) || (map == NULL)){
+      exit (1); // malloc fails.
+  }
+  assert(map->slot_size == 1);
+  for (size_t i = NUM_OF_INT_FLOAT_PAIRS; i > 0; --i)
+    {
+      assert(ordered_map_insert (map, pairs[i - 1]) == 1);
+      assert(ordered_map_get_load_factor (map) <= HASH_MAP_MAX_LOAD_FACTOR);
+    }
+  assert(ordered_map_insert (map, pairs[0]) == 0);
+  assert(map->size == NUM_OF_INT_FLOAT_PAIRS);
+  assert(map->slot_size == 4); // the index grew past 2^16 entries.
+  size_t pos = 0;
+  size_t expected = NUM_OF_INT_FLOAT_PAIRS;
+  const pair *cur;
+  while ((cur = ordered_map_next (map, &pos)) != NULL){
+      assert(int_key_cmp (cur->key, pairs[--expected]->key));
+  }
+  assert(expected == 0);
+  for (size_t i = 1; i < NUM_OF_INT_FLOAT_PAIRS; i += 2)
+    {
+      assert(ordered_map_erase (map, pairs[i]->key) == 1);
+      assert(ordered_map_erase (map, pairs[i]->key) == 0);
+    }
+  assert(ordered_map_apply_if (map, is_even, dev_float_value)
+         == NUM_OF_INT_FLOAT_PAIRS / 2);
+  pos = 0;
+  expected = NUM_OF_INT_FLOAT_PAIRS;
+  while ((cur = ordered_map_next (map, &pos)) != NULL){
+      expected -= 2;
+      assert(int_key_cmp (cur->key, pairs[expected]->key));
+      assert(*(float *) cur->value == *(float *) pairs[expected]->value / 2);
+      assert(ordered_map_at (map, pairs[expected]->key) == cur->value);
+      assert(ordered_map_at (map, pairs[expected + 1]->key) == NULL);
+    }
+  assert(expected == 0);
+  for (size_t i = 0; i < NUM_OF_INT_FLOAT_PAIRS; i += 2)
+    {
+      assert(ordered_map_erase (map, pairs[i]->key) == 1);
+    }
+  assert(map->size == 0);
+  assert(map->capacity == HASH_MAP_INITIAL_CAP);
+  assert(map->slot_size == 1);
+  // churn (erase the oldest pair, insert a new one) at every size: each
+  // rebuild must leave room for a quarter of the dense array.
+  size_t next = 0;
+  for (size_t size = 1; size <= NUM_OF_CHURN_SIZES; ++size)
+    {
+      while (map->size < size){
+          assert(ordered_map_insert (map, pairs[next++]) == 1);
+      }
+      for (size_t i = 0; i < 4 * size; ++i)
+        {
+          pos = 0;
+          cur = ordered_map_next (map, &pos);
+          assert(ordered_map_erase (map, cur->key) == 1);
+          size_t num_entries = map->num_entries;
+          assert(ordered_map_insert (map, pairs[next++]) == 1);
+          if (map->num_entries <= num_entries){ // rebuilt.
+              assert(map->entries_capacity - map->num_entries
+                     >= map->entries_capacity / 4);
+          }
+        }
+    }
+  assert(next <= NUM_OF_INT_FLOAT_PAIRS);
+  ordered_map_free (&map);
+  assert(map == NULL);
+  free_pair_list (&pairs, NUM_OF_INT_FLOAT_PAIRS);
+}
+
+/**
+ * This function checks the Bloom filter front end of the hashmap library.
+ * Half of the int-float pairs are inserted, then every pair is looked up:
+ * the filter must never hide a present key, and must answer most of the
+ * absent keys by itself. Erasing most of the keys must rebuild the filter.
+ */
+void test_hash_map_filter(void){
+  pair **pairs = create_int_float_pairs (NUM_OF_INT_FLOAT_PAIRS);
+  hashmap *hash_map = hashmap_alloc (hash_int);
+  if ((pairs == NULL) || (hash_map == NULL)){
+      exit (1); // malloc fails.
+  }
+  hashmap_filter_stats stats;
+  assert(hashmap_get_filter_stats (hash_map, &stats) == 0); // no filter.
+  assert(hashmap_enable_filter (hash_map, 0) == 1);
+  for (size_t i = 0; i < NUM_OF_INT_FLOAT_PAIRS / 2; ++i)
+    {
+      assert(hashmap_insert (hash_map, pairs[i]) == 1);
+    }
+  assert(hashmap_get_filter_stats (hash_map, &stats) == 1);
+  assert(stats.lookups == 0); // the probes of the inserts are not counted.
+  for (size_t i = 0; i < NUM_OF_INT_FLOAT_PAIRS; ++i)
+    {
+      int present = i < NUM_OF_INT_FLOAT_PAIRS / 2;
+      assert((hashmap_at (hash_map, pairs[i]->key) != NULL) == present);
+    }
+  assert(hashmap_get_filter_stats (hash_map, &stats) == 1);
+  assert(stats.lookups == NUM_OF_INT_FLOAT_PAIRS);
+  assert(stats.negatives + stats.false_positives
+         >= NUM_OF_INT_FLOAT_PAIRS / 2);
+  assert(stats.observed_fpr < 0.05);
+  assert(stats.estimated_fpr > 0 && stats.estimated_fpr < 0.05);
+  for (size_t i = 0; i < NUM_OF_INT_FLOAT_PAIRS / 2; i += 4)
+    {
+      assert(hashmap_at (hash_map, pairs[i]->key) != NULL);
+      for (size_t j = i + 1; (j < i + 4) && (j < NUM_OF_INT_FLOAT_PAIRS / 2); ++j)
+        {
+          assert(hashmap_erase (hash_map, pairs[j]->key) == 1);
+        }
+    }
+  // rebuilt after the erases, so it no longer holds all the inserted keys.
+  assert(hash_map->filter->num_keys < NUM_OF_INT_FLOAT_PAIRS / 2);
+  assert(hash_map->filter->num_erased * 2 <= hash_map->filter->num_keys);
+  for (size_t i = 0; i < NUM_OF_INT_FLOAT_PAIRS / 2; ++i)
+    {
+      assert((hashmap_at (hash_map, pairs[i]->key) != NULL) == (i % 4 == 0));
+    }
+  hashmap_disable_filter (hash_map);
+  assert(hashmap_at (hash_map, pairs[0]->key) != NULL);
+  hashmap_free (&hash_map);
+  free_pair_list (&pairs, NUM_OF_INT_FLOAT_PAIRS);
+}
+
+/*
+ * checks that hash_map holds exactly pairs[from, to) with their original
+ * values.
+ */
+void check_map_holds(const hashmap *hash_map, pair **pairs, size_t num_of_pairs,
+                     size_t from, size_t to){
+  assert(hash_map->size == to - from);
+  for (size_t i = 0; i < num_of_pairs; ++i)
+    {
+      valueT val = hashmap_at (hash_map, pairs[i]->key);
+      if ((i >= from) && (i < to)){
+          assert(val != NULL && float_value_cmp (val, pairs[i]->value));
+      }
+      else{
+          assert(val == NULL);
+      }
+    }
+}
+
+/**
+ * This function checks the hashmap_snapshot function of the hashmap library.
+ * A snapshot of the first half of the int-float pairs is taken, then the
+ * live map grows (and rehashes), erases, and changes values in place, and
+ * the snapshot must still hold the original half. A snapshot of the
+ * snapshot is freed before and after its parent.
+ */
+void test_hash_map_snapshot(void){
+  pair **pairs = create_int_float_pairs (NUM_OF_INT_FLOAT_PAIRS);
+  hashmap *hash_map = hashmap_alloc (hash_int);
+  if ((pairs == NULL) || (hash_map == NULL)){
+      exit (1); // malloc fails.
+  }
+  size_t half = NUM_OF_INT_FLOAT_PAIRS / 2;
+  for (size_t i = 0; i < half; ++i)
+    {
+      hashmap_insert (hash_map, pairs[i]);
+    }
+  hashmap *snapshot = hashmap_snapshot (hash_map);
+  assert(snapshot != NULL && snapshot->buckets == hash_map->buckets);
+  check_map_holds (snapshot, pairs, NUM_OF_INT_FLOAT_PAIRS, 0, half);
+  for (size_t i = half; i < NUM_OF_INT_FLOAT_PAIRS; ++i)
+    {
+      assert(hashmap_insert (hash_map, pairs[i]) == 1);
+    }
+  assert(hashmap_apply_if (hash_map, is_even, dev_float_value)
+         == NUM_OF_INT_FLOAT_PAIRS / 2);
+  assert(hashmap_apply_if (hash_map, is_even, dev_float_value)
+         == NUM_OF_INT_FLOAT_PAIRS / 2); // now on the private copies.
+  hashmap *snapshot_2 = hashmap_snapshot (snapshot);
+  for (size_t i = 0; i < half; ++i)
+    {
+      assert(hashmap_erase (hash_map, pairs[i]->key) == 1);
+    }
+  check_map_holds (snapshot, pairs, NUM_OF_INT_FLOAT_PAIRS, 0, half);
+  hashmap_free (&snapshot);
+  check_map_holds (snapshot_2, pairs, NUM_OF_INT_FLOAT_PAIRS, 0, half);
+  // the values of the live map were halved twice, not the snapshot's.
+  for (size_t i = half; i < NUM_OF_INT_FLOAT_PAIRS; ++i)
+    {
+      float *val = hashmap_at (hash_map, pairs[i]->key);
+      float expected = *(float *) pairs[i]->value;
+      if (i % 2 == 0){
+          expected = expected / 2 / 2;
+      }
+      assert(*val == expected);
+    }
+  // writes to a snapshot are copy on write too.
+  assert(hashmap_erase (snapshot_2, pairs[0]->key) == 1);
+  hashmap *snapshot_3 = hashmap_snapshot (snapshot_2);
+  hashmap_free (&snapshot_2);
+  check_map_holds (snapshot_3, pairs, NUM_OF_INT_FLOAT_PAIRS, 1, half);
+  hashmap_free (&hash_map);
+  check_map_holds (snapshot_3, pairs, NUM_OF_INT_FLOAT_PAIRS, 1, half);
+  hashmap_free (&snapshot_3);
+  free_pair_list (&pairs, NUM_OF_INT_FLOAT_PAIRS);
+}
+
+/*
+ * adds the float src value to the float dest value.
+ */
+void add_float_value(valueT dest, const_valueT src){
+  *((float*)dest) += *((const float*)src);
+}
+
+/*
+ * returns a map holding pairs[from, to), NULL if malloc fails.
+ */
+hashmap *map_of_pairs(pair **pairs, size_t from, size_t to){
+  hashmap *hash_map = hashmap_alloc (hash_int);
+  if (hash_map == NULL){
+      return NULL;
+  }
+  for (size_t i = from; i < to; ++i)
+    {
+      hashmap_insert (hash_map, pairs[i]);
+    }
+  return hash_map;
+}
+
+/**
+ * This function checks hashmap_merge and hashmap_move_all.
+ * dest holds the first 3/4 of the int-float pairs and src the last 3/4, so
+ * the middle half is in conflict, and every policy is checked on it.
+ */
+void test_hash_map_merge(void){
+  pair **pairs = create_int_float_pairs (NUM_OF_INT_FLOAT_PAIRS);
+  if (pairs == NULL){
+      exit (1); // malloc fails.
+  }
+  size_t quarter = NUM_OF_INT_FLOAT_PAIRS / 4;
+  float one = 1;
+  for (int policy = HASH_MAP_MERGE_KEEP; policy <= HASH_MAP_MERGE_COMBINE;
+       ++policy)
+    {
+      for (int move = 0; move <= 1; ++move)
+        {
+          hashmap *dest = map_of_pairs (pairs, 0, 3 * quarter);
+          hashmap *src = map_of_pairs (pairs, quarter, 4 * quarter);
+          if ((dest == NULL) || (src == NULL)){
+              exit (1); // malloc fails.
+          }
+          // src values are the original + 1, to tell them apart.
+          for (size_t i = quarter; i < 4 * quarter; ++i)
+            {
+              add_float_value (hashmap_at (src, pairs[i]->key), &one);
+            }
+          assert(hashmap_merge (dest, src, HASH_MAP_MERGE_COMBINE, NULL) == 0);
+          int merged = move ? hashmap_move_all (dest, src, policy,
+                                                add_float_value) :
+                       hashmap_merge (dest, src, policy, add_float_value);
+          assert(merged == 1);
+          assert(dest->size == NUM_OF_INT_FLOAT_PAIRS);
+          assert(src->size == (move ? 0 : 3 * quarter));
+          for (size_t i = 0; i < NUM_OF_INT_FLOAT_PAIRS; ++i)
+            {
+              float orig = *(float *) pairs[i]->value;
+              float expected = orig;
+              if (i >= 3 * quarter){
+                  expected = orig + 1;
+              }
+              else if (i >= quarter){
+                  expected = (policy == HASH_MAP_MERGE_KEEP) ? orig :
+                             (policy == HASH_MAP_MERGE_OVERWRITE) ? orig + 1 :
+                             orig + (orig + 1);
+              }
+              assert(*(float *) hashmap_at (dest, pairs[i]->key) == expected);
+              assert((hashmap_at (src, pairs[i]->key) != NULL)
+                     == (!move && i >= quarter));
+            }
+          hashmap_free (&dest);
+          hashmap_free (&src);
+        }
+    }
+  // merging presizes dest once.
+  hashmap *dest = hashmap_alloc (hash_int);
+  hashmap *src = map_of_pairs (pairs, 0, NUM_OF_INT_FLOAT_PAIRS);
+  assert(hashmap_move_all (dest, src, HASH_MAP_MERGE_KEEP, NULL) == 1);
+  assert(dest->capacity == src->capacity);
+  assert(hashmap_insert (src, pairs[0]) == 1); // src is still usable.
+  // a reserve beyond any bucket array fails and leaves the map as it was.
+  size_t capacity = dest->capacity;
+  assert(hashmap_reserve (dest, SIZE_MAX) == 0);
+  assert(hashmap_reserve (dest, SIZE_MAX / 4) == 0);
+  assert(dest->capacity == capacity);
+  assert(hashmap_erase (dest, pairs[0]->key) == 1);
+  assert(hashmap_insert (dest, pairs[0]) == 1);
+  assert(dest->size == NUM_OF_INT_FLOAT_PAIRS);
+  hashmap_free (&dest);
+  hashmap_free (&src);
+  free_pair_list (&pairs, NUM_OF_INT_FLOAT_PAIRS);
+}
+
+/**
+ * This function checks the multi threaded resize against a single threaded
+ * map through growing and shrinking, with a snapshot sharing the buckets.
+ */
+void test_hash_map_parallel_resize(void){
+  pair **pairs = create_int_float_pairs (NUM_OF_INT_FLOAT_PAIRS);
+  hashmap *map = hashmap_alloc (hash_int);
+  hashmap *single = hashmap_alloc (hash_int);
+  if ((pairs == NULL) || (map == NULL) || (single == NULL)){
+      exit (1); // malloc fails.
+  }
+  assert(hashmap_set_resize_threads (map, 0, 0) == 0);
+  assert(hashmap_set_resize_threads (map, 4, 64) == 1);
+  hashmap *snapshot = NULL;
+  for (size_t i = 0; i < NUM_OF_INT_FLOAT_PAIRS; ++i)
+    {
+      assert(hashmap_insert (map, pairs[i]) == 1);
+      assert(hashmap_insert (single, pairs[i]) == 1);
+      assert(map->capacity == single->capacity);
+      if (i == NUM_OF_INT_FLOAT_PAIRS / 4){
+          snapshot = hashmap_snapshot (map); // later resizes copy shared buckets.
+      }
+    }
+  for (size_t i = 0; i < NUM_OF_INT_FLOAT_PAIRS; ++i)
+    {
+      assert(*(float *) hashmap_at (map, pairs[i]->key)
+             == *(float *) pairs[i]->value);
+    }
+  // shrinking splits the new buckets between the threads.
+  for (size_t i = 0; i < NUM_OF_INT_FLOAT_PAIRS; ++i)
+    {
+      if (i % 8 != 0){
+          assert(hashmap_erase (map, pairs[i]->key) == 1);
+          assert(hashmap_erase (single, pairs[i]->key) == 1);
+          assert(map->capacity == single->capacity);
+      }
+    }
+  for (size_t i = 0; i < NUM_OF_INT_FLOAT_PAIRS; ++i)
+    {
+      assert((hashmap_at (map, pairs[i]->key) != NULL) == (i % 8 == 0));
+      assert((hashmap_at (snapshot, pairs[i]->key) != NULL)
+             == (i <= NUM_OF_INT_FLOAT_PAIRS / 4));
+    }
+  hashmap_free (&snapshot);
+  hashmap_free (&map);
+  hashmap_free (&single);
+  free_pair_list (&pairs, NUM_OF_INT_FLOAT_PAIRS);
+}
+
+/**
+ * This function checks hashmap_set_huge_pages on a map large enough for a
+ * huge page, whatever the backing the system actually gives it.
+ */
+void test_hash_map_huge_pages(void){
+  pair **pairs = create_int_float_pairs (NUM_OF_INT_FLOAT_PAIRS);
+  hashmap *map = hashmap_alloc (hash_int);
+  if ((pairs == NULL) || (map == NULL)){
+      exit (1); // malloc fails.
+  }
+  hashmap_huge_page_stats stats;
+  assert(hashmap_get_huge_page_stats (NULL, &stats) == 0);
+  assert(hashmap_set_huge_pages (map, 1) == 1);
+  assert(hashmap_get_huge_page_stats (map, &stats) == 1);
+  assert(stats.requested == 1);
+  assert(stats.kind == HUGE_PAGES_NONE); // too small for a huge page.
+  for (size_t i = 0; i < NUM_OF_INT_FLOAT_PAIRS; ++i)
+    {
+      assert(hashmap_insert (map, pairs[i]) == 1);
+    }
+  hashmap *snapshot = hashmap_snapshot (map);
+  assert(hashmap_get_huge_page_stats (map, &stats) == 1);
+  assert(stats.bucket_bytes == sizeof (vector *) * map->capacity);
+  assert(stats.bucket_bytes >= HUGE_PAGES_MIN_BYTES);
+  assert(stats.huge_page_bytes <= stats.bucket_bytes + HUGE_PAGE_SIZE);
+  assert((stats.kind != HUGE_PAGES_NONE) || (stats.huge_page_bytes == 0));
+  // moving back to malloc copies the shared array.
+  assert(hashmap_set_huge_pages (map, 0) == 1);
+  assert(hashmap_get_huge_page_stats (map, &stats) == 1);
+  assert((stats.kind == HUGE_PAGES_NONE) && (stats.huge_page_bytes == 0));
+  for (size_t i = 0; i < NUM_OF_INT_FLOAT_PAIRS; ++i)
+    {
+      if (i % 2 == 0){
+          assert(hashmap_erase (map, pairs[i]->key) == 1);
+      }
+    }
+  for (size_t i = 0; i < NUM_OF_INT_FLOAT_PAIRS; ++i)
+    {
+      assert((hashmap_at (map, pairs[i]->key) != NULL) == (i % 2 == 1));
+      assert(*(float *) hashmap_at (snapshot, pairs[i]->key)
+             == *(float *) pairs[i]->value);
+    }
+  hashmap_free (&snapshot);
+  hashmap_free (&map);
+  free_pair_list (&pairs, NUM_OF_INT_FLOAT_PAIRS);
+}
+
+/*
+ * returns the payload of an int-float pair.
+ */
+size_t int_float_size(const_keyT key, const_valueT value){
+  (void) key;
+  (void) value;
+  return sizeof (int) + sizeof (float);
+}
+
+/*
+ * checks the incrementally maintained memory usage of a map against a walk
+ * over its buckets (a map without buckets is all in its struct).
+ */
+void check_memory_usage(const hashmap *hash_map){
+  hashmap_memory_usage usage;
+  assert(hashmap_get_memory_usage (hash_map, &usage) == 1);
+  if (hash_map->buckets == NULL){
+      assert(usage.table_bytes == sizeof (hashmap));
+      assert((usage.bucket_bytes == 0) && (usage.slack_bytes == 0));
+  }
+  else{
+      size_t slots = 0;
+      for (size_t i = 0; i < hash_map->capacity; ++i)
+        {
+          slots += hash_map->buckets[i]->capacity;
+        }
+      assert(usage.table_bytes == sizeof (hashmap)
+                                  + sizeof (vector *) * hash_map->capacity);
+      assert(usage.bucket_bytes == sizeof (vector) * hash_map->capacity
+                                   + sizeof (void *) * hash_map->size);
+      assert(usage.slack_bytes == sizeof (void *) * (slots - hash_map->size));
+  }
+  assert(usage.entry_bytes == sizeof (pair) * hash_map->size);
+  assert(usage.payload_bytes == (hash_map->size_func == NULL ? 0 :
+                                 hash_map->size * int_float_size (NULL, NULL)));
+  assert(usage.total_bytes == usage.table_bytes + usage.bucket_bytes
+                              + usage.slack_bytes + usage.entry_bytes
+                              + usage.payload_bytes + usage.filter_bytes);
+}
+
+/**
+ * This function checks the memory accounting through insertion, erasing,
+ * snapshots, apply_if and merging.
+ */
+void test_hash_map_memory_usage(void){
+  pair **pairs = create_int_float_pairs (NUM_OF_INT_FLOAT_PAIRS);
+  hashmap *map = hashmap_alloc (hash_int);
+  if ((pairs == NULL) || (map == NULL)){
+      exit (1); // malloc fails.
+  }
+  hashmap_memory_usage usage;
+  assert(hashmap_get_memory_usage (NULL, &usage) == 0);
+  check_memory_usage (map);
+  size_t half = NUM_OF_INT_FLOAT_PAIRS / 2;
+  for (size_t i = 0; i < half; ++i)
+    {
+      assert(hashmap_insert (map, pairs[i]) == 1);
+    }
+  check_memory_usage (map);
+  assert(hashmap_set_payload_size_func (map, int_float_size) == 1);
+  check_memory_usage (map);
+  hashmap *snapshot = hashmap_snapshot (map);
+  assert(hashmap_apply_if (map, is_even, dev_float_value) > 0);
+  for (size_t i = 0; i < half; i += 3)
+    {
+      assert(hashmap_erase (map, pairs[i]->key) == 1);
+    }
+  check_memory_usage (map);
+  check_memory_usage (snapshot);
+  hashmap *src = map_of_pairs (pairs, half / 2, NUM_OF_INT_FLOAT_PAIRS);
+  assert(hashmap_set_payload_size_func (src, int_float_size) == 1);
+  assert(hashmap_move_all (map, src, HASH_MAP_MERGE_KEEP, NULL) == 1);
+  check_memory_usage (map);
+  check_memory_usage (src);
+  assert(hashmap_enable_filter (map, 0) == 1);
+  assert(hashmap_get_memory_usage (map, &usage) == 1);
+  assert(usage.filter_bytes > 0);
+  check_memory_usage (map);
+  hashmap_free (&src);
+  hashmap_free (&snapshot);
+  hashmap_free (&map);
+  free_pair_list (&pairs, NUM_OF_INT_FLOAT_PAIRS);
+}
+
+/**
+ * This function checks hashmap_compact_step after erasing most of the
+ * pairs: every bucket ends up fitted to its pairs and every pair survives.
+ */
+void test_hash_map_compact(void){
+  pair **pairs = create_int_float_pairs (NUM_OF_INT_FLOAT_PAIRS);
+  hashmap *map = hashmap_alloc (hash_int);
+  if ((pairs == NULL) || (map == NULL)){
+      exit (1); // malloc fails.
+  }
+  assert(hashmap_compact_step (NULL, 1) == -1);
+  for (size_t i = 0; i < NUM_OF_INT_FLOAT_PAIRS; ++i)
+    {
+      assert(hashmap_insert (map, pairs[i]) == 1);
+    }
+  for (size_t i = 0; i < NUM_OF_INT_FLOAT_PAIRS; ++i)
+    {
+      if (i % 10 != 0){
+          assert(hashmap_erase (map, pairs[i]->key) == 1);
+      }
+    }
+  // a snapshot keeps the buckets as they are.
+  hashmap *snapshot = hashmap_snapshot (map);
+  assert(hashmap_compact_step (map, 1) == 0);
+  hashmap_free (&snapshot);
+  hashmap_memory_usage before, after;
+  assert(hashmap_get_memory_usage (map, &before) == 1);
+  const float *kept = hashmap_at (map, pairs[0]->key);
+  int steps = 0, left;
+  while ((left = hashmap_compact_step (map, 100)) == 1){
+      steps++;
+    }
+  assert(left == 0);
+  assert(steps == (int) ((map->capacity - 1) / 100));
+  assert(hashmap_get_memory_usage (map, &after) == 1);
+  assert(after.slack_bytes < before.slack_bytes);
+  for (size_t i = 0; i < map->capacity; ++i)
+    {
+      size_t size = map->buckets[i]->size;
+      assert(map->buckets[i]->capacity == (size > 0 ? size : 1));
+    }
+  check_memory_usage (map);
+  assert(hashmap_at (map, pairs[0]->key) == kept); // the pairs never move.
+  for (size_t i = 0; i < NUM_OF_INT_FLOAT_PAIRS; ++i)
+    {
+      float *value = hashmap_at (map, pairs[i]->key);
+      assert((value != NULL) == (i % 10 == 0));
+      assert((value == NULL) || (*value == *(float *) pairs[i]->value));
+    }
+  // fitted buckets still grow and shrink.
+  for (size_t i = 0; i < NUM_OF_INT_FLOAT_PAIRS; ++i)
+    {
+      assert(hashmap_insert (map, pairs[i]) == (i % 10 != 0));
+    }
+  assert(hashmap_compact (map) == 1);
+  for (size_t i = 0; i < NUM_OF_INT_FLOAT_PAIRS; ++i)
+    {
+      assert(hashmap_erase (map, pairs[i]->key) == 1);
+    }
+  assert(map->size == 0);
+  check_memory_usage (map);
+  hashmap_free (&map);
+  free_pair_list (&pairs, NUM_OF_INT_FLOAT_PAIRS);
+}
+
+/**
+ * This function checks the small map mode: a new map keeps its pairs
+ * without buckets (with the capacity following the load factors) until it
+ * outgrows HASH_MAP_SMALL_MAX pairs or needs its buckets.
+ */
+void test_hash_map_small(void){
+  pair **pairs = create_int_float_pairs (NUM_OF_INT_FLOAT_PAIRS);
+  hashmap *map = hashmap_alloc (hash_int);
+  if ((pairs == NULL) || (map == NULL)){
+      exit (1); // malloc fails.
+  }
+  assert(map->buckets == NULL);
+  assert(hashmap_set_payload_size_func (map, int_float_size) == 1);
+  for (size_t i = 0; i < HASH_MAP_SMALL_MAX; ++i)
+    {
+      assert(hashmap_insert (map, pairs[i]) == 1);
+      assert(hashmap_insert (map, pairs[i]) == 0);
+    }
+  assert((map->buckets == NULL) && (map->capacity == HASH_MAP_INITIAL_CAP));
+  check_memory_usage (map);
+  assert(hashmap_apply_if (map, is_even, dev_float_value)
+         == HASH_MAP_SMALL_MAX / 2); // the even pairs are erased below.
+  for (size_t i = 0; i < HASH_MAP_SMALL_MAX; ++i)
+    {
+      if (i % 2 == 0){
+          assert(hashmap_erase (map, pairs[i]->key) == 1);
+          assert(hashmap_erase (map, pairs[i]->key) == 0);
+      }
+    }
+  for (size_t i = 0; i < NUM_OF_INT_FLOAT_PAIRS; ++i)
+    {
+      float *value = hashmap_at (map, pairs[i]->key);
+      assert((value != NULL) == ((i < HASH_MAP_SMALL_MAX) && (i % 2 == 1)));
+      assert((value == NULL) || (*value == *(float *) pairs[i]->value));
+    }
+  // the capacity shrinks as it would with buckets.
+  assert(hashmap_erase (map, pairs[1]->key) == 1);
+  assert(hashmap_erase (map, pairs[3]->key) == 1);
+  assert((map->buckets == NULL) && (map->capacity == HASH_MAP_INITIAL_CAP / 2));
+  check_memory_usage (map);
+  // the ninth pair moves the pairs to buckets.
+  for (size_t i = 0; i < HASH_MAP_SMALL_MAX + 1; ++i)
+    {
+      assert(hashmap_insert (map, pairs[i]) == ((i != 5) && (i != 7)));
+    }
+  assert((map->buckets != NULL) && (map->size == HASH_MAP_SMALL_MAX + 1));
+  assert(map->capacity == HASH_MAP_INITIAL_CAP);
+  check_memory_usage (map);
+  for (size_t i = 0; i < HASH_MAP_SMALL_MAX + 1; ++i)
+    {
+      assert(*(float *) hashmap_at (map, pairs[i]->key)
+             == *(float *) pairs[i]->value);
+    }
+  hashmap_free (&map);
+  // a snapshot needs buckets to share, merging copies the small pairs.
+  hashmap *small = map_of_pairs (pairs, 0, 3);
+  hashmap *other = map_of_pairs (pairs, 2, 5);
+  assert((small->buckets == NULL) && (other->buckets == NULL));
+  assert(hashmap_merge (small, other, HASH_MAP_MERGE_KEEP, NULL) == 1);
+  assert(small->size == 5);
+  assert(hashmap_move_all (other, small, HASH_MAP_MERGE_OVERWRITE, NULL) == 1);
+  assert((small->size == 0) && (other->size == 5));
+  hashmap *snapshot = hashmap_snapshot (small);
+  assert((small->buckets != NULL) && (snapshot->buckets == small->buckets));
+  hashmap_free (&snapshot);
+  hashmap_free (&small);
+  hashmap_free (&other);
+  free_pair_list (&pairs, NUM_OF_INT_FLOAT_PAIRS);
+}
+
+/*
+ * returns the longest bucket of a map.
+ */
+size_t longest_bucket(const hashmap *hash_map){
+  size_t longest = 0;
+  for (size_t i = 0; i < hash_map->capacity; ++i)
+    {
+      if (hash_map->buckets[i]->size > longest){
+          longest = hash_map->buckets[i]->size;
+      }
+    }
+  return longest;
+}
+
+/**
+ * This function checks the hash flooding defences: keys found to collide
+ * under one seed share a sorted bucket that still finds every key, and are
+ * spread again by another seed.
+ */
+void test_hash_map_seed(void){
+  hashmap *map = hashmap_alloc (hash_int);
+  hashmap *other = hashmap_alloc (hash_int);
+  pair **pairs = malloc (sizeof (pair *) * NUM_OF_COLLIDING_PAIRS);
+  if ((map == NULL) || (other == NULL) || (pairs == NULL)){
+      exit (1); // malloc fails.
+  }
+  assert(map->seed != other->seed);
+  hashmap_free (&other);
+  assert(hashmap_set_seed (map, 0) == 1);
+  float value = FLOAT_VALUE_BASE_VAL;
+  int key = 0;
+  for (size_t i = 0; i < NUM_OF_COLLIDING_PAIRS; ++key)
+    {
+      if ((hashmap_seeded_hash (map, &key) & COLLIDING_MASK) == 0){
+          pairs[i++] = pair_alloc (&key, &value, int_key_cpy, float_value_cpy,
+                                   int_key_cmp, float_value_cmp,
+                                   basic_data_key_free, basic_data_value_free);
+          value += DELTA_FOR_FLOAT_VAL;
+      }
+    }
+  for (size_t i = 0; i < NUM_OF_COLLIDING_PAIRS; ++i)
+    {
+      assert(hashmap_insert (map, pairs[i]) == 1);
+      assert(hashmap_insert (map, pairs[i]) == 0);
+    }
+  vector *bucket = map->buckets[0];
+  assert(bucket->size == NUM_OF_COLLIDING_PAIRS);
+  for (size_t i = 1; i < bucket->size; ++i)
+    {
+      assert(hashmap_seeded_hash (map, ((pair *) bucket->data[i - 1])->key)
+             <= hashmap_seeded_hash (map, ((pair *) bucket->data[i])->key));
+    }
+  for (size_t i = 0; i < NUM_OF_COLLIDING_PAIRS; i += 2)
+    {
+      assert(hashmap_erase (map, pairs[i]->key) == 1);
+      assert(hashmap_erase (map, pairs[i]->key) == 0);
+    }
+  for (size_t i = 0; i < NUM_OF_COLLIDING_PAIRS; ++i)
+    {
+      float *found = hashmap_at (map, pairs[i]->key);
+      assert((found != NULL) == (i % 2 == 1));
+      assert((found == NULL) || (*found == *(float *) pairs[i]->value));
+    }
+  // another seed spreads the keys.
+  assert(hashmap_set_seed (map, 1) == 1);
+  assert(longest_bucket (map) <= HASH_MAP_TREEIFY_THRESHOLD);
+  for (size_t i = 0; i < NUM_OF_COLLIDING_PAIRS; ++i)
+    {
+      assert((hashmap_at (map, pairs[i]->key) != NULL) == (i % 2 == 1));
+    }
+  assert(hashmap_set_seed (map, 0) == 1);
+  assert(longest_bucket (map) == NUM_OF_COLLIDING_PAIRS / 2);
+  for (size_t i = 1; i < NUM_OF_COLLIDING_PAIRS; i += 2)
+    {
+      assert(hashmap_erase (map, pairs[i]->key) == 1);
+    }
+  assert(map->size == 0);
+  hashmap_free (&map);
+  free_pair_list (&pairs, NUM_OF_COLLIDING_PAIRS);
+}
+
+/*
+ * serializes a 4 byte int key or float value.
+ */
+size_t encode_4_bytes(const void *elem, char *buf, size_t buf_len){
+  if (buf_len >= 4){
+      memcpy (buf, elem, 4);
+  }
+  return 4;
+}
+
+/*
+ * deserializes an int key.
+ */
+void *decode_int(const char *buf, size_t len){
+  int *key = (len == sizeof (int)) ? malloc (sizeof (int)) : NULL;
+  if (key != NULL){
+      memcpy (key, buf, sizeof (int));
+  }
+  return key;
+}
+
+/*
+ * deserializes a float value.
+ */
+void *decode_float(const char *buf, size_t len){
+  float *value = (len == sizeof (float)) ? malloc (sizeof (float)) : NULL;
+  if (value != NULL){
+      memcpy (value, buf, sizeof (float));
+  }
+  return value;
+}
+
+/*
+ * removes the files of the wal test map.
+ */
+void remove_wal_files(void){
+  remove (WAL_TEST_PATH ".log");
+  remove (WAL_TEST_PATH ".log.old");
+  remove (WAL_TEST_PATH ".snap");
+  remove (WAL_TEST_PATH ".snap.tmp");
+}
+
+/*
+ * checks that the map holds pairs[i] with value *expected[i] for every
+ * expected[i] that is not NULL, and nothing else.
+ */
+void check_wal_holds(wal_map *wal, pair **pairs, float **expected){
+  size_t size = 0;
+  for (size_t i = 0; i < NUM_OF_WAL_PAIRS; ++i)
+    {
+      float *value = wal_map_at (wal, pairs[i]->key);
+      assert((value == NULL) == (expected[i] == NULL));
+      assert((value == NULL) || (*value == *expected[i]));
+      size += (value != NULL);
+    }
+  assert(wal->map->size == size);
+}
+
+/*
+ * A keyT_func that accepts every key.
+ */
+int any_key(const_keyT key){
+  (void) key;
+  return 1;
+}
+
+void test_hash_map_erase_if(void){
+  pair **pairs = create_int_float_pairs (NUM_OF_INT_FLOAT_PAIRS);
+  pair **char_pairs = create_char_int_pairs (NUM_OF_DIGITS);
+  hashmap *map = hashmap_alloc (hash_int);
+  if ((pairs == NULL) || (char_pairs == NULL) || (map == NULL)){
+      exit (1); // malloc fails.
+  }
+  assert(hashmap_erase_if (NULL, is_even) == 0);
+  assert(hashmap_erase_if (map, NULL) == 0);
+  // a small map.
+  hashmap *small = hashmap_alloc (hash_char);
+  for (size_t i = 0; i < HASH_MAP_SMALL_MAX; ++i)
+    {
+      assert(hashmap_insert (small, char_pairs[i]) == 1);
+    }
+  assert(hashmap_erase_if (small, is_digit) == 0);
+  assert(hashmap_erase_if (small, any_key) == HASH_MAP_SMALL_MAX);
+  assert(small->size == 0 && small->buckets == NULL);
+  assert(small->capacity == HASH_MAP_INITIAL_CAP);
+  hashmap_free (&small);
+  // a large map shared with a snapshot, behind a filter.
+  for (size_t i = 0; i < NUM_OF_INT_FLOAT_PAIRS; ++i)
+    {
+      assert(hashmap_insert (map, pairs[i]) == 1);
+    }
+  assert(hashmap_enable_filter (map, 0) == 1);
+  hashmap *snapshot = hashmap_snapshot (map);
+  assert(snapshot != NULL);
+  assert(hashmap_erase_if (map, is_even) == NUM_OF_INT_FLOAT_PAIRS / 2);
+  assert(map->size == NUM_OF_INT_FLOAT_PAIRS / 2);
+  assert(hashmap_get_load_factor (map) > HASH_MAP_MIN_LOAD_FACTOR);
+  assert((double) map->size / (2 * map->capacity) <= HASH_MAP_MIN_LOAD_FACTOR);
+  assert(snapshot->size == NUM_OF_INT_FLOAT_PAIRS);
+  for (size_t i = 0; i < NUM_OF_INT_FLOAT_PAIRS; ++i)
+    {
+      float *value = hashmap_at (map, pairs[i]->key);
+      assert((value != NULL) == (i % 2 == 1));
+      assert((value == NULL) || (*value == *(float *) pairs[i]->value));
+      assert(hashmap_at (snapshot, pairs[i]->key) != NULL);
+    }
+  hashmap_free (&snapshot);
+  check_memory_usage (map);
+  assert(hashmap_erase_if (map, is_even) == 0);
+  assert(hashmap_erase_if (map, any_key) == NUM_OF_INT_FLOAT_PAIRS / 2);
+  assert(map->size == 0 && map->capacity == HASH_MAP_INITIAL_CAP);
+  check_memory_usage (map);
+  hashmap_free (&map);
+  // a long sorted bucket stays sorted.
+  map = hashmap_alloc (hash_int);
+  assert(hashmap_set_seed (map, 0) == 1);
+  int key = 0, num_of_even = 0;
+  for (size_t i = 0; i < NUM_OF_COLLIDING_PAIRS; ++key)
+    {
+      if ((hashmap_seeded_hash (map, &key) & COLLIDING_MASK) == 0){
+          pair *colliding = pair_alloc (&key, pairs[0]->value, int_key_cpy,
+                                        float_value_cpy, int_key_cmp,
+                                        float_value_cmp, basic_data_key_free,
+                                        basic_data_value_free);
+          assert(hashmap_insert (map, colliding) == 1);
+          pair_free ((void **) &colliding);
+          num_of_even += (key % 2 == 0);
+          i++;
+      }
+    }
+  assert(hashmap_erase_if (map, is_even) == (size_t) num_of_even);
+  vector *bucket = map->buckets[0];
+  assert(bucket->size == NUM_OF_COLLIDING_PAIRS - (size_t) num_of_even);
+  for (size_t i = 1; i < bucket->size; ++i)
+    {
+      assert(hashmap_seeded_hash (map, ((pair *) bucket->data[i - 1])->key)
+             <= hashmap_seeded_hash (map, ((pair *) bucket->data[i])->key));
+    }
+  for (size_t i = 0; i < bucket->size; ++i)
+    {
+      const int *found = ((pair *) bucket->data[i])->key;
+      assert(*found % 2 != 0);
+      assert(hashmap_at (map, found) != NULL);
+    }
+  hashmap_free (&map);
+  free_pair_list (&char_pairs, NUM_OF_DIGITS);
+  free_pair_list (&pairs, NUM_OF_INT_FLOAT_PAIRS);
+}
+
+/*
+ * Drains every event of subscriber (up to NUM_OF_FEED_EVENTS) into events.
+ * Returns the number of events.
+ */
+size_t drain_all(change_feed_subscriber *subscriber,
+                 change_feed_event **events){
+  size_t num_of_events = 0, got;
+  while ((got = change_feed_drain (subscriber, events + num_of_events, 3))
+         > 0){
+      num_of_events += got;
+      assert(num_of_events <= NUM_OF_FEED_EVENTS);
+    }
+  return num_of_events;
+}
+
+/*
+ * @struct feed_consumer
+ * A thread draining a subscriber until it saw last_seq (or its drops).
+ */
+typedef struct feed_consumer {
+    change_feed_subscriber *subscriber;
+    size_t last_seq;
+    size_t num_of_events;
+} feed_consumer;
+
+void *consume_feed(void *arg){
+  feed_consumer *consumer = (feed_consumer *) arg;
+  change_feed_event *events[NUM_OF_FEED_EVENTS];
+  size_t seq = 0;
+  while (consumer->num_of_events
+         + change_feed_dropped (consumer->subscriber) < consumer->last_seq){
+      size_t got = change_feed_drain (consumer->subscriber, events,
+                                      NUM_OF_FEED_EVENTS);
+      for (size_t i = 0; i < got; ++i)
+        {
+          assert(events[i]->seq > seq); // in order, with gaps for drops.
+          seq = events[i]->seq;
+          assert(events[i]->type == CHANGE_FEED_INSERT);
+          assert(*(int *) events[i]->pair->key
+                 == INT_KEY_BASE_VALUE + (int) seq - 1);
+        }
+      change_feed_release (events, got);
+      consumer->num_of_events += got;
+    }
+  return NULL;
+}
+
+void test_hash_map_change_feed(void){
+  pair **pairs = create_int_float_pairs (NUM_OF_INT_FLOAT_PAIRS);
+  hashmap *map = hashmap_alloc (hash_int);
+  if ((pairs == NULL) || (map == NULL)){
+      exit (1); // malloc fails.
+  }
+  change_feed_event *events[NUM_OF_FEED_EVENTS];
+  assert(hashmap_subscribe (NULL, 0) == NULL);
+  assert(hashmap_subscribe (map, CHANGE_FEED_MAX_CAP + 1) == NULL);
+  assert(hashmap_subscribe (map, SIZE_MAX) == NULL);
+  change_feed_subscriber *all = hashmap_subscribe (map, NUM_OF_FEED_EVENTS);
+  change_feed_subscriber *few = hashmap_subscribe (map, 3); // rounded to 4.
+  assert(all != NULL && few != NULL && few->capacity == 4);
+  // insertions, through the small pairs and the buckets.
+  for (size_t i = 0; i < 2 * HASH_MAP_SMALL_MAX; ++i)
+    {
+      assert(hashmap_insert (map, pairs[i]) == 1);
+    }
+  assert(hashmap_insert (map, pairs[0]) == 0); // no change, no event.
+  size_t num_of_events = drain_all (all, events);
+  assert(num_of_events == 2 * HASH_MAP_SMALL_MAX);
+  for (size_t i = 0; i < num_of_events; ++i)
+    {
+      assert(events[i]->type == CHANGE_FEED_INSERT && events[i]->seq == i + 1);
+      assert(pair_cmp (events[i]->pair, pairs[i]) == 1);
+    }
+  change_feed_release (events, num_of_events);
+  assert(drain_all (few, events) == 4);
+  change_feed_release (events, 4);
+  assert(change_feed_dropped (few) == 2 * HASH_MAP_SMALL_MAX - 4);
+  // updates carry the new values, erasures the erased pairs.
+  assert(hashmap_apply_if (map, is_even, dev_float_value)
+         == (int) HASH_MAP_SMALL_MAX);
+  assert(hashmap_erase (map, pairs[1]->key) == 1);
+  assert(hashmap_erase_if (map, is_even) == HASH_MAP_SMALL_MAX);
+  num_of_events = drain_all (all, events);
+  assert(num_of_events == 2 * HASH_MAP_SMALL_MAX + 1);
+  for (size_t i = 0; i < num_of_events; ++i)
+    {
+      int key = *(int *) events[i]->pair->key;
+      float value = *(float *) events[i]->pair->value;
+      float original = *(float *) pairs[key - INT_KEY_BASE_VALUE]->value;
+      assert(key % 2 == 0 || (i == HASH_MAP_SMALL_MAX && key == 101));
+      assert(events[i]->type == ((i < HASH_MAP_SMALL_MAX) ? CHANGE_FEED_UPDATE
+                                                          : CHANGE_FEED_ERASE));
+      assert(value == ((key % 2 == 0) ? original / 2 : original));
+    }
+  change_feed_release (events, num_of_events);
+  // merges: a new key and an overwritten key.
+  hashmap *src = map_of_pairs (pairs, 2 * HASH_MAP_SMALL_MAX - 1,
+                               2 * HASH_MAP_SMALL_MAX + 1);
+  assert(hashmap_merge (map, src, HASH_MAP_MERGE_OVERWRITE, NULL) == 1);
+  assert(drain_all (all, events) == 2);
+  assert(events[0]->type + events[1]->type
+         == CHANGE_FEED_INSERT + CHANGE_FEED_UPDATE);
+  change_feed_release (events, 2);
+  hashmap_free (&src);
+  // a full subscriber is unsubscribed, the other is freed with the map.
+  assert(hashmap_insert (map, pairs[0]) == 1);
+  hashmap_unsubscribe (map, &few);
+  assert(few == NULL && map->subscribers == all && all->next == NULL);
+  hashmap_free (&map);
+  // a consumer on another thread, with drops or without.
+  for (size_t capacity = NUM_OF_FEED_EVENTS; capacity <= NUM_OF_INT_FLOAT_PAIRS;
+       capacity = NUM_OF_INT_FLOAT_PAIRS)
+    {
+      map = hashmap_alloc (hash_int);
+      feed_consumer consumer = {hashmap_subscribe (map, capacity),
+                                NUM_OF_INT_FLOAT_PAIRS, 0};
+      pthread_t thread;
+      assert(pthread_create (&thread, NULL, consume_feed, &consumer) == 0);
+      for (size_t i = 0; i < NUM_OF_INT_FLOAT_PAIRS; ++i)
+        {
+          assert(hashmap_insert (map, pairs[i]) == 1);
+        }
+      pthread_join (thread, NULL);
+      assert(consumer.num_of_events + change_feed_dropped (consumer.subscriber)
+             == NUM_OF_INT_FLOAT_PAIRS);
+      assert((change_feed_dropped (consumer.subscriber) == 0)
+             || (capacity < NUM_OF_INT_FLOAT_PAIRS));
+      hashmap_free (&map);
+      if (capacity == NUM_OF_INT_FLOAT_PAIRS){
+          break;
+      }
+    }
+  free_pair_list (&pairs, NUM_OF_INT_FLOAT_PAIRS);
+}
+
+/*
+ * A hashmap_diff_func that checks a difference of test_hash_map_diff: keys
+ * below the base key are only in the second map, keys of the last pairs
+ * only in the first, and the values of the others were halved.
+ */
+void check_difference(const_keyT key, const_valueT value_a,
+                      const_valueT value_b, void *arg){
+  int ind = *(const int *) key - INT_KEY_BASE_VALUE;
+  (void) arg;
+  if (ind < 0){
+      assert(value_a == NULL && value_b != NULL);
+  }
+  else if (ind >= NUM_OF_INT_FLOAT_PAIRS - NUM_OF_CHANGED_PAIRS){
+      assert(value_a != NULL && value_b == NULL);
+  }
+  else{
+      assert(value_a != NULL && value_b != NULL);
+      assert(*(const float *) value_b == *(const float *) value_a / 2);
+  }
+}
+
+/*
+ * Applies the events of the change feed of a map to a replica.
+ */
+void apply_changes(hashmap *replica, change_feed_subscriber *subscriber){
+  change_feed_event *events[NUM_OF_FEED_EVENTS];
+  size_t got;
+  while ((got = change_feed_drain (subscriber, events, NUM_OF_FEED_EVENTS))
+         > 0){
+      for (size_t i = 0; i < got; ++i)
+        {
+          if (events[i]->type != CHANGE_FEED_INSERT){
+              assert(hashmap_erase (replica, events[i]->pair->key) == 1);
+          }
+          if (events[i]->type != CHANGE_FEED_ERASE){
+              assert(hashmap_insert (replica, events[i]->pair) == 1);
+          }
+        }
+      change_feed_release (events, got);
+    }
+}
+
+void test_hash_map_diff(void){
+  pair **pairs = create_int_float_pairs (NUM_OF_INT_FLOAT_PAIRS);
+  hashmap *primary = hashmap_alloc (hash_int);
+  hashmap *replica = hashmap_alloc (hash_int);
+  if ((pairs == NULL) || (primary == NULL) || (replica == NULL)){
+      exit (1); // malloc fails.
+  }
+  assert(hashmap_diff (NULL, replica, NULL, NULL, NULL) == -1);
+  assert(hashmap_enable_digests (primary, NULL, 0) == 0);
+  assert(hashmap_set_seed (primary, 7) == 1);
+  assert(hashmap_set_seed (replica, 7) == 1);
+  assert(hashmap_enable_digests (primary, hash_float, 0) == 1);
+  assert(primary->digest_groups == HASH_MAP_DIGEST_GROUPS);
+  // the same pairs, inserted in another order.
+  for (size_t i = 0; i < NUM_OF_INT_FLOAT_PAIRS; ++i)
+    {
+      assert(hashmap_insert (primary, pairs[i]) == 1);
+      assert(hashmap_insert (replica, pairs[NUM_OF_INT_FLOAT_PAIRS - 1 - i])
+             == 1);
+    }
+  assert(hashmap_enable_digests (replica, hash_float, 0) == 1);
+  size_t visited;
+  assert(hashmap_diff (primary, replica, NULL, NULL, &visited) == 0);
+  assert(visited == 0);
+  assert(memcmp (primary->digests, replica->digests,
+                 sizeof (size_t) * HASH_MAP_DIGEST_GROUPS) == 0);
+  hashmap *snapshot = hashmap_snapshot (primary);
+  change_feed_subscriber *feed = hashmap_subscribe (primary, 0);
+  // new keys, erased keys and changed values.
+  float value = FLOAT_VALUE_BASE_VAL;
+  for (int i = 0; i < NUM_OF_CHANGED_PAIRS; ++i)
+    {
+      int key = INT_KEY_BASE_VALUE - 1 - i;
+      pair *new_pair = pair_alloc (&key, &value, int_key_cpy, float_value_cpy,
+                                   int_key_cmp, float_value_cmp,
+                                   basic_data_key_free, basic_data_value_free);
+      assert(hashmap_insert (primary, new_pair) == 1);
+      pair_free ((void **) &new_pair);
+      assert(hashmap_erase (primary, pairs[NUM_OF_INT_FLOAT_PAIRS - 1 - i]->key)
+             == 1);
+      dev_float_value (pairs[i * 1000]->value);
+      hashmap *changed = map_of_pairs (pairs, i * 1000, i * 1000 + 1);
+      assert(hashmap_merge (primary, changed, HASH_MAP_MERGE_OVERWRITE, NULL)
+             == 1);
+      hashmap_free (&changed);
+    }
+  long num_of_changes = 3 * NUM_OF_CHANGED_PAIRS;
+  assert(hashmap_diff (replica, primary, check_difference, NULL, &visited)
+         == num_of_changes);
+  assert(visited > 0 && visited <= (size_t) num_of_changes);
+  assert(hashmap_diff (snapshot, primary, check_difference, NULL, NULL)
+         == num_of_changes);
+  // without digests (or with another seed) every pair is compared.
+  hashmap_disable_digests (snapshot);
+  assert(hashmap_diff (snapshot, primary, check_difference, NULL, &visited)
+         == num_of_changes);
+  assert(visited == 1);
+  hashmap_free (&snapshot);
+  // the change feed brings the replica back in sync.
+  apply_changes (replica, feed);
+  assert(hashmap_diff (replica, primary, NULL, NULL, &visited) == 0);
+  assert(visited == 0);
+  assert(hashmap_set_seed (replica, 8) == 1);
+  assert(hashmap_diff (replica, primary, NULL, NULL, &visited) == 0);
+  assert(visited == 1);
+  hashmap_free (&primary);
+  hashmap_free (&replica);
+  free_pair_list (&pairs, NUM_OF_INT_FLOAT_PAIRS);
+}
+
+/**
+ * This function checks wal_map through writes, reopening, compaction,
+ * a torn log tail and automatic compaction, with every sync policy.
+ */
+void test_wal_map(void){
+  pair **pairs = create_int_float_pairs (2 * NUM_OF_WAL_PAIRS);
+  float **expected = calloc (NUM_OF_WAL_PAIRS, sizeof (float *));
+  if ((pairs == NULL) || (expected == NULL)){
+      exit (1); // malloc fails.
+  }
+  wal_codec codec = {encode_4_bytes, encode_4_bytes, decode_int, decode_float,
+                     int_key_cpy, float_value_cpy, int_key_cmp,
+                     float_value_cmp, basic_data_key_free,
+                     basic_data_value_free};
+  remove_wal_files ();
+  assert(wal_map_open (WAL_TEST_PATH, hash_int, &codec, 7, 0) == NULL);
+  wal_map *wal = wal_map_open (WAL_TEST_PATH, hash_int, &codec,
+                               WAL_SYNC_INTERVAL, 1);
+  assert(wal != NULL);
+  for (size_t i = 0; i < NUM_OF_WAL_PAIRS; ++i)
+    {
+      assert(wal_map_insert (wal, pairs[i]) == 1);
+      expected[i] = pairs[i]->value;
+    }
+  assert(wal_map_insert (wal, pairs[0]) == 0);
+  for (size_t i = 0; i < NUM_OF_WAL_PAIRS; i += 3)
+    {
+      pair *updated = pair_alloc (pairs[i]->key,
+                                  pairs[i + NUM_OF_WAL_PAIRS]->value,
+                                  int_key_cpy, float_value_cpy, int_key_cmp,
+                                  float_value_cmp, basic_data_key_free,
+                                  basic_data_value_free);
+      assert(wal_map_update (wal, updated) == 1);
+      expected[i] = pairs[i + NUM_OF_WAL_PAIRS]->value;
+      pair_free ((void **) &updated);
+    }
+  for (size_t i = 0; i < NUM_OF_WAL_PAIRS; i += 5)
+    {
+      assert(wal_map_erase (wal, pairs[i]->key) == 1);
+      expected[i] = NULL;
+    }
+  assert(wal_map_erase (wal, pairs[0]->key) == 0);
+  assert(wal_map_close (&wal) == 1);
+  assert(wal == NULL);
+  // recovery from the log, then a compaction.
+  wal = wal_map_open (WAL_TEST_PATH, hash_int, &codec, WAL_SYNC_ALWAYS, 0);
+  assert(wal != NULL);
+  check_wal_holds (wal, pairs, expected);
+  assert(wal_map_compact (wal, 1) == 1);
+  FILE *file = fopen (WAL_TEST_PATH ".log.old", "rb");
+  assert(file == NULL);
+  assert(wal->log_bytes == 0);
+  for (size_t i = 0; i < NUM_OF_WAL_PAIRS; i += 5)
+    {
+      assert(wal_map_insert (wal, pairs[i]) == 1);
+      expected[i] = pairs[i]->value;
+    }
+  assert(wal->durable_lsn == wal->next_lsn);
+  assert(wal_map_close (&wal) == 1);
+  // a torn record at the tail is dropped.
+  file = fopen (WAL_TEST_PATH ".log", "ab");
+  assert(file != NULL);
+  fwrite ("\x20\0\0\0torn", 1, 8, file);
+  fclose (file);
+  wal = wal_map_open (WAL_TEST_PATH, hash_int, &codec, WAL_SYNC_NONE, 0);
+  assert(wal != NULL);
+  check_wal_holds (wal, pairs, expected);
+  assert(wal_map_erase (wal, pairs[1]->key) == 1);
+  expected[1] = NULL;
+  wal_map_set_compact_bytes (wal, 4096);
+  for (size_t i = 2; i < NUM_OF_WAL_PAIRS; i += 2)
+    {
+      assert(wal_map_erase (wal, pairs[i]->key) == 1);
+      assert(wal_map_insert (wal, pairs[i]) == 1);
+      assert(wal_map_sync (wal) == 1);
+      expected[i] = pairs[i]->value;
+    }
+  assert(wal->log_bytes < NUM_OF_WAL_PAIRS * 16);
+  assert(wal_map_close (&wal) == 1);
+  wal = wal_map_open (WAL_TEST_PATH, hash_int, &codec, WAL_SYNC_NONE, 0);
+  assert(wal != NULL);
+  check_wal_holds (wal, pairs, expected);
+  assert(wal_map_close (&wal) == 1);
+  // a write whose record can not be written is undone.
+  pair *updated = pair_alloc (pairs[2]->key, pairs[NUM_OF_WAL_PAIRS]->value,
+                              int_key_cpy, float_value_cpy, int_key_cmp,
+                              float_value_cmp, basic_data_key_free,
+                              basic_data_value_free);
+  assert(updated != NULL);
+  for (int op = WAL_OP_INSERT; op <= WAL_OP_ERASE; ++op)
+    {
+      wal = wal_map_open (WAL_TEST_PATH, hash_int, &codec, WAL_SYNC_ALWAYS,
+                          0);
+      assert(wal != NULL);
+      int fd = wal->fd;
+      wal->fd = -1; // every write fails.
+      if (op == WAL_OP_INSERT){
+          assert(wal_map_insert (wal, pairs[NUM_OF_WAL_PAIRS]) == 0);
+      }
+      else if (op == WAL_OP_UPDATE){
+          assert(wal_map_update (wal, updated) == 0);
+      }
+      else{
+          assert(wal_map_erase (wal, pairs[2]->key) == 0);
+      }
+      assert(wal_map_at (wal, pairs[NUM_OF_WAL_PAIRS]->key) == NULL);
+      check_wal_holds (wal, pairs, expected);
+      assert(wal_map_insert (wal, pairs[NUM_OF_WAL_PAIRS]) == 0);
+      wal->fd = fd;
+      assert(wal_map_close (&wal) == 0);
+    }
+  pair_free ((void **) &updated);
+  wal = wal_map_open (WAL_TEST_PATH, hash_int, &codec, WAL_SYNC_NONE, 0);
+  assert(wal != NULL);
+  check_wal_holds (wal, pairs, expected);
+  assert(wal_map_close (&wal) == 1);
+  remove_wal_files ();
+  free (expected);
+  free_pair_list (&pairs, 2 * NUM_OF_WAL_PAIRS);
+}
+
+/*
+ * returns a column map holding num_of_entries entries, with negative and
+ * positive keys. exits if malloc fails.
+ */
+column_map *create_column_map(size_t num_of_entries){
+  column_map *map = column_map_alloc ();
+  if (map == NULL){
+      exit (1); // malloc fails.
+  }
+  for (size_t i = 0; i < num_of_entries; ++i)
+    {
+      int64_t key = ((int64_t) i - (int64_t) num_of_entries / 2) * 3;
+      assert(column_map_insert (map, key, (double) i * 0.5) == 1);
+    }
+  return map;
+}
+
+/*
+ * checks every pair of a spill map: the pairs at odd indices with their
+ * values, the ones at even indices erased when erased is 1.
+ */
+void check_spill_map(spill_map *map, pair **pairs, int erased){
+  const_keyT *keys = malloc (sizeof (const_keyT) * NUM_OF_SPILL_PAIRS);
+  valueT *values = malloc (sizeof (valueT) * NUM_OF_SPILL_PAIRS);
+  if ((keys == NULL) || (values == NULL)){
+      exit (1); // malloc fails.
+  }
+  for (size_t i = 0; i < NUM_OF_SPILL_PAIRS; ++i)
+    {
+      keys[i] = pairs[i]->key;
+      float *value = spill_map_at (map, pairs[i]->key);
+      assert((value == NULL) == (erased && (i % 2 == 0)));
+      assert((value == NULL) || (*value == *(float *) pairs[i]->value));
+    }
+  size_t found = spill_map_at_batch (map, keys, NUM_OF_SPILL_PAIRS, values);
+  assert(found == (erased ? NUM_OF_SPILL_PAIRS / 2 : NUM_OF_SPILL_PAIRS));
+  for (size_t i = 0; i < NUM_OF_SPILL_PAIRS; ++i)
+    {
+      assert((values[i] == NULL) == (erased && (i % 2 == 0)));
+      if (values[i] != NULL){
+          assert(float_value_cmp (values[i], pairs[i]->value) == 1);
+          basic_data_value_free (&values[i]);
+      }
+    }
+  free (keys);
+  free (values);
+}
+
+void test_spill_map(void){
+  pair **pairs = create_int_float_pairs (NUM_OF_SPILL_PAIRS);
+  if (pairs == NULL){
+      exit (1); // malloc fails.
+  }
+  wal_codec codec = {encode_4_bytes, encode_4_bytes, decode_int, decode_float,
+                     int_key_cpy, float_value_cpy, int_key_cmp,
+                     float_value_cmp, basic_data_key_free,
+                     basic_data_value_free};
+  assert(spill_map_open (SPILL_TEST_PATH, hash_int, NULL, 0, 0, 0) == NULL);
+  assert(spill_map_open (SPILL_TEST_PATH, hash_int, &codec,
+                         SPILL_MAP_MAX_PAGES + 1, 0, 0) == NULL);
+  assert(spill_map_open (SPILL_TEST_PATH, hash_int, &codec, SIZE_MAX, 0, 0)
+         == NULL);
+  wal_codec no_decode = codec;
+  no_decode.value_decode = NULL;
+  assert(spill_map_open (SPILL_TEST_PATH, hash_int, &no_decode, 0, 0, 0)
+         == NULL);
+  FILE *existing = fopen (SPILL_TEST_PATH, "w"); // never overwritten.
+  assert(existing != NULL && fputs ("keep", existing) >= 0);
+  fclose (existing);
+  assert(spill_map_open (SPILL_TEST_PATH, hash_int, &codec, 0, 0, 0) == NULL);
+  assert(remove (SPILL_TEST_PATH) == 0);
+  for (size_t threads = 0; threads <= 2; threads += 2)
+    {
+      spill_map *map = spill_map_open (SPILL_TEST_PATH, hash_int, &codec,
+                                       NUM_OF_SPILL_PAGES,
+                                       SPILL_TEST_BUDGET, threads);
+      assert(map != NULL);
+      assert(remove (SPILL_TEST_PATH) != 0); // unlinked at once.
+      for (size_t i = 0; i < NUM_OF_SPILL_PAIRS; ++i)
+        {
+          assert(spill_map_insert (map, pairs[i]) == 1);
+        }
+      assert(spill_map_insert (map, pairs[0]) == 0);
+      assert(map->size == NUM_OF_SPILL_PAIRS);
+      spill_map_stats stats;
+      assert(spill_map_get_stats (map, &stats) == 1);
+      assert(stats.evictions > 0 && stats.pages_written > 0);
+      assert(stats.resident_bytes <= SPILL_TEST_BUDGET);
+      assert(stats.resident_pages < NUM_OF_SPILL_PAGES && stats.file_bytes > 0);
+      check_spill_map (map, pairs, 0);
+      for (size_t i = 0; i < NUM_OF_SPILL_PAIRS; i += 2)
+        {
+          assert(spill_map_erase (map, pairs[i]->key) == 1);
+        }
+      assert(spill_map_erase (map, pairs[0]->key) == 0);
+      check_spill_map (map, pairs, 1);
+      size_t reads = stats.page_faults + stats.prefetched;
+      assert(spill_map_get_stats (map, &stats) == 1);
+      assert(stats.page_faults + stats.prefetched > reads);
+      assert((threads > 0) || (stats.prefetched == 0));
+      assert(stats.resident_bytes <= SPILL_TEST_BUDGET);
+      spill_map_close (&map);
+      assert(map == NULL);
+    }
+  // once a page can not be written, inserts fail instead of growing.
+  spill_map *map = spill_map_open (SPILL_TEST_PATH, hash_int, &codec,
+                                   NUM_OF_SPILL_PAGES, SPILL_TEST_BUDGET, 0);
+  assert(map != NULL);
+  int fd = map->fd;
+  map->fd = -1; // every write fails.
+  size_t inserted = 0;
+  while ((inserted < NUM_OF_SPILL_PAIRS)
+         && (spill_map_insert (map, pairs[inserted]) == 1)){
+      inserted += 1;
+  }
+  assert(inserted < NUM_OF_SPILL_PAIRS && map->failed);
+  assert(spill_map_insert (map, pairs[NUM_OF_SPILL_PAIRS - 1]) == 0);
+  assert(spill_map_at (map, pairs[0]->key) != NULL);
+  map->fd = fd;
+  spill_map_close (&map);
+  free_pair_list (&pairs, NUM_OF_SPILL_PAIRS);
+}
+
+/**
+ * This function checks column_map: insertion, lookup and erasing, and every
+ * predicate and update of the bulk passes, on the AVX2 kernels and on the
+ * scalar ones against a plain loop.
+ */
+void test_column_map(void){
+  size_t num = NUM_OF_INT_FLOAT_PAIRS / 10 + 3; // not a multiple of a block.
+  column_map *simd = create_column_map (num);
+  column_map *scalar = create_column_map (num);
+  assert(column_map_insert (simd, 0, 1) == 0);
+  assert(column_map_set_simd (scalar, 0) == 0);
+  int64_t *selected = malloc (sizeof (int64_t) * num);
+  int64_t *expected = malloc (sizeof (int64_t) * num);
+  if ((selected == NULL) || (expected == NULL)){
+      exit (1); // malloc fails.
+  }
+  column_update update = {COLUMN_SET, 0, 0};
+  for (int column = COLUMN_KEYS; column <= COLUMN_VALUES; ++column)
+    {
+      for (int op = COLUMN_ALL; op <= COLUMN_RANGE; ++op)
+        {
+          column_pred pred = {column, op, -300, 600, 1000.5, 2500};
+          size_t count = 0;
+          for (size_t i = 0; i < scalar->size; ++i)
+            {
+              double x = (column == COLUMN_KEYS) ? (double) scalar->keys[i] :
+                         scalar->values[i];
+              double a = (column == COLUMN_KEYS) ? -300 : 1000.5;
+              double b = (column == COLUMN_KEYS) ? 600 : 2500;
+              int hit = (op == COLUMN_ALL) || ((op == COLUMN_EQ) && (x == a))
+                        || ((op == COLUMN_NE) && (x != a))
+                        || ((op == COLUMN_LT) && (x < a))
+                        || ((op == COLUMN_LE) && (x <= a))
+                        || ((op == COLUMN_GT) && (x > a))
+                        || ((op == COLUMN_GE) && (x >= a))
+                        || ((op == COLUMN_RANGE) && (x >= a) && (x <= b));
+              if (hit){
+                  expected[count++] = scalar->keys[i];
+              }
+            }
+          assert(column_map_count_if (simd, &pred) == count);
+          assert(column_map_count_if (scalar, &pred) == count);
+          assert(column_map_select (simd, &pred, selected, num) == count);
+          assert(memcmp (selected, expected, sizeof (int64_t) * count) == 0);
+          assert(column_map_select (scalar, &pred, selected, 2) == (count < 2 ?
+                                                                   count : 2));
+          update.op = op % (COLUMN_SCALE_ADD + 1);
+          update.a = 1.5;
+          update.b = -2;
+          assert(column_map_apply_if (simd, &pred, &update) == count);
+          assert(column_map_apply_if (scalar, &pred, &update) == count);
+          assert(memcmp (simd->values, scalar->values,
+                         sizeof (double) * num) == 0);
+        }
+    }
+  // erasing moves the last entry into the hole.
+  for (size_t i = 0; i < num; i += 2)
+    {
+      int64_t key = ((int64_t) i - (int64_t) num / 2) * 3;
+      double value = *column_map_at (scalar, key);
+      assert(column_map_erase (scalar, key) == 1);
+      assert(column_map_at (scalar, key) == NULL);
+      assert(column_map_insert (scalar, key, value) == 1);
+      assert(column_map_erase (scalar, key) == 1);
+    }
+  assert(column_map_erase (scalar, 1) == 0);
+  assert(scalar->size == num / 2);
+  for (size_t i = 0; i < num; ++i)
+    {
+      int64_t key = ((int64_t) i - (int64_t) num / 2) * 3;
+      double *value = column_map_at (scalar, key);
+      assert((value != NULL) == (i % 2 == 1));
+      assert((value == NULL) || (*value == *column_map_at (simd, key)));
+    }
+  assert(column_map_get_load_factor (scalar) >= HASH_MAP_MIN_LOAD_FACTOR);
+  free (selected);
+  free (expected);
+  column_map_free (&simd);
+  column_map_free (&scalar);
+}
+
+/*
+ * @struct flow_key
+ * A 12 byte key for test_fixed_map, hashed by its bytes.
+ */
+typedef struct flow_key {
+    uint32_t src;
+    uint32_t dst;
+    uint16_t src_port;
+    uint16_t dst_port;
+} flow_key;
+
+void test_fixed_map(void){
+  static unsigned char buffer[1 << 16];
+  fixed_map map;
+  size_t bytes = fixed_map_bytes (NUM_OF_FIXED_ENTRIES, sizeof (flow_key),
+                                  sizeof (double));
+  assert(bytes > 0 && bytes <= sizeof (buffer) - 1);
+  assert(fixed_map_bytes (0, sizeof (flow_key), sizeof (double)) == 0);
+  assert(fixed_map_init (&map, buffer, bytes - 1, NUM_OF_FIXED_ENTRIES,
+                         sizeof (flow_key), sizeof (double), NULL) == 0);
+  // an unaligned buffer is aligned by the map.
+  assert(fixed_map_init (&map, buffer + 1, bytes, NUM_OF_FIXED_ENTRIES,
+                         sizeof (flow_key), sizeof (double), NULL) == 1);
+  int in_map[2 * NUM_OF_FIXED_ENTRIES] = {0};
+  flow_key key = {0};
+  double value;
+  for (size_t i = 0; i < 2 * NUM_OF_FIXED_ENTRIES; ++i)
+    {
+      key.src_port = (uint16_t) i;
+      value = (double) i;
+      int inserted = fixed_map_insert (&map, &key, &value);
+      assert(inserted == ((i < NUM_OF_FIXED_ENTRIES) ? 1 : FIXED_MAP_FULL));
+      in_map[i] = (inserted == 1);
+    }
+  key.src_port = 0;
+  assert(fixed_map_insert (&map, &key, &value) == 0); // already in the map.
+  assert(fixed_map_get_load_factor (&map) <= 0.5);
+  // erase and insert keys in a pseudo random order, against in_map.
+  size_t state = 1;
+  for (size_t round = 0; round < 20 * NUM_OF_FIXED_ENTRIES; ++round)
+    {
+      state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+      size_t i = (state >> 33) % (2 * NUM_OF_FIXED_ENTRIES);
+      key.src_port = (uint16_t) i;
+      value = (double) i;
+      if (in_map[i]){
+          assert(fixed_map_erase (&map, &key) == 1);
+          in_map[i] = 0;
+      }
+      else{
+          int inserted = fixed_map_insert (&map, &key, &value);
+          assert((inserted == 1) || (map.size == NUM_OF_FIXED_ENTRIES));
+          in_map[i] = (inserted == 1);
+      }
+    }
+  size_t size = 0;
+  for (size_t i = 0; i < 2 * NUM_OF_FIXED_ENTRIES; ++i)
+    {
+      key.src_port = (uint16_t) i;
+      double *found = fixed_map_at (&map, &key);
+      assert((found != NULL) == in_map[i]);
+      assert((found == NULL) || (*found == (double) i));
+      size += in_map[i];
+    }
+  assert(map.size == size);
+  for (size_t pos = 0; pos < map.size; ++pos)
+    {
+      const flow_key *stored = fixed_map_key_at (&map, pos);
+      assert(*(double *) fixed_map_value_at (&map, pos) == stored->src_port);
+    }
+  assert(fixed_map_key_at (&map, map.size) == NULL);
+  fixed_map_clear (&map);
+  assert(map.size == 0 && fixed_map_at (&map, &key) == NULL);
+  // a user hash function and no values: a set.
+  int int_key = INT_KEY_BASE_VALUE;
+  assert(fixed_map_init (&map, buffer, sizeof (buffer), NUM_OF_FIXED_ENTRIES,
+                         sizeof (int), 0, hash_int) == 1);
+  assert(fixed_map_insert (&map, &int_key, NULL) == 1);
+  assert(fixed_map_at (&map, &int_key) != NULL);
+  assert(fixed_map_erase (&map, &int_key) == 1);
+  assert(fixed_map_erase (&map, &int_key) == 0);
+}
+
+void test_map_server(void){
+  map_server *server = map_server_start (SERVER_TEST_PATH, 4, 2);
+  assert(server != NULL);
+  assert(map_server_start (SERVER_TEST_PATH, 4, 2) == NULL); // in use.
+  map_client *client = map_client_connect (SERVER_TEST_PATH);
+  assert(client != NULL);
+  map_reply reply;
+  // one request at a time.
+  assert(map_client_get (client, "key", 3, &reply) == 1);
+  assert(reply.status == MAP_STATUS_NOT_FOUND && reply.value == NULL);
+  assert(map_client_put (client, "key", 3, "value", 5) == MAP_STATUS_OK);
+  assert(map_client_get (client, "key", 3, &reply) == 1);
+  assert(reply.status == MAP_STATUS_OK && reply.value_len == 5);
+  assert(memcmp (reply.value, "value", 5) == 0);
+  assert(map_client_put (client, "key", 3, "", 0) == MAP_STATUS_OK);
+  assert(map_client_get (client, "key", 3, &reply) == 1);
+  assert(reply.status == MAP_STATUS_OK && reply.value_len == 0);
+  assert(map_server_size (server) == 1);
+  assert(map_client_erase (client, "key", 3) == MAP_STATUS_OK);
+  assert(map_client_erase (client, "key", 3) == MAP_STATUS_NOT_FOUND);
+  assert(map_server_size (server) == 0);
+  // pipelined puts, then gets and batch gets of every key.
+  char key[NUM_OF_DIGITS + 4], value[2 * NUM_OF_DIGITS + 4];
+  for (int i = 0; i < NUM_OF_SERVER_PAIRS; ++i)
+    {
+      sprintf (key, "k%d", i);
+      sprintf (value, "value%d", i * 7);
+      assert(map_client_send_put (client, key, strlen (key), value,
+                                  strlen (value)) == 1);
+    }
+  for (int i = 0; i < NUM_OF_SERVER_PAIRS; ++i)
+    {
+      assert(map_client_recv (client, &reply) == 1);
+      assert(reply.op == MAP_OP_PUT && reply.status == MAP_STATUS_OK);
+    }
+  assert(map_client_recv (client, &reply) == 0); // nothing in flight.
+  assert(map_server_size (server) == NUM_OF_SERVER_PAIRS);
+  char batch[2][NUM_OF_DIGITS + 4];
+  const char *batch_keys[2] = {batch[0], batch[1]};
+  size_t batch_lens[2];
+  for (int i = 0; i < NUM_OF_SERVER_PAIRS; ++i)
+    {
+      sprintf (key, "k%d", i);
+      assert(map_client_send_get (client, key, strlen (key)) == 1);
+      sprintf (batch[0], "k%d", i);
+      sprintf (batch[1], "k%d", i + NUM_OF_SERVER_PAIRS); // missing.
+      batch_lens[0] = strlen (batch[0]);
+      batch_lens[1] = strlen (batch[1]);
+      assert(map_client_send_batch_get (client, batch_keys, batch_lens, 2)
+             == 1);
+    }
+  for (int i = 0; i < NUM_OF_SERVER_PAIRS; ++i)
+    {
+      int status;
+      const char *found;
+      size_t found_len;
+      sprintf (value, "value%d", i * 7);
+      assert(map_client_recv (client, &reply) == 1);
+      assert(reply.op == MAP_OP_GET && reply.status == MAP_STATUS_OK);
+      assert(reply.value_len == strlen (value));
+      assert(memcmp (reply.value, value, reply.value_len) == 0);
+      assert(map_client_recv (client, &reply) == 1);
+      assert(reply.op == MAP_OP_BATCH_GET && reply.count == 2);
+      assert(map_reply_next (&reply, &status, &found, &found_len) == 1);
+      assert(status == MAP_STATUS_OK && found_len == strlen (value));
+      assert(memcmp (found, value, found_len) == 0);
+      assert(map_reply_next (&reply, &status, &found, &found_len) == 1);
+      assert(status == MAP_STATUS_NOT_FOUND && found == NULL);
+      assert(map_reply_next (&reply, &status, &found, &found_len) == 0);
+    }
+  // replies far beyond MAP_SERVER_MAX_PENDING_OUT, never read while sending.
+  char *big = malloc (BIG_VALUE_BYTES);
+  assert(big != NULL);
+  memset (big, 'b', BIG_VALUE_BYTES);
+  assert(map_client_put (client, "big", 3, big, BIG_VALUE_BYTES)
+         == MAP_STATUS_OK);
+  size_t num_of_big_gets = 3 * MAP_SERVER_MAX_PENDING_OUT / BIG_VALUE_BYTES;
+  for (size_t i = 0; i < num_of_big_gets; ++i)
+    {
+      assert(map_client_send_get (client, "big", 3) == 1);
+    }
+  for (size_t i = 0; i < num_of_big_gets; ++i)
+    {
+      assert(map_client_recv (client, &reply) == 1);
+      assert(reply.status == MAP_STATUS_OK);
+      assert(reply.value_len == BIG_VALUE_BYTES);
+      assert(memcmp (reply.value, big, BIG_VALUE_BYTES) == 0);
+    }
+  free (big);
+  // a malformed request is answered, then the connection is closed.
+  map_client *bad = map_client_connect (SERVER_TEST_PATH);
+  assert(bad != NULL);
+  assert(map_client_send_get (bad, "key", 3) == 1);
+  bad->out.data[sizeof (uint32_t)] = (char) 99; // an unknown op.
+  assert(map_client_send_get (bad, "key", 3) == 1);
+  assert(map_client_recv (bad, &reply) == 1);
+  assert(reply.status == MAP_STATUS_BAD_REQUEST);
+  assert(map_client_recv (bad, &reply) == 0);
+  map_client_close (&bad);
+  // a batch get whose count does not match its keys is malformed too.
+  const char *one_key = "k1";
+  size_t one_len = 2;
+  uint32_t bad_counts[] = {3, 1, UINT32_MAX};
+  for (size_t i = 0; i < sizeof (bad_counts) / sizeof (uint32_t); ++i)
+    {
+      bad = map_client_connect (SERVER_TEST_PATH);
+      assert(bad != NULL);
+      assert(map_client_send_batch_get (bad, &one_key, &one_len,
+                                        (i == 1) ? 0 : 1) == 1);
+      map_proto_put_u32 (bad->out.data + MAP_PROTO_HEADER_BYTES,
+                         bad_counts[i]);
+      assert(map_client_recv (bad, &reply) == 1);
+      assert(reply.status == MAP_STATUS_BAD_REQUEST);
+      assert(map_client_recv (bad, &reply) == 0);
+      map_client_close (&bad);
+    }
+  // the other connection is still served.
+  assert(map_client_get (client, "k1", 2, &reply) == 1);
+  assert(reply.status == MAP_STATUS_OK);
+  assert(map_server_size (server) == NUM_OF_SERVER_PAIRS + 1);
+  map_client_close (&client);
+  map_server_stop (&server);
+  assert(server == NULL);
+  assert(map_client_connect (SERVER_TEST_PATH) == NULL);
+  // a file at the path is never removed, a socket left by a crash is.
+  FILE *file = fopen (SERVER_TEST_PATH, "w");
+  assert(file != NULL);
+  fclose (file);
+  assert(map_server_start (SERVER_TEST_PATH, 1, 1) == NULL);
+  assert(remove (SERVER_TEST_PATH) == 0);
+  struct sockaddr_un addr;
+  memset (&addr, 0, sizeof (addr));
+  addr.sun_family = AF_UNIX;
+  strcpy (addr.sun_path, SERVER_TEST_PATH);
+  int stale = socket (AF_UNIX, SOCK_STREAM, 0);
+  assert(bind (stale, (struct sockaddr *) &addr, sizeof (addr)) == 0);
+  close (stale);
+  server = map_server_start (SERVER_TEST_PATH, 1, 1);
+  assert(server != NULL);
+  map_server_stop (&server);
+}
+
+/*
+ * Builds a 16 byte key whose strkey_hash_bytes is 0, whatever its first 8
+ * bytes (first), by inverting the mixing of strkey.c.
+ */
+void colliding_strkey(uint64_t first, char *key){
+  const uint64_t mul_1 = 0x9e3779b97f4a7c15ULL, mul_2 = 0xff51afd7ed558ccdULL;
+  uint64_t inverse = mul_1; // of mul_1 modulo 2^64, by Newton's method.
+  for (int i = 0; i < 6; ++i)
+    {
+      inverse *= 2 - mul_1 * inverse;
+    }
+  uint64_t hash = (16 * mul_1) ^ (first * mul_1);
+  hash = ((hash << 29) | (hash >> 35)) * mul_2;
+  uint64_t second = hash * inverse; // cancels hash out, leaving 0.
+  memcpy (key, &first, sizeof (first));
+  memcpy (key + sizeof (first), &second, sizeof (second));
+}
+
+/*
+ * Orders size_t hashes for qsort.
+ */
+int compare_hashes(const void *hash_1, const void *hash_2){
+  size_t a = *(const size_t *) hash_1, b = *(const size_t *) hash_2;
+  return (a > b) - (a < b);
+}
+
+void test_map_server_flooding(void){
+  map_server *server = map_server_start (SERVER_TEST_PATH, 4, 1);
+  assert(server != NULL);
+  map_client *client = map_client_connect (SERVER_TEST_PATH);
+  assert(client != NULL);
+  char (*keys)[16] = malloc (NUM_OF_FLOODING_KEYS * 16);
+  size_t *hashes = malloc (NUM_OF_FLOODING_KEYS * sizeof (size_t));
+  assert((keys != NULL) && (hashes != NULL));
+  size_t num_of_shards_used = 0;
+  for (size_t i = 0; i < NUM_OF_FLOODING_KEYS; ++i)
+    {
+      colliding_strkey (i, keys[i]);
+      assert(strkey_hash_bytes (keys[i], 16) == 0);
+      hashes[i] = strkey_hash_keyed (keys[i], 16, server->hash_key);
+      num_of_shards_used |= 1UL << (hashes[i] % server->num_of_shards);
+      assert(map_client_send_put (client, keys[i], 16, keys[i], 8) == 1);
+    }
+  // the keyed hashes of the keys spread them over the shards and buckets.
+  assert(num_of_shards_used == (1UL << server->num_of_shards) - 1);
+  qsort (hashes, NUM_OF_FLOODING_KEYS, sizeof (size_t), compare_hashes);
+  for (size_t i = 1; i < NUM_OF_FLOODING_KEYS; ++i)
+    {
+      assert(hashes[i - 1] != hashes[i]);
+    }
+  map_reply reply;
+  for (size_t i = 0; i < NUM_OF_FLOODING_KEYS; ++i)
+    {
+      assert(map_client_recv (client, &reply) == 1);
+      assert(reply.status == MAP_STATUS_OK);
+    }
+  assert(map_server_size (server) == NUM_OF_FLOODING_KEYS);
+  for (size_t i = 0; i < NUM_OF_FLOODING_KEYS; ++i)
+    {
+      assert(map_client_get (client, keys[i], 16, &reply) == 1);
+      assert(reply.status == MAP_STATUS_OK && reply.value_len == 8);
+      assert(memcmp (reply.value, keys[i], 8) == 0);
+    }
+  free (keys);
+  free (hashes);
+  map_client_close (&client);
+  map_server_stop (&server);
+}
+
+/*
+ * A hash_join_emit that counts the matches whose payloads agree with the
+ * rows of test_hash_join.
+ */
+void count_join_match(int64_t key, int64_t build_payload,
+                      int64_t probe_payload, void *arg){
+  assert(build_payload / 2 == key);
+  assert(probe_payload == key + PROBE_KEY_OFFSET);
+  __atomic_add_fetch ((size_t *) arg, 1, __ATOMIC_RELAXED);
+}
+
+/*
+ * Checks the result of a join of the rows of test_hash_join: every build
+ * row (inner) or probe row (semi and anti) that should match does, once.
+ */
+void check_join_result(const hash_join_result *result, int type){
+  size_t num_of_hits = NUM_OF_JOIN_KEYS;
+  size_t num_of_rows = (type == HASH_JOIN_INNER) ? 2 * NUM_OF_JOIN_KEYS :
+                       NUM_OF_PROBE_ROWS;
+  size_t expected = (type == HASH_JOIN_INNER) ? 2 * num_of_hits :
+                    ((type == HASH_JOIN_SEMI) ? num_of_hits :
+                     NUM_OF_PROBE_ROWS - num_of_hits);
+  assert(result->size == expected);
+  assert((result->build_payloads != NULL) == (type == HASH_JOIN_INNER));
+  char *seen = calloc (num_of_rows, 1);
+  assert(seen != NULL);
+  for (size_t i = 0; i < result->size; ++i)
+    {
+      int64_t key = result->keys[i];
+      int hit = (key >= 0) && (key < NUM_OF_JOIN_KEYS);
+      assert(result->probe_payloads[i] == key + PROBE_KEY_OFFSET);
+      assert(hit == (type != HASH_JOIN_ANTI));
+      int64_t row = (type == HASH_JOIN_INNER) ? result->build_payloads[i] :
+                    result->probe_payloads[i];
+      assert((type != HASH_JOIN_INNER) || (row / 2 == key));
+      assert(seen[row] == 0);
+      seen[row] = 1;
+    }
+  free (seen);
+}
+
+void test_hash_join(void){
+  int64_t *build_keys = malloc (sizeof (int64_t) * 2 * NUM_OF_JOIN_KEYS);
+  int64_t *build_rows = malloc (sizeof (int64_t) * 2 * NUM_OF_JOIN_KEYS);
+  int64_t *probe_keys = malloc (sizeof (int64_t) * NUM_OF_PROBE_ROWS);
+  int64_t *probe_rows = malloc (sizeof (int64_t) * NUM_OF_PROBE_ROWS);
+  assert(build_keys && build_rows && probe_keys && probe_rows);
+  // every key twice on the build side, the probe side hits some of them.
+  for (int64_t i = 0; i < 2 * NUM_OF_JOIN_KEYS; ++i)
+    {
+      build_keys[i] = i / 2;
+      build_rows[i] = i;
+    }
+  for (int64_t i = 0; i < NUM_OF_PROBE_ROWS; ++i)
+    {
+      probe_keys[i] = i - PROBE_KEY_OFFSET;
+      probe_rows[i] = i;
+    }
+  hash_join_input build = {build_keys, build_rows, 2 * NUM_OF_JOIN_KEYS};
+  hash_join_input probe = {probe_keys, probe_rows, NUM_OF_PROBE_ROWS};
+  hash_join_result result;
+  for (size_t num_threads = 1; num_threads <= 4; num_threads += 3)
+    {
+      for (int type = HASH_JOIN_INNER; type <= HASH_JOIN_ANTI; ++type)
+        {
+          assert(hash_join_collect (type, &build, &probe, num_threads,
+                                    &result) == 1);
+          check_join_result (&result, type);
+          hash_join_result_destroy (&result);
+          assert(result.keys == NULL && result.size == 0);
+        }
+      size_t count = 0;
+      assert(hash_join (HASH_JOIN_INNER, &build, &probe, num_threads,
+                        count_join_match, &count) == 1);
+      assert(count == 2 * NUM_OF_JOIN_KEYS);
+    }
+  // an empty build side, and no payloads.
+  hash_join_input empty = {NULL, NULL, 0};
+  probe.payloads = NULL;
+  assert(hash_join_collect (HASH_JOIN_ANTI, &empty, &probe, 2, &result) == 1);
+  assert(result.size == NUM_OF_PROBE_ROWS);
+  for (size_t i = 0; i < result.size; ++i)
+    {
+      assert(result.probe_payloads[i] == 0);
+    }
+  hash_join_result_destroy (&result);
+  assert(hash_join_collect (HASH_JOIN_INNER, &empty, &probe, 2, &result)
+         == 1);
+  assert(result.size == 0);
+  hash_join_result_destroy (&result);
+  assert(hash_join_collect (HASH_JOIN_ANTI + 1, &build, &probe, 1, &result)
+         == 0);
+  assert(hash_join (HASH_JOIN_INNER, &build, &probe, 1, NULL, NULL) == 0);
+  free (build_keys);
+  free (build_rows);
+  free (probe_keys);
+  free (probe_rows);
+}
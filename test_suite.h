@@ -36,4 +36,185 @@ void test_hash_map_get_load_factor(void);
  */
 void test_hash_map_apply_if();
 
+/**
+ * This function checks the Bloom filter front end of the hashmap library
+ * (hashmap_enable_filter). If a lookup through the filter is wrong,
+ * the functions exits with exit code 1.
+ */
+void test_hash_map_filter(void);
+
+/**
+ * This function checks the hashmap_snapshot function of the hashmap library.
+ * If a snapshot sees a later change (or the map loses one),
+ * the functions exits with exit code 1.
+ */
+void test_hash_map_snapshot(void);
+
+/**
+ * This function checks the hashmap_merge and hashmap_move_all functions of
+ * the hashmap library. If a merged value is wrong, the functions exits with
+ * exit code 1.
+ */
+void test_hash_map_merge(void);
+
+/**
+ * This function checks the multi threaded resize of the hashmap library.
+ * If a pair is lost or the capacity is wrong, the functions exits with
+ * exit code 1.
+ */
+void test_hash_map_parallel_resize(void);
+
+/**
+ * This function checks the hashmap_set_huge_pages function of the hashmap
+ * library. If a pair is lost or the reported backing is inconsistent, the
+ * functions exits with exit code 1.
+ */
+void test_hash_map_huge_pages(void);
+
+/**
+ * This function checks the hashmap_get_memory_usage function of the hashmap
+ * library. If a counter differs from a walk over the buckets, the functions
+ * exits with exit code 1.
+ */
+void test_hash_map_memory_usage(void);
+
+/**
+ * This function checks the hashmap_compact and hashmap_compact_step
+ * functions of the hashmap library. If a pair is lost or a bucket is not
+ * fitted, the functions exits with exit code 1.
+ */
+void test_hash_map_compact(void);
+
+/**
+ * This function checks the small map mode of the hashmap library. If the
+ * map loses a pair or moves to buckets too early or too late, the functions
+ * exits with exit code 1.
+ */
+void test_hash_map_small(void);
+
+/**
+ * This function checks the seeded hashing and the sorted long buckets of
+ * the hashmap library. If colliding keys are lost, the functions exits with
+ * exit code 1.
+ */
+void test_hash_map_seed(void);
+
+/**
+ * This function checks hashmap_erase_if on small, large, shared (snapshot)
+ * and colliding maps. If the map fails at some points, the functions exits
+ * with exit code 1.
+ */
+void test_hash_map_erase_if(void);
+
+/**
+ * This function checks the change feed of the hashmap: the events of every
+ * kind of change, full rings, and a consumer draining on another thread.
+ * If an event is wrong or missing, the functions exits with exit code 1.
+ */
+void test_hash_map_change_feed(void);
+
+/**
+ * This function checks hashmap_diff with and without digests, and a replica
+ * kept in sync from the change feed. If a difference is missed, the
+ * functions exits with exit code 1.
+ */
+void test_hash_map_diff(void);
+
+/**
+ * This function checks the wal_map of the hashmap library. If a write is
+ * lost after reopening the map, the functions exits with exit code 1.
+ */
+void test_wal_map(void);
+
+/**
+ * This function checks the spill_map of the hashmap library with a memory
+ * budget much smaller than its pairs. If a pair is lost on its way to the
+ * file and back, the functions exits with exit code 1.
+ */
+void test_spill_map(void);
+
+/**
+ * This function checks the column_map of the hashmap library. If the AVX2
+ * and the scalar kernels disagree with a plain loop, the functions exits
+ * with exit code 1.
+ */
+void test_column_map(void);
+
+/**
+ * This function checks the fixed_map of the hashmap library on a static
+ * buffer: a full map, erasing and reinserting against a plain array. If an
+ * entry is lost, the functions exits with exit code 1.
+ */
+void test_fixed_map(void);
+
+/**
+ * This function checks the map_server and the map_client of the hashmap
+ * library over a Unix socket. If a reply is wrong, the functions exits with
+ * exit code 1.
+ */
+void test_map_server(void);
+
+/**
+ * This function puts keys crafted to collide under strkey_hash_bytes into
+ * a map_server, and checks that the keyed hash of the server spreads them
+ * over its shards and buckets. If a reply is wrong, the functions exits
+ * with exit code 1.
+ */
+void test_map_server_flooding(void);
+
+/**
+ * This function checks the inner, semi and anti joins of hash_join.h on one
+ * and on several threads. If a match is wrong or missing, the functions
+ * exits with exit code 1.
+ */
+void test_hash_join(void);
+
+/**
+ * This function checks the maps generated by HASHMAP_DECLARE (typed_hashmap.h).
+ * If a generated function fails at some points, the functions exits with exit code 1.
+ */
+void test_typed_hashmap(void);
+
+/**
+ * This function checks hash maps with strkey keys (strkey.h).
+ * If a lookup fails at some points, the functions exits with exit code 1.
+ */
+void test_strkey_hashmap(void);
+
+/**
+ * This function checks maps sharing reference counted values (shared_value.h).
+ * If a count is wrong at some points, the functions exits with exit code 1.
+ */
+void test_shared_value(void);
+
+/**
+ * This function checks the lru_cache container (lru_cache.h).
+ * If the cache fails at some points, the functions exits with exit code 1.
+ */
+void test_lru_cache(void);
+
+/**
+ * This function checks the ttl_map container (ttl_map.h).
+ * If an entry expires too early or too late, the functions exits with exit code 1.
+ */
+void test_ttl_map(void);
+
+/**
+ * This function checks the agg_map aggregation map (agg_map.h).
+ * If an accumulator is wrong, the functions exits with exit code 1.
+ */
+void test_agg_map(void);
+
+/**
+ * This function checks the hashset container and its set algebra (hashset.h).
+ * If the set fails at some points, the functions exits with exit code 1.
+ */
+void test_hashset(void);
+
+/**
+ * This function checks the insertion ordered ordered_map (ordered_map.h).
+ * If the map fails at some points, the functions exits with exit code 1.
+ */
+void test_ordered_map(void);
+
 #endif //TESTSUITE_H_
@@ -0,0 +1,293 @@
+#include "ttl_map.h"
+
+#define SLOT_MASK (TTL_WHEEL_SLOTS - 1)
+#define MAX_WHEEL_DELTA ((1ULL << (TTL_WHEEL_BITS * TTL_WHEEL_LEVELS)) - 1)
+
+/*
+ * Removes node from the list it is in (if any).
+ */
+static void list_remove (ttl_node *node)
+{
+  if (node->list == NULL){
+      return;
+  }
+  if (node->prev != NULL){
+      node->prev->next = node->next;
+  }
+  else{
+      *(node->list) = node->next;
+  }
+  if (node->next != NULL){
+      node->next->prev = node->prev;
+  }
+  node->prev = NULL;
+  node->next = NULL;
+  node->list = NULL;
+}
+
+/*
+ * Adds node to the front of the list *list.
+ */
+static void list_push (ttl_node **list, ttl_node *node)
+{
+  node->prev = NULL;
+  node->next = *list;
+  if (*list != NULL){
+      (*list)->prev = node;
+  }
+  *list = node;
+  node->list = list;
+}
+
+/*
+ * Places node in the wheel slot matching its expiry, relative to the
+ * next tick to process. Entries that are already due go to the due list.
+ */
+static void place_node (ttl_map *map, ttl_node *node)
+{
+  if (node->expires < map->next_tick){
+      list_push (&(map->due), node);
+      return;
+  }
+  uint64_t delta = node->expires - map->next_tick;
+  uint64_t expires = node->expires;
+  if (delta > MAX_WHEEL_DELTA){
+      delta = MAX_WHEEL_DELTA;
+      expires = map->next_tick + MAX_WHEEL_DELTA; // re-placed on cascade.
+  }
+  size_t level = 0;
+  while ((level + 1 < TTL_WHEEL_LEVELS)
+         && (delta >= (1ULL << (TTL_WHEEL_BITS * (level + 1))))){
+      level++;
+  }
+  size_t slot = (expires >> (TTL_WHEEL_BITS * level)) & SLOT_MASK;
+  list_push (&(map->wheel[level][slot]), node);
+}
+
+/*
+ * Re-places every node of a wheel slot, returns the slot index.
+ */
+static size_t cascade (ttl_map *map, size_t level)
+{
+  size_t slot = (map->next_tick >> (TTL_WHEEL_BITS * level)) & SLOT_MASK;
+  ttl_node *cur = map->wheel[level][slot];
+  map->wheel[level][slot] = NULL;
+  while (cur != NULL){
+      ttl_node *next = cur->next;
+      cur->list = NULL;
+      place_node (map, cur);
+      cur = next;
+  }
+  return slot;
+}
+
+/*
+ * Unlinks a node from the table and the wheel and frees it.
+ */
+static void remove_node (ttl_map *map, ttl_node *node)
+{
+  list_remove (node);
+  entry_table_unlink (&(map->table), &(node->base));
+  entry_table_release_entry (&(node->base));
+  free (node);
+}
+
+/*
+ * Finds the node of key, erasing it if it expired.
+ */
+static ttl_node *find_live (ttl_map *map, const_keyT key, uint64_t now)
+{
+  ttl_node *node = (ttl_node *) entry_table_find
+      (&(map->table), key, entry_table_hash (&(map->table), key));
+  if ((node != NULL) && (node->list != NULL) && (node->expires <= now)){
+      remove_node (map, node);
+      return NULL;
+  }
+  return node;
+}
+
+/*
+ * Sets the expiry of node and moves it to the matching wheel slot.
+ */
+static void set_expiry (ttl_map *map, ttl_node *node, uint64_t now,
+                        uint64_t ttl)
+{
+  list_remove (node);
+  if (ttl == TTL_NEVER){
+      return;
+  }
+  node->expires = now + ttl;
+  place_node (map, node);
+}
+
+/**
+ * Allocates dynamically a new ttl map.
+ * @return pointer to dynamically allocated ttl map.
+ * @if_fail return NULL.
+ */
+ttl_map *ttl_map_alloc (hash_func func, uint64_t now)
+{
+  ttl_map *map = calloc (1, sizeof (ttl_map));
+  if (map == NULL){
+      return NULL;
+  }
+  if (entry_table_init (&(map->table), func) == 0){
+      free (map);
+      return NULL;
+  }
+  map->next_tick = now + 1;
+  return map;
+}
+
+/**
+ * Frees a ttl map and all of its entries.
+ * @param p_map pointer to dynamically allocated pointer to ttl map.
+ */
+void ttl_map_free (ttl_map **p_map)
+{
+  if ((p_map == NULL) || (*p_map == NULL)){
+      return;
+  }
+  entry_table *table = &((*p_map)->table);
+  for (size_t i = 0; i < table->capacity; ++i)
+    {
+      table_entry *cur = table->buckets[i];
+      while (cur != NULL){
+          table_entry *next = cur->chain_next;
+          entry_table_release_entry (cur);
+          free (cur);
+          cur = next;
+      }
+    }
+  entry_table_destroy (table);
+  free (*p_map);
+  *p_map = NULL;
+}
+
+/**
+ * Inserts a copy of in_pair that expires ttl ticks after now.
+ * @return 1 for successful insertion, 0 otherwise.
+ */
+int ttl_map_insert (ttl_map *map, const pair *in_pair, uint64_t now,
+                    uint64_t ttl)
+{
+  if ((map == NULL) || (in_pair == NULL)){
+      return 0;
+  }
+  if ((in_pair->key == NULL) || (in_pair->value == NULL)){
+      return 0;
+  }
+  if (find_live (map, in_pair->key, now) != NULL){
+      return 0;
+  }
+  ttl_node *node = malloc (sizeof (ttl_node));
+  if (node == NULL){
+      return 0;
+  }
+  if (entry_table_set_entry (&(map->table), &(node->base), in_pair) == 0){
+      free (node);
+      return 0;
+  }
+  if (entry_table_link (&(map->table), &(node->base)) == 0){
+      entry_table_release_entry (&(node->base));
+      free (node);
+      return 0;
+  }
+  node->prev = NULL;
+  node->next = NULL;
+  node->list = NULL;
+  set_expiry (map, node, now, ttl);
+  return 1;
+}
+
+/**
+ * Returns the value associated with key, an expired entry is erased.
+ * @return the value (not a copy of it) if exists and did not expire,
+ * NULL otherwise.
+ */
+valueT ttl_map_at (ttl_map *map, const_keyT key, uint64_t now)
+{
+  if ((map == NULL) || (key == NULL)){
+      return NULL;
+  }
+  ttl_node *node = find_live (map, key, now);
+  if (node == NULL){
+      return NULL;
+  }
+  return node->base.entry.value;
+}
+
+/**
+ * Sets the entry associated with key to expire ttl ticks after now.
+ * @return 1 on success, 0 if the key is not in the map or expired.
+ */
+int ttl_map_touch (ttl_map *map, const_keyT key, uint64_t now, uint64_t ttl)
+{
+  if ((map == NULL) || (key == NULL)){
+      return 0;
+  }
+  ttl_node *node = find_live (map, key, now);
+  if (node == NULL){
+      return 0;
+  }
+  set_expiry (map, node, now, ttl);
+  return 1;
+}
+
+/**
+ * Erases the entry associated with key.
+ * @return 1 if the erasing was done successfully, 0 otherwise.
+ */
+int ttl_map_erase (ttl_map *map, const_keyT key)
+{
+  if ((map == NULL) || (key == NULL)){
+      return 0;
+  }
+  ttl_node *node = (ttl_node *) entry_table_find
+      (&(map->table), key, entry_table_hash (&(map->table), key));
+  if (node == NULL){
+      return 0;
+  }
+  remove_node (map, node);
+  return 1;
+}
+
+/**
+ * Advances the timer wheel to now and removes up to max_expired expired
+ * entries. Every tick moves one level 0 slot to the due list, and every
+ * TTL_WHEEL_SLOTS ticks a slot of the next level is cascaded down, so each
+ * entry is touched at most TTL_WHEEL_LEVELS times before it expires.
+ * @return the number of removed entries.
+ */
+size_t ttl_map_advance (ttl_map *map, uint64_t now, size_t max_expired)
+{
+  if (map == NULL){
+      return 0;
+  }
+  if ((map->table.size == 0) && (map->next_tick <= now)){
+      map->next_tick = now + 1; // nothing to expire, skip the ticks.
+  }
+  while (map->next_tick <= now){
+      size_t level = 1;
+      if ((map->next_tick & SLOT_MASK) == 0){
+          while ((level < TTL_WHEEL_LEVELS) && (cascade (map, level) == 0)){
+              level++;
+          }
+      }
+      size_t slot = map->next_tick & SLOT_MASK;
+      ttl_node *cur = map->wheel[0][slot];
+      map->wheel[0][slot] = NULL;
+      while (cur != NULL){
+          ttl_node *next = cur->next;
+          list_push (&(map->due), cur);
+          cur = next;
+      }
+      map->next_tick++;
+  }
+  size_t removed = 0;
+  while ((map->due != NULL) && ((max_expired == 0) || (removed < max_expired))){
+      remove_node (map, map->due);
+      removed++;
+  }
+  return removed;
+}
@@ -0,0 +1,126 @@
+#ifndef TTL_MAP_H_
+#define TTL_MAP_H_
+
+#include <stdlib.h>
+#include <stdint.h>
+#include "entry_table.h"
+
+/**
+ * A hash map whose entries expire.
+ * Time is measured in caller defined ticks (e.g. milliseconds) and is passed
+ * to every operation, the map does not read any clock.
+ * Expiry is tracked in a hierarchical timer wheel of TTL_WHEEL_LEVELS levels
+ * of TTL_WHEEL_SLOTS slots each, linked through the entries themselves:
+ * expired entries are never returned (they are removed lazily on access),
+ * and ttl_map_advance removes them incrementally, in work proportional to
+ * the number of expired entries rather than to the size of the map.
+ */
+
+/**
+ * @def TTL_WHEEL_BITS
+ * log2 of the number of slots in each level of the timer wheel.
+ */
+#define TTL_WHEEL_BITS 6U
+
+/**
+ * @def TTL_WHEEL_SLOTS
+ * The number of slots in each level of the timer wheel.
+ */
+#define TTL_WHEEL_SLOTS (1UL << TTL_WHEEL_BITS)
+
+/**
+ * @def TTL_WHEEL_LEVELS
+ * The number of levels of the timer wheel. Entries further in the future
+ * than TTL_WHEEL_SLOTS^TTL_WHEEL_LEVELS ticks wait in the last level and
+ * are re-placed when it cascades.
+ */
+#define TTL_WHEEL_LEVELS 4U
+
+/**
+ * @def TTL_NEVER
+ * A ttl for entries that never expire.
+ */
+#define TTL_NEVER 0UL
+
+/**
+ * @struct ttl_node
+ * @param base the table entry (must be the first member).
+ * @param prev, next neighbours in the wheel slot (or due list).
+ * @param list the head of the list the node is in, NULL if none.
+ * @param expires the tick at which the entry expires.
+ */
+typedef struct ttl_node {
+    table_entry base;
+    struct ttl_node *prev;
+    struct ttl_node *next;
+    struct ttl_node **list;
+    uint64_t expires;
+} ttl_node;
+
+/**
+ * @struct ttl_map
+ * @param table the entries, by key.
+ * @param wheel the timer wheel slots.
+ * @param due entries that expired and were not removed yet.
+ * @param next_tick the next tick the wheel has to process.
+ */
+typedef struct ttl_map {
+    entry_table table;
+    ttl_node *wheel[TTL_WHEEL_LEVELS][TTL_WHEEL_SLOTS];
+    ttl_node *due;
+    uint64_t next_tick;
+} ttl_map;
+
+/**
+ * Allocates dynamically a new ttl map.
+ * @param func a function which "hashes" keys.
+ * @param now the current tick.
+ * @return pointer to dynamically allocated ttl map.
+ * @if_fail return NULL.
+ */
+ttl_map *ttl_map_alloc (hash_func func, uint64_t now);
+
+/**
+ * Frees a ttl map and all of its entries.
+ * @param p_map pointer to dynamically allocated pointer to ttl map.
+ */
+void ttl_map_free (ttl_map **p_map);
+
+/**
+ * Inserts a copy of in_pair that expires ttl ticks after now.
+ * @param ttl the time to live, TTL_NEVER for an entry that never expires.
+ * @return 1 for successful insertion, 0 otherwise (also if the key is
+ * already in the map and did not expire).
+ */
+int ttl_map_insert (ttl_map *map, const pair *in_pair, uint64_t now,
+                    uint64_t ttl);
+
+/**
+ * Returns the value associated with key, an expired entry is erased.
+ * @return the value (not a copy of it) if exists and did not expire,
+ * NULL otherwise.
+ */
+valueT ttl_map_at (ttl_map *map, const_keyT key, uint64_t now);
+
+/**
+ * Sets the entry associated with key to expire ttl ticks after now
+ * (extends or shortens its time to live).
+ * @return 1 on success, 0 if the key is not in the map or expired.
+ */
+int ttl_map_touch (ttl_map *map, const_keyT key, uint64_t now, uint64_t ttl);
+
+/**
+ * Erases the entry associated with key.
+ * @return 1 if the erasing was done successfully, 0 otherwise.
+ */
+int ttl_map_erase (ttl_map *map, const_keyT key);
+
+/**
+ * Advances the timer wheel to now and removes up to max_expired expired
+ * entries. Entries left over are removed by the next calls.
+ * @param max_expired the maximal number of entries to remove, 0 for no limit.
+ * @return the number of removed entries.
+ */
+size_t ttl_map_advance (ttl_map *map, uint64_t now, size_t max_expired);
+
+#endif //TTL_MAP_H_
@@ -0,0 +1,254 @@
+#ifndef TYPED_HASHMAP_H_
+#define TYPED_HASHMAP_H_
+
+#include <stdlib.h>
+#include <stdint.h>
+#include "hashmap.h"
+
+/**
+ * Type specialized hash maps.
+ * HASHMAP_DECLARE(name, K, V, hash, eq) generates a struct called "name"
+ * and a family of static inline functions (name_alloc, name_insert, name_at,
+ * name_erase ...) that mirror the generic hashmap API.
+ * Keys and values are stored by value in one flat, open addressed (linear
+ * probing) entry array, and "hash" / "eq" are expanded in place, so no
+ * function pointers are called on the lookup path.
+ *
+ * Example:
+ *   HASHMAP_DECLARE(int_float_map, int32_t, float,
+ *                   HASHMAP_INT_HASH, HASHMAP_INT_EQ)
+ *   int_float_map *map = int_float_map_alloc ();
+ *   int_float_map_insert (map, 7, 1.5f);
+ *   float *val = int_float_map_at (map, 7);
+ *
+ * The map grows and shrinks with the same load factors and growth factor
+ * as the generic hashmap (HASH_MAP_MAX_LOAD_FACTOR, HASH_MAP_MIN_LOAD_FACTOR,
+ * HASH_MAP_GROWTH_FACTOR), but never shrinks below HASH_MAP_INITIAL_CAP.
+ */
+
+/**
+ * Mixes the bits of a 64 bit integer (splitmix64 finalizer), so keys that
+ * differ only in their high bits do not collide after the capacity masking.
+ */
+static inline size_t typed_hashmap_mix64 (uint64_t x)
+{
+  x ^= x >> 30;
+  x *= 0xbf58476d1ce4e5b9ULL;
+  x ^= x >> 27;
+  x *= 0x94d049bb133111ebULL;
+  x ^= x >> 31;
+  return (size_t) x;
+}
+
+/**
+ * @def HASHMAP_INT_HASH
+ * A hash expression for any integer key type.
+ */
+#define HASHMAP_INT_HASH(key) typed_hashmap_mix64 ((uint64_t) (key))
+
+/**
+ * @def HASHMAP_INT_EQ
+ * An equality expression for any key type that supports "==".
+ */
+#define HASHMAP_INT_EQ(key_1, key_2) ((key_1) == (key_2))
+
+/**
+ * @def HASHMAP_DECLARE
+ * Generates a typed hash map.
+ * @param name the name of the generated struct and the prefix of its functions.
+ * @param K the key type (stored by value).
+ * @param V the value type (stored by value).
+ * @param hash a function or function-like macro: size_t hash (K key).
+ * @param eq a function or function-like macro: int eq (K key_1, K key_2),
+ * returns non zero if the keys are equal.
+ */
+#define HASHMAP_DECLARE(name, K, V, hash, eq)                                 \
+                                                                              \
+typedef struct name##_entry {                                                 \
+  K key;                                                                      \
+  V value;                                                                    \
+} name##_entry;                                                               \
+                                                                              \
+/* used[i] is 1 if entries[i] holds a pair, 0 if the slot is empty. */        \
+typedef struct name {                                                         \
+  name##_entry *entries;                                                      \
+  unsigned char *used;                                                        \
+  size_t size;                                                                \
+  size_t capacity;                                                            \
+  size_t max_size; /* size at which the next insertion grows the map */       \
+  size_t min_size; /* size at which the next erase shrinks the map */         \
+} name;                                                                       \
+                                                                              \
+static inline int name##_set_capacity (name *map, size_t new_capacity)        \
+{                                                                             \
+  name##_entry *entries = malloc (sizeof (name##_entry) * new_capacity);      \
+  unsigned char *used = calloc (new_capacity, sizeof (unsigned char));        \
+  if ((entries == NULL) || (used == NULL)){                                   \
+      free (entries);                                                         \
+      free (used);                                                            \
+      return 0;                                                               \
+  }                                                                           \
+  for (size_t i = 0; i < map->capacity; ++i)                                  \
+    {                                                                         \
+      if (map->used[i]){                                                      \
+          size_t ind = (size_t) (hash (map->entries[i].key))                  \
+                       & (new_capacity - 1);                                  \
+          while (used[ind]){                                                  \
+              ind = (ind + 1) & (new_capacity - 1);                           \
+          }                                                                   \
+          entries[ind] = map->entries[i];                                     \
+          used[ind] = 1;                                                      \
+      }                                                                       \
+    }                                                                         \
+  free (map->entries);                                                        \
+  free (map->used);                                                           \
+  map->entries = entries;                                                     \
+  map->used = used;                                                           \
+  map->capacity = new_capacity;                                               \
+  map->max_size = (size_t) (HASH_MAP_MAX_LOAD_FACTOR * new_capacity);         \
+  map->min_size = (new_capacity > HASH_MAP_INITIAL_CAP) ?                     \
+                  (size_t) (HASH_MAP_MIN_LOAD_FACTOR * new_capacity) : 0;     \
+  return 1;                                                                   \
+}                                                                             \
+                                                                              \
+/* Allocates a new empty map, returns NULL on failure. */                     \
+static inline name *name##_alloc (void)                                       \
+{                                                                             \
+  name *map = malloc (sizeof (name));                                         \
+  if (map == NULL){                                                           \
+      return NULL;                                                            \
+  }                                                                           \
+  map->entries = NULL;                                                        \
+  map->used = NULL;                                                           \
+  map->size = 0;                                                              \
+  map->capacity = 0;                                                          \
+  if (name##_set_capacity (map, HASH_MAP_INITIAL_CAP) == 0){                  \
+      free (map);                                                             \
+      return NULL;                                                            \
+  }                                                                           \
+  return map;                                                                 \
+}                                                                             \
+                                                                              \
+/* Frees the map and sets *p_map to NULL. */                                  \
+static inline void name##_free (name **p_map)                                 \
+{                                                                             \
+  if ((p_map == NULL) || (*p_map == NULL)){                                   \
+      return;                                                                 \
+  }                                                                           \
+  free ((*p_map)->entries);                                                   \
+  free ((*p_map)->used);                                                      \
+  free (*p_map);                                                              \
+  *p_map = NULL;                                                              \
+}                                                                             \
+                                                                              \
+/* Returns the slot holding key, or the capacity if key is not in the map. */ \
+static inline size_t name##_find (const name *map, K key)                     \
+{                                                                             \
+  size_t ind = (size_t) (hash (key)) & (map->capacity - 1);                   \
+  while (map->used[ind]){                                                     \
+      if (eq (map->entries[ind].key, key)){                                   \
+          return ind;                                                         \
+      }                                                                       \
+      ind = (ind + 1) & (map->capacity - 1);                                  \
+  }                                                                           \
+  return map->capacity;                                                       \
+}                                                                             \
+                                                                              \
+/* Returns a pointer to the value stored with key, NULL if there is none.     \
+ * The pointer is valid until the next insertion or erase. */                 \
+static inline V *name##_at (const name *map, K key)                           \
+{                                                                             \
+  if (map == NULL){                                                           \
+      return NULL;                                                            \
+  }                                                                           \
+  size_t ind = name##_find (map, key);                                        \
+  if (ind == map->capacity){                                                  \
+      return NULL;                                                            \
+  }                                                                           \
+  return &(map->entries[ind].value);                                          \
+}                                                                             \
+                                                                              \
+/* Inserts (key, value), returns 1 on success, 0 if the key is already in     \
+ * the map or allocation failed. */                                           \
+static inline int name##_insert (name *map, K key, V value)                   \
+{                                                                             \
+  if (map == NULL){                                                           \
+      return 0;                                                               \
+  }                                                                           \
+  if (name##_find (map, key) != map->capacity){                               \
+      return 0;                                                               \
+  }                                                                           \
+  if (map->size >= map->max_size){                                            \
+      if (name##_set_capacity (map,                                           \
+                               map->capacity * HASH_MAP_GROWTH_FACTOR) == 0){ \
+          return 0;                                                           \
+      }                                                                       \
+  }                                                                           \
+  size_t ind = (size_t) (hash (key)) & (map->capacity - 1);                   \
+  while (map->used[ind]){                                                     \
+      ind = (ind + 1) & (map->capacity - 1);                                  \
+  }                                                                           \
+  map->entries[ind].key = key;                                                \
+  map->entries[ind].value = value;                                            \
+  map->used[ind] = 1;                                                         \
+  map->size += 1;                                                             \
+  return 1;                                                                   \
+}                                                                             \
+                                                                              \
+/* Erases key, returns 1 on success, 0 if key is not in the map. */           \
+static inline int name##_erase (name *map, K key)                             \
+{                                                                             \
+  if (map == NULL){                                                           \
+      return 0;                                                               \
+  }                                                                           \
+  size_t ind = name##_find (map, key);                                        \
+  if (ind == map->capacity){                                                  \
+      return 0;                                                               \
+  }                                                                           \
+  size_t mask = map->capacity - 1;                                            \
+  size_t next = (ind + 1) & mask;                                             \
+  while (map->used[next]){ /* backward shift, no tombstones */                \
+      size_t home = (size_t) (hash (map->entries[next].key)) & mask;          \
+      if (((next - home) & mask) >= ((next - ind) & mask)){                   \
+          map->entries[ind] = map->entries[next];                             \
+          ind = next;                                                         \
+      }                                                                       \
+      next = (next + 1) & mask;                                               \
+  }                                                                           \
+  map->used[ind] = 0;                                                         \
+  map->size -= 1;                                                             \
+  if ((map->min_size != 0) && (map->size <= map->min_size)){                  \
+      name##_set_capacity (map, map->capacity / HASH_MAP_GROWTH_FACTOR);      \
+  }                                                                           \
+  return 1;                                                                   \
+}                                                                             \
+                                                                              \
+/* Returns the load factor of the map, -1 if the function failed. */          \
+static inline double name##_get_load_factor (const name *map)                 \
+{                                                                             \
+  if ((map == NULL) || (map->capacity == 0)){                                 \
+      return -1;                                                              \
+  }                                                                           \
+  return (double) map->size / map->capacity;                                  \
+}                                                                             \
+                                                                              \
+/* Applies val_func on every value whose key satisfies key_func, returns      \
+ * the number of changed values. */                                          \
+static inline int name##_apply_if (const name *map, int (*key_func) (K),      \
+                                   void (*val_func) (V *))                    \
+{                                                                             \
+  if ((map == NULL) || (key_func == NULL) || (val_func == NULL)){             \
+      return 0;                                                               \
+  }                                                                           \
+  int changed_vals = 0;                                                       \
+  for (size_t i = 0; i < map->capacity; ++i)                                  \
+    {                                                                         \
+      if (map->used[i] && key_func (map->entries[i].key)){                    \
+          val_func (&(map->entries[i].value));                                \
+          changed_vals++;                                                     \
+      }                                                                       \
+    }                                                                         \
+  return changed_vals;                                                        \
+}
+
+#endif //TYPED_HASHMAP_H_
@@ -39,6 +39,7 @@ vector *vector_alloc(vector_elem_cpy elem_copy_func,
   vec->data = data;
   vec->elem_cmp_func = elem_cmp_func; vec->elem_copy_func = elem_copy_func;
   vec->elem_free_func =elem_free_func;
+  vec->ref_count = 1;
   return vec;
 }
 
@@ -49,6 +50,10 @@ vector *vector_alloc(vector_elem_cpy elem_copy_func,
 void vector_free(vector **p_vector){
   vector *vec;
   vec = *p_vector;
+  if (__atomic_sub_fetch (&(vec->ref_count), 1, __ATOMIC_ACQ_REL) != 0){
+      *p_vector = NULL; // still owned by others.
+      return;
+  }
   for (size_t i = 0; i < vec->size; ++i)
     {
       vec->elem_free_func(&(vec->data[i]));
@@ -58,6 +63,14 @@ void vector_free(vector **p_vector){
   *p_vector = NULL;
 }
 
+/**
+ * Adds an owner to the vector, every owner must call vector_free.
+ * @param vector a pointer to vector.
+ */
+void vector_retain(vector *vector){
+  __atomic_add_fetch (&(vector->ref_count), 1, __ATOMIC_RELAXED);
+}
+
 /**
  * Returns the element at the given index.
  * @param vector pointer to a vector.
@@ -159,6 +172,26 @@ int vector_push_back(vector *vector, const void *value){
   return SUCSSES;
 }
 
+/**
+ * Adds a value to the back of the vector without copying it, the vector
+ * takes ownership of value (and will free it with elem_free_func).
+ * @param vector a pointer to vector.
+ * @param value the value to be added to the vector.
+ * @return 1 if the adding has been done successfully, 0 otherwise.
+ */
+int vector_push_back_move(vector *vector, void *value){
+  if((vector == NULL) || (value == NULL)){
+    return FAIL;
+  }
+  if(vector_get_load_factor (vector)>=VECTOR_MAX_LOAD_FACTOR){
+      if(vector_increase_cap (vector) == 0){
+          return FAIL; //case of allocation failure.
+        }
+    }
+  vector->data[vector->size] = value;
+  vector->size += 1;
+  return SUCSSES;
+}
 
 /**
  * Removes the element at the given index from the vector. alters the indices
@@ -200,3 +233,25 @@ void vector_clear(vector *vector){
     }
 }
 
+/**
+ * Shrinks the capacity of the vector to its size (at least 1).
+ * @param vector a pointer to vector.
+ * @return 1 if the shrinking has been done successfully, 0 otherwise.
+ */
+int vector_shrink_to_fit(vector *vector){
+  if(vector == NULL){
+      return FAIL;
+  }
+  size_t new_capacity = (vector->size > 0) ? vector->size : 1;
+  if(new_capacity == vector->capacity){
+      return SUCSSES;
+  }
+  void** temp = realloc (vector->data, sizeof (void*) * new_capacity);
+  if(temp == NULL){
+      return FAIL;
+  }
+  vector->data = temp;
+  vector->capacity = new_capacity;
+  return SUCSSES;
+}
+
@@ -61,6 +61,8 @@ typedef void (*vector_elem_free)(void **);
  * stored in the vector.
  * @param elem_free_func - a function which frees the elements stored
  * in the vector.
+ * @param ref_count - the number of owners of the vector (see vector_retain),
+ * the vector is freed when the last owner frees it.
  */
 typedef struct vector {
   size_t capacity;
@@ -69,6 +71,7 @@ typedef struct vector {
   vector_elem_cpy elem_copy_func;
   vector_elem_cmp elem_cmp_func;
   vector_elem_free elem_free_func;
+  size_t ref_count;
 } vector;
 
 /**
@@ -85,10 +88,21 @@ vector *vector_alloc(vector_elem_cpy elem_copy_func, vector_elem_cmp elem_cmp_fu
 
 /**
  * Frees a vector and the elements the vector itself allocated.
+ * If the vector has other owners (see vector_retain) only this owner's
+ * reference is dropped.
  * @param p_vector pointer to dynamically allocated pointer to vector.
  */
 void vector_free(vector **p_vector);
 
+/**
+ * Adds an owner to the vector, every owner must call vector_free.
+ * A vector with more than one owner is shared and must not be modified.
+ * The reference count is updated atomically, so owners may live in
+ * different threads.
+ * @param vector a pointer to vector.
+ */
+void vector_retain(vector *vector);
+
 /**
  * Returns the element at the given index.
  * @param vector pointer to a vector.
@@ -115,6 +129,15 @@ int vector_find(const vector *vector, const void *value);
  */
 int vector_push_back(vector *vector, const void *value);
 
+/**
+ * Adds a value to the back of the vector without copying it, the vector
+ * takes ownership of value (and will free it with elem_free_func).
+ * @param vector a pointer to vector.
+ * @param value the value to be added to the vector.
+ * @return 1 if the adding has been done successfully, 0 otherwise.
+ */
+int vector_push_back_move(vector *vector, void *value);
+
 /**
  * This function returns the load factor of the vector.
  * @param vector a vector.
@@ -137,4 +160,12 @@ int vector_erase(vector *vector, size_t ind);
  */
 void vector_clear(vector *vector);
 
+/**
+ * Shrinks the capacity of the vector to its size (at least 1), releasing
+ * the unused part of the data array.
+ * @param vector a pointer to vector.
+ * @return 1 if the shrinking has been done successfully, 0 otherwise.
+ */
+int vector_shrink_to_fit(vector *vector);
+
 #endif //VECTOR_H_
@@ -0,0 +1,733 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "wal_map.h"
+
+/*
+ * A record is a header (the body length and the checksum of the body,
+ * 4 bytes each) followed by the body: the op (1 byte), the key length
+ * (4 bytes), the key and the value.
+ */
+#define RECORD_HEADER_BYTES 8
+#define BODY_HEADER_BYTES 5
+
+#define LOG_SUFFIX ".log"
+#define OLD_LOG_SUFFIX ".log.old"
+#define SNAP_SUFFIX ".snap"
+#define TMP_SNAP_SUFFIX ".snap.tmp"
+
+/*
+ * FNV-1a over len bytes.
+ */
+static uint32_t checksum (const char *bytes, size_t len)
+{
+  uint32_t hash = 2166136261u;
+  for (size_t i = 0; i < len; ++i)
+    {
+      hash ^= (unsigned char) bytes[i];
+      hash *= 16777619u;
+    }
+  return hash;
+}
+
+/*
+ * Returns the dynamically allocated name "<path><suffix>".
+ */
+static char *file_name (const char *path, const char *suffix)
+{
+  char *name = malloc (strlen (path) + strlen (suffix) + 1);
+  if (name != NULL){
+      strcpy (name, path);
+      strcat (name, suffix);
+  }
+  return name;
+}
+
+static int file_exists (const char *path, const char *suffix)
+{
+  char *name = file_name (path, suffix);
+  struct stat st;
+  int exists = (name != NULL) && (stat (name, &st) == 0);
+  free (name);
+  return exists;
+}
+
+static void remove_file (const char *path, const char *suffix)
+{
+  char *name = file_name (path, suffix);
+  if (name != NULL){
+      unlink (name);
+  }
+  free (name);
+}
+
+static int buffer_reserve (wal_buffer *buf, size_t extra)
+{
+  if (buf->len + extra <= buf->capacity){
+      return 1;
+  }
+  size_t capacity = (buf->capacity == 0) ? 4096 : buf->capacity;
+  while (capacity < buf->len + extra){
+      capacity *= 2;
+  }
+  char *data = realloc (buf->data, capacity);
+  if (data == NULL){
+      return 0;
+  }
+  buf->data = data;
+  buf->capacity = capacity;
+  return 1;
+}
+
+/*
+ * Appends a record of op to buf (value is NULL for WAL_OP_ERASE).
+ */
+static int append_record (wal_buffer *buf, const wal_codec *codec, int op,
+                          const_keyT key, const_valueT value)
+{
+  size_t key_len = codec->key_encode (key, NULL, 0);
+  size_t value_len = (value == NULL) ? 0 :
+                     codec->value_encode (value, NULL, 0);
+  size_t body_len = BODY_HEADER_BYTES + key_len + value_len;
+  if ((body_len > UINT32_MAX)
+      || (buffer_reserve (buf, RECORD_HEADER_BYTES + body_len) == 0)){
+      return 0;
+  }
+  char *record = buf->data + buf->len;
+  char *body = record + RECORD_HEADER_BYTES;
+  uint32_t len32 = (uint32_t) key_len;
+  body[0] = (char) op;
+  memcpy (body + 1, &len32, sizeof (len32));
+  codec->key_encode (key, body + BODY_HEADER_BYTES, key_len);
+  if (value != NULL){
+      codec->value_encode (value, body + BODY_HEADER_BYTES + key_len,
+                           value_len);
+  }
+  len32 = (uint32_t) body_len;
+  uint32_t sum = checksum (body, body_len);
+  memcpy (record, &len32, sizeof (len32));
+  memcpy (record + sizeof (len32), &sum, sizeof (sum));
+  buf->len += RECORD_HEADER_BYTES + body_len;
+  return 1;
+}
+
+static int write_all (int fd, const char *data, size_t len)
+{
+  while (len > 0){
+      ssize_t written = write (fd, data, len);
+      if (written < 0){
+          if (errno == EINTR){
+              continue;
+          }
+          return 0;
+      }
+      data += written;
+      len -= (size_t) written;
+  }
+  return 1;
+}
+
+/*
+ * fsyncs the directory of path, so renames and new files survive a crash.
+ */
+static int sync_dir (const char *path)
+{
+  const char *slash = strrchr (path, '/');
+  char *dir = (slash == NULL) ? file_name (".", "") :
+              malloc ((size_t) (slash - path) + 2);
+  if (dir == NULL){
+      return 0;
+  }
+  if (slash != NULL){
+      size_t len = (slash == path) ? 1 : (size_t) (slash - path);
+      memcpy (dir, path, len);
+      dir[len] = '\0';
+  }
+  int fd = open (dir, O_RDONLY);
+  free (dir);
+  if (fd < 0){
+      return 0;
+  }
+  int ok = (fsync (fd) == 0) || (errno == EINVAL); // not every fs can.
+  close (fd);
+  return ok;
+}
+
+/*
+ * Sets (op WAL_OP_INSERT / WAL_OP_UPDATE) or erases a key while replaying.
+ */
+static int replay_record (wal_map *wal, int op, const char *key_bytes,
+                          size_t key_len, const char *value_bytes,
+                          size_t value_len)
+{
+  const wal_codec *codec = &(wal->codec);
+  keyT key = codec->key_decode (key_bytes, key_len);
+  if (key == NULL){
+      return 0;
+  }
+  hashmap_erase (wal->map, key);
+  int ok = 1;
+  if (op != WAL_OP_ERASE){
+      valueT value = codec->value_decode (value_bytes, value_len);
+      pair *in_pair = (value == NULL) ? NULL :
+                      pair_alloc (key, value, codec->key_cpy, codec->value_cpy,
+                                  codec->key_cmp, codec->value_cmp,
+                                  codec->key_free, codec->value_free);
+      ok = (in_pair != NULL) && hashmap_insert (wal->map, in_pair);
+      if (in_pair != NULL){
+          pair_free ((void **) &in_pair);
+      }
+      if (value != NULL){
+          codec->value_free (&value);
+      }
+  }
+  codec->key_free (&key);
+  return ok;
+}
+
+/*
+ * Replays the records of "<path><suffix>" into the map. A missing file is
+ * empty, and a torn or corrupt record ends the file: *good_bytes is set
+ * to the size of the valid prefix. Returns 0 on failure.
+ */
+static int replay_file (wal_map *wal, const char *suffix, size_t *good_bytes)
+{
+  *good_bytes = 0;
+  char *name = file_name (wal->path, suffix);
+  if (name == NULL){
+      return 0;
+  }
+  FILE *file = fopen (name, "rb");
+  free (name);
+  if (file == NULL){
+      return errno == ENOENT;
+  }
+  wal_buffer body = {NULL, 0, 0};
+  int ok = 1;
+  while (ok){
+      char header[RECORD_HEADER_BYTES];
+      uint32_t body_len, sum, key_len;
+      if (fread (header, 1, sizeof (header), file) != sizeof (header)){
+          break;
+      }
+      memcpy (&body_len, header, sizeof (body_len));
+      memcpy (&sum, header + sizeof (body_len), sizeof (sum));
+      if (body_len < BODY_HEADER_BYTES){
+          break;
+      }
+      if (buffer_reserve (&body, body_len) == 0){
+          ok = 0;
+          break;
+      }
+      if ((fread (body.data, 1, body_len, file) != body_len)
+          || (checksum (body.data, body_len) != sum)){
+          break;
+      }
+      int op = body.data[0];
+      memcpy (&key_len, body.data + 1, sizeof (key_len));
+      if (((op != WAL_OP_INSERT) && (op != WAL_OP_UPDATE)
+           && (op != WAL_OP_ERASE))
+          || (key_len > body_len - BODY_HEADER_BYTES)){
+          break;
+      }
+      const char *key_bytes = body.data + BODY_HEADER_BYTES;
+      ok = replay_record (wal, op, key_bytes, key_len, key_bytes + key_len,
+                          body_len - BODY_HEADER_BYTES - key_len);
+      *good_bytes += RECORD_HEADER_BYTES + body_len;
+  }
+  free (body.data);
+  fclose (file);
+  return ok;
+}
+
+/*
+ * Writes the pending records (and fsyncs the log if sync). One writer
+ * writes at a time, without the lock, while the others keep appending to
+ * the pending buffer. Called with the lock held.
+ */
+static int flush_locked (wal_map *wal, int sync)
+{
+  while (wal->flushing){
+      pthread_cond_wait (&(wal->flushed), &(wal->lock));
+  }
+  if (wal->failed){
+      return 0;
+  }
+  uint64_t target = wal->next_lsn;
+  if ((wal->pending.len == 0) && (!sync || (wal->durable_lsn == target))){
+      return 1;
+  }
+  wal_buffer batch = wal->pending;
+  wal->pending = wal->writing;
+  wal->writing = batch;
+  wal->flushing = 1;
+  pthread_mutex_unlock (&(wal->lock));
+  int ok = write_all (wal->fd, batch.data, batch.len);
+  if (ok && sync){
+      ok = fsync (wal->fd) == 0;
+  }
+  pthread_mutex_lock (&(wal->lock));
+  wal->flushing = 0;
+  wal->writing.len = 0;
+  if (ok){
+      wal->log_bytes += batch.len;
+      wal->written_lsn = target;
+      if (sync){
+          wal->durable_lsn = target;
+      }
+  }
+  else{
+      wal->failed = 1;
+  }
+  pthread_cond_broadcast (&(wal->flushed));
+  return ok;
+}
+
+/*
+ * Writes the snapshot of a compaction to "<path>.snap.tmp" and moves it
+ * to "<path>.snap", then drops the old log.
+ */
+static int write_snapshot (wal_map *wal, const hashmap *snapshot)
+{
+  char *tmp_name = file_name (wal->path, TMP_SNAP_SUFFIX);
+  char *snap_name = file_name (wal->path, SNAP_SUFFIX);
+  int fd = (tmp_name == NULL) ? -1 :
+           open (tmp_name, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  int ok = (snap_name != NULL) && (fd >= 0);
+  wal_buffer buf = {NULL, 0, 0};
+  for (size_t i = 0; ok && (i < snapshot->capacity); ++i)
+    {
+      const vector *vec = snapshot->buckets[i];
+      for (size_t j = 0; ok && (j < vec->size); ++j)
+        {
+          const pair *cur_pair = (const pair *) vec->data[j];
+          ok = append_record (&buf, &(wal->codec), WAL_OP_INSERT,
+                              cur_pair->key, cur_pair->value);
+          if (ok && (buf.len >= WAL_MAX_PENDING)){
+              ok = write_all (fd, buf.data, buf.len);
+              buf.len = 0;
+          }
+        }
+    }
+  ok = ok && write_all (fd, buf.data, buf.len) && (fsync (fd) == 0);
+  if (fd >= 0){
+      close (fd);
+  }
+  ok = ok && (rename (tmp_name, snap_name) == 0) && sync_dir (wal->path);
+  if (ok){
+      remove_file (wal->path, OLD_LOG_SUFFIX);
+  }
+  else if (tmp_name != NULL){
+      unlink (tmp_name);
+  }
+  free (buf.data);
+  free (tmp_name);
+  free (snap_name);
+  return ok;
+}
+
+static void *compact_thread (void *arg)
+{
+  wal_map *wal = (wal_map *) arg;
+  int ok = write_snapshot (wal, wal->snapshot);
+  pthread_mutex_lock (&(wal->lock));
+  hashmap_free (&(wal->snapshot));
+  wal->compact_failed = !ok;
+  pthread_cond_broadcast (&(wal->flushed));
+  pthread_mutex_unlock (&(wal->lock));
+  return NULL;
+}
+
+/*
+ * Rotates the log and starts the compaction thread. If the old log of a
+ * failed compaction is still there, the log is not rotated (the snapshot
+ * contains its records, so replaying them again is harmless). Called with
+ * the lock held.
+ */
+static int start_compaction_locked (wal_map *wal)
+{
+  if (wal->snapshot != NULL){
+      return 1; // already running.
+  }
+  do {
+      if (flush_locked (wal, 1) == 0){
+          return 0;
+      }
+  } while (wal->pending.len > 0);
+  if (wal->snapshot != NULL){
+      return 1; // started while the log was flushed.
+  }
+  if (wal->has_compactor){
+      pthread_join (wal->compactor, NULL); // it already released the lock.
+      wal->has_compactor = 0;
+  }
+  if (!file_exists (wal->path, OLD_LOG_SUFFIX)){
+      char *log_name = file_name (wal->path, LOG_SUFFIX);
+      char *old_name = file_name (wal->path, OLD_LOG_SUFFIX);
+      int ok = (log_name != NULL) && (old_name != NULL)
+               && (rename (log_name, old_name) == 0);
+      if (ok){
+          close (wal->fd);
+          wal->fd = open (log_name, O_WRONLY | O_CREAT | O_APPEND, 0644);
+          wal->log_bytes = 0;
+          if (wal->fd < 0){
+              wal->failed = 1;
+              ok = 0;
+          }
+      }
+      free (log_name);
+      free (old_name);
+      if (!ok){
+          return 0;
+      }
+  }
+  wal->snapshot = hashmap_snapshot (wal->map);
+  if (wal->snapshot == NULL){
+      return 0;
+  }
+  if (pthread_create (&(wal->compactor), NULL, compact_thread, wal) != 0){
+      hashmap_free (&(wal->snapshot));
+      return 0;
+  }
+  wal->has_compactor = 1;
+  return 1;
+}
+
+/*
+ * Gives the record just appended its sequence number and makes it as
+ * durable as the sync policy asks. With WAL_SYNC_ALWAYS a failure returns
+ * 0 once it is this write's turn to be undone (the writes that were not
+ * durable are undone newest first); the caller undoes its change and calls
+ * undo_done_locked. With the other policies the write stays applied and
+ * only the later writes fail. Called with the lock held.
+ */
+static int commit_locked (wal_map *wal)
+{
+  uint64_t lsn = ++(wal->next_lsn);
+  if (wal->sync_policy == WAL_SYNC_ALWAYS){
+      // the first waiter writes for everyone who appended before it.
+      while (wal->durable_lsn < lsn){
+          if (wal->flushing){
+              pthread_cond_wait (&(wal->flushed), &(wal->lock));
+          }
+          else if (wal->failed){
+              // no write starts any more, so durable_lsn is final.
+              if (!wal->undoing){
+                  wal->undoing = 1;
+                  wal->undo_lsn = wal->next_lsn;
+              }
+              while (wal->undo_lsn != lsn){
+                  pthread_cond_wait (&(wal->flushed), &(wal->lock));
+              }
+              return 0;
+          }
+          else{
+              flush_locked (wal, 1);
+          }
+      }
+  }
+  else if (wal->pending.len >= WAL_MAX_PENDING){
+      flush_locked (wal, 0);
+  }
+  if (!wal->failed && (wal->compact_bytes != 0)
+      && (wal->log_bytes >= wal->compact_bytes) && (wal->snapshot == NULL)){
+      start_compaction_locked (wal); // a failure is retried on later writes.
+  }
+  return 1;
+}
+
+/*
+ * Lets the next older write undo its change, after commit_locked failed.
+ */
+static void undo_done_locked (wal_map *wal)
+{
+  --(wal->undo_lsn);
+  pthread_cond_broadcast (&(wal->flushed));
+}
+
+static void *sync_thread (void *arg)
+{
+  wal_map *wal = (wal_map *) arg;
+  pthread_mutex_lock (&(wal->lock));
+  while (!wal->stop){
+      struct timespec deadline;
+      clock_gettime (CLOCK_REALTIME, &deadline);
+      deadline.tv_sec += (time_t) (wal->sync_interval_ms / 1000);
+      deadline.tv_nsec += (long) (wal->sync_interval_ms % 1000) * 1000000L;
+      if (deadline.tv_nsec >= 1000000000L){
+          deadline.tv_sec += 1;
+          deadline.tv_nsec -= 1000000000L;
+      }
+      pthread_cond_timedwait (&(wal->wake), &(wal->lock), &deadline);
+      if (!wal->stop && (wal->durable_lsn < wal->next_lsn)){
+          flush_locked (wal, 1);
+      }
+  }
+  pthread_mutex_unlock (&(wal->lock));
+  return NULL;
+}
+
+/*
+ * Frees a map whose sync thread is not running (a compaction thread must
+ * have finished).
+ */
+static void free_wal (wal_map *wal)
+{
+  if (wal->has_compactor){
+      pthread_join (wal->compactor, NULL);
+  }
+  if (wal->fd >= 0){
+      close (wal->fd);
+  }
+  if (wal->map != NULL){
+      hashmap_free (&(wal->map));
+  }
+  pthread_mutex_destroy (&(wal->lock));
+  pthread_cond_destroy (&(wal->flushed));
+  pthread_cond_destroy (&(wal->wake));
+  free (wal->pending.data);
+  free (wal->writing.data);
+  free (wal->path);
+  free (wal);
+}
+
+wal_map *wal_map_open (const char *path, hash_func func,
+                       const wal_codec *codec, int sync_policy,
+                       size_t sync_interval_ms)
+{
+  if ((path == NULL) || (func == NULL) || (codec == NULL)
+      || (codec->key_encode == NULL) || (codec->value_encode == NULL)
+      || (codec->key_decode == NULL) || (codec->value_decode == NULL)
+      || (sync_policy < WAL_SYNC_NONE) || (sync_policy > WAL_SYNC_ALWAYS)){
+      return NULL;
+  }
+  wal_map *wal = calloc (1, sizeof (wal_map));
+  if (wal == NULL){
+      return NULL;
+  }
+  wal->fd = -1;
+  wal->codec = *codec;
+  wal->sync_policy = sync_policy;
+  wal->sync_interval_ms = (sync_interval_ms == 0) ?
+                          WAL_DEFAULT_SYNC_INTERVAL_MS : sync_interval_ms;
+  pthread_mutex_init (&(wal->lock), NULL);
+  pthread_cond_init (&(wal->flushed), NULL);
+  pthread_cond_init (&(wal->wake), NULL);
+  wal->path = file_name (path, "");
+  wal->map = hashmap_alloc (func);
+  size_t snap_bytes, old_bytes, log_bytes;
+  if ((wal->path == NULL) || (wal->map == NULL)
+      || (replay_file (wal, SNAP_SUFFIX, &snap_bytes) == 0)
+      || (replay_file (wal, OLD_LOG_SUFFIX, &old_bytes) == 0)
+      || (replay_file (wal, LOG_SUFFIX, &log_bytes) == 0)){
+      free_wal (wal);
+      return NULL;
+  }
+  char *log_name = file_name (path, LOG_SUFFIX);
+  if (log_name != NULL){
+      wal->fd = open (log_name, O_WRONLY | O_CREAT | O_APPEND, 0644);
+  }
+  free (log_name);
+  // drops a torn tail, so new records follow the last valid one.
+  if ((wal->fd < 0) || (ftruncate (wal->fd, (off_t) log_bytes) != 0)){
+      free_wal (wal);
+      return NULL;
+  }
+  wal->log_bytes = log_bytes;
+  if (file_exists (path, OLD_LOG_SUFFIX) && (wal_map_compact (wal, 1) == 0)){
+      free_wal (wal); // an interrupted compaction could not be finished.
+      return NULL;
+  }
+  if (sync_policy == WAL_SYNC_INTERVAL){
+      if (pthread_create (&(wal->syncer), NULL, sync_thread, wal) != 0){
+          free_wal (wal);
+          return NULL;
+      }
+      wal->has_syncer = 1;
+  }
+  return wal;
+}
+
+int wal_map_close (wal_map **p_wal)
+{
+  if ((p_wal == NULL) || (*p_wal == NULL)){
+      return 0;
+  }
+  wal_map *wal = *p_wal;
+  pthread_mutex_lock (&(wal->lock));
+  wal->stop = 1;
+  pthread_cond_broadcast (&(wal->wake));
+  int ok = flush_locked (wal, 1);
+  while (wal->snapshot != NULL){
+      pthread_cond_wait (&(wal->flushed), &(wal->lock));
+  }
+  pthread_mutex_unlock (&(wal->lock));
+  if (wal->has_syncer){
+      pthread_join (wal->syncer, NULL);
+  }
+  free_wal (wal);
+  *p_wal = NULL;
+  return ok;
+}
+
+int wal_map_insert (wal_map *wal, const pair *in_pair)
+{
+  if ((wal == NULL) || (in_pair == NULL) || (in_pair->key == NULL)
+      || (in_pair->value == NULL)){
+      return 0;
+  }
+  pthread_mutex_lock (&(wal->lock));
+  size_t mark = wal->pending.len;
+  int ok = !wal->failed && (hashmap_at (wal->map, in_pair->key) == NULL)
+           && append_record (&(wal->pending), &(wal->codec), WAL_OP_INSERT,
+                             in_pair->key, in_pair->value);
+  if (ok && (hashmap_insert (wal->map, in_pair) == 0)){
+      wal->pending.len = mark; // not applied, so not logged.
+      ok = 0;
+  }
+  if (ok && (commit_locked (wal) == 0)){
+      hashmap_erase (wal->map, in_pair->key);
+      undo_done_locked (wal);
+      ok = 0;
+  }
+  pthread_mutex_unlock (&(wal->lock));
+  return ok;
+}
+
+int wal_map_update (wal_map *wal, const pair *in_pair)
+{
+  if ((wal == NULL) || (in_pair == NULL) || (in_pair->key == NULL)
+      || (in_pair->value == NULL)){
+      return 0;
+  }
+  pthread_mutex_lock (&(wal->lock));
+  size_t mark = wal->pending.len;
+  int ok = !wal->failed
+           && append_record (&(wal->pending), &(wal->codec), WAL_OP_UPDATE,
+                             in_pair->key, in_pair->value);
+  if (ok){
+      void *old_pair = NULL;
+      const_valueT old_value = hashmap_at (wal->map, in_pair->key);
+      if (old_value != NULL){
+          old_pair = pair_alloc (in_pair->key, old_value, wal->codec.key_cpy,
+                                 wal->codec.value_cpy, wal->codec.key_cmp,
+                                 wal->codec.value_cmp, wal->codec.key_free,
+                                 wal->codec.value_free);
+          ok = (old_pair != NULL) && hashmap_erase (wal->map, in_pair->key);
+      }
+      if (ok && (hashmap_insert (wal->map, in_pair) == 0)){
+          ok = 0;
+          if ((old_pair != NULL) && (hashmap_insert (wal->map, old_pair) == 0)){
+              wal->failed = 1; // the map lost the key, the log did not.
+          }
+      }
+      if (!ok){
+          wal->pending.len = mark;
+      }
+      else if (commit_locked (wal) == 0){
+          ok = 0;
+          hashmap_erase (wal->map, in_pair->key);
+          if (old_pair != NULL){
+              hashmap_insert (wal->map, old_pair);
+          }
+          undo_done_locked (wal);
+      }
+      if (old_pair != NULL){
+          pair_free (&old_pair);
+      }
+  }
+  pthread_mutex_unlock (&(wal->lock));
+  return ok;
+}
+
+int wal_map_erase (wal_map *wal, const_keyT key)
+{
+  if ((wal == NULL) || (key == NULL)){
+      return 0;
+  }
+  pthread_mutex_lock (&(wal->lock));
+  size_t mark = wal->pending.len;
+  const_valueT old_value = wal->failed ? NULL : hashmap_at (wal->map, key);
+  void *old_pair = NULL;
+  int ok = (old_value != NULL)
+           && append_record (&(wal->pending), &(wal->codec), WAL_OP_ERASE,
+                             key, NULL);
+  if (ok && (wal->sync_policy == WAL_SYNC_ALWAYS)){
+      // kept to undo the erasure if its record can not be written.
+      old_pair = pair_alloc (key, old_value, wal->codec.key_cpy,
+                             wal->codec.value_cpy, wal->codec.key_cmp,
+                             wal->codec.value_cmp, wal->codec.key_free,
+                             wal->codec.value_free);
+      ok = old_pair != NULL;
+  }
+  if (ok && (hashmap_erase (wal->map, key) == 0)){
+      ok = 0;
+  }
+  if (!ok){
+      wal->pending.len = mark;
+  }
+  else if (commit_locked (wal) == 0){
+      ok = 0;
+      hashmap_insert (wal->map, old_pair);
+      undo_done_locked (wal);
+  }
+  if (old_pair != NULL){
+      pair_free (&old_pair);
+  }
+  pthread_mutex_unlock (&(wal->lock));
+  return ok;
+}
+
+valueT wal_map_at (wal_map *wal, const_keyT key)
+{
+  if ((wal == NULL) || (key == NULL)){
+      return NULL;
+  }
+  pthread_mutex_lock (&(wal->lock));
+  valueT value = hashmap_at (wal->map, key);
+  pthread_mutex_unlock (&(wal->lock));
+  return value;
+}
+
+int wal_map_sync (wal_map *wal)
+{
+  if (wal == NULL){
+      return 0;
+  }
+  pthread_mutex_lock (&(wal->lock));
+  int ok = flush_locked (wal, 1);
+  pthread_mutex_unlock (&(wal->lock));
+  return ok;
+}
+
+int wal_map_compact (wal_map *wal, int wait)
+{
+  if (wal == NULL){
+      return 0;
+  }
+  pthread_mutex_lock (&(wal->lock));
+  int ok = start_compaction_locked (wal);
+  if (ok && wait){
+      while (wal->snapshot != NULL){
+          pthread_cond_wait (&(wal->flushed), &(wal->lock));
+      }
+      ok = !wal->compact_failed;
+  }
+  pthread_mutex_unlock (&(wal->lock));
+  return ok;
+}
+
+void wal_map_set_compact_bytes (wal_map *wal, size_t compact_bytes)
+{
+  if (wal == NULL){
+      return;
+  }
+  pthread_mutex_lock (&(wal->lock));
+  wal->compact_bytes = compact_bytes;
+  pthread_mutex_unlock (&(wal->lock));
+}
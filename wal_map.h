@@ -0,0 +1,238 @@
+#ifndef WAL_MAP_H_
+#define WAL_MAP_H_
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <pthread.h>
+#include "hashmap.h"
+
+/**
+ * A durable hash map: every successful insert, update and erase is appended
+ * to a write ahead log, "<path>.log", and the map is rebuilt from the log
+ * when it is opened again.
+ * Records are buffered in memory and written (and fsynced) in groups:
+ * concurrent writers that need durability share one fsync (group commit),
+ * and with WAL_SYNC_INTERVAL a background thread syncs every few ms.
+ * Compaction rotates the log to "<path>.log.old", writes the map (through
+ * an O(1) hashmap_snapshot, so writers are not blocked) to "<path>.snap"
+ * on a background thread, and drops the old log.
+ * Recovery loads the snapshot and replays "<path>.log.old" and "<path>.log"
+ * in order. Inserts and updates replay as "set" and erasures as "erase",
+ * so replaying records a snapshot already contains is harmless. A torn or
+ * corrupt record at the tail of the log (a crash in the middle of a write)
+ * ends the replay, and the log is truncated there.
+ * Records are written in the host byte order.
+ * All the functions may be called from several threads.
+ */
+
+/**
+ * @def WAL_SYNC_NONE, WAL_SYNC_INTERVAL, WAL_SYNC_ALWAYS
+ * Sync policies: never fsync (the records reach the kernel when the buffer
+ * fills up, on wal_map_sync and on close), fsync every sync interval on a
+ * background thread, or return from a write only once its record was
+ * fsynced (writers waiting at the same time share one fsync).
+ * With WAL_SYNC_ALWAYS a write that fails because its record could not be
+ * written is undone in the map (together with the writes that were waiting
+ * for the same fsync, newest first), so 0 means "not applied". A failed
+ * write may still have put part of its records in the log, and they are
+ * replayed on the next open. With the other policies an I/O error does
+ * not fail the write that ran into it (its record was not promised to be
+ * durable): it fails every later write, wal_map_sync and wal_map_close.
+ */
+#define WAL_SYNC_NONE 0
+#define WAL_SYNC_INTERVAL 1
+#define WAL_SYNC_ALWAYS 2
+
+/**
+ * @def WAL_DEFAULT_SYNC_INTERVAL_MS
+ * The sync interval used when wal_map_open gets 0.
+ */
+#define WAL_DEFAULT_SYNC_INTERVAL_MS 10UL
+
+/**
+ * @def WAL_MAX_PENDING
+ * A writer writes the buffered records itself once they reach this many
+ * bytes.
+ */
+#define WAL_MAX_PENDING (1UL << 20)
+
+/**
+ * @def WAL_OP_INSERT, WAL_OP_UPDATE, WAL_OP_ERASE
+ * The operation of a log record.
+ */
+#define WAL_OP_INSERT 1
+#define WAL_OP_UPDATE 2
+#define WAL_OP_ERASE 3
+
+/**
+ * @typedef wal_encode_func
+ * Serializes a key or a value: writes it to buf if it fits in buf_len
+ * bytes, and returns the number of bytes it needs either way.
+ */
+typedef size_t (*wal_encode_func) (const void *, char *, size_t);
+
+/**
+ * @typedef wal_decode_func
+ * Deserializes len bytes into a dynamically allocated key or value (freed
+ * with the codec's key_free / value_free), NULL on failure.
+ */
+typedef void *(*wal_decode_func) (const char *, size_t);
+
+/**
+ * @struct wal_codec
+ * How the keys and values of the map are written to and read from the
+ * log, and the pair functions of the pairs rebuilt from it.
+ */
+typedef struct wal_codec {
+    wal_encode_func key_encode;
+    wal_encode_func value_encode;
+    wal_decode_func key_decode;
+    wal_decode_func value_decode;
+    pair_key_cpy key_cpy;
+    pair_value_cpy value_cpy;
+    pair_key_cmp key_cmp;
+    pair_value_cmp value_cmp;
+    pair_key_free key_free;
+    pair_value_free value_free;
+} wal_codec;
+
+/**
+ * @struct wal_buffer
+ * Encoded records waiting to be written.
+ */
+typedef struct wal_buffer {
+    char *data;
+    size_t len;
+    size_t capacity;
+} wal_buffer;
+
+/**
+ * @struct wal_map
+ * @param map the in memory map.
+ * @param codec the key and value serialization.
+ * @param path the base path of the files.
+ * @param fd the open log.
+ * @param sync_policy WAL_SYNC_NONE, WAL_SYNC_INTERVAL or WAL_SYNC_ALWAYS.
+ * @param sync_interval_ms the interval of WAL_SYNC_INTERVAL.
+ * @param pending, writing the records appended since the last write, and
+ * the records a writer is writing right now (outside the lock).
+ * @param next_lsn the number of records appended.
+ * @param written_lsn, durable_lsn the records written, and fsynced.
+ * @param flushing 1 while a writer writes outside the lock.
+ * @param failed 1 after an I/O error, every later write fails.
+ * @param undoing, undo_lsn 1 once the writes that were not durable when a
+ * write failed are being undone, and the next of them to undo.
+ * @param log_bytes the size of the log.
+ * @param compact_bytes compaction starts when the log reaches this size,
+ * 0 for manual compaction only.
+ * @param snapshot the map being written by the compaction, NULL if none.
+ * @param compact_failed 1 if the last compaction failed.
+ * @param stop 1 when the background threads should exit.
+ * @param lock, flushed, wake the lock, the condition signalled when a write
+ * finished, and the one that wakes the sync thread.
+ * @param syncer, compactor the background threads.
+ * @param has_syncer, has_compactor 1 if the thread was started.
+ */
+typedef struct wal_map {
+    hashmap *map;
+    wal_codec codec;
+    char *path;
+    int fd;
+    int sync_policy;
+    size_t sync_interval_ms;
+    wal_buffer pending;
+    wal_buffer writing;
+    uint64_t next_lsn;
+    uint64_t written_lsn;
+    uint64_t durable_lsn;
+    int flushing;
+    int failed;
+    int undoing;
+    uint64_t undo_lsn;
+    size_t log_bytes;
+    size_t compact_bytes;
+    hashmap *snapshot;
+    int compact_failed;
+    int stop;
+    pthread_mutex_t lock;
+    pthread_cond_t flushed;
+    pthread_cond_t wake;
+    pthread_t syncer;
+    pthread_t compactor;
+    int has_syncer;
+    int has_compactor;
+} wal_map;
+
+/**
+ * Opens (or creates) a durable map, recovering its content from the
+ * snapshot and the logs.
+ * @param path the base path of the files.
+ * @param func a function which "hashes" keys.
+ * @param codec the key and value serialization (copied).
+ * @param sync_policy WAL_SYNC_NONE, WAL_SYNC_INTERVAL or WAL_SYNC_ALWAYS.
+ * @param sync_interval_ms the interval of WAL_SYNC_INTERVAL, 0 for
+ * WAL_DEFAULT_SYNC_INTERVAL_MS.
+ * @return pointer to dynamically allocated map.
+ * @if_fail return NULL.
+ */
+wal_map *wal_map_open (const char *path, hash_func func,
+                       const wal_codec *codec, int sync_policy,
+                       size_t sync_interval_ms);
+
+/**
+ * Writes and fsyncs the buffered records, waits for a running compaction,
+ * and frees the map.
+ * @param p_wal pointer to dynamically allocated pointer to map.
+ * @return 1 if every record reached the disk, 0 otherwise.
+ */
+int wal_map_close (wal_map **p_wal);
+
+/**
+ * Inserts a copy of in_pair, like hashmap_insert.
+ * @return 1 on success, 0 if the key is already in the map or on failure.
+ */
+int wal_map_insert (wal_map *wal, const pair *in_pair);
+
+/**
+ * Inserts a copy of in_pair, replacing the value of its key if it is
+ * already in the map.
+ * @return 1 on success, 0 otherwise.
+ */
+int wal_map_update (wal_map *wal, const pair *in_pair);
+
+/**
+ * Erases the pair of key, like hashmap_erase.
+ * @return 1 on success, 0 if key is not in the map or on failure.
+ */
+int wal_map_erase (wal_map *wal, const_keyT key);
+
+/**
+ * Returns the value of key, like hashmap_at (the value belongs to the map
+ * and is valid until the key is updated or erased).
+ */
+valueT wal_map_at (wal_map *wal, const_keyT key);
+
+/**
+ * Writes and fsyncs every buffered record.
+ * @return 1 on success, 0 otherwise.
+ */
+int wal_map_sync (wal_map *wal);
+
+/**
+ * Starts a compaction on a background thread (if none is running).
+ * @param wal a map.
+ * @param wait 1 to return only once the compaction finished.
+ * @return 1 on success (with wait, if the compaction succeeded), 0
+ * otherwise.
+ */
+int wal_map_compact (wal_map *wal, int wait);
+
+/**
+ * Makes every write start a compaction once the log reaches
+ * compact_bytes bytes.
+ * @param wal a map.
+ * @param compact_bytes the log size, 0 for manual compaction only.
+ */
+void wal_map_set_compact_bytes (wal_map *wal, size_t compact_bytes);
+
+#endif //WAL_MAP_H_